@@ -0,0 +1,275 @@
+// autorun.c
+// for refurbishing benches: drop sd:/wiimedic/autorun.cfg on the card and
+// WiiMedic runs the report straight from the HBC, with nobody pressing
+// buttons, and goes back where it came from. nothing gets drawn and none of
+// the loops wait on VSync while it runs, so a console takes seconds instead
+// of however long someone takes to walk over to it.
+//
+// the config is plain key = value lines, # starts a comment:
+//
+//   modules        = nand, ios, storage, network   (default: all of them)
+//   ios            = quick | deep
+//   storage        = quick | sweep | pipeline
+//   bench_kb       = 4096          quick benchmark file size
+//   bench_passes   = 3
+//   wpad_warmup_ms = 500           how long after start-up remotes get to reconnect
+//   probe          = label, host or IP, port [, essential]   (repeatable)
+//   use_cache      = yes | no      reuse results from the last report
+//   report         = console | keep | overwrite
+//   upload         = http://host[:port]/path       POST the report there too
+//   upload_format  = text | json
+//   exit           = hbc | system | menu
+//
+// anything it doesn't understand is skipped and counted in the report
+// header, a typo shouldn't cost a whole run.
+
+#include <gccore.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "autorun.h"
+#include "controller_test.h"
+#include "history.h"
+#include "ios_check.h"
+#include "network_test.h"
+#include "report.h"
+#include "storage_test.h"
+#include "subsys.h"
+#include "ui_common.h"
+
+// last, it wraps the IOS and libfat calls by name
+#include "prof_calls.h"
+
+#define AUTORUN_MAX_SIZE 4096
+
+typedef struct {
+    report_opts report;
+    int         exit_to;
+    int         storage_mode;
+    u32         bench_kb;
+    int         bench_passes;
+    int         bad_lines;
+    int         first_bad;
+} autorun_cfg;
+
+static char s_cfg_text[AUTORUN_MAX_SIZE + 1];
+
+
+static char *trim(char *s) {
+    char *end;
+    while (*s == ' ' || *s == '\t') s++;
+    end = s + strlen(s);
+    while (end > s && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r')) end--;
+    *end = '\0';
+    return s;
+}
+
+// next comma-separated field of *s, trimmed. NULL when there are no more
+static char *next_field(char **s) {
+    char *start = *s, *comma;
+    if (!start) return NULL;
+    comma = strchr(start, ',');
+    if (comma) {
+        *comma = '\0';
+        *s = comma + 1;
+    } else {
+        *s = NULL;
+    }
+    return trim(start);
+}
+
+static int parse_bool(const char *v) {
+    if (!strcasecmp(v, "yes") || !strcasecmp(v, "true") || !strcmp(v, "1")) return 1;
+    if (!strcasecmp(v, "no") || !strcasecmp(v, "false") || !strcmp(v, "0")) return 0;
+    return -1;
+}
+
+static bool parse_u32(const char *v, u32 *out) {
+    char *end;
+    unsigned long n = strtoul(v, &end, 10);
+    if (end == v || *end) return false;
+    *out = (u32)n;
+    return true;
+}
+
+static bool parse_modules(autorun_cfg *c, char *v) {
+    u32 mask = 0, bit;
+    char *name;
+
+    while ((name = next_field(&v)) != NULL) {
+        if (!strcasecmp(name, "all")) {
+            mask = REPORT_ALL;
+            continue;
+        }
+        if ((bit = report_module_bit(name)) == 0) return false;
+        mask |= bit;
+    }
+    if (mask == 0) return false;
+    c->report.modules = mask;
+    return true;
+}
+
+static bool parse_probe(char *v) {
+    char *label = next_field(&v);
+    char *host  = next_field(&v);
+    char *port  = next_field(&v);
+    char *flag  = next_field(&v);
+    u32 p;
+
+    if (!label || !host || !port || !parse_u32(port, &p) || p == 0 || p > 0xFFFF) return false;
+    if (flag && strcasecmp(flag, "essential") != 0) return false;
+    return add_network_probe(label, host, (u16)p, flag != NULL);
+}
+
+static bool parse_line(autorun_cfg *c, const char *key, char *v) {
+    u32 n;
+    int b;
+
+    if (!strcasecmp(key, "modules")) return parse_modules(c, v);
+    if (!strcasecmp(key, "probe"))   return parse_probe(v);
+
+    if (!strcasecmp(key, "ios")) {
+        if      (!strcasecmp(v, "quick")) set_ios_check_deep(false);
+        else if (!strcasecmp(v, "deep"))  set_ios_check_deep(true);
+        else return false;
+        return true;
+    }
+    if (!strcasecmp(key, "storage")) {
+        if      (!strcasecmp(v, "quick"))    c->storage_mode = STORAGE_QUICK;
+        else if (!strcasecmp(v, "sweep"))    c->storage_mode = STORAGE_SWEEP;
+        else if (!strcasecmp(v, "pipeline")) c->storage_mode = STORAGE_PIPELINE;
+        else return false;
+        return true;
+    }
+    if (!strcasecmp(key, "bench_kb")) {
+        if (!parse_u32(v, &n) || n == 0) return false;
+        c->bench_kb = n;
+        return true;
+    }
+    if (!strcasecmp(key, "bench_passes")) {
+        if (!parse_u32(v, &n) || n == 0) return false;
+        c->bench_passes = (int)n;
+        return true;
+    }
+    if (!strcasecmp(key, "wpad_warmup_ms")) {
+        if (!parse_u32(v, &n)) return false;
+        set_controller_warmup_ms(n);
+        return true;
+    }
+    if (!strcasecmp(key, "use_cache")) {
+        if ((b = parse_bool(v)) < 0) return false;
+        c->report.use_cache = b;
+        return true;
+    }
+    if (!strcasecmp(key, "report")) {
+        if      (!strcasecmp(v, "console"))   c->report.existing = REPORT_FILE_CONSOLE;
+        else if (!strcasecmp(v, "keep"))      c->report.existing = REPORT_FILE_KEEP;
+        else if (!strcasecmp(v, "overwrite")) c->report.existing = REPORT_FILE_OVERWRITE;
+        else return false;
+        return true;
+    }
+    if (!strcasecmp(key, "upload")) {
+        // points into s_cfg_text, which stays put
+        if (strncasecmp(v, "http://", 7) != 0) return false;
+        c->report.upload_url = v;
+        return true;
+    }
+    if (!strcasecmp(key, "upload_format")) {
+        if      (!strcasecmp(v, "text")) c->report.upload_json = false;
+        else if (!strcasecmp(v, "json")) c->report.upload_json = true;
+        else return false;
+        return true;
+    }
+    if (!strcasecmp(key, "exit")) {
+        if      (!strcasecmp(v, "hbc"))    c->exit_to = AUTORUN_EXIT_HBC;
+        else if (!strcasecmp(v, "system")) c->exit_to = AUTORUN_EXIT_SYSTEM;
+        else if (!strcasecmp(v, "menu"))   c->exit_to = AUTORUN_EXIT_MENU;
+        else return false;
+        return true;
+    }
+    return false;
+}
+
+// false if there's no config file at all
+static bool load_config(autorun_cfg *c) {
+    char *line, *next;
+    size_t len;
+    int lineno = 0;
+    FILE *fp;
+
+    // only SD, the config never lives on USB and that probe is the slow one
+    if (!subsys_wait_sd()) return false;
+    fp = fopen(AUTORUN_FILE, "rb");
+    if (!fp) return false;
+    len = fread(s_cfg_text, 1, AUTORUN_MAX_SIZE, fp);
+    fclose(fp);
+    s_cfg_text[len] = '\0';
+
+    for (line = s_cfg_text; line; line = next) {
+        char *eq, *key;
+
+        lineno++;
+        next = strchr(line, '\n');
+        if (next) *next++ = '\0';
+        if ((eq = strchr(line, '#')) != NULL) *eq = '\0';
+        line = trim(line);
+        if (!*line) continue;
+
+        eq  = strchr(line, '=');
+        key = line;
+        if (eq) {
+            *eq = '\0';
+            key = trim(key);
+        }
+        if (!eq || !parse_line(c, key, trim(eq + 1))) {
+            if (c->bad_lines++ == 0) c->first_bad = lineno;
+        }
+    }
+    return true;
+}
+
+
+int run_autorun(void) {
+    PROF_FUNC();
+    static char note[128];
+    autorun_cfg cfg;
+    bool ok;
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.report.modules   = REPORT_ALL;
+    cfg.report.use_cache = true;
+    cfg.report.existing  = REPORT_FILE_CONSOLE;
+    cfg.exit_to          = AUTORUN_EXIT_HBC;
+    cfg.storage_mode     = STORAGE_QUICK;
+    cfg.bench_kb         = 1024;
+    cfg.bench_passes     = 3;
+
+    if (!load_config(&cfg)) return AUTORUN_NONE;
+    set_storage_test_options(cfg.storage_mode, cfg.bench_kb, cfg.bench_passes);
+
+    if (cfg.bad_lines > 0)
+        snprintf(note, sizeof(note), "Unattended run from %s (%d line%s not understood, first on line %d)",
+                 AUTORUN_FILE, cfg.bad_lines, cfg.bad_lines == 1 ? "" : "s", cfg.first_bad);
+    else
+        snprintf(note, sizeof(note), "Unattended run from %s", AUTORUN_FILE);
+    cfg.report.note = note;
+
+    // one line so whoever is at the bench knows it's busy, then nothing
+    // until it's done
+    ui_clear();
+    printf(UI_BGREEN "\n  WiiMedic v" WIIMEDIC_VERSION UI_RESET UI_WHITE " - unattended run, don't power off\n" UI_RESET);
+
+    ui_set_headless(true);
+    ok = report_generate(&cfg.report);
+    history_flush();
+    ui_set_headless(false);
+
+    if (ok) return cfg.exit_to;
+    // back at the HBC looks the same as a good run, so stay and say so
+    printf(UI_BRED "  The report couldn't be %s\n" UI_RESET,
+           cfg.report.upload_url ? "written or uploaded - check the card and the server" : "written - check the card");
+    return AUTORUN_EXIT_MENU;
+}
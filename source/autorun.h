@@ -0,0 +1,23 @@
+/*
+ * WiiMedic - autorun.h
+ * Unattended report runs driven by a config file on SD
+ */
+#ifndef AUTORUN_H
+#define AUTORUN_H
+
+#define AUTORUN_FILE "sd:/wiimedic/autorun.cfg"
+
+// Where to go once an unattended run is done
+enum {
+    AUTORUN_NONE = 0,       // no config file, carry on with the menu
+    AUTORUN_EXIT_HBC,
+    AUTORUN_EXIT_SYSTEM,    // System Menu
+    AUTORUN_EXIT_MENU,      // WiiMedic's own menu, for trying out a config
+};
+
+// If AUTORUN_FILE exists, runs the report it describes without drawing
+// anything or waiting on a button, and returns AUTORUN_EXIT_*.
+// AUTORUN_NONE if there's no file
+int run_autorun(void);
+
+#endif // AUTORUN_H
@@ -1,20 +1,38 @@
 // controller_test.c
 // reads the current state of GC controllers and Wii Remotes, checks for drift.
-// this is a snapshot test, not a live viewer - tell the user to hold buttons
+// the snapshot test is not a live viewer - tell the user to hold buttons
 // before running it if they want to see button presses register.
+//
+// the continuous sampling mode is the live one. it samples everything on
+// its own thread at ~1kHz so one unlucky read can't make a thumb resting
+// on the stick look like drift (or hide real drift).
+//
+// the link monitor is for setups with several remotes on one console: it
+// counts how many reports each remote really gets through per second.
 
 #include <gccore.h>
 #include <math.h>
+#include <ogc/lwp.h>
+#include <ogc/lwp_watchdog.h>
+#include <ogc/machine/processor.h>
+#include <ogc/mutex.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include <wiiuse/wpad.h>
 
 #include "controller_test.h"
+#include "subsys.h"
 #include "ui_common.h"
 
+// last, it wraps the IOS and libfat calls by name
+#include "prof_calls.h"
+
 static int s_gc_detected  = 0;
 static int s_wm_detected  = 0;
+static u32 s_warmup_ms    = SUBSYS_WPAD_SETTLE_MS;
 
 
 // maps raw battery level byte to bars (0-4).
@@ -104,16 +122,10 @@ static void test_wiimotes(void) {
     ui_draw_section("Wii Remote / Extensions");
     s_wm_detected = 0;
 
-    // the Bluetooth stack needs a few frames to settle after WPAD_Init.
-    // one scan is never enough and the results are garbage. 30 frames
-    // works consistently. annoying but that's how it is.
-    {
-        int i;
-        for (i = 0; i < 30; i++) {
-            WPAD_ScanPads();
-            VIDEO_WaitVSync();
-        }
-    }
+    // the Bluetooth stack needs a moment to settle after WPAD_Init. one
+    // scan is never enough and the results are garbage. it's counted from
+    // start-up, so after a while in the menu this doesn't wait at all
+    subsys_wait_wpad(SUBSYS_WPAD_SETTLE_MS);
 
     for (chan = 0; chan < 4; chan++) {
         u32 type;
@@ -194,7 +206,481 @@ static void test_wiimotes(void) {
 }
 
 
-void run_controller_test(void) {
+// --- continuous sampling ---
+// a dedicated thread polls every GC port and Wii Remote about once a
+// millisecond and pushes raw samples into a single-producer/single-consumer
+// ring. the main thread drains it once a frame, keeps the running stats and
+// draws the stick plot. no lock needed: only the sampler writes s_ring_head
+// and only the main thread writes s_ring_tail.
+
+#define SAMP_SOURCES    8           // 0-3 GC ports, 4-7 Wii Remotes
+#define SAMP_RING_SIZE  4096        // must be a power of two
+#define SAMP_POLL_US    1000
+#define SAMP_SI_RATE    1           // SI poll interval in ms, 0 is once per frame
+#define BOUNCE_US       20000       // release->press quicker than this is bounce
+#define REST_MAX_R      40          // further out than this is a thumb, not drift
+#define STICK_RMAX      182         // sqrt(2 * 128^2), rounded up
+#define DRIFT_MEAN      8.0f        // same threshold as the snapshot test
+#define NOISE_STDDEV    3.0f
+
+typedef struct {
+    u64 t;
+    u32 btns;
+    u8  src;
+    u32 seq;        // polls of this source so far, dropped ones included
+    bool stick;     // x/y are real - false for a Wii Remote with no nunchuk
+    s8  x, y;       // GC main stick / nunchuk stick
+    s8  cx, cy;     // GC c-stick, zero for Wii Remotes
+} ctl_sample;
+
+static ctl_sample    s_ring[SAMP_RING_SIZE];
+static volatile u32  s_ring_head    = 0;
+static volatile u32  s_ring_tail    = 0;
+static volatile u32  s_ring_dropped = 0;
+static volatile bool s_samp_stop    = false;
+static lwp_t         s_samp_thread;
+static u8            s_samp_stack[8192] __attribute__((aligned(32)));
+static u32           s_samp_seq[SAMP_SOURCES];  // only the poller touches it
+
+// the sync is mostly there to stop the compiler moving the slot write past
+// the head update - Broadway is single core, but the sampler can preempt us
+// anywhere.
+static void ring_push(const ctl_sample *s) {
+    u32 head = s_ring_head;
+    if (head - s_ring_tail >= SAMP_RING_SIZE) {
+        s_ring_dropped++;
+        return;
+    }
+    s_ring[head & (SAMP_RING_SIZE - 1)] = *s;
+    _sync();
+    s_ring_head = head + 1;
+}
+
+static bool ring_pop(ctl_sample *s) {
+    u32 tail = s_ring_tail;
+    if (tail == s_ring_head) return false;
+    _sync();
+    *s = s_ring[tail & (SAMP_RING_SIZE - 1)];
+    _sync();
+    s_ring_tail = tail + 1;
+    return true;
+}
+
+
+// PAD_Read gets the latest SI data directly instead of the latched
+// PAD_ScanPads copy, so with the SI rate turned up we really do see
+// every poll. Wii Remotes only report at ~100Hz, the extra polls just
+// repeat the last report.
+static void sampler_poll(void) {
+    PADStatus st[4];
+    ctl_sample s;
+    u64 now;
+    int i;
+
+    PAD_Read(st);
+    WPAD_ScanPads();
+    now = gettime();
+
+    for (i = 0; i < 4; i++) {
+        if (st[i].err != PAD_ERR_NONE) continue;
+        s.t    = now;
+        s.src  = (u8)i;
+        s.seq  = ++s_samp_seq[i];
+        s.btns = st[i].button;
+        s.stick = true;
+        s.x    = st[i].stickX;
+        s.y    = st[i].stickY;
+        s.cx   = st[i].substickX;
+        s.cy   = st[i].substickY;
+        ring_push(&s);
+    }
+    for (i = 0; i < 4; i++) {
+        WPADData *wd = WPAD_Data(i);
+        if (!wd || wd->err != WPAD_ERR_NONE) continue;
+        s.t    = now;
+        s.src  = (u8)(4 + i);
+        s.seq  = ++s_samp_seq[4 + i];
+        s.btns = wd->btns_h;
+        s.x = s.y = s.cx = s.cy = 0;
+        s.stick = wd->exp.type == WPAD_EXP_NUNCHUK;
+        if (s.stick) {
+            s.x = (s8)(wd->exp.nunchuk.js.pos.x - wd->exp.nunchuk.js.center.x);
+            s.y = (s8)(wd->exp.nunchuk.js.pos.y - wd->exp.nunchuk.js.center.y);
+        }
+        ring_push(&s);
+    }
+}
+
+static void *sampler_thread(void *arg) {
+    (void)arg;
+    while (!s_samp_stop) {
+        sampler_poll();
+        usleep(SAMP_POLL_US);
+    }
+    return NULL;
+}
+
+
+typedef struct {
+    u32 n;          // resting samples
+    u32 moved;      // samples past REST_MAX_R
+    s64 sum_x, sum_y;
+    s64 sq_x, sq_y;
+    u32 max_r;
+    u32 rhist[STICK_RMAX + 1];
+} stick_stats;
+
+typedef struct {
+    bool        seen;
+    bool        has_stick;  // some sample came with a stick attached
+    u32         samples;
+    u64         first_t, last_t;
+    u32         first_seq, last_seq;
+    stick_stats stick[2];
+    u32         last_btns;
+    u64         release_t[32];
+    u32         presses;
+    u32         bounces;
+    s8          x, y;       // latest main stick, for the plot
+} src_stats;
+
+static src_stats s_src[SAMP_SOURCES];
+static sink_log  s_samp_log;
+
+static void stick_add(stick_stats *st, s8 x, s8 y) {
+    u32 r = (u32)(sqrtf((float)(x * x + y * y)) + 0.5f);
+    if (r > REST_MAX_R) {
+        st->moved++;
+        return;
+    }
+    st->n++;
+    st->sum_x += x;
+    st->sum_y += y;
+    st->sq_x  += x * x;
+    st->sq_y  += y * y;
+    if (r > st->max_r) st->max_r = r;
+    st->rhist[r]++;
+}
+
+static void src_add(const ctl_sample *s) {
+    src_stats *src = &s_src[s->src];
+    u32 changed = s->btns ^ src->last_btns;
+    int b;
+
+    if (!src->seen) {
+        src->seen      = true;
+        src->first_t   = s->t;
+        src->first_seq = s->seq;
+        src->last_btns = s->btns;
+        changed = 0;
+    }
+    src->samples++;
+    src->last_t   = s->t;
+    src->last_seq = s->seq;
+    src->x = s->x;
+    src->y = s->y;
+
+    if (s->stick) {
+        src->has_stick = true;
+        stick_add(&src->stick[0], s->x, s->y);
+    }
+    if (s->src < 4) stick_add(&src->stick[1], s->cx, s->cy);
+
+    // a press that comes right after a release of the same button is the
+    // contact bouncing, not the player
+    for (b = 0; changed && b < 32; b++) {
+        u32 bit = 1u << b;
+        if (!(changed & bit)) continue;
+        changed &= ~bit;
+        if (s->btns & bit) {
+            src->presses++;
+            if (src->release_t[b] &&
+                ticks_to_microsecs(s->t - src->release_t[b]) < BOUNCE_US)
+                src->bounces++;
+        } else {
+            src->release_t[b] = s->t;
+        }
+    }
+    src->last_btns = s->btns;
+}
+
+static float stick_mean(const stick_stats *st, bool y) {
+    if (st->n == 0) return 0.0f;
+    return (float)(y ? st->sum_y : st->sum_x) / (float)st->n;
+}
+
+static float stick_var(const stick_stats *st, bool y) {
+    float m;
+    if (st->n == 0) return 0.0f;
+    m = stick_mean(st, y);
+    return (float)(y ? st->sq_y : st->sq_x) / (float)st->n - m * m;
+}
+
+// dead zone that covers 99% of resting samples, plus one for luck
+static u32 stick_deadzone(const stick_stats *st) {
+    u32 want, acc = 0, r;
+    if (st->n == 0) return 0;
+    want = st->n - st->n / 100;
+    for (r = 0; r <= STICK_RMAX; r++) {
+        acc += st->rhist[r];
+        if (acc >= want) return r + 1;
+    }
+    return STICK_RMAX;
+}
+
+// polls the sampler made, not samples we got round to draining - if the
+// ring overflows while the screen is busy that mustn't look like a slow pad
+static u32 src_rate(const src_stats *src) {
+    u32 ms = (u32)ticks_to_millisecs(src->last_t - src->first_t);
+    return ms ? (u32)((u64)(src->last_seq - src->first_seq) * 1000 / ms) : 0;
+}
+
+static void src_name(int i, char *buf, size_t sz) {
+    if (i < 4) snprintf(buf, sz, "GC Port %d", i + 1);
+    else       snprintf(buf, sz, "Wii Remote %d", i - 3);
+}
+
+
+// --- live stick plot ---
+// the whole view is redrawn into a ui_frame every vsync. the frame diff
+// means only the cell the dot left, the cell it moved to and the digits
+// that changed actually get repainted.
+
+#define PLOT_W    33    // odd so there's a real center column
+#define PLOT_H    17
+#define PLOT_ROW  4
+#define PLOT_COL  3
+#define STAT_COL  (PLOT_COL + PLOT_W + 4)
+
+static char plot_bg(int c, int r) {
+    bool cx = (c == PLOT_W / 2), cy = (r == PLOT_H / 2);
+    if (cx && cy) return '+';
+    if (cx) return '|';
+    if (cy) return '-';
+    return '.';
+}
+
+static void plot_cell(s8 x, s8 y, int *c, int *r) {
+    *c = ((int)x + 128) * PLOT_W / 256;
+    *r = (127 - (int)y) * PLOT_H / 256;
+    if (*r < 0) *r = 0;
+    if (*r >= PLOT_H) *r = PLOT_H - 1;
+}
+
+static void draw_plot(int sel) {
+    char line[PLOT_W + 3];
+    int r, c, dc = -1, dr = -1;
+
+    if (sel >= 0 && s_src[sel].has_stick) plot_cell(s_src[sel].x, s_src[sel].y, &dc, &dr);
+
+    memset(line, '-', sizeof(line) - 1);
+    line[0] = line[PLOT_W + 1] = '+';
+    line[PLOT_W + 2] = '\0';
+    ui_frame_goto(PLOT_ROW - 1, PLOT_COL - 1);
+    ui_printf(UI_WHITE "%s", line);
+    ui_frame_goto(PLOT_ROW + PLOT_H, PLOT_COL - 1);
+    ui_printf("%s", line);
+
+    for (r = 0; r < PLOT_H; r++) {
+        for (c = 0; c < PLOT_W; c++) line[c] = plot_bg(c, r);
+        line[PLOT_W] = '\0';
+        ui_frame_goto(PLOT_ROW + r, PLOT_COL - 1);
+        if (r == dr) {
+            line[dc] = '\0';
+            ui_printf(UI_WHITE "|%s" UI_BGREEN "@" UI_WHITE "%s|", line, line + dc + 1);
+        } else {
+            ui_printf(UI_WHITE "|%s|", line);
+        }
+    }
+    ui_printf(UI_RESET);
+}
+
+static void stat_line(int row, const char *fmt, ...) {
+    char line[40];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(line, sizeof(line), fmt, ap);
+    va_end(ap);
+    ui_frame_goto(PLOT_ROW + row, STAT_COL);
+    ui_printf(UI_WHITE "%s" UI_RESET, line);
+}
+
+static void draw_stats(int sel) {
+    const src_stats *src = &s_src[sel];
+    const stick_stats *st = &src->stick[0];
+    char name[24];
+
+    src_name(sel, name, sizeof(name));
+    ui_frame_goto(PLOT_ROW, STAT_COL);
+    ui_printf(UI_BCYAN "%s" UI_RESET, name);
+    stat_line(2,  "Rate       %u samples/s", src_rate(src));
+    stat_line(3,  "Mean       X=%+5.1f Y=%+5.1f", stick_mean(st, false), stick_mean(st, true));
+    stat_line(4,  "Std dev    X=%5.2f Y=%5.2f",
+              sqrtf(stick_var(st, false)), sqrtf(stick_var(st, true)));
+    stat_line(5,  "Max rest   %u", st->max_r);
+    stat_line(6,  "Dead zone  ~%u", stick_deadzone(st));
+    stat_line(7,  "Moved      %u samples", st->moved);
+    stat_line(9,  "Presses    %u", src->presses);
+    stat_line(10, "Bounces    %u", src->bounces);
+    stat_line(12, "Dropped    %u", s_ring_dropped);
+}
+
+
+// ("cstick", "mean_x") -> "cstick_mean_x". static buffer, use it straight away
+static const char *stick_key(const char *key, const char *field) {
+    static char name[32];
+    snprintf(name, sizeof(name), "%s_%s", key, field);
+    return name;
+}
+
+// key is the field prefix for the structured report, "stick" or "cstick"
+static void report_stick(const char *who, const char *stick, const char *key,
+                         const stick_stats *st) {
+    report_sink *rep = &s_samp_log.sink;
+    char buf[96];
+    float mx = stick_mean(st, false), my = stick_mean(st, true);
+    float sx = sqrtf(stick_var(st, false)), sy = sqrtf(stick_var(st, true));
+    float off = sqrtf(mx * mx + my * my);
+    u32 dz = stick_deadzone(st);
+
+    if (st->n == 0) return;
+
+    snprintf(buf, sizeof(buf), "mean %+.1f,%+.1f  sd %.2f,%.2f  max %u  dz ~%u",
+             mx, my, sx, sy, (unsigned)st->max_r, (unsigned)dz);
+    ui_draw_kv(stick, buf);
+
+    if (off > DRIFT_MEAN)
+        ui_draw_warn("  Resting position is off center - real drift");
+    else if (sx > NOISE_STDDEV || sy > NOISE_STDDEV)
+        ui_draw_warn("  Jittery at rest - worn pot or dirty contacts");
+    else
+        ui_draw_ok("  Rests centered and steady");
+
+    sink_text(rep, "%s %s: mean %+.1f,%+.1f sd %.2f,%.2f max %u deadzone ~%u%s\n",
+              who, stick, mx, my, sx, sy, (unsigned)st->max_r, (unsigned)dz,
+              off > DRIFT_MEAN ? " [DRIFT]" : "");
+
+    sink_field_num(rep,  stick_key(key, "mean_x"),   mx);
+    sink_field_num(rep,  stick_key(key, "mean_y"),   my);
+    sink_field_num(rep,  stick_key(key, "sd_x"),     sx);
+    sink_field_num(rep,  stick_key(key, "sd_y"),     sy);
+    sink_field_int(rep,  stick_key(key, "max_r"),    st->max_r);
+    sink_field_int(rep,  stick_key(key, "deadzone"), dz);
+    sink_field_bool(rep, stick_key(key, "drift"),    off > DRIFT_MEAN);
+}
+
+
+static void run_sampling(void) {
+    int sel = -1, i;
+    bool quit = false, threaded;
+    char buf[96];
+
+    memset(s_src, 0, sizeof(s_src));
+    memset(s_samp_seq, 0, sizeof(s_samp_seq));
+    s_ring_head = s_ring_tail = s_ring_dropped = 0;
+    s_samp_stop = false;
+
+    SI_SetSamplingRate(SAMP_SI_RATE);
+    // without the thread we poll once a frame ourselves - a much lower rate,
+    // but bounce and drift still show up and START/HOME still get us out
+    threaded = LWP_CreateThread(&s_samp_thread, sampler_thread, NULL,
+                                s_samp_stack, sizeof(s_samp_stack), 80) >= 0;
+
+    ui_live_begin();
+
+    while (!quit) {
+        ctl_sample s;
+
+        if (!threaded) sampler_poll();
+        while (ring_pop(&s)) {
+            u32 down = s.btns & ~s_src[s.src].last_btns;
+            bool gc = s.src < 4;
+
+            src_add(&s);
+            if (down & (gc ? PAD_BUTTON_START : WPAD_BUTTON_HOME)) quit = true;
+            if (sel < 0) sel = s.src;
+            if (down & (gc ? PAD_BUTTON_RIGHT : WPAD_BUTTON_RIGHT)) {
+                for (i = 1; i <= SAMP_SOURCES; i++) {
+                    int n = (sel + i) % SAMP_SOURCES;
+                    if (s_src[n].seen) { sel = n; break; }
+                }
+            }
+        }
+
+        ui_frame_begin();
+        ui_printf(UI_BWHITE " Continuous sampling" UI_RESET UI_WHITE
+                  " - leave the sticks alone, tap buttons to check bounce\n");
+        ui_printf(" [RIGHT] Next controller   [START / HOME] Stop\n" UI_RESET);
+        draw_plot(sel);
+        if (sel >= 0) {
+            draw_stats(sel);
+        } else {
+            ui_frame_goto(PLOT_ROW, STAT_COL);
+            ui_printf(UI_BYELLOW "Waiting for a controller..." UI_RESET);
+        }
+        ui_frame_end();
+
+        VIDEO_WaitVSync();
+    }
+
+    s_samp_stop = true;
+    if (threaded) LWP_JoinThread(s_samp_thread, NULL);
+    SI_SetSamplingRate(0);
+    ui_live_end("Controller Diagnostics");
+    if (!threaded)
+        ui_draw_warn("Sampler thread didn't start - polled once a frame instead");
+
+    // --- summary, this part lands in the scroll view and the report ---
+    if (!s_samp_log.sink.emit) sink_log_init(&s_samp_log);
+    sink_log_clear(&s_samp_log);
+    sink_subsection(&s_samp_log.sink, "Continuous Sampling");
+    sink_list(&s_samp_log.sink, "sampling");
+
+    for (i = 0; i < SAMP_SOURCES; i++) {
+        const src_stats *src = &s_src[i];
+        char name[24];
+
+        if (!src->seen) continue;
+        src_name(i, name, sizeof(name));
+        ui_draw_section(name);
+
+        snprintf(buf, sizeof(buf), "%u over %u ms (%u/s)", src->samples,
+                 (unsigned)ticks_to_millisecs(src->last_t - src->first_t), src_rate(src));
+        ui_draw_kv("Samples", buf);
+
+        sink_item(&s_samp_log.sink);
+        sink_field_str(&s_samp_log.sink, "controller", name);
+        sink_field_int(&s_samp_log.sink, "samples",    src->samples);
+        sink_field_int(&s_samp_log.sink, "rate",       src_rate(src));
+
+        // a bare Wii Remote has no stick to say anything about
+        if (src->has_stick)
+            report_stick(name, i < 4 ? "Main Stick" : "Nunchuk Stick", "stick", &src->stick[0]);
+        if (i < 4) report_stick(name, "C-Stick", "cstick", &src->stick[1]);
+
+        snprintf(buf, sizeof(buf), "%u presses, %u bounced", src->presses, src->bounces);
+        ui_draw_kv_color("Buttons", src->bounces ? UI_BYELLOW : UI_BGREEN, buf);
+        if (src->bounces)
+            ui_draw_warn("Some button contacts are bouncing - worn or dirty");
+
+        sink_text(&s_samp_log.sink, "%s buttons: %u presses, %u bounces, %u samples/s\n",
+                  name, src->presses, src->bounces, src_rate(src));
+        sink_field_int(&s_samp_log.sink, "presses", src->presses);
+        sink_field_int(&s_samp_log.sink, "bounces", src->bounces);
+    }
+    sink_list_end(&s_samp_log.sink);
+    sink_field_int(&s_samp_log.sink, "samples_dropped", s_ring_dropped);
+
+    if (s_ring_dropped) {
+        snprintf(buf, sizeof(buf), "%u samples dropped (ring full)", s_ring_dropped);
+        ui_draw_warn(buf);
+    }
+    if (sel < 0) ui_draw_warn("No controllers showed up while sampling");
+    ui_draw_ok("Sampling finished");
+}
+
+
+static void run_snapshot(void) {
     char buf[64];
 
     ui_draw_info("This is a one-shot snapshot. Hold any buttons you want to check");
@@ -223,8 +709,305 @@ void run_controller_test(void) {
 }
 
 
+// --- Wii Remote link monitor ---
+// counts the data reports each remote actually delivers. WPAD queues every
+// report into the event buffers we hand it, and a worker drains them with
+// WPAD_ReadPending about once a millisecond, stamping each with gettime().
+// while this runs nothing else may call WPAD_ScanPads, it drains the same
+// queue.
+//
+// a remote in continuous reporting mode sends ~100 reports/s. a gap well
+// past 10ms is a late report, and a long gap is counted as the reports
+// that should have been in it. several reports landing in one drain means
+// they were held up and then sent in a burst.
+
+#define LINK_EVENT_BUFS  32
+#define LINK_NOMINAL_US  10000      // 100Hz reporting
+#define LINK_LATE_US     25000
+#define LINK_POLL_US     1000
+#define LINK_GOOD_RATE   90
+#define LINK_BAD_RATE    60
+
+typedef struct {
+    bool  seen;
+    u32   reports;
+    u32   late;
+    u32   dropped;
+    u32   bunched;
+    u32   max_gap_us;
+    u64   last_t;
+    u32   min_rate;         // worst finished window
+    u32   last_btns;
+
+    // current window
+    u32   w_reports;
+    u32   w_late;
+    u32   w_dropped;
+    u32   w_dots;
+    double w_sum, w_sq;     // accel magnitude. magnitude^2 runs to ~1e6 over
+                            // ~1000 reports, float cancels the noise away
+
+    // last finished window, what the screen shows
+    u32   rate;
+    u32   lost;
+    float dots;
+    float noise;
+    u32   windows;
+    float noise_sum;
+} link_stats;
+
+static WPADData      s_link_bufs[4][LINK_EVENT_BUFS] __attribute__((aligned(32)));
+static link_stats    s_link[4];
+static mutex_t       s_link_lock;
+static volatile bool s_link_stop = false;
+static volatile bool s_link_quit = false;
+static u32           s_link_window_ms = 1000;
+static u64           s_link_drain_t;
+static u32           s_link_drain_n[4];
+static sink_log      s_link_log;
+
+static void link_report_cb(s32 chan, const WPADData *wd) {
+    link_stats *ls;
+    double mag;
+
+    if (chan < 0 || chan > 3 || !wd) return;
+    ls = &s_link[chan];
+
+    if (ls->seen) {
+        u32 gap = (u32)ticks_to_microsecs(s_link_drain_t - ls->last_t);
+        if (gap > ls->max_gap_us) ls->max_gap_us = gap;
+        if (gap > LINK_LATE_US) {
+            u32 lost = gap / LINK_NOMINAL_US - 1;
+            ls->late++;
+            ls->w_late++;
+            ls->dropped   += lost;
+            ls->w_dropped += lost;
+        }
+    }
+    if (s_link_drain_n[chan]++ > 0) ls->bunched++;
+
+    ls->seen   = true;
+    ls->last_t = s_link_drain_t;
+    ls->reports++;
+    ls->w_reports++;
+    ls->w_dots += (u32)wd->ir.num_dots;
+
+    mag = sqrt((double)(wd->accel.x * wd->accel.x + wd->accel.y * wd->accel.y +
+                        wd->accel.z * wd->accel.z));
+    ls->w_sum += mag;
+    ls->w_sq  += mag * mag;
+
+    // our own edge check, btns_d is only worked out by WPAD_ScanPads
+    if ((wd->btns_h & ~ls->last_btns) & WPAD_BUTTON_HOME) s_link_quit = true;
+    ls->last_btns = wd->btns_h;
+}
+
+static void link_roll_window(void) {
+    int i;
+    for (i = 0; i < 4; i++) {
+        link_stats *ls = &s_link[i];
+        if (!ls->seen) continue;
+
+        ls->rate = (u32)((u64)ls->w_reports * 1000 / s_link_window_ms);
+        ls->lost = ls->w_dropped;
+        if (ls->w_reports) {
+            double m = ls->w_sum / ls->w_reports;
+            double v = ls->w_sq / ls->w_reports - m * m;
+            ls->dots  = (float)ls->w_dots / ls->w_reports;
+            ls->noise = v > 0.0 ? (float)sqrt(v) : 0.0f;
+        } else {
+            ls->dots = ls->noise = 0.0f;
+        }
+        if (ls->windows == 0 || ls->rate < ls->min_rate) ls->min_rate = ls->rate;
+        ls->windows++;
+        ls->noise_sum += ls->noise;
+
+        ls->w_reports = ls->w_late = ls->w_dropped = ls->w_dots = 0;
+        ls->w_sum = ls->w_sq = 0.0;
+    }
+}
+
+static void *link_thread(void *arg) {
+    u64 window_t0 = gettime();
+    (void)arg;
+
+    while (!s_link_stop) {
+        int i;
+
+        LWP_MutexLock(s_link_lock);
+        s_link_drain_t = gettime();
+        for (i = 0; i < 4; i++) {
+            s_link_drain_n[i] = 0;
+            WPAD_ReadPending(i, link_report_cb);
+        }
+        if (ticks_to_millisecs(s_link_drain_t - window_t0) >= s_link_window_ms) {
+            link_roll_window();
+            window_t0 = s_link_drain_t;
+        }
+        LWP_MutexUnlock(s_link_lock);
+
+        usleep(LINK_POLL_US);
+    }
+    return NULL;
+}
+
+static const char *link_color(u32 rate) {
+    if (rate >= LINK_GOOD_RATE) return UI_BGREEN;
+    if (rate >= LINK_BAD_RATE)  return UI_BYELLOW;
+    return UI_BRED;
+}
+
+
+static void run_link_monitor(void) {
+    static const char *windows[] = { "1 second window", "5 second window", "10 second window" };
+    static const u32 window_ms[] = { 1000, 5000, 10000 };
+    link_stats snap[4];
+    int w, i, frame = 0;
+    char buf[96];
+
+    w = ui_choose("Wii Remote Link Monitor", windows, 3);
+    if (w < 0) {
+        ui_draw_info("Cancelled.");
+        return;
+    }
+    s_link_window_ms = window_ms[w];
+
+    memset(s_link, 0, sizeof(s_link));
+    s_link_stop = s_link_quit = false;
+    LWP_MutexInit(&s_link_lock, false);
+    for (i = 0; i < 4; i++)
+        WPAD_SetEventBufs(i, s_link_bufs[i], LINK_EVENT_BUFS);
+    if (LWP_CreateThread(&s_samp_thread, link_thread, NULL,
+                         s_samp_stack, sizeof(s_samp_stack), 80) < 0) {
+        for (i = 0; i < 4; i++) WPAD_SetEventBufs(i, NULL, 0);
+        LWP_MutexDestroy(s_link_lock);
+        ui_draw_err("Can't start the link monitor thread - out of memory?");
+        return;
+    }
+
+    ui_live_begin();
+
+    // HOME on a remote comes in through link_report_cb. START on a GC pad
+    // gets us out when there's no remote, or it dropped off mid-test
+    while (!s_link_quit) {
+        PAD_ScanPads();
+        for (i = 0; i < 4; i++)
+            if (PAD_ButtonsDown(i) & PAD_BUTTON_START) s_link_quit = true;
+
+        if (frame % 15 == 0) {
+            LWP_MutexLock(s_link_lock);
+            memcpy(snap, s_link, sizeof(snap));
+            LWP_MutexUnlock(s_link_lock);
+
+            ui_frame_begin();
+            ui_printf(UI_BWHITE " Wii Remote link monitor" UI_RESET UI_WHITE
+                      " - %u s window, leave the remotes still for the noise figure\n",
+                      (unsigned)(s_link_window_ms / 1000));
+            ui_printf(" [HOME / START] Stop\n\n" UI_RESET);
+            ui_printf(UI_BCYAN "   Remote  Reports/s  Late  Lost  Max gap  IR dots  Accel noise\n" UI_RESET);
+
+            for (i = 0; i < 4; i++) {
+                if (!snap[i].seen) {
+                    ui_printf(UI_WHITE "   %d       (no reports)\n" UI_RESET, i + 1);
+                    continue;
+                }
+                ui_printf("   %d       %s%5u" UI_RESET UI_WHITE "   %5u %5u %6u ms  %6.1f   %8.2f\n" UI_RESET,
+                          i + 1, link_color(snap[i].rate), snap[i].rate, snap[i].late,
+                          snap[i].dropped, snap[i].max_gap_us / 1000, snap[i].dots, snap[i].noise);
+            }
+            ui_frame_end();
+        }
+        frame++;
+        VIDEO_WaitVSync();
+    }
+
+    s_link_stop = true;
+    LWP_JoinThread(s_samp_thread, NULL);
+    for (i = 0; i < 4; i++) WPAD_SetEventBufs(i, NULL, 0);
+    LWP_MutexDestroy(s_link_lock);
+    ui_live_end("Controller Diagnostics");
+
+    // --- summary ---
+    ui_draw_section("Wii Remote Link Quality");
+    if (!s_link_log.sink.emit) sink_log_init(&s_link_log);
+    sink_log_clear(&s_link_log);
+    snprintf(buf, sizeof(buf), "Wii Remote Link Monitor (%u s windows)",
+             (unsigned)(s_link_window_ms / 1000));
+    sink_subsection(&s_link_log.sink, buf);
+    sink_field_int(&s_link_log.sink, "link_window_ms", s_link_window_ms);
+    sink_list(&s_link_log.sink, "links");
+
+    {
+        int active = 0, weak = 0;
+
+        for (i = 0; i < 4; i++) {
+            link_stats *ls = &s_link[i];
+            float noise;
+            if (!ls->seen) continue;
+            active++;
+            noise = ls->windows ? ls->noise_sum / ls->windows : ls->noise;
+
+            snprintf(buf, sizeof(buf), "Wii Remote %d", i + 1);
+            ui_draw_ok(buf);
+            snprintf(buf, sizeof(buf), "%u total, worst window %u/s", ls->reports, ls->min_rate);
+            ui_draw_kv_color("  Reports", link_color(ls->min_rate), buf);
+            snprintf(buf, sizeof(buf), "%u late, ~%u lost, %u bunched, max gap %u ms",
+                     ls->late, ls->dropped, ls->bunched, ls->max_gap_us / 1000);
+            ui_draw_kv("  Timing", buf);
+            snprintf(buf, sizeof(buf), "%.2f", noise);
+            ui_draw_kv("  Accel Noise", buf);
+
+            if (ls->windows && ls->min_rate < LINK_BAD_RATE) weak++;
+
+            sink_text(&s_link_log.sink,
+                      "  Remote %d: %u reports, worst %u/s, %u late, ~%u lost, max gap %u ms, accel noise %.2f\n",
+                      i + 1, ls->reports, ls->min_rate, ls->late, ls->dropped,
+                      ls->max_gap_us / 1000, noise);
+            sink_item(&s_link_log.sink);
+            sink_field_int(&s_link_log.sink, "remote",     i + 1);
+            sink_field_int(&s_link_log.sink, "reports",    ls->reports);
+            sink_field_int(&s_link_log.sink, "worst_rate", ls->min_rate);
+            sink_field_int(&s_link_log.sink, "late",       ls->late);
+            sink_field_int(&s_link_log.sink, "lost",       ls->dropped);
+            sink_field_int(&s_link_log.sink, "bunched",    ls->bunched);
+            sink_field_int(&s_link_log.sink, "max_gap_us", ls->max_gap_us);
+            sink_field_num(&s_link_log.sink, "accel_noise", noise);
+        }
+
+        sink_list_end(&s_link_log.sink);
+        if (active == 0) {
+            ui_draw_warn("No Wii Remote reports came in");
+            sink_text(&s_link_log.sink, "  (no reports)\n");
+        } else if (weak > 0 && active >= 3) {
+            ui_draw_warn("Report rate is dropping with several remotes on - Bluetooth looks saturated");
+        } else if (weak > 0) {
+            ui_draw_warn("Report rate is dropping - check for interference or distance");
+        } else {
+            ui_draw_ok("Links look healthy");
+        }
+    }
+}
+
+
+void run_controller_test(void) {
+    PROF_FUNC();
+    static const char *modes[] = {
+        "Snapshot (one read of every controller)",
+        "Continuous sampling (drift, dead zone, bounce)",
+        "Wii Remote link monitor (report rate, IR, noise)"
+    };
+    int mode = ui_choose("Controller Diagnostics", modes, 3);
+
+    if (mode < 0)       ui_draw_info("Cancelled.");
+    else if (mode == 0) run_snapshot();
+    else if (mode == 1) run_sampling();
+    else                run_link_monitor();
+}
+
+
 // quick version used by the report generator - just needs counts, not UI output
 void scan_controllers_quick(void) {
+    PROF_FUNC();
     int i;
 
     s_gc_detected = 0;
@@ -235,12 +1018,9 @@ void scan_controllers_quick(void) {
         }
     }
 
-    // still need the BT warmup, no way around it
+    // still need the BT warmup, but only whatever's left of it since start-up
     s_wm_detected = 0;
-    for (i = 0; i < 30; i++) {
-        WPAD_ScanPads();
-        VIDEO_WaitVSync();
-    }
+    subsys_wait_wpad(s_warmup_ms);
     for (i = 0; i < 4; i++) {
         u32 type;
         if (WPAD_Probe(i, &type) == WPAD_ERR_NONE)
@@ -249,11 +1029,19 @@ void scan_controllers_quick(void) {
 }
 
 
-void get_controller_test_report(char *buf, int bufsize) {
-    snprintf(buf, bufsize,
-             "=== CONTROLLER DIAGNOSTICS ===\n"
-             "GameCube Ports Active: %d / 4\n"
-             "Wii Remotes Connected: %d / 4\n"
-             "\n",
-             s_gc_detected, s_wm_detected);
+void set_controller_warmup_ms(u32 ms) {
+    s_warmup_ms = ms;
+}
+
+
+void get_controller_test_report(report_sink *sink) {
+    PROF_FUNC();
+    sink_section(sink, "CONTROLLER DIAGNOSTICS");
+    sink_kv(sink, "GameCube Ports", "%d / 4 active", s_gc_detected);
+    sink_kv(sink, "Wii Remotes", "%d / 4 connected", s_wm_detected);
+    sink_field_int(sink, "gc_ports_active",    s_gc_detected);
+    sink_field_int(sink, "wiimotes_connected", s_wm_detected);
+    sink_log_replay(&s_samp_log, sink);
+    sink_log_replay(&s_link_log, sink);
+    sink_end(sink);
 }
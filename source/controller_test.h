@@ -5,13 +5,20 @@
 #ifndef CONTROLLER_TEST_H
 #define CONTROLLER_TEST_H
 
+#include "report_sink.h"
+
 // Run the controller diagnostic test
 void run_controller_test(void);
 
 // Quick scan - just count connected controllers (no UI output)
 void scan_controllers_quick(void);
 
-// Get controller test report as string
-void get_controller_test_report(char *buf, int bufsize);
+// How long after start-up the quick scan lets Bluetooth settle before
+// counting remotes (default 500 ms). Remotes that haven't reconnected by
+// then don't count
+void set_controller_warmup_ms(u32 ms);
+
+// Emit the controller test report section into a sink
+void get_controller_test_report(report_sink *sink);
 
 #endif // CONTROLLER_TEST_H
@@ -0,0 +1,323 @@
+// history.c
+// every quick benchmark, NAND check and network test leaves one small
+// fixed-size record in WiiMedic_History.bin. nothing is ever rewritten,
+// new records just go on the end, so a pulled card or a power cut costs at
+// most the record that was being written. the trend screen reads the tail
+// of the file in one go and draws a sparkline per series - a card whose
+// write speed has been sliding for months shows up here long before it
+// starts eating saves.
+//
+// modules queue records from wherever they are (the report runs them on
+// worker threads, and those don't get to touch the card), and the menu
+// flushes the queue once the module is done.
+
+#include <dirent.h>
+#include <gccore.h>
+#include <ogc/machine/processor.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "history.h"
+#include "storage_test.h"
+#include "subsys.h"
+#include "ui_common.h"
+
+// last, it wraps the IOS and libfat calls by name
+#include "prof_calls.h"
+
+#define HISTORY_MAGIC    0x574D4849     // 'WMHI'
+#define HISTORY_VERSION  1
+#define HIST_PENDING_MAX 8
+#define HIST_VIEW_MAX    256            // 12 KB of records, plenty of months
+#define HIST_SPARK_W     40
+#define HIST_MIN_TREND   4              // points before we call anything a trend
+
+typedef struct {
+    u32 magic;
+    u16 version;
+    u16 record_size;
+} hist_header;
+
+static hist_record s_pending[HIST_PENDING_MAX];
+static int         s_pending_count = 0;
+static hist_record s_view[HIST_VIEW_MAX];
+
+
+void history_add(const hist_record *r) {
+    hist_record rec = *r;
+    u32 level;
+
+    rec.time = (u32)time(NULL);
+    _CPU_ISR_Disable(level);
+    if (s_pending_count < HIST_PENDING_MAX) s_pending[s_pending_count++] = rec;
+    _CPU_ISR_Restore(level);
+}
+
+
+// SD if it's there, otherwise USB. false if neither is mounted
+static bool history_path(char *out, int outsize) {
+    static const char *roots[] = { "sd:/", "usb:/" };
+    int i;
+
+    subsys_wait_fat();
+    for (i = 0; i < 2; i++) {
+        DIR *d = opendir(roots[i]);
+        if (!d) continue;
+        closedir(d);
+        snprintf(out, outsize, "%s" HISTORY_FILE, roots[i]);
+        return true;
+    }
+    return false;
+}
+
+static bool header_ok(const hist_header *h) {
+    return h->magic == HISTORY_MAGIC && h->version == HISTORY_VERSION &&
+           h->record_size == sizeof(hist_record);
+}
+
+
+bool history_flush(void) {
+    static hist_record out[HIST_PENDING_MAX];
+    static const hist_record blank;
+    hist_header hdr;
+    char path[64];
+    u32 level, device_id = 0;
+    long size = 0;
+    FILE *fp;
+    bool ok = true;
+    int n, i;
+
+    _CPU_ISR_Disable(level);
+    n = s_pending_count;
+    memcpy(out, s_pending, n * sizeof(hist_record));
+    s_pending_count = 0;
+    _CPU_ISR_Restore(level);
+
+    if (n == 0) return true;
+    if (!history_path(path, sizeof(path))) return false;
+
+    ES_GetDeviceID(&device_id);
+    for (i = 0; i < n; i++) out[i].console = device_id;
+
+    // keep the file if its header is ours, otherwise start a new one -
+    // records from another layout can't be read anyway
+    fp = fopen(path, "r+b");
+    if (fp && (fread(&hdr, sizeof(hdr), 1, fp) != 1 || !header_ok(&hdr))) {
+        fclose(fp);
+        fp = NULL;
+    }
+    if (fp) {
+        fseek(fp, 0, SEEK_END);
+        size = ftell(fp) - (long)sizeof(hdr);
+        // a record torn in half by a pulled card. pad it out to a whole
+        // one so everything after it stays aligned; the reader skips it
+        if (size % (long)sizeof(hist_record)) {
+            u32 pad = sizeof(hist_record) - (u32)(size % (long)sizeof(hist_record));
+            ok = fwrite(&blank, 1, pad, fp) == pad;
+        }
+    } else {
+        fp = fopen(path, "wb");
+        if (!fp) return false;
+        hdr.magic       = HISTORY_MAGIC;
+        hdr.version     = HISTORY_VERSION;
+        hdr.record_size = sizeof(hist_record);
+        ok = fwrite(&hdr, sizeof(hdr), 1, fp) == 1;
+    }
+
+    ok = ok && fwrite(out, sizeof(hist_record), n, fp) == (size_t)n;
+    fclose(fp);
+    return ok;
+}
+
+
+int history_read(hist_record *out, int max) {
+    hist_header hdr;
+    char path[64];
+    long n, skip;
+    FILE *fp;
+    int got;
+
+    if (max <= 0 || !history_path(path, sizeof(path))) return 0;
+    fp = fopen(path, "rb");
+    if (!fp) return 0;
+    if (fread(&hdr, sizeof(hdr), 1, fp) != 1 || !header_ok(&hdr)) {
+        fclose(fp);
+        return 0;
+    }
+
+    // only the tail is worth drawing, and it comes in with a single read
+    fseek(fp, 0, SEEK_END);
+    n = (ftell(fp) - (long)sizeof(hdr)) / (long)sizeof(hist_record);
+    skip = n > max ? n - max : 0;
+    fseek(fp, (long)sizeof(hdr) + skip * (long)sizeof(hist_record), SEEK_SET);
+    got = (int)fread(out, sizeof(hist_record), (size_t)(n - skip), fp);
+    fclose(fp);
+    return got;
+}
+
+
+// --- trend screen ---
+
+static float get_sd_write(const hist_record *r)  { return r->sd_write_kbs; }
+static float get_sd_read(const hist_record *r)   { return r->sd_read_kbs; }
+static float get_usb_write(const hist_record *r) { return r->usb_write_kbs; }
+static float get_usb_read(const hist_record *r)  { return r->usb_read_kbs; }
+static float get_nand_mb(const hist_record *r)   { return (float)r->nand_clusters * 16.0f / 1024.0f; }
+static float get_inodes(const hist_record *r)    { return (float)r->nand_inodes; }
+static float get_score(const hist_record *r)     { return (float)r->health_score; }
+static float get_latency(const hist_record *r)   { return r->net_latency_ms; }
+
+static u32 sd_serial(const hist_record *r)  { return r->sd_serial; }
+static u32 usb_serial(const hist_record *r) { return r->usb_serial; }
+
+// pulls one series out of the records, oldest first. serial != NULL keeps
+// only the card `want`, a new card shouldn't look like the old one dying.
+// zero and negative values are half-written records, they don't count
+static int collect(int count, u16 flag, float (*get)(const hist_record *),
+                   u32 (*serial)(const hist_record *), u32 want, float *vals) {
+    int i, n = 0;
+    for (i = 0; i < count; i++) {
+        const hist_record *r = &s_view[i];
+        float v;
+        if (!(r->flags & flag)) continue;
+        if (serial && serial(r) != want) continue;
+        v = get(r);
+        if (v > 0.0f) vals[n++] = v;
+    }
+    return n;
+}
+
+static float best_before_last(const float *vals, int n) {
+    float best = 0.0f;
+    int i;
+    for (i = 0; i < n - 1; i++)
+        if (vals[i] > best) best = vals[i];
+    return best;
+}
+
+static void date_str(u32 t, char *out, int outsize) {
+    time_t tt = (time_t)t;
+    if (strftime(out, outsize, "%Y-%m-%d", localtime(&tt)) == 0)
+        snprintf(out, outsize, "?");
+}
+
+
+// SD or USB: which card, then write and read speed. warns once the latest
+// write is well down on the best this card has ever done. card is the
+// serial of whatever is in the slot now, the records of any other card
+// (or this one before a reformat) are left out
+static void storage_trend(int count, const char *title, u16 flag,
+                          float (*wr)(const hist_record *), float (*rd)(const hist_record *),
+                          u32 (*serial)(const hist_record *), u32 card) {
+    static float vals[HIST_VIEW_MAX];
+    char buf[96], date[16];
+    int i, n;
+
+    ui_draw_section(title);
+
+    if (card == 0) {
+        ui_draw_info("Nothing in the slot right now (or it isn't FAT)");
+        return;
+    }
+    for (i = count - 1; i >= 0; i--) {
+        if ((s_view[i].flags & flag) && serial(&s_view[i]) == card) break;
+    }
+    if (i < 0) {
+        snprintf(buf, sizeof(buf), "No benchmark runs recorded for this one (%04X-%04X) yet",
+                 (unsigned)(card >> 16), (unsigned)(card & 0xFFFF));
+        ui_draw_info(buf);
+        return;
+    }
+    date_str(s_view[i].time, date, sizeof(date));
+    snprintf(buf, sizeof(buf), "%04X-%04X, last run %s", (unsigned)(card >> 16), (unsigned)(card & 0xFFFF), date);
+    ui_draw_kv("Card", buf);
+
+    n = collect(count, flag, wr, serial, card, vals);
+    if (n > 0) {
+        float best = best_before_last(vals, n);
+        snprintf(buf, sizeof(buf), "write %.0f KB/s (%d runs)", vals[n - 1], n);
+        ui_draw_spark(vals, n, HIST_SPARK_W, UI_BGREEN, buf);
+        if (n >= HIST_MIN_TREND && vals[n - 1] < best * 0.8f) {
+            snprintf(buf, sizeof(buf), "Write speed is down %.0f%% from this card's best (%.0f KB/s)",
+                     100.0f - vals[n - 1] * 100.0f / best, best);
+            ui_draw_warn(buf);
+            ui_draw_info("A slowly dropping card is often on its way out - back it up");
+        }
+    }
+
+    n = collect(count, flag, rd, serial, card, vals);
+    if (n > 0) {
+        snprintf(buf, sizeof(buf), "read %.0f KB/s", vals[n - 1]);
+        ui_draw_spark(vals, n, HIST_SPARK_W, UI_BCYAN, buf);
+    }
+}
+
+
+void run_history_view(void) {
+    PROF_FUNC();
+    static float vals[HIST_VIEW_MAX];
+    char buf[96], first[16], last[16];
+    u32 me = 0;
+    int count, i, n, m;
+
+    count = history_read(s_view, HIST_VIEW_MAX);
+
+    // the card may have been through other consoles, only show this one
+    ES_GetDeviceID(&me);
+    for (i = m = 0; i < count; i++) {
+        if (s_view[i].console == me && s_view[i].time != 0 && s_view[i].flags != 0)
+            s_view[m++] = s_view[i];
+    }
+    count = m;
+
+    if (count == 0) {
+        ui_draw_info("No history for this console yet.");
+        ui_draw_info("Every storage benchmark, NAND check and network test adds a point.");
+        return;
+    }
+
+    date_str(s_view[0].time, first, sizeof(first));
+    date_str(s_view[count - 1].time, last, sizeof(last));
+    snprintf(buf, sizeof(buf), "%d records, %s to %s", count, first, last);
+    ui_draw_kv("History", buf);
+
+    storage_trend(count, "SD Card", HIST_SD, get_sd_write, get_sd_read, sd_serial,
+                  get_storage_volume_serial(false));
+    storage_trend(count, "USB Drive", HIST_USB, get_usb_write, get_usb_read, usb_serial,
+                  get_storage_volume_serial(true));
+
+    ui_draw_section("NAND");
+    n = collect(count, HIST_NAND, get_nand_mb, NULL, 0, vals);
+    if (n == 0) {
+        ui_draw_info("No NAND checks recorded yet");
+    } else {
+        snprintf(buf, sizeof(buf), "used %.1f MB (%d checks)", vals[n - 1], n);
+        ui_draw_spark(vals, n, HIST_SPARK_W, UI_BYELLOW, buf);
+        n = collect(count, HIST_NAND, get_inodes, NULL, 0, vals);
+        if (n > 0) {
+            snprintf(buf, sizeof(buf), "inodes %.0f", vals[n - 1]);
+            ui_draw_spark(vals, n, HIST_SPARK_W, UI_BYELLOW, buf);
+        }
+        n = collect(count, HIST_NAND, get_score, NULL, 0, vals);
+        if (n > 0) {
+            snprintf(buf, sizeof(buf), "health %.0f/100", vals[n - 1]);
+            ui_draw_spark(vals, n, HIST_SPARK_W, vals[n - 1] >= 80.0f ? UI_BGREEN : UI_BRED, buf);
+        }
+    }
+
+    ui_draw_section("Network");
+    n = collect(count, HIST_NET, get_latency, NULL, 0, vals);
+    if (n == 0) {
+        ui_draw_info("No network tests recorded yet");
+    } else {
+        snprintf(buf, sizeof(buf), "connect %.1f ms (%d tests)", vals[n - 1], n);
+        ui_draw_spark(vals, n, HIST_SPARK_W, UI_BCYAN, buf);
+    }
+
+    ui_printf("\n");
+    ui_draw_info("Taller is more: speed, space used, score, latency.");
+    ui_draw_info("Storage graphs only show the card that's in now.");
+}
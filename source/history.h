@@ -0,0 +1,52 @@
+/*
+ * WiiMedic - history.h
+ * Append-only log of benchmark and health numbers, and the trend screen
+ */
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <gccore.h>
+
+#define HISTORY_FILE "WiiMedic_History.bin"
+
+// which parts of a record are filled in
+#define HIST_SD     (1 << 0)    // sd_* (quick benchmark)
+#define HIST_USB    (1 << 1)    // usb_* (quick benchmark)
+#define HIST_NAND   (1 << 2)    // nand_* and health_score
+#define HIST_NET    (1 << 3)    // net_latency_ms
+
+// One measurement, 48 bytes on disk. Never reorder or resize the fields;
+// add new ones in place of reserved and bump HISTORY_VERSION instead
+typedef struct {
+    u32   time;             // time() when it was measured
+    u32   console;          // ES device ID, the card may visit other consoles
+    u16   flags;            // HIST_*
+    u8    health_score;     // NAND health, 0-100
+    u8    reserved;
+    u32   sd_serial;        // FAT volume serial, tells one card from another
+    float sd_write_kbs;
+    float sd_read_kbs;
+    u32   usb_serial;
+    float usb_write_kbs;
+    float usb_read_kbs;
+    u32   nand_clusters;    // used clusters (16 KB each)
+    u32   nand_inodes;      // used inodes
+    float net_latency_ms;   // mean connect time of the probes that worked
+} hist_record;
+
+// Queues a record (flags and whatever they cover filled in, the rest zero).
+// Safe from the report's worker threads - nothing touches the card until
+// history_flush()
+void history_add(const hist_record *r);
+
+// Appends everything queued to the history file on SD (USB if there's no
+// SD) in one write. Returns false if records were queued but not written
+bool history_flush(void);
+
+// The newest records (up to max), oldest first. Returns how many
+int history_read(hist_record *out, int max);
+
+// Show sparklines of storage speed, NAND fill and latency over time
+void run_history_view(void);
+
+#endif // HISTORY_H
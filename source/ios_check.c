@@ -2,17 +2,31 @@
 // scans every installed IOS slot, figures out what's a stub, what's real,
 // and what's a cIOS. mostly useful for diagnosing "why won't USB Loader GX work"
 // type problems.
+//
+// deep verify goes further and SHA-1s every content of every IOS (and the
+// system menu) against the hashes in its TMD. a content that doesn't match
+// is a corrupted install, which is behind a lot of bricks.
 
 #include <gccore.h>
 #include <malloc.h>
+#include <ogc/isfs.h>
+#include <ogc/lwp.h>
+#include <ogc/lwp_watchdog.h>
+#include <ogc/semaphore.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "ios_check.h"
+#include "nand_index.h"
+#include "result_cache.h"
+#include "scratch.h"
+#include "sha1.h"
 #include "ui_common.h"
 
-#define MAX_REPORT 8192
+// last, it wraps the IOS and libfat calls by name
+#include "prof_calls.h"
+
 
 
 // revision 0 is always a stub, rev 65280 (0xFF00) is Nintendo's placeholder
@@ -57,89 +71,309 @@ static const char *get_ios_description(u32 slot) {
 }
 
 
+// TMD prefetch. while the main thread formats row N a worker pulls the
+// TMD for row N+1 into the NAND index, so the ES round-trips overlap with
+// the console output instead of adding to it.
+#define MAX_IOS_SLOTS 256
+
 // module state - stored so the report generator can pull it later
 // without having to re-run the scan
-static char s_report[MAX_REPORT];
-static int  s_total_ios  = 0;
-static int  s_stub_count = 0;
-static int  s_cios_count = 0;
+typedef struct {
+    u32         slot;
+    u32         revision;
+    u32         us;         // TMD fetch time
+    const char *status;
+} ios_row;
+
+static ios_row s_rows[MAX_IOS_SLOTS];
+static bool    s_scan_done  = false;
+static int     s_total_ios  = 0;
+static int     s_stub_count = 0;
+static int     s_cios_count = 0;
+static u32     s_total_us   = 0;
+static u32     s_slow_us    = 0;
+static u32     s_slow_slot  = 0;
+static int     s_report_mode = 0;   // what the report runs, autorun.cfg can ask for deep
+
+static u64           s_ios_ids[MAX_IOS_SLOTS];
+static sem_t         s_pf_go, s_pf_done;
+static volatile u64  s_pf_id;
+static volatile bool s_pf_quit;
+static lwp_t         s_pf_thread;
+static u8            s_pf_stack[8192] __attribute__((aligned(32)));
+// above the main thread: it runs the moment it's handed a title, gets as far
+// as the ES call and sleeps on the IPC reply, and that wait is what overlaps
+// with the main thread formatting the previous row
+#define PF_PRIO 72
+
+// deep verify. shared contents live in /shared1 under names from
+// content.map, which maps each one's SHA-1 to an 8-digit file name.
+#define SM_TITLE_ID      0x0000000100000002ULL
+#define VERIFY_CHUNK     (64 * 1024)
+#define CONTENT_SHARED   0x8000
+#define MAX_BAD_SHOWN    16
+
+enum { CONTENT_OK = 0, CONTENT_BAD, CONTENT_MISSING };
+
+typedef struct {
+    char name[8];
+    u8   hash[SHA1_DIGEST_SIZE];
+} __attribute__((packed)) cmap_entry;
+
+typedef struct {
+    u32 slot;           // IOS number, 0 for the system menu
+    u32 cid;
+    int result;
+} bad_content;
+
+static cmap_entry *s_cmap       = NULL;
+static u32         s_cmap_count = 0;
+static bool        s_deep_run   = false;
+static int         s_deep_titles, s_deep_contents;
+static u64         s_deep_bytes;
+static u32         s_deep_ms;
+static bad_content s_bad[MAX_BAD_SHOWN];
+static int         s_bad_count;
+
+static char s_vpath[ISFS_MAXPATH] ATTRIBUTE_ALIGN(32);
+
+static void load_content_map(void) {
+    s32 size, fd;
+
+    if (s_cmap) return;
+    size = nand_index_file_size("/shared1/content.map");
+    if (size <= 0) return;
+
+    s_cmap = (cmap_entry *)memalign(32, (size + 31) & ~31);
+    if (!s_cmap) return;
+
+    strcpy(s_vpath, "/shared1/content.map");
+    fd = ISFS_Open(s_vpath, ISFS_OPEN_READ);
+    if (fd < 0 || ISFS_Read(fd, s_cmap, size) != size) {
+        free(s_cmap);
+        s_cmap = NULL;
+    } else {
+        s_cmap_count = (u32)size / sizeof(cmap_entry);
+    }
+    if (fd >= 0) ISFS_Close(fd);
+}
 
 
-void run_ios_check(void) {
+static int verify_content(u64 tid, const tmd_content *c, u8 *buf) {
+    u8 digest[SHA1_DIGEST_SIZE];
+    sha1_ctx ctx;
+    u64 left = c->size;
+    s32 fd;
+
+    if (c->type & CONTENT_SHARED) {
+        u32 i;
+        bool found = false;
+        for (i = 0; i < s_cmap_count; i++) {
+            if (memcmp(s_cmap[i].hash, c->hash, SHA1_DIGEST_SIZE) == 0) {
+                snprintf(s_vpath, sizeof(s_vpath), "/shared1/%.8s.app", s_cmap[i].name);
+                found = true;
+                break;
+            }
+        }
+        if (!found) return CONTENT_MISSING;
+    } else {
+        snprintf(s_vpath, sizeof(s_vpath), "/title/%08x/%08x/content/%08x.app",
+                 (unsigned)(tid >> 32), (unsigned)(tid & 0xFFFFFFFF), (unsigned)c->cid);
+    }
+
+    fd = ISFS_Open(s_vpath, ISFS_OPEN_READ);
+    if (fd < 0) return CONTENT_MISSING;
+
+    sha1_init(&ctx);
+    while (left > 0) {
+        u32 want = (left > VERIFY_CHUNK) ? VERIFY_CHUNK : (u32)left;
+        s32 got = ISFS_Read(fd, buf, want);
+        if (got <= 0) break;
+        sha1_update(&ctx, buf, (u32)got);
+        s_deep_bytes += (u32)got;
+        left -= (u32)got;
+    }
+    ISFS_Close(fd);
+
+    if (left > 0) return CONTENT_MISSING;
+    sha1_final(&ctx, digest);
+    return memcmp(digest, c->hash, SHA1_DIGEST_SIZE) == 0 ? CONTENT_OK : CONTENT_BAD;
+}
+
+
+// hashes every content of one title. returns how many didn't check out
+static int verify_title(u64 tid, u32 slot, u8 *buf) {
+    const tmd *t = nand_index_tmd(tid);
+    int bad = 0;
+    u16 i;
+
+    if (!t) return 0;
+    s_deep_titles++;
+
+    for (i = 0; i < t->num_contents; i++) {
+        int r = verify_content(tid, &t->contents[i], buf);
+        s_deep_contents++;
+        if (r == CONTENT_OK) continue;
+        bad++;
+        if (s_bad_count < MAX_BAD_SHOWN) {
+            s_bad[s_bad_count].slot   = slot;
+            s_bad[s_bad_count].cid    = t->contents[i].cid;
+            s_bad[s_bad_count].result = r;
+        }
+        s_bad_count++;
+    }
+    return bad;
+}
+
+
+static void run_deep_verify(int n_ios) {
+    PROF_FUNC();
+    u8 *buf = (u8 *)scratch_alloc(VERIFY_CHUNK);
+    char msg[96];
+    int k;
+
+    if (!buf) {
+        ui_draw_err("Out of memory - can't allocate the hash buffer");
+        return;
+    }
+
+    if (!nand_index_ready()) {
+        ui_draw_err("Can't open the NAND filesystem - deep verify needs it");
+        scratch_free(buf);
+        return;
+    }
+
+    load_content_map();
+    if (!s_cmap)
+        ui_draw_warn("Can't read /shared1/content.map - shared contents will show as missing");
+
+    s_deep_titles = s_deep_contents = s_bad_count = 0;
+    s_deep_bytes = 0;
+
+    u64 t0 = gettime();
+
+    ui_spin_set_msg("Hashing System Menu...");
+    if (verify_title(SM_TITLE_ID, 0, buf) > 0)
+        ui_draw_err("System Menu contents don't match the TMD - get help before changing anything");
+
+    for (k = 0; k < n_ios; k++) {
+        u32 slot = (u32)(s_ios_ids[k] & 0xFFFFFFFF);
+        snprintf(msg, sizeof(msg), "Hashing IOS%u...", slot);
+        ui_spin_set_msg(msg);
+        if (verify_title(s_ios_ids[k], slot, buf) > 0) {
+            snprintf(msg, sizeof(msg), "IOS%u is corrupted - reinstall it", slot);
+            ui_draw_err(msg);
+        }
+    }
+
+    s_deep_ms = (u32)ticks_to_millisecs(gettime() - t0);
+    s_deep_run = true;
+    scratch_free(buf);
+}
+
+
+static float deep_mbs(void) {
+    if (s_deep_ms == 0) return 0.0f;
+    return (float)s_deep_bytes / (1024.0f * 1024.0f) / ((float)s_deep_ms / 1000.0f);
+}
+
+
+static void *tmd_prefetch(void *arg) {
+    (void)arg;
+    while (1) {
+        LWP_SemWait(s_pf_go);
+        if (s_pf_quit) break;
+        nand_index_tmd(s_pf_id);
+        LWP_SemPost(s_pf_done);
+    }
+    return NULL;
+}
+
+
+// mode 0 = quick scan, 1 = deep verify
+static void ios_scan(int mode) {
+    PROF_FUNC();
     u32 title_count = 0;
     s32 ret;
     u32 i;
-    int rpos = 0;
+    int n_ios = 0, k;
 
     ui_draw_info("Scanning installed IOS slots...");
     ui_printf("\n");
 
-    ret = ES_GetNumTitles(&title_count);
+    // the title list and TMDs come out of the shared NAND index, so if
+    // system info or the report already asked for them it's free
+    const u64 *title_list = NULL;
+    ret = nand_index_titles(&title_list, &title_count);
     if (ret < 0 || title_count == 0) {
         char msg[64];
-        snprintf(msg, sizeof(msg), "ES_GetNumTitles failed (error %d)", ret);
+        snprintf(msg, sizeof(msg), "Can't read installed titles (error %d)", ret);
         ui_draw_err(msg);
         return;
     }
 
-    u64 *title_list = (u64 *)memalign(32, title_count * sizeof(u64));
-    if (!title_list) {
-        ui_draw_err("Out of memory - can't allocate title list");
-        return;
-    }
+    // only care about IOS titles (upper = 1, lower 3-255)
+    // skip the system menu and shop channel title IDs
+    for (i = 0; i < title_count && n_ios < MAX_IOS_SLOTS; i++) {
+        u32 upper = (u32)(title_list[i] >> 32);
+        u32 lower = (u32)(title_list[i] & 0xFFFFFFFF);
 
-    ret = ES_GetTitles(title_list, title_count);
-    if (ret < 0) {
-        char msg[64];
-        snprintf(msg, sizeof(msg), "ES_GetTitles failed (error %d)", ret);
-        ui_draw_err(msg);
-        free(title_list);
-        return;
+        if (upper != 1) continue;
+        if (lower < 3 || lower > 255) continue;
+        if (lower == 0x100 || lower == 0x101) continue;
+        s_ios_ids[n_ios++] = title_list[i];
     }
 
-    ui_printf(UI_BCYAN "   %-8s %-12s %-10s %s\n" UI_RESET, "IOS", "Revision", "Status", "Notes");
-    ui_printf(UI_WHITE "   -------- ------------ ---------- --------------------------\n" UI_RESET);
+    ui_printf(UI_BCYAN "   %-8s %-12s %-10s %6s %s\n" UI_RESET, "IOS", "Revision", "Status", "Time", "Notes");
+    ui_printf(UI_WHITE "   -------- ------------ ---------- ------ -------------------\n" UI_RESET);
 
+    s_scan_done  = false;
+    s_deep_run   = false;
     s_total_ios  = 0;
     s_stub_count = 0;
     s_cios_count = 0;
+    s_total_us   = 0;
+    s_slow_us    = 0;
+    s_slow_slot  = 0;
 
-    memset(s_report, 0, sizeof(s_report));
-    rpos = snprintf(s_report, MAX_REPORT,
-                    "=== IOS INSTALLATION SCAN ===\n"
-                    "%-8s %-12s %-10s %s\n"
-                    "-------- ------------ ---------- ----------------------------\n",
-                    "IOS", "Revision", "Status", "Notes");
+    s_pf_quit = false;
+    LWP_SemInit(&s_pf_go, 0, 1);
+    LWP_SemInit(&s_pf_done, 0, 1);
+    // no worker just means every TMD gets fetched inline below
+    bool prefetch = LWP_CreateThread(&s_pf_thread, tmd_prefetch, NULL,
+                                     s_pf_stack, sizeof(s_pf_stack), PF_PRIO) >= 0;
 
-    for (i = 0; i < title_count; i++) {
-        u32 upper = (u32)(title_list[i] >> 32);
-        u32 lower = (u32)(title_list[i] & 0xFFFFFFFF);
+    for (k = 0; k < n_ios; k++) {
+        u32 lower = (u32)(s_ios_ids[k] & 0xFFFFFFFF);
 
-        // only care about IOS titles (upper = 1, lower 3-255)
-        // skip the system menu and shop channel title IDs
-        if (upper != 1) continue;
-        if (lower < 3 || lower > 255) continue;
-        if (lower == 0x100 || lower == 0x101) continue;
+        // row k was handed to the worker last time around
+        if (prefetch && k > 0) LWP_SemWait(s_pf_done);
 
         s_total_ios++;
 
-        u32 tmd_size = 0;
         u32 revision = 0;
         bool is_stub = false;
 
-        ret = ES_GetStoredTMDSize(title_list[i], &tmd_size);
-        if (ret >= 0 && tmd_size > 0) {
-            signed_blob *tbuf = (signed_blob *)memalign(32, tmd_size);
-            if (tbuf) {
-                ret = ES_GetStoredTMD(title_list[i], tbuf, tmd_size);
-                if (ret >= 0) {
-                    tmd *t = SIGNATURE_PAYLOAD(tbuf);
-                    revision = t->title_version;
-                    if (t->num_contents == 0 || is_known_stub_revision(revision))
-                        is_stub = true;
-                }
-                free(tbuf);
-            }
+        const tmd *t = nand_index_tmd(s_ios_ids[k]);
+        if (t) {
+            revision = t->title_version;
+            if (t->num_contents == 0 || is_known_stub_revision(revision))
+                is_stub = true;
+        }
+
+        // time is what ES actually took for this slot, whichever thread
+        // ended up doing the fetch. read it before the next hand-off, the
+        // worker holds the index lock for the whole of its fetch
+        u32 us = nand_index_tmd_us(s_ios_ids[k]);
+
+        if (prefetch && k + 1 < n_ios) {
+            s_pf_id = s_ios_ids[k + 1];
+            LWP_SemPost(s_pf_go);
+        }
+        s_total_us += us;
+        if (us > s_slow_us) {
+            s_slow_us   = us;
+            s_slow_slot = lower;
         }
 
         const char *status, *color;
@@ -161,15 +395,28 @@ void run_ios_check(void) {
             color  = UI_BGREEN;
         }
 
-        ui_printf("   %sIOS%-4u  rev %-8u %-10s" UI_WHITE " %s\n" UI_RESET,
-                  color, lower, revision, status, desc);
+        ui_printf("   %sIOS%-4u  rev %-8u %-10s" UI_WHITE " %4.1fms %s\n" UI_RESET,
+                  color, lower, revision, status, (float)us / 1000.0f, desc);
 
-        rpos += snprintf(s_report + rpos, MAX_REPORT - rpos,
-                         "IOS%-4u  rev %-8u %-10s %s\n",
-                         lower, revision, status, desc);
+        s_rows[k].slot     = lower;
+        s_rows[k].revision = revision;
+        s_rows[k].us       = us;
+        s_rows[k].status   = status;
     }
+    s_scan_done = true;
 
-    free(title_list);
+    if (prefetch) {
+        s_pf_quit = true;
+        LWP_SemPost(s_pf_go);
+        LWP_JoinThread(s_pf_thread, NULL);
+    }
+    LWP_SemDestroy(s_pf_go);
+    LWP_SemDestroy(s_pf_done);
+
+    if (mode == 1) {
+        ui_draw_section("Content Verification");
+        run_deep_verify(n_ios);
+    }
 
     ui_draw_section("Summary");
     {
@@ -191,12 +438,42 @@ void run_ios_check(void) {
             snprintf(buf, sizeof(buf), "%d installed", s_cios_count);
             ui_draw_kv("Custom IOS (cIOS)", buf);
         }
+
+        snprintf(buf, sizeof(buf), "%.1f ms total", (float)s_total_us / 1000.0f);
+        ui_draw_kv("TMD Fetch Time", buf);
+        if (s_slow_us > 0) {
+            snprintf(buf, sizeof(buf), "IOS%u (%.1f ms)", s_slow_slot, (float)s_slow_us / 1000.0f);
+            ui_draw_kv("Slowest Slot", buf);
+        }
     }
 
-    rpos += snprintf(s_report + rpos, MAX_REPORT - rpos,
-                     "\nTotal: %d | Active: %d | Stubs: %d | cIOS: %d\n\n",
-                     s_total_ios, s_total_ios - s_stub_count,
-                     s_stub_count, s_cios_count);
+    if (mode == 1 && s_deep_run) {
+        char buf[96];
+        int j;
+
+        ui_draw_section("Verification Results");
+        snprintf(buf, sizeof(buf), "%d contents in %d titles", s_deep_contents, s_deep_titles);
+        ui_draw_kv("Hashed", buf);
+        snprintf(buf, sizeof(buf), "%.1f MB in %.1f s (%.2f MB/s)",
+                 (float)s_deep_bytes / (1024.0f * 1024.0f), (float)s_deep_ms / 1000.0f, deep_mbs());
+        ui_draw_kv("Throughput", buf);
+
+        if (s_bad_count == 0) {
+            ui_draw_ok("Every content matches its TMD hash");
+        } else {
+            snprintf(buf, sizeof(buf), "%d contents failed verification", s_bad_count);
+            ui_draw_err(buf);
+            for (j = 0; j < s_bad_count && j < MAX_BAD_SHOWN; j++) {
+                if (s_bad[j].slot == 0)
+                    snprintf(buf, sizeof(buf), "System Menu content %08x: %s", s_bad[j].cid,
+                             s_bad[j].result == CONTENT_BAD ? "hash mismatch" : "missing/unreadable");
+                else
+                    snprintf(buf, sizeof(buf), "IOS%u content %08x: %s", s_bad[j].slot, s_bad[j].cid,
+                             s_bad[j].result == CONTENT_BAD ? "hash mismatch" : "missing/unreadable");
+                ui_draw_warn(buf);
+            }
+        }
+    }
 
     ui_printf("\n");
     if (s_cios_count > 0) {
@@ -211,7 +488,124 @@ void run_ios_check(void) {
 }
 
 
-void get_ios_check_report(char *buf, int bufsize) {
-    strncpy(buf, s_report, bufsize - 1);
-    buf[bufsize - 1] = '\0';
+void run_ios_check(void) {
+    static const char *modes[] = {
+        "Quick scan (revisions and stubs)",
+        "Deep verify (SHA-1 every content, takes a minute or two)"
+    };
+    int mode = ui_choose("IOS Installation Scan", modes, 2);
+    if (mode < 0) {
+        ui_draw_info("Cancelled.");
+        return;
+    }
+    ios_scan(mode);
+}
+
+void run_ios_quick_scan(void) {
+    ios_scan(s_report_mode);
+}
+
+void set_ios_check_deep(bool deep) {
+    s_report_mode = deep ? 1 : 0;
+}
+
+bool has_ios_check_run(void) { return s_scan_done; }
+
+
+// the installed IOS set and each one's revision. the TMDs come out of the
+// NAND index, so if the scan has to run after all it gets them for free
+u64 get_ios_check_cache_key(void) {
+    const u64 *list = NULL;
+    u32 count = 0, i;
+    // a saved quick scan doesn't answer a request for a deep one
+    u64 h = rcache_hash_u32(RCACHE_KEY_INIT, (u32)s_report_mode);
+
+    if (nand_index_titles(&list, &count) < 0 || count == 0) return 0;
+    for (i = 0; i < count; i++) {
+        const tmd *t;
+        if ((u32)(list[i] >> 32) != 1) continue;
+        t = nand_index_tmd(list[i]);
+        h = rcache_hash(h, &list[i], sizeof(list[i]));
+        h = rcache_hash_u32(h, t ? t->title_version : 0xFFFFFFFF);
+    }
+    return h;
+}
+
+
+void get_ios_check_report(report_sink *sink) {
+    PROF_FUNC();
+    int k, j;
+
+    sink_section(sink, "IOS INSTALLATION SCAN");
+    if (!s_scan_done) {
+        sink_text(sink, "Not run yet. Go to the main menu and run IOS Scan first for full data.\n");
+        sink_field_bool(sink, "run", false);
+        sink_end(sink);
+        return;
+    }
+
+    sink_text(sink, "%-8s %-12s %-10s %6s %s\n", "IOS", "Revision", "Status", "Time", "Notes");
+    sink_text(sink, "-------- ------------ ---------- ------ ---------------------\n");
+    for (k = 0; k < s_total_ios; k++) {
+        const ios_row *r = &s_rows[k];
+        sink_text(sink, "IOS%-4u  rev %-8u %-10s %4.1fms %s\n",
+                  r->slot, r->revision, r->status, (float)r->us / 1000.0f,
+                  get_ios_description(r->slot));
+    }
+
+    sink_text(sink, "\n");
+    sink_kv(sink, "Total IOS",  "%d", s_total_ios);
+    sink_kv(sink, "Active",     "%d", s_total_ios - s_stub_count);
+    sink_kv(sink, "Stubs",      "%d", s_stub_count);
+    sink_kv(sink, "cIOS",       "%d", s_cios_count);
+    sink_kv(sink, "TMD Fetch",  "%.1f ms total, slowest IOS%u (%.1f ms)",
+            (float)s_total_us / 1000.0f, s_slow_slot, (float)s_slow_us / 1000.0f);
+
+    if (s_deep_run) {
+        sink_kv(sink, "Deep Verify", "%d contents in %d titles, %.1f MB at %.2f MB/s, %d bad",
+                s_deep_contents, s_deep_titles,
+                (float)s_deep_bytes / (1024.0f * 1024.0f), deep_mbs(), s_bad_count);
+        for (j = 0; j < s_bad_count && j < MAX_BAD_SHOWN; j++) {
+            char who[16];
+            if (s_bad[j].slot == 0) strcpy(who, "System Menu");
+            else                    snprintf(who, sizeof(who), "IOS%u", s_bad[j].slot);
+            sink_text(sink, "  %s content %08x: %s\n", who, s_bad[j].cid,
+                      s_bad[j].result == CONTENT_BAD ? "HASH MISMATCH" : "missing/unreadable");
+        }
+    }
+
+    sink_field_bool(sink, "run",          true);
+    sink_field_int(sink,  "total",        s_total_ios);
+    sink_field_int(sink,  "stubs",        s_stub_count);
+    sink_field_int(sink,  "cios",         s_cios_count);
+    sink_field_int(sink,  "tmd_total_us", s_total_us);
+    sink_list(sink, "slots");
+    for (k = 0; k < s_total_ios; k++) {
+        sink_item(sink);
+        sink_field_int(sink, "slot",     s_rows[k].slot);
+        sink_field_int(sink, "revision", s_rows[k].revision);
+        sink_field_str(sink, "status",   s_rows[k].status);
+        sink_field_int(sink, "tmd_us",   s_rows[k].us);
+    }
+    sink_list_end(sink);
+
+    sink_field_bool(sink, "deep_verify", s_deep_run);
+    if (s_deep_run) {
+        sink_field_int(sink, "deep_titles",   s_deep_titles);
+        sink_field_int(sink, "deep_contents", s_deep_contents);
+        sink_field_int(sink, "deep_bytes",    s_deep_bytes);
+        sink_field_num(sink, "deep_mbs",      deep_mbs());
+        sink_field_int(sink, "deep_bad",      s_bad_count);
+        sink_list(sink, "bad_contents");
+        for (j = 0; j < s_bad_count && j < MAX_BAD_SHOWN; j++) {
+            char cid[12];
+            snprintf(cid, sizeof(cid), "%08x", s_bad[j].cid);
+            sink_item(sink);
+            sink_field_int(sink,  "slot",     s_bad[j].slot);
+            sink_field_str(sink,  "content",  cid);
+            sink_field_bool(sink, "mismatch", s_bad[j].result == CONTENT_BAD);
+        }
+        sink_list_end(sink);
+    }
+    sink_end(sink);
 }
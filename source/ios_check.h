@@ -5,10 +5,24 @@
 #ifndef IOS_CHECK_H
 #define IOS_CHECK_H
 
-// Run the IOS installation scan
+#include "report_sink.h"
+
+// Run the IOS installation scan (asks quick or deep first)
 void run_ios_check(void);
 
-// Get IOS check report as string
-void get_ios_check_report(char *buf, int bufsize);
+// Scan without asking, for the report. Quick unless set_ios_check_deep
+// asked for content verification as well
+void run_ios_quick_scan(void);
+void set_ios_check_deep(bool deep);
+
+// True once a scan has finished this session
+bool has_ios_check_run(void);
+
+// Result cache key for the report: the installed IOS slots and their
+// revisions. 0 if the title list can't be read
+u64 get_ios_check_cache_key(void);
+
+// Emit the IOS check report section into a sink
+void get_ios_check_report(report_sink *sink);
 
 #endif // IOS_CHECK_H
@@ -1,5 +1,4 @@
 
-#include <fat.h>
 #include <gccore.h>
 #include <ogc/system.h>
 #include <stdio.h>
@@ -7,16 +6,24 @@
 #include <string.h>
 #include <wiiuse/wpad.h>
 
+#include "autorun.h"
 #include "controller_test.h"
+#include "history.h"
 #include "ios_check.h"
 #include "nand_health.h"
+#include "nand_index.h"
 #include "network_test.h"
 #include "report.h"
+#include "scratch.h"
 #include "storage_test.h"
+#include "subsys.h"
 #include "system_info.h"
 #include "ui_common.h"
 
-#define MENU_ITEMS 8
+// last, it wraps the IOS and libfat calls by name
+#include "prof_calls.h"
+
+#define MENU_ITEMS 9
 
 static const char *menu_labels[MENU_ITEMS] = {
     "System Information",
@@ -26,6 +33,7 @@ static const char *menu_labels[MENU_ITEMS] = {
     "Controller Diagnostics",
     "Network Connectivity Test",
     "Generate Full Report to SD",
+    "History & Trends",
     "Exit to Homebrew Channel"
 };
 
@@ -37,6 +45,7 @@ static const char *menu_descs[MENU_ITEMS] = {
     "Test GC controllers and Wii Remotes, detect stick drift",
     "Check WiFi module, IP config, internet connectivity",
     "Save a full diagnostic report as text file to SD card",
+    "Storage speed, NAND fill and latency across past runs",
     "Return to the Homebrew Channel"
 };
 
@@ -63,24 +72,27 @@ static void init_video(void) {
 }
 
 
+// drawn as a frame, so moving the cursor only repaints the two menu
+// lines and the description that actually changed
 static void draw_menu(int selected) {
     int i;
 
-    ui_clear();
+    ui_frame_begin();
     ui_draw_banner();
 
-    printf(UI_BCYAN "   DIAGNOSTIC MODULES\n" UI_RESET);
-    printf(UI_WHITE "   -------------------\n\n" UI_RESET);
+    ui_printf(UI_BCYAN "   DIAGNOSTIC MODULES\n" UI_RESET);
+    ui_printf(UI_WHITE "   -------------------\n\n" UI_RESET);
 
     for (i = 0; i < MENU_ITEMS; i++) {
         if (i == selected)
-            printf(UI_BGREEN "   >> [%d] %s\n" UI_RESET, i + 1, menu_labels[i]);
+            ui_printf(UI_BGREEN "   >> [%d] %s\n" UI_RESET, i + 1, menu_labels[i]);
         else
-            printf(UI_WHITE "      [%d] %s\n" UI_RESET, i + 1, menu_labels[i]);
+            ui_printf(UI_WHITE "      [%d] %s\n" UI_RESET, i + 1, menu_labels[i]);
     }
 
-    printf("\n" UI_YELLOW "   %s\n" UI_RESET, menu_descs[selected]);
+    ui_printf("\n" UI_YELLOW "   %s\n" UI_RESET, menu_descs[selected]);
     ui_draw_footer(NULL);
+    ui_frame_end();
 }
 
 
@@ -94,22 +106,55 @@ static void run_subscreen(const char *title, void (*func)(void)) {
     ui_spin_start(spin_msg);
     ui_scroll_begin();
     func();
+    // whatever the module measured goes on the end of the history file
+    if (!history_flush())
+        ui_draw_warn("Couldn't add this run to the history file");
     ui_spin_stop();
 
     ui_scroll_view(title);
 }
 
 
+static void shutdown_and_exit(bool to_hbc) {
+    // don't pull the rug out from under a USB mount that's still going
+    subsys_wait_fat();
+    nand_index_shutdown();
+    WPAD_Shutdown();
+
+    if (to_hbc) {
+        // try HBC title IDs newest to oldest. LULZ is what HackMii installs these days.
+        // OHBC is the vWii variant. JODI and HAXX are ancient but whatever,
+        // fall back to system menu if none of them are installed.
+        if (WII_LaunchTitle(0x000100014C554C5AULL) < 0)   // LULZ - modern
+          if (WII_LaunchTitle(0x000100014F484243ULL) < 0)  // OHBC - vWii
+            if (WII_LaunchTitle(0x000100014A4F4449ULL) < 0) // JODI - old
+              if (WII_LaunchTitle(0x0001000148415858ULL) < 0) // HAXX - ancient
+                SYS_ResetSystem(SYS_RETURNTOMENU, 0, 0);
+    } else {
+        SYS_ResetSystem(SYS_RETURNTOMENU, 0, 0);
+    }
+}
+
+
 int main(int argc, char **argv) {
     int selected = 0;
     bool running = true;
     bool exit_to_hbc = false;
+    int autorun;
 
     init_video();
-    WPAD_Init();
-    WPAD_SetDataFormat(WPAD_CHAN_ALL, WPAD_FMT_BTNS_ACC_IR);
-    PAD_Init();
-    fatInitDefault();
+    // early, long before the heap has spilled over into MEM2
+    scratch_init();
+    // SD and USB mount in the background from here, the menu doesn't
+    // need them and USB can take seconds to answer
+    subsys_init();
+
+    // a config on the card means a bench run, no menu unless it asks for one
+    autorun = run_autorun();
+    if (autorun == AUTORUN_EXIT_HBC || autorun == AUTORUN_EXIT_SYSTEM) {
+        shutdown_and_exit(autorun == AUTORUN_EXIT_HBC);
+        return 0;
+    }
 
     while (running) {
         draw_menu(selected);
@@ -142,9 +187,10 @@ int main(int argc, char **argv) {
                     case 2: run_subscreen("IOS Installation Scan", run_ios_check);        break;
                     case 3: run_subscreen("Storage Speed Test",    run_storage_test);     break;
                     case 4: run_subscreen("Controller Diagnostics",run_controller_test);  break;
-                    case 5: run_subscreen("Network Connectivity",  run_network_test);     break;
+                    case 5: run_subscreen("Network Connectivity",  run_network_menu);     break;
                     case 6: run_subscreen("Generate Full Report",  run_report_generator); break;
-                    case 7:
+                    case 7: run_subscreen("History & Trends",      run_history_view);     break;
+                    case 8:
                         exit_to_hbc = true;
                         running = false;
                         break;
@@ -163,20 +209,7 @@ int main(int argc, char **argv) {
 
     ui_clear();
     printf(UI_BGREEN "\n  WiiMedic shutting down. Stay healthy!\n\n" UI_RESET);
-    WPAD_Shutdown();
-
-    if (exit_to_hbc) {
-        // try HBC title IDs newest to oldest. LULZ is what HackMii installs these days.
-        // OHBC is the vWii variant. JODI and HAXX are ancient but whatever,
-        // fall back to system menu if none of them are installed.
-        if (WII_LaunchTitle(0x000100014C554C5AULL) < 0)   // LULZ - modern
-          if (WII_LaunchTitle(0x000100014F484243ULL) < 0)  // OHBC - vWii
-            if (WII_LaunchTitle(0x000100014A4F4449ULL) < 0) // JODI - old
-              if (WII_LaunchTitle(0x0001000148415858ULL) < 0) // HAXX - ancient
-                SYS_ResetSystem(SYS_RETURNTOMENU, 0, 0);
-    } else {
-        SYS_ResetSystem(SYS_RETURNTOMENU, 0, 0);
-    }
+    shutdown_and_exit(exit_to_hbc);
 
     return 0;
 }
@@ -2,17 +2,27 @@
 // scans the Wii NAND, reports usage, and gives it a health score out of 100.
 // the health score is a bit made up but it gives people a quick summary
 // without having to read through all the raw numbers.
+//
+// it also walks /title/<hi>/<lo> and asks IOS for the usage of every
+// installed title, so you can see what's actually eating the space.
 
 #include <gccore.h>
 #include <ogc/isfs.h>
+#include <ogc/lwp_watchdog.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "history.h"
 #include "nand_health.h"
+#include "nand_index.h"
+#include "result_cache.h"
 #include "ui_common.h"
 
+// last, it wraps the IOS and libfat calls by name
+#include "prof_calls.h"
+
 // Wii NAND layout: 512MB flash, 32768 clusters at 16KB each, 6143 inodes max.
 // these are fixed hardware limits, not filesystem limits.
 #define NAND_TOTAL_CLUSTERS 32768
@@ -28,53 +38,213 @@ static int  s_title_count   = 0;
 static int  s_ticket_count  = 0;
 static bool s_nand_run      = false;
 
+// title walker. /title/<hi>/<lo> is two levels deep - anything at depth 2
+// is a title and gets one ISFS_GetUsage for its whole subtree.
+// the walk state lives in statics: a full console has a few hundred titles
+// and thousands of inodes, and every ReadDir is an IPC round-trip, so we
+// don't want a malloc per level on top of that. the listings and usage
+// numbers themselves come from (and stay in) the shared NAND index.
+#define WALK_ROOT        "/title"
+#define WALK_TITLE_DEPTH 2
+#define WALK_MAX_STACK   512
+#define WALK_NAME_LEN    13     // 12 chars + NUL, ISFS name limit
+#define MAX_TITLES       512
+#define TOP_TITLES       10
+
+typedef struct {
+    char name[WALK_NAME_LEN];
+    u8   depth;
+} walk_entry;
+
+typedef struct {
+    u32 hi, lo;
+    u32 clusters;
+    u32 inodes;
+} title_usage;
+
+static char        s_walk_path[ISFS_MAXPATH];
+static walk_entry  s_walk_stack[WALK_MAX_STACK];
+static title_usage s_titles[MAX_TITLES];
+static int         s_title_usage_count = 0;
+static u32         s_title_clusters    = 0;
+static u32         s_title_inodes      = 0;
+static u32         s_walk_ms           = 0;
+static bool        s_walk_truncated    = false;
+
 
 bool has_nand_health_run(void) { return s_nand_run; }
 
+// anything that changes what the check finds (installs, deletes, saves
+// growing) moves the used cluster or inode count
+u64 get_nand_health_cache_key(void) {
+    u32 clusters = 0, inodes = 0;
+    u64 h = RCACHE_KEY_INIT;
+    if (!nand_index_ready() || nand_index_usage("/", &clusters, &inodes) < 0) return 0;
+    h = rcache_hash_u32(h, clusters);
+    return rcache_hash_u32(h, inodes);
+}
+
 
 // counts entries in a NAND directory. returns -1 if access is denied
 // (which happens on /sys pretty much always unless you're running a very
 // permissive cIOS)
 static int count_nand_entries(const char *path) {
-    char pbuf[ISFS_MAXPATH] ATTRIBUTE_ALIGN(32);
+    const char *names;
     u32 count = 0;
 
-    strncpy(pbuf, path, ISFS_MAXPATH - 1);
-    pbuf[ISFS_MAXPATH - 1] = '\0';
-
-    s32 ret = ISFS_ReadDir(pbuf, NULL, &count);
+    s32 ret = nand_index_readdir(path, &names, &count);
     if (ret < 0) return -1;
     return (int)count;
 }
 
 
+// iterative DFS over /title with an explicit stack. one path buffer is
+// shared by the whole walk: entering an entry at depth d just truncates
+// back to where its parent's path ended and appends the name.
+// returns number of titles found, -1 if /title itself can't be read.
+static int walk_titles(void) {
+    u16 len_at[WALK_TITLE_DEPTH + 1];
+    int sp = 0;
+    u64 t0 = gettime();
+
+    s_title_usage_count = 0;
+    s_title_clusters = s_title_inodes = 0;
+    s_walk_truncated = false;
+
+    strcpy(s_walk_path, WALK_ROOT);
+    len_at[0] = (u16)strlen(WALK_ROOT);
+    s_walk_stack[sp].name[0] = '\0';
+    s_walk_stack[sp].depth = 0;
+    sp++;
+
+    while (sp > 0) {
+        walk_entry e = s_walk_stack[--sp];
+        u32 count = 0, i;
+        int len;
+        const char *name;
+
+        if (e.depth > 0) {
+            len = len_at[e.depth - 1];
+            len += snprintf(s_walk_path + len, ISFS_MAXPATH - len, "/%s", e.name);
+            if (len >= ISFS_MAXPATH) continue;
+            len_at[e.depth] = (u16)len;
+        } else {
+            s_walk_path[len_at[0]] = '\0';
+        }
+
+        if (e.depth == WALK_TITLE_DEPTH) {
+            u32 clusters = 0, inodes = 0;
+            title_usage *t;
+
+            if (nand_index_usage(s_walk_path, &clusters, &inodes) < 0) continue;
+            s_title_clusters += clusters;
+            s_title_inodes   += inodes;
+            if (s_title_usage_count >= MAX_TITLES) {
+                s_walk_truncated = true;
+                continue;
+            }
+            t = &s_titles[s_title_usage_count++];
+            t->hi = strtoul(s_walk_path + len_at[0] + 1, NULL, 16);
+            t->lo = strtoul(e.name, NULL, 16);
+            t->clusters = clusters;
+            t->inodes   = inodes;
+            continue;
+        }
+
+        if (nand_index_readdir(s_walk_path, &name, &count) < 0) {
+            if (e.depth == 0) return -1;
+            continue;
+        }
+
+        // names come back NUL-separated, push them all in one go
+        for (i = 0; i < count; i++) {
+            int nlen = strnlen(name, WALK_NAME_LEN - 1);
+            if (sp < WALK_MAX_STACK) {
+                memcpy(s_walk_stack[sp].name, name, nlen);
+                s_walk_stack[sp].name[nlen] = '\0';
+                s_walk_stack[sp].depth = e.depth + 1;
+                sp++;
+            } else {
+                s_walk_truncated = true;
+            }
+            name += nlen + 1;
+        }
+    }
+
+    s_walk_ms = (u32)ticks_to_millisecs(gettime() - t0);
+    return s_title_usage_count;
+}
+
+
+static int cmp_title_usage(const void *a, const void *b) {
+    const title_usage *ta = (const title_usage *)a;
+    const title_usage *tb = (const title_usage *)b;
+    if (ta->clusters != tb->clusters) return (ta->clusters < tb->clusters) ? 1 : -1;
+    if (ta->inodes   != tb->inodes)   return (ta->inodes   < tb->inodes)   ? 1 : -1;
+    return 0;
+}
+
+
+static const char *title_category(u32 hi) {
+    switch (hi) {
+        case 0x00000001: return "System";
+        case 0x00010000: return "Disc save";
+        case 0x00010001: return "Channel";
+        case 0x00010002: return "Sys channel";
+        case 0x00010004: return "Disc channel";
+        case 0x00010005: return "DLC";
+        case 0x00010008: return "Hidden";
+        default:         return "Other";
+    }
+}
+
+
+// title IDs below the system range are 4 ascii chars (RMCE, HAXX etc).
+// system titles (IOS, boot2, the menu) are just numbers.
+static void title_label(const title_usage *t, char *out, int outsize) {
+    char code[5];
+    int i;
+    bool printable = (t->hi != 0x00000001);
+
+    for (i = 0; i < 4; i++) {
+        code[i] = (char)((t->lo >> (24 - i * 8)) & 0xFF);
+        if (code[i] < 0x20 || code[i] > 0x7E) printable = false;
+    }
+    code[4] = '\0';
+
+    if (printable)
+        snprintf(out, outsize, "%08X-%08X (%s)", t->hi, t->lo, code);
+    else
+        snprintf(out, outsize, "%08X-%08X", t->hi, t->lo);
+}
+
+
 void run_nand_health(void) {
+    PROF_FUNC();
     s32 ret;
     float cluster_pct = 0.0f, inode_pct = 0.0f;
 
     ui_draw_info("Initializing NAND filesystem scan...");
     ui_printf("\n");
 
-    ret = ISFS_Initialize();
-    bool we_opened = (ret >= 0);
-    if (ret < 0 && ret != -105) { // -105 = already initialized
+    if (!nand_index_ready()) {
         ui_draw_err("Failed to initialize ISFS");
         char msg[64];
-        snprintf(msg, sizeof(msg), "Error code: %d", ret);
+        snprintf(msg, sizeof(msg), "Error code: %d", nand_index_error());
         ui_draw_info(msg);
         ui_draw_warn("Try running on IOS58 or a cIOS that allows NAND access");
         return;
     }
 
-    // ISFS_GetUsage returns FREE counts, not used.
-    // subtract from totals to get the actual used numbers.
-    u32 free_clusters = 0, free_inodes = 0;
-    ret = ISFS_GetUsage("/", &free_clusters, &free_inodes);
+    // ISFS_GetUsage counts what's USED under the path (walk_titles relies
+    // on that too), so on "/" free is whatever's left of the totals.
+    u32 used_clusters = 0, used_inodes = 0;
+    ret = nand_index_usage("/", &used_clusters, &used_inodes);
     if (ret >= 0) {
-        s_free_blocks = (free_clusters <= NAND_TOTAL_CLUSTERS) ? free_clusters : 0;
-        s_free_inodes = (free_inodes   <= NAND_TOTAL_INODES)   ? free_inodes   : 0;
-        s_used_blocks = NAND_TOTAL_CLUSTERS - s_free_blocks;
-        s_used_inodes = NAND_TOTAL_INODES   - s_free_inodes;
+        s_used_blocks = (used_clusters <= NAND_TOTAL_CLUSTERS) ? used_clusters : NAND_TOTAL_CLUSTERS;
+        s_used_inodes = (used_inodes   <= NAND_TOTAL_INODES)   ? used_inodes   : NAND_TOTAL_INODES;
+        s_free_blocks = NAND_TOTAL_CLUSTERS - s_used_blocks;
+        s_free_inodes = NAND_TOTAL_INODES   - s_used_inodes;
     } else {
         // GetUsage failing isn't fatal, we can still do the dir scan
         char errmsg[80];
@@ -181,6 +351,51 @@ void run_nand_health(void) {
         if (import_cnt > 0) s_health_score -= 10;
         if (tmp_cnt > 10)   s_health_score -= 5;
         if (s_health_score < 0) s_health_score = 0;
+
+        // no usage numbers = nothing worth plotting
+        if (ret >= 0) {
+            hist_record h;
+            memset(&h, 0, sizeof(h));
+            h.flags         = HIST_NAND;
+            h.nand_clusters = s_used_blocks;
+            h.nand_inodes   = s_used_inodes;
+            h.health_score  = (u8)s_health_score;
+            history_add(&h);
+        }
+    }
+
+    ui_draw_section("Largest Titles");
+    {
+        int found = walk_titles();
+        char buf[96], label[40];
+        int i, shown;
+
+        if (found < 0) {
+            ui_draw_warn("Can't read /title - per-title usage unavailable");
+        } else if (found == 0) {
+            ui_draw_info("No installed titles found");
+        } else {
+            qsort(s_titles, s_title_usage_count, sizeof(title_usage), cmp_title_usage);
+
+            snprintf(buf, sizeof(buf), "%d (walked in %u ms)", found, s_walk_ms);
+            ui_draw_kv("Titles Found", buf);
+            snprintf(buf, sizeof(buf), "%u clusters (%.1f MB), %u inodes",
+                     s_title_clusters, (float)s_title_clusters * 16.0f / 1024.0f, s_title_inodes);
+            ui_draw_kv("Used By Titles", buf);
+            if (s_walk_truncated)
+                ui_draw_warn("Too many titles to list them all - totals may be low");
+
+            ui_printf("\n   " UI_BCYAN "%-30s %-12s %8s %7s\n" UI_RESET,
+                      "Title", "Type", "MB", "Inodes");
+            shown = (s_title_usage_count < TOP_TITLES) ? s_title_usage_count : TOP_TITLES;
+            for (i = 0; i < shown; i++) {
+                const title_usage *t = &s_titles[i];
+                title_label(t, label, sizeof(label));
+                ui_printf("   " UI_WHITE "%-30s %-12s" UI_RESET " %8.1f %7u\n",
+                          label, title_category(t->hi),
+                          (float)t->clusters * 16.0f / 1024.0f, t->inodes);
+            }
+        }
     }
 
     {
@@ -211,25 +426,62 @@ void run_nand_health(void) {
     ui_printf("\n");
     ui_draw_ok("NAND health check complete");
 
-    if (we_opened) ISFS_Deinitialize();
     s_nand_run = true;
 }
 
 
-void get_nand_health_report(char *buf, int bufsize) {
-    snprintf(buf, bufsize,
-             "=== NAND HEALTH CHECK ===\n"
-             "Clusters Used:       %u / %u\n"
-             "Clusters Free:       %u\n"
-             "Inodes Used:         %u / %u\n"
-             "Inodes Free:         %u\n"
-             "Title Categories:    %d\n"
-             "Ticket Groups:       %d\n"
-             "Health Score:        %d/100\n"
-             "Status:              %s\n"
-             "\n",
-             s_used_blocks, (u32)NAND_TOTAL_CLUSTERS, s_free_blocks,
-             s_used_inodes, (u32)NAND_TOTAL_INODES,   s_free_inodes,
-             s_title_count, s_ticket_count,
-             s_health_score, s_health_status);
+void get_nand_health_report(report_sink *sink) {
+    PROF_FUNC();
+    int i, shown;
+
+    sink_section(sink, "NAND HEALTH CHECK");
+    sink_kv(sink, "Clusters Used",    "%u / %u", s_used_blocks, (u32)NAND_TOTAL_CLUSTERS);
+    sink_kv(sink, "Clusters Free",    "%u", s_free_blocks);
+    sink_kv(sink, "Inodes Used",      "%u / %u", s_used_inodes, (u32)NAND_TOTAL_INODES);
+    sink_kv(sink, "Inodes Free",      "%u", s_free_inodes);
+    sink_kv(sink, "Title Categories", "%d", s_title_count);
+    sink_kv(sink, "Ticket Groups",    "%d", s_ticket_count);
+    sink_kv(sink, "Health Score",     "%d/100", s_health_score);
+    sink_kv(sink, "Status",           "%s", s_health_status);
+
+    if (s_title_usage_count > 0) {
+        sink_kv(sink, "Titles Found",   "%d", s_title_usage_count);
+        sink_kv(sink, "Used By Titles", "%u clusters, %u inodes", s_title_clusters, s_title_inodes);
+        sink_text(sink, "Largest Titles:\n");
+        shown = (s_title_usage_count < TOP_TITLES) ? s_title_usage_count : TOP_TITLES;
+        for (i = 0; i < shown; i++) {
+            char label[40];
+            title_label(&s_titles[i], label, sizeof(label));
+            sink_text(sink, "  %-30s %-12s %7.1f MB %5u inodes\n",
+                      label, title_category(s_titles[i].hi),
+                      (float)s_titles[i].clusters * 16.0f / 1024.0f, s_titles[i].inodes);
+        }
+    }
+
+    sink_field_bool(sink, "run",              s_nand_run);
+    sink_field_int(sink,  "used_clusters",    s_used_blocks);
+    sink_field_int(sink,  "free_clusters",    s_free_blocks);
+    sink_field_int(sink,  "used_inodes",      s_used_inodes);
+    sink_field_int(sink,  "free_inodes",      s_free_inodes);
+    sink_field_int(sink,  "title_categories", s_title_count);
+    sink_field_int(sink,  "ticket_groups",    s_ticket_count);
+    sink_field_int(sink,  "health_score",     s_health_score);
+    sink_field_str(sink,  "status",           s_health_status);
+    sink_field_int(sink,  "title_clusters",   s_title_clusters);
+    sink_field_int(sink,  "title_inodes",     s_title_inodes);
+    sink_field_bool(sink, "walk_truncated",   s_walk_truncated);
+    sink_field_int(sink,  "walk_ms",          s_walk_ms);
+
+    // every title, not just the top ten - the server can sort them
+    sink_list(sink, "titles");
+    for (i = 0; i < s_title_usage_count; i++) {
+        char id[20];
+        snprintf(id, sizeof(id), "%08x%08x", s_titles[i].hi, s_titles[i].lo);
+        sink_item(sink);
+        sink_field_str(sink, "id",       id);
+        sink_field_int(sink, "clusters", s_titles[i].clusters);
+        sink_field_int(sink, "inodes",   s_titles[i].inodes);
+    }
+    sink_list_end(sink);
+    sink_end(sink);
 }
@@ -5,13 +5,19 @@
 #ifndef NAND_HEALTH_H
 #define NAND_HEALTH_H
 
+#include "report_sink.h"
+
 // Run the NAND health check display
 void run_nand_health(void);
 
 // Returns true if run_nand_health() has been called at least once
 bool has_nand_health_run(void);
 
-// Get NAND health report as string
-void get_nand_health_report(char *buf, int bufsize);
+// Result cache key for the report: changes whenever NAND usage does.
+// 0 if the NAND can't be read
+u64 get_nand_health_cache_key(void);
+
+// Emit the NAND health report section into a sink
+void get_nand_health_report(report_sink *sink);
 
 #endif // NAND_HEALTH_H
@@ -0,0 +1,430 @@
+// nand_index.c
+// one shared cache for everything we ask ISFS and ES about the NAND.
+// system info, the NAND check and the IOS scan all poke at the same system
+// menu paths and TMDs, and every one of those is an IOS IPC round-trip that
+// can take a good few ms. ISFS gets opened once and stays open, and every
+// answer (failures included) is remembered until nand_index_flush().
+//
+// the tables are small and searched linearly with a hash compare up front.
+// a few hundred entries at most, that's nothing next to a single IPC call.
+//
+// TMDs are fetched into one max-size staging buffer and then copied into a
+// pool, so there's no memalign/free per title. the TMD side can be called
+// from a worker thread (the IOS scan prefetches on one), so it takes a lock.
+
+#include <gccore.h>
+#include <malloc.h>
+#include <ogc/isfs.h>
+#include <ogc/lwp_watchdog.h>
+#include <ogc/mutex.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nand_index.h"
+
+// last, it wraps the IOS and libfat calls by name
+#include "prof_calls.h"
+
+// ISFS_Initialize returns this if the filesystem was already open
+#define ISFS_EALREADY   -105
+
+#define NIDX_MAX_DIRS   64
+#define NIDX_MAX_FILES  64
+#define NIDX_MAX_USAGE  512
+#define NIDX_MAX_TMDS   320
+#define NIDX_NAME_LEN   13      // 12 chars + NUL per ReadDir entry
+
+// biggest TMD IOS can hand us: signature + header + every content slot
+#define TMD_STAGE_SIZE  ((MAX_SIGNATURE_SIZE + sizeof(tmd) + \
+                          MAX_NUM_TMD_CONTENTS * sizeof(tmd_content) + 31) & ~31)
+#define TMD_POOL_CHUNK  (64 * 1024)
+#define TMD_POOL_MAX    16
+
+typedef struct {
+    u32  hash;
+    char path[ISFS_MAXPATH];
+    s32  ret;
+    u32  count;
+    char *names;
+} dir_entry;
+
+typedef struct {
+    u32  hash;
+    char path[ISFS_MAXPATH];
+    s32  size;      // negative = ISFS error
+} file_entry;
+
+typedef struct {
+    u32  hash;
+    char path[ISFS_MAXPATH];
+    s32  ret;
+    u32  clusters, inodes;
+} usage_entry;
+
+typedef struct {
+    u64  id;
+    s32  ret;       // result of the size query
+    u32  size;      // signed size, what ES wants back
+    bool fetched;   // only the size is known until this is set
+    tmd *payload;   // points into the pool, NULL if the fetch failed
+    u32  fetch_us;  // time spent in ES for this title
+} tmd_entry;
+
+static s32  s_isfs_state = 1;   // 1 = not tried yet, 0 = open, <0 = error
+static bool s_we_opened  = false;
+
+static dir_entry   s_dirs[NIDX_MAX_DIRS];
+static int         s_dir_count = 0;
+static file_entry  s_files[NIDX_MAX_FILES];
+static int         s_file_count = 0;
+static usage_entry s_usage[NIDX_MAX_USAGE];
+static int         s_usage_count = 0;
+static tmd_entry   s_tmds[NIDX_MAX_TMDS];
+static int         s_tmd_count = 0;
+
+static u8  s_tmd_stage[TMD_STAGE_SIZE] ATTRIBUTE_ALIGN(32);
+static u8 *s_pool[TMD_POOL_MAX];
+static int s_pool_count = 0;
+static u32 s_pool_used  = TMD_POOL_CHUNK;   // "full" so the first alloc grabs a chunk
+static mutex_t s_tmd_lock = LWP_MUTEX_NULL;
+
+static u64 *s_titles      = NULL;
+static u32  s_title_count = 0;
+static s32  s_titles_ret  = 1;  // 1 = not fetched yet
+
+// ISFS wants its path arguments 32-byte aligned
+static char s_pbuf[ISFS_MAXPATH] ATTRIBUTE_ALIGN(32);
+
+// used when the dir table is full - the answer doesn't get remembered, but
+// the list still has to last until flush like a cached one. each spilled
+// list sits after a header holding the previous one, newest first
+#define SPILL_HDR 32    // keeps the list itself 32-byte aligned for ISFS
+static char *s_spill_names = NULL;
+
+
+// FNV-1a, only used to skip most of the strcmps
+static u32 path_hash(const char *path) {
+    u32 h = 2166136261u;
+    while (*path) {
+        h ^= (u8)*path++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+
+static const char *aligned_path(const char *path) {
+    strncpy(s_pbuf, path, ISFS_MAXPATH - 1);
+    s_pbuf[ISFS_MAXPATH - 1] = '\0';
+    return s_pbuf;
+}
+
+
+bool nand_index_ready(void) {
+    if (s_isfs_state == 1) {
+        s32 ret = ISFS_Initialize();
+        s_we_opened  = (ret >= 0);
+        s_isfs_state = (ret >= 0 || ret == ISFS_EALREADY) ? 0 : ret;
+    }
+    return s_isfs_state == 0;
+}
+
+
+s32 nand_index_error(void) {
+    return (s_isfs_state < 0) ? s_isfs_state : 0;
+}
+
+
+s32 nand_index_readdir(const char *path, const char **names, u32 *count) {
+    u32 h = path_hash(path);
+    u32 n = 0;
+    u32 hdr = s_dir_count < NIDX_MAX_DIRS ? 0 : SPILL_HDR;
+    char *block = NULL, *list = NULL;
+    s32 ret;
+    int i;
+
+    *names = NULL;
+    *count = 0;
+
+    for (i = 0; i < s_dir_count; i++) {
+        if (s_dirs[i].hash == h && strcmp(s_dirs[i].path, path) == 0) {
+            *names = s_dirs[i].names;
+            *count = s_dirs[i].count;
+            return s_dirs[i].ret;
+        }
+    }
+
+    if (!nand_index_ready()) return s_isfs_state;
+
+    // first call gets the count, second fills the name list
+    ret = ISFS_ReadDir(aligned_path(path), NULL, &n);
+    if (ret >= 0 && n > 0) {
+        block = (char *)memalign(32, (hdr + n * NIDX_NAME_LEN + 31) & ~31);
+        if (!block) return ISFS_ENOMEM;
+        list = block + hdr;
+        ret = ISFS_ReadDir(aligned_path(path), list, &n);
+        if (ret < 0) {
+            free(block);
+            block = list = NULL;
+            n = 0;
+        }
+    } else if (ret < 0) {
+        n = 0;
+    }
+
+    if (!hdr) {
+        dir_entry *d = &s_dirs[s_dir_count++];
+        d->hash = h;
+        strncpy(d->path, path, ISFS_MAXPATH - 1);
+        d->path[ISFS_MAXPATH - 1] = '\0';
+        d->ret   = ret;
+        d->count = n;
+        d->names = list;
+    } else if (block) {
+        *(char **)block = s_spill_names;
+        s_spill_names = block;
+    }
+
+    *names = list;
+    *count = n;
+    return ret;
+}
+
+
+s32 nand_index_file_size(const char *path) {
+    static fstats st ATTRIBUTE_ALIGN(32);
+    u32 h = path_hash(path);
+    s32 fd, size;
+    int i;
+
+    for (i = 0; i < s_file_count; i++) {
+        if (s_files[i].hash == h && strcmp(s_files[i].path, path) == 0)
+            return s_files[i].size;
+    }
+
+    if (!nand_index_ready()) return s_isfs_state;
+
+    fd = ISFS_Open(aligned_path(path), ISFS_OPEN_READ);
+    if (fd < 0) {
+        size = fd;
+    } else {
+        size = (ISFS_GetFileStats(fd, &st) >= 0) ? (s32)st.file_length : 0;
+        ISFS_Close(fd);
+    }
+
+    if (s_file_count < NIDX_MAX_FILES) {
+        file_entry *f = &s_files[s_file_count++];
+        f->hash = h;
+        strncpy(f->path, path, ISFS_MAXPATH - 1);
+        f->path[ISFS_MAXPATH - 1] = '\0';
+        f->size = size;
+    }
+    return size;
+}
+
+
+s32 nand_index_usage(const char *path, u32 *clusters, u32 *inodes) {
+    u32 h = path_hash(path);
+    u32 c = 0, n = 0;
+    s32 ret;
+    int i;
+
+    for (i = 0; i < s_usage_count; i++) {
+        if (s_usage[i].hash == h && strcmp(s_usage[i].path, path) == 0) {
+            *clusters = s_usage[i].clusters;
+            *inodes   = s_usage[i].inodes;
+            return s_usage[i].ret;
+        }
+    }
+
+    if (!nand_index_ready()) return s_isfs_state;
+
+    ret = ISFS_GetUsage(aligned_path(path), &c, &n);
+
+    if (s_usage_count < NIDX_MAX_USAGE) {
+        usage_entry *u = &s_usage[s_usage_count++];
+        u->hash = h;
+        strncpy(u->path, path, ISFS_MAXPATH - 1);
+        u->path[ISFS_MAXPATH - 1] = '\0';
+        u->ret      = ret;
+        u->clusters = c;
+        u->inodes   = n;
+    }
+
+    *clusters = c;
+    *inodes   = n;
+    return ret;
+}
+
+
+// the first caller has to be the main thread (the IOS scan asks for the
+// title list before it starts its prefetch thread), after that it's safe
+static void tmd_lock(void) {
+    if (s_tmd_lock == LWP_MUTEX_NULL) LWP_MutexInit(&s_tmd_lock, true);
+    LWP_MutexLock(s_tmd_lock);
+}
+
+static void tmd_unlock(void) {
+    LWP_MutexUnlock(s_tmd_lock);
+}
+
+
+s32 nand_index_titles(const u64 **list, u32 *count) {
+    s32 ret;
+
+    tmd_lock();
+    if (s_titles_ret == 1) {
+        u32 n = 0;
+        ret = ES_GetNumTitles(&n);
+
+        if (ret >= 0 && n > 0) {
+            s_titles = (u64 *)memalign(32, (n * sizeof(u64) + 31) & ~31);
+            if (!s_titles) {
+                // don't remember this one, try again later
+                tmd_unlock();
+                return -1;
+            }
+            ret = ES_GetTitles(s_titles, n);
+        }
+        if (ret < 0) {
+            free(s_titles);
+            s_titles = NULL;
+            n = 0;
+        }
+        s_title_count = n;
+        s_titles_ret  = ret;
+    }
+
+    *list  = s_titles;
+    *count = s_title_count;
+    ret = s_titles_ret;
+    tmd_unlock();
+    return ret;
+}
+
+
+// bump allocator over 64KB chunks. nothing is freed until the flush,
+// and chunks never move so handed-out pointers stay put
+static void *pool_alloc(u32 size) {
+    size = (size + 3) & ~3;
+    if (size > TMD_POOL_CHUNK) return NULL;
+    if (s_pool_used + size > TMD_POOL_CHUNK) {
+        if (s_pool_count >= TMD_POOL_MAX) return NULL;
+        s_pool[s_pool_count] = (u8 *)malloc(TMD_POOL_CHUNK);
+        if (!s_pool[s_pool_count]) return NULL;
+        s_pool_count++;
+        s_pool_used = 0;
+    }
+    void *p = s_pool[s_pool_count - 1] + s_pool_used;
+    s_pool_used += size;
+    return p;
+}
+
+
+static tmd_entry *find_tmd(u64 title_id) {
+    int i;
+    for (i = 0; i < s_tmd_count; i++) {
+        if (s_tmds[i].id == title_id) return &s_tmds[i];
+    }
+    if (s_tmd_count >= NIDX_MAX_TMDS) return NULL;
+
+    tmd_entry *e = &s_tmds[s_tmd_count++];
+    u64 t0 = gettime();
+    memset(e, 0, sizeof(*e));
+    e->id  = title_id;
+    e->ret = ES_GetStoredTMDSize(title_id, &e->size);
+    e->fetch_us = (u32)ticks_to_microsecs(gettime() - t0);
+    return e;
+}
+
+
+s32 nand_index_tmd_size(u64 title_id, u32 *size) {
+    s32 ret;
+
+    tmd_lock();
+    tmd_entry *e = find_tmd(title_id);
+    if (!e) {
+        // table full, just ask IOS directly
+        ret = ES_GetStoredTMDSize(title_id, size);
+    } else {
+        *size = e->size;
+        ret = e->ret;
+    }
+    tmd_unlock();
+    return ret;
+}
+
+
+// ES won't give us a TMD without being told its exact size, so it's still
+// two calls per title - but only ever once per title per session
+const tmd *nand_index_tmd(u64 title_id) {
+    const tmd *t = NULL;
+
+    tmd_lock();
+    tmd_entry *e = find_tmd(title_id);
+
+    if (e && e->ret >= 0 && e->size > 0 && e->size <= TMD_STAGE_SIZE && !e->fetched) {
+        u64 t0 = gettime();
+        signed_blob *blob = (signed_blob *)s_tmd_stage;
+
+        e->fetched = true;
+        if (ES_GetStoredTMD(title_id, blob, e->size) >= 0) {
+            const tmd *src = (const tmd *)SIGNATURE_PAYLOAD(blob);
+            u32 len = e->size - (u32)((const u8 *)src - s_tmd_stage);
+            e->payload = (tmd *)pool_alloc(len);
+            if (e->payload) memcpy(e->payload, src, len);
+        }
+        e->fetch_us += (u32)ticks_to_microsecs(gettime() - t0);
+    }
+    if (e) t = e->payload;
+
+    tmd_unlock();
+    return t;
+}
+
+
+u32 nand_index_tmd_us(u64 title_id) {
+    u32 us = 0;
+    int i;
+
+    tmd_lock();
+    for (i = 0; i < s_tmd_count; i++) {
+        if (s_tmds[i].id == title_id) {
+            us = s_tmds[i].fetch_us;
+            break;
+        }
+    }
+    tmd_unlock();
+    return us;
+}
+
+
+void nand_index_flush(void) {
+    int i;
+
+    for (i = 0; i < s_dir_count; i++) free(s_dirs[i].names);
+    for (i = 0; i < s_pool_count; i++) free(s_pool[i]);
+    while (s_spill_names) {
+        char *next = *(char **)s_spill_names;
+        free(s_spill_names);
+        s_spill_names = next;
+    }
+    free(s_titles);
+
+    s_titles      = NULL;
+    s_title_count = 0;
+    s_pool_count  = 0;
+    s_pool_used   = TMD_POOL_CHUNK;
+    s_titles_ret  = 1;
+    s_dir_count = s_file_count = s_usage_count = s_tmd_count = 0;
+}
+
+
+void nand_index_shutdown(void) {
+    nand_index_flush();
+    if (s_we_opened) ISFS_Deinitialize();
+    s_we_opened  = false;
+    s_isfs_state = 1;
+}
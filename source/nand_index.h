@@ -0,0 +1,46 @@
+/*
+ * WiiMedic - nand_index.h
+ * Shared ISFS/ES lookup cache
+ */
+#ifndef NAND_INDEX_H
+#define NAND_INDEX_H
+
+#include <gccore.h>
+
+// Open ISFS for the session (only the first call does any work).
+// Returns false if the NAND can't be accessed, see nand_index_error()
+bool nand_index_ready(void);
+
+// ISFS_Initialize error from nand_index_ready(), 0 if it worked
+s32 nand_index_error(void);
+
+// Directory listing as a NUL-separated name list, like ISFS_ReadDir.
+// The list stays valid until nand_index_flush(). Returns the ISFS result
+s32 nand_index_readdir(const char *path, const char **names, u32 *count);
+
+// File size in bytes, or a negative ISFS error if it can't be opened
+s32 nand_index_file_size(const char *path);
+
+// ISFS_GetUsage, cached per path
+s32 nand_index_usage(const char *path, u32 *clusters, u32 *inodes);
+
+// Installed title list from ES. The list stays valid until nand_index_flush()
+s32 nand_index_titles(const u64 **list, u32 *count);
+
+// Stored TMD size without fetching the TMD itself
+s32 nand_index_tmd_size(u64 title_id, u32 *size);
+
+// Stored TMD for a title, NULL if it isn't installed or can't be read.
+// Safe to call from a worker thread once the main thread has used the index
+const tmd *nand_index_tmd(u64 title_id);
+
+// Microseconds spent in ES fetching this title's TMD, 0 if never fetched
+u32 nand_index_tmd_us(u64 title_id);
+
+// Drop everything cached (ISFS stays open)
+void nand_index_flush(void);
+
+// Flush and close ISFS if we were the ones who opened it
+void nand_index_shutdown(void);
+
+#endif // NAND_INDEX_H
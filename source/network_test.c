@@ -7,21 +7,56 @@
 // the flow is: net_init -> get IP -> net_deinit -> WD_Init -> card info + AP scan
 // -> WD_Deinit -> retry net_init if first attempt failed.
 // it's annoying but it's the only way to get both pieces of info reliably.
+//
+// there are no fixed frame waits between the steps any more. each hand-off
+// polls for the next thing to actually be ready (WD_Init succeeding, card
+// info coming back sane, net_init not saying EAGAIN) with a deadline, and
+// every stage is timed so the report shows where the time went. the one
+// bit of real overlap: the driver gets released on a worker thread while
+// the main thread parses and prints the scan results.
+//
+// connectivity is checked by the probe engine: every target in s_targets
+// gets a non-blocking connect at the same time and one net_poll loop waits
+// on all of them, each with its own deadline. a dead route costs one
+// timeout total instead of one per target.
+//
+// the download test streams a known-size file over plain HTTP and throws
+// the data away, to see what the Wii can actually pull for WAD/update
+// downloads. the read size is swept because the IOS network stack is
+// very picky about how much you ask net_recv for at once.
+//
+// AP scan results are walked in place by bss_iter and boiled down into
+// ap_record entries plus per-channel counts, which is enough to recommend
+// the least crowded of 1/6/11 and to diff one scan against the next in
+// the repeated-scan mode.
 
 #include <errno.h>
 #include <gccore.h>
+#include <malloc.h>
 #include <network.h>
+#include <ogc/isfs.h>
 #include <ogc/lwp.h>
 #include <ogc/lwp_watchdog.h>
 #include <ogc/wd.h>
+#include <unistd.h>
+#include <wiiuse/wpad.h>
+#include <stdarg.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 
+#include "history.h"
+#include "nand_index.h"
 #include "network_test.h"
+#include "result_cache.h"
+#include "scratch.h"
 #include "ui_common.h"
 
+// last, it wraps the IOS and libfat calls by name
+#include "prof_calls.h"
+
 #define MAX_SCAN_APS  32
 #define SCAN_BUF_SIZE 4096
 
@@ -36,7 +71,95 @@
 #define AOSSAPScan 3  // scan-only WD init mode, doesn't need NCD lock
 #endif
 
-static char s_report[8192];
+// probe targets. essential ones decide the "is the internet working"
+// verdict, the rest are the online services people actually care about.
+// add to this table to probe more things, everything else scales with it
+// (up to MAX_TARGETS).
+typedef struct {
+    const char *label;
+    const char *host;   // resolved with DNS, NULL to use ip directly
+    u32         ip;
+    u16         port;
+    bool        essential;
+} probe_target;
+
+#define MAX_TARGETS      8
+#define PROBE_TEXT_LEN   48
+
+static const probe_target s_default_targets[] = {
+    { "Google DNS",   NULL,            0x08080808, 53, true  },
+    { "Cloudflare",   NULL,            0x01010101, 80, true  },
+    { "Wiimmfi",      "wiimmfi.de",    0,          80, false },
+    { "WiiLink",      "wiilink.ca",    0,          80, false },
+    { "RiiConnect24", "rc24.xyz",      0,          80, false },
+};
+
+// autorun.cfg can swap the services for its own. the strings are copied
+// in here so the config buffer doesn't have to stay around
+static probe_target s_custom_targets[MAX_TARGETS];
+static char         s_custom_text[MAX_TARGETS][2][PROBE_TEXT_LEN];
+
+static const probe_target *s_targets = s_default_targets;
+static int s_num_targets = (int)(sizeof(s_default_targets) / sizeof(s_default_targets[0]));
+#define PROBE_TIMEOUT_MS 4000
+#define PROBE_POLL_MS    20
+
+enum { PROBE_PENDING = 0, PROBE_OK, PROBE_FAILED, PROBE_TIMEOUT, PROBE_NO_DNS };
+
+typedef struct {
+    s32  sock;
+    u32  ip;
+    int  state;
+    s32  err;
+    u64  t0;
+    u32  us;            // connect time, or how long until it gave up
+    bool keep;          // leave the socket open on success (HTTP test)
+} probe_result;
+
+// latency mode: LAT_ROUNDS rounds of concurrent probes, one sample per
+// target per round, all in microseconds straight from gettime()
+#define LAT_ROUNDS      100
+#define LAT_TIMEOUT_MS  1000
+#define LAT_BUCKETS     8
+static const u32 s_lat_edges_ms[LAT_BUCKETS - 1] = { 5, 10, 20, 40, 80, 160, 320 };
+
+static u32  s_lat[MAX_TARGETS][LAT_ROUNDS];
+static int  s_lat_n[MAX_TARGETS];
+
+// download test. plain HTTP on purpose - the Wii can't do modern TLS and
+// that's what the homebrew download tools end up using anyway.
+typedef struct {
+    const char *host;
+    const char *path;
+    u32         size;
+} dl_object;
+
+static const dl_object s_dl_objects[] = {
+    { "speedtest.tele2.net",              "/10MB.zip", 10 * 1024 * 1024 },
+    { "ipv4.download.thinkbroadband.com", "/10MB.zip", 10 * 1024 * 1024 },
+};
+#define NUM_DL_OBJECTS   (int)(sizeof(s_dl_objects) / sizeof(s_dl_objects[0]))
+#define DL_IDLE_MS       5000       // no data for this long = give up
+#define DL_MAX_MS        20000      // cap on one download
+#define DL_SWEEP_BYTES   (2 * 1024 * 1024)
+#define DL_DEFAULT_READ  8192
+#define DL_MAX_READ      32768
+#define DL_NSIZES        5
+static const u32 s_dl_sizes[DL_NSIZES] = { 1024, 4096, 8192, 16384, 32768 };
+
+typedef struct {
+    s32 err;            // 0 or a net_* error
+    int status;         // HTTP status, 0 if we never got one
+    u32 content_len;
+    u32 ttfb_us;        // request sent -> first response byte
+    u32 body_bytes;
+    u32 body_us;        // first body byte -> done
+} dl_result;
+
+static probe_result s_probes[MAX_TARGETS];
+static bool         s_probes_valid = false;
+static u32          s_probe_total_ms = 0;
+
 static bool s_wifi_ok      = false;
 static bool s_wd_ok        = false;
 static bool s_ip_ok        = false;
@@ -52,24 +175,147 @@ static WDInfo s_wdinfo                   __attribute__((aligned(32)));
 static u8     s_wd_guard2[64]            __attribute__((aligned(32), unused));
 static u8     s_scan_buf[SCAN_BUF_SIZE]  __attribute__((aligned(32)));
 
-// net_init can block for several seconds, so we run it on a thread.
-// otherwise the screen just freezes and people think it crashed.
+// IOS calls that block for a while (net_init especially, several seconds)
+// run on a worker thread so the spinner keeps going and the main thread
+// can do something useful in the meantime.
 static lwp_t          s_net_thread;
+static bool           s_net_threaded;   // job_join has a thread to wait for
 static u8             s_net_stack[8192]  __attribute__((aligned(32)));
 static s32            s_net_ret;
-static volatile bool  s_net_done;
 
 static void *net_init_thread(void *arg) {
     (void)arg;
-    s_net_ret  = net_init();
-    s_net_done = true;
+    s_net_ret = net_init();
     return NULL;
 }
 
+static void *wd_release_thread(void *arg) {
+    (void)arg;
+    WD_Deinit();
+    return NULL;
+}
+
+// no thread means no overlap, but the job still gets done and job_join
+// doesn't wait on a handle that was never made
+static void job_start(void *(*fn)(void *)) {
+    s_net_threaded = LWP_CreateThread(&s_net_thread, fn, NULL, s_net_stack,
+                                      sizeof(s_net_stack), 64) >= 0;
+    if (!s_net_threaded) fn(NULL);
+}
+
+static void job_join(void) {
+    if (s_net_threaded) LWP_JoinThread(s_net_thread, NULL);
+    s_net_threaded = false;
+}
+
+// stage timings for the report. names are string literals
+#define MAX_STAGES     16
+#define READY_POLL_US  5000
+#define WD_READY_MS    2000
+#define NET_READY_MS   3000
+#define SCAN_RETRIES   3
+#define ROUND_DIFF_ROWS 6   // change lines on the per-round page
+#define ROUND_AP_ROWS   8   // AP lines on the per-round page
+
+typedef struct {
+    const char *name;
+    u32         ms;
+} net_stage;
+
+static net_stage s_stages[MAX_STAGES];
+static int       s_stage_count = 0;
+static u64       s_stage_t0;
+
+static void stage_begin(const char *name) {
+    char msg[64];
+    snprintf(msg, sizeof(msg), "%s...", name);
+    ui_spin_set_msg(msg);
+    if (s_stage_count < MAX_STAGES) s_stages[s_stage_count].name = name;
+    s_stage_t0 = gettime();
+}
+
+static void stage_end(void) {
+    if (s_stage_count < MAX_STAGES)
+        s_stages[s_stage_count++].ms = (u32)ticks_to_millisecs(gettime() - s_stage_t0);
+}
+
 
 bool has_network_test_run(void) { return s_test_done; }
 
 
+// the saved connection settings (SSID, key, static IP...). changing which
+// network the console joins changes this file. the report also puts an age
+// limit on the cached result, since the network itself can change under us
+u64 get_network_test_cache_key(void) {
+    static char path[ISFS_MAXPATH] ATTRIBUTE_ALIGN(32) = "/shared2/sys/net/02/config.dat";
+    u64 h = RCACHE_KEY_INIT;
+    s32 size, fd;
+    u8 *buf;
+    int i;
+
+    // and what gets probed, autorun.cfg can change that
+    for (i = 0; i < s_num_targets; i++) {
+        const probe_target *t = &s_targets[i];
+        h = rcache_hash(h, t->label, strlen(t->label));
+        if (t->host) h = rcache_hash(h, t->host, strlen(t->host));
+        h = rcache_hash_u32(h, t->ip);
+        h = rcache_hash_u32(h, ((u32)t->port << 1) | t->essential);
+    }
+
+    if (!nand_index_ready()) return 0;
+    size = nand_index_file_size(path);
+    if (size <= 0) return 0;
+
+    buf = (u8 *)scratch_alloc((u32)size);
+    if (!buf) return 0;
+    fd = ISFS_Open(path, ISFS_OPEN_READ);
+    if (fd >= 0 && ISFS_Read(fd, buf, size) == size)
+        h = rcache_hash(h, buf, (u32)size);
+    else
+        h = 0;
+    if (fd >= 0) ISFS_Close(fd);
+    scratch_free(buf);
+    return h;
+}
+
+
+bool add_network_probe(const char *label, const char *host, u16 port, bool essential) {
+    unsigned a, b, c, d;
+    probe_target *t;
+    int i;
+    char tail;
+
+    // the first one drops the default services but keeps the essential
+    // ones, they're what the "is the internet working" verdict stands on
+    if (s_targets == s_default_targets) {
+        s_num_targets = 0;
+        for (i = 0; i < (int)(sizeof(s_default_targets) / sizeof(s_default_targets[0])); i++) {
+            if (s_default_targets[i].essential)
+                s_custom_targets[s_num_targets++] = s_default_targets[i];
+        }
+        s_targets = s_custom_targets;
+    }
+    if (s_num_targets >= MAX_TARGETS || !label || !host || !*host || port == 0) return false;
+
+    t = &s_custom_targets[s_num_targets];
+    snprintf(s_custom_text[s_num_targets][0], PROBE_TEXT_LEN, "%s", label);
+    snprintf(s_custom_text[s_num_targets][1], PROBE_TEXT_LEN, "%s", host);
+    t->label     = s_custom_text[s_num_targets][0];
+    t->host      = s_custom_text[s_num_targets][1];
+    t->ip        = 0;
+    t->port      = port;
+    t->essential = essential;
+    // a dotted address skips DNS, same as the built-in ones
+    if (sscanf(host, "%u.%u.%u.%u%c", &a, &b, &c, &d, &tail) == 4 &&
+        a < 256 && b < 256 && c < 256 && d < 256) {
+        t->host = NULL;
+        t->ip   = (a << 24) | (b << 16) | (c << 8) | d;
+    }
+    s_num_targets++;
+    return true;
+}
+
+
 static void ip_to_str(u32 ip, char *buf, size_t sz) {
     snprintf(buf, sz, "%d.%d.%d.%d",
              (ip >> 24) & 0xFF, (ip >> 16) & 0xFF,
@@ -96,43 +342,146 @@ static const char *signal_str(u8 level) {
 }
 
 
-// tries a TCP connect to a known host. measures how long it takes.
-// we use this to check if the internet is actually reachable, not just that
-// we got an IP (DHCP can hand you an address even with no route to the internet)
-static bool test_tcp(const char *label, u32 host_ip, u16 port) {
-    s32 sock = net_socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
-    if (sock < 0) {
-        ui_draw_err("Socket creation failed - this shouldn't happen");
-        return false;
+static const char *probe_state_str(int state) {
+    switch (state) {
+        case PROBE_OK:      return "Connected";
+        case PROBE_TIMEOUT: return "Timed out";
+        case PROBE_NO_DNS:  return "DNS lookup failed";
+        default:            return "Failed";
     }
+}
+
+
+static void probe_finish(probe_result *r, int state, s32 err) {
+    r->state = state;
+    r->err   = err;
+    r->us    = (u32)ticks_to_microsecs(gettime() - r->t0);
+    if (state == PROBE_OK && r->keep) return;
+    if (r->sock >= 0) net_close(r->sock);
+    r->sock = -1;
+}
+
 
+// kicks off a non-blocking connect. returns false if it already finished
+// (instant success or instant failure), true if it's in flight
+static bool probe_start(probe_result *r, u16 port) {
     struct sockaddr_in addr;
+    s32 ret;
+
+    r->sock = net_socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+    r->t0   = gettime();
+    if (r->sock < 0) {
+        probe_finish(r, PROBE_FAILED, r->sock);
+        return false;
+    }
+    net_fcntl(r->sock, F_SETFL, net_fcntl(r->sock, F_GETFL, 0) | IOS_O_NONBLOCK);
+
     memset(&addr, 0, sizeof(addr));
     addr.sin_family      = AF_INET;
     addr.sin_port        = htons(port);
-    addr.sin_addr.s_addr = htonl(host_ip);
+    addr.sin_addr.s_addr = htonl(r->ip);
 
-    u64 t0 = gettime();
-    s32 ret = net_connect(sock, (struct sockaddr *)&addr, sizeof(addr));
-    float ms = (float)ticks_to_millisecs(gettime() - t0);
-    net_close(sock);
-
-    char buf[128];
-    if (ret >= 0) {
-        snprintf(buf, sizeof(buf), "%s: Connected (%.0f ms)", label, ms);
-        ui_draw_ok(buf);
-        return true;
-    } else {
-        snprintf(buf, sizeof(buf), "%s: Failed (error %d)", label, ret);
-        ui_draw_err(buf);
+    ret = net_connect(r->sock, (struct sockaddr *)&addr, sizeof(addr));
+    if (ret >= 0 || ret == -EISCONN) {
+        probe_finish(r, PROBE_OK, 0);
+        return false;
+    }
+    if (ret != -EINPROGRESS && ret != -EALREADY) {
+        probe_finish(r, PROBE_FAILED, ret);
         return false;
     }
+    return true;
+}
+
+
+// asking connect() again is the portable way to find out how a
+// non-blocking connect went once poll says the socket is writable
+static void probe_check(probe_result *r, u16 port) {
+    struct sockaddr_in addr;
+    s32 ret;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(port);
+    addr.sin_addr.s_addr = htonl(r->ip);
+
+    ret = net_connect(r->sock, (struct sockaddr *)&addr, sizeof(addr));
+    if (ret >= 0 || ret == -EISCONN)
+        probe_finish(r, PROBE_OK, 0);
+    else if (ret != -EINPROGRESS && ret != -EALREADY)
+        probe_finish(r, PROBE_FAILED, ret);
 }
 
 
-static void wait_frames(int n) {
+// DNS has no non-blocking API on IOS, so lookups happen up front, once.
+// they're usually quick once the first one has warmed up the resolver.
+static void resolve_targets(const probe_target *targets, probe_result *res, int n) {
     int i;
-    for (i = 0; i < n; i++) VIDEO_WaitVSync();
+    for (i = 0; i < n; i++) {
+        memset(&res[i], 0, sizeof(res[i]));
+        res[i].sock = -1;
+        res[i].ip   = targets[i].ip;
+        if (targets[i].host) {
+            struct hostent *he = net_gethostbyname(targets[i].host);
+            if (he && he->h_addr_list && he->h_addr_list[0])
+                res[i].ip = ntohl(*(u32 *)he->h_addr_list[0]);
+        }
+    }
+}
+
+
+// probes every resolved target concurrently. total time is roughly the
+// slowest single probe (capped at timeout_ms), not the sum of them.
+static void run_probes(const probe_target *targets, probe_result *res, int n, u32 timeout_ms) {
+    PROF_FUNC();
+    struct pollsd fds[MAX_TARGETS];
+    int idx[MAX_TARGETS];
+    int i, pending = 0;
+    u64 start = gettime();
+
+    for (i = 0; i < n; i++) {
+        res[i].sock  = -1;
+        res[i].state = PROBE_PENDING;
+        res[i].err   = 0;
+        if (res[i].ip == 0) {
+            res[i].t0 = gettime();
+            probe_finish(&res[i], PROBE_NO_DNS, 0);
+        } else if (probe_start(&res[i], targets[i].port)) {
+            pending++;
+        }
+    }
+
+    while (pending > 0) {
+        int nfds = 0;
+        u64 now;
+
+        for (i = 0; i < n; i++) {
+            if (res[i].state != PROBE_PENDING) continue;
+            fds[nfds].socket  = res[i].sock;
+            fds[nfds].events  = POLLOUT;
+            fds[nfds].revents = 0;
+            idx[nfds++] = i;
+        }
+
+        net_poll(fds, nfds, PROBE_POLL_MS);
+        now = gettime();
+
+        for (i = 0; i < nfds; i++) {
+            probe_result *r = &res[idx[i]];
+            if (fds[i].revents & (POLLERR | POLLHUP))
+                probe_finish(r, PROBE_FAILED, 0);
+            else if (fds[i].revents & POLLOUT)
+                probe_check(r, targets[idx[i]].port);
+
+            if (r->state == PROBE_PENDING &&
+                ticks_to_millisecs(now - r->t0) >= timeout_ms)
+                probe_finish(r, PROBE_TIMEOUT, 0);
+
+            if (r->state != PROBE_PENDING) pending--;
+        }
+    }
+
+    s_probe_total_ms = (u32)ticks_to_millisecs(gettime() - start);
 }
 
 
@@ -147,128 +496,333 @@ static u16 bss_entry_len(BSSDescriptor *bss) {
 }
 
 
-// parses the scan results buffer and prints each AP.
-// the buffer format varies by IOS version which is delightful.
-// we try the "2-byte count then descriptors" format first, fall back to
-// walking by bss->length if that turns up nothing.
-static int parse_and_display_aps(int *rpos_ptr, u8 *buf, s32 scan_ret) {
-    int rpos = *rpos_ptr;
-    int count = 0;
-    u8 *ptr = buf;
-    u8 *end = buf + SCAN_BUF_SIZE;
+static bool bssid_is_zero(const u8 *b) {
+    return !b[0] && !b[1] && !b[2] && !b[3] && !b[4] && !b[5];
+}
 
-    rpos += snprintf(s_report + rpos, sizeof(s_report) - rpos,
-                     "\n--- Nearby Access Points ---\n");
 
-    if (scan_ret < 0) {
-        rpos += snprintf(s_report + rpos, sizeof(s_report) - rpos,
-                         "  AP scan failed (error %d)\n", (int)scan_ret);
-        *rpos_ptr = rpos;
-        return -1;
+// walks the scan results handing out descriptors in place, nothing gets
+// copied. the buffer format varies by IOS version which is delightful:
+// counted is "2-byte count then descriptors", strided has no count and
+// steps by bss->length. zero BSSIDs (padding) are skipped.
+enum { BSS_FMT_COUNTED, BSS_FMT_STRIDED };
+
+typedef struct {
+    u8 *ptr;
+    u8 *end;
+    int fmt;
+    int left;   // entries still to go, counted format only
+} bss_iter;
+
+static void bss_iter_init(bss_iter *it, u8 *buf, u32 len, int fmt) {
+    it->ptr  = buf;
+    it->end  = buf + len;
+    it->fmt  = fmt;
+    it->left = 0;
+    if (fmt == BSS_FMT_COUNTED && len >= 2) {
+        u16 n = (u16)((buf[0] << 8) | buf[1]);
+        it->ptr += 2;
+        if (n > 0 && n <= 64) it->left = n;
     }
+}
 
-    // format A: [count_hi, count_lo] followed by BSSDescriptor array
-    if (ptr + 2 <= end) {
-        u16 n = (u16)((ptr[0] << 8) | ptr[1]);
-        ptr += 2;
+static BSSDescriptor *bss_iter_next(bss_iter *it) {
+    while (it->ptr < it->end - sizeof(BSSDescriptor)) {
+        BSSDescriptor *bss = (BSSDescriptor *)it->ptr;
+        u16 len;
 
-        if (n > 0 && n <= 64) {
-            int i;
-            for (i = 0; i < n && ptr < (end - sizeof(BSSDescriptor)) && count < MAX_SCAN_APS; i++) {
-                BSSDescriptor *bss = (BSSDescriptor *)ptr;
-                u16 entry_len;
+        if (it->fmt == BSS_FMT_COUNTED) {
+            if (it->left == 0) return NULL;
+            it->left--;
+            if (bss->SSIDLength > 32) {
+                len = sizeof(BSSDescriptor);
+            } else {
+                len = bss_entry_len(bss);
+                if (len < sizeof(BSSDescriptor)) len = sizeof(BSSDescriptor);
+            }
+            if (it->ptr + len > it->end) return NULL;
+        } else {
+            if (bss->length < sizeof(BSSDescriptor) || bss->SSIDLength > 32)
+                return NULL;
+            len = bss->length;
+        }
 
-                if (bss->SSIDLength > 32) {
-                    entry_len = sizeof(BSSDescriptor);
-                } else {
-                    entry_len = bss_entry_len(bss);
-                    if (entry_len < sizeof(BSSDescriptor))
-                        entry_len = sizeof(BSSDescriptor);
-                }
+        it->ptr += len;
+        if (!bssid_is_zero(bss->BSSID)) return bss;
+    }
+    return NULL;
+}
 
-                if (ptr + entry_len > end) break;
 
-                // skip zero BSSIDs (padding / uninitialized entries)
-                if (!bss->BSSID[0] && !bss->BSSID[1] && !bss->BSSID[2] &&
-                    !bss->BSSID[3] && !bss->BSSID[4] && !bss->BSSID[5]) {
-                    ptr += entry_len;
-                    continue;
-                }
+// one AP out of a scan. the descriptor stays in s_scan_buf, this is only
+// what we keep for display and for comparing against the next scan.
+typedef struct {
+    u8          bssid[6];
+    char        ssid[33];
+    u8          channel;
+    u8          sig;
+    const char *sec;
+} ap_record;
+
+#define NUM_CHANNELS 14
+
+static ap_record s_aps[MAX_SCAN_APS];
+static int       s_ap_count = 0;
+static ap_record s_prev_aps[MAX_SCAN_APS];
+static int       s_prev_count = 0;
+static u8        s_ch_count[NUM_CHANNELS + 1];
+static u16       s_ch_sig[NUM_CHANNELS + 1];    // sum of radio levels, 0-3 each
+
+// report records for each mode, kept from the last run of that mode and
+// replayed when the report generator asks for them. a standard run starts
+// a new session and throws the other three away
+static sink_log s_log;
+static sink_log s_lat_log;
+static sink_log s_dl_log;
+static sink_log s_scan_log;
+
+static void logs_init(void) {
+    static bool done = false;
+    if (done) return;
+    sink_log_init(&s_log);
+    sink_log_init(&s_lat_log);
+    sink_log_init(&s_dl_log);
+    sink_log_init(&s_scan_log);
+    done = true;
+}
 
-                char ssid[33], bssid_str[20], line[128];
-                memset(ssid, 0, sizeof(ssid));
-                if (bss->SSIDLength > 0 && bss->SSIDLength <= 32)
-                    memcpy(ssid, bss->SSID, bss->SSIDLength);
-                else
-                    strcpy(ssid, "(Hidden)");
+static int collect_aps(u8 *buf, int fmt) {
+    bss_iter it;
+    BSSDescriptor *bss;
+
+    s_ap_count = 0;
+    bss_iter_init(&it, buf, SCAN_BUF_SIZE, fmt);
+    while (s_ap_count < MAX_SCAN_APS && (bss = bss_iter_next(&it)) != NULL) {
+        ap_record *ap = &s_aps[s_ap_count++];
+
+        memcpy(ap->bssid, bss->BSSID, 6);
+        memset(ap->ssid, 0, sizeof(ap->ssid));
+        if (bss->SSIDLength > 0 && bss->SSIDLength <= 32)
+            memcpy(ap->ssid, bss->SSID, bss->SSIDLength);
+        else
+            strcpy(ap->ssid, "(Hidden)");
+        ap->channel = (u8)bss->channel;
+        ap->sig     = WD_GetRadioLevel(bss);
+        ap->sec     = security_str(bss);
+    }
+    return s_ap_count;
+}
 
-                mac_to_str(bss->BSSID, bssid_str, sizeof(bssid_str));
-                u8 sig = WD_GetRadioLevel(bss);
 
-                snprintf(line, sizeof(line), "%-24s Ch:%-2d  Sig:%s  %s",
-                         ssid, bss->channel, signal_str(sig), security_str(bss));
+// fills s_aps from the scan buffer plus the per-channel tallies.
+// counted format first, strided if that turns up nothing.
+static int scan_parse(u8 *buf, s32 scan_ret) {
+    int i;
 
-                if (sig >= 2) ui_draw_ok(line);
-                else if (sig == 1) ui_draw_warn(line);
-                else ui_draw_err(line);
+    memset(s_ch_count, 0, sizeof(s_ch_count));
+    memset(s_ch_sig, 0, sizeof(s_ch_sig));
+    s_ap_count = 0;
+    if (scan_ret < 0) return -1;
 
-                rpos += snprintf(s_report + rpos, sizeof(s_report) - rpos,
-                                 "  %s  BSSID:%s  Ch:%d  Signal:%s  %s\n",
-                                 ssid, bssid_str, bss->channel, signal_str(sig), security_str(bss));
-                count++;
-                ptr += entry_len;
-            }
-        }
+    if (collect_aps(buf, BSS_FMT_COUNTED) == 0)
+        collect_aps(buf, BSS_FMT_STRIDED);
+
+    for (i = 0; i < s_ap_count; i++) {
+        u8 ch = s_aps[i].channel;
+        if (ch < 1 || ch > NUM_CHANNELS) continue;
+        s_ch_count[ch]++;
+        s_ch_sig[ch] += s_aps[i].sig;
     }
+    return s_ap_count;
+}
 
-    // format B fallback: no leading count, stride from bss->length
-    if (count == 0) {
-        ptr = buf;
-        while (ptr < (end - sizeof(BSSDescriptor)) && count < MAX_SCAN_APS) {
-            BSSDescriptor *bss = (BSSDescriptor *)ptr;
-            if (bss->length == 0 || bss->length < sizeof(BSSDescriptor) || bss->SSIDLength > 32)
-                break;
 
-            if (!bss->BSSID[0] && !bss->BSSID[1] && !bss->BSSID[2] &&
-                !bss->BSSID[3] && !bss->BSSID[4] && !bss->BSSID[5]) {
-                ptr += bss->length;
-                continue;
-            }
+// 2.4GHz channels are 5MHz apart but ~22MHz wide, so anything within 4
+// channels of you overlaps. every AP counts for how close and how loud it is.
+static u32 channel_congestion(int ch) {
+    u32 score = 0;
+    int i;
+    for (i = 0; i < s_ap_count; i++) {
+        int d = abs((int)s_aps[i].channel - ch);
+        if (d < 5) score += (u32)(5 - d) * (s_aps[i].sig + 1);
+    }
+    return score;
+}
 
-            char ssid[33], bssid_str[20], line[128];
-            memset(ssid, 0, sizeof(ssid));
-            if (bss->SSIDLength > 0) memcpy(ssid, bss->SSID, bss->SSIDLength);
-            else strcpy(ssid, "(Hidden)");
+// only 1, 6 and 11 are worth recommending, they're the ones that
+// don't overlap each other
+static int best_channel(u32 *score_out) {
+    static const int cands[3] = { 1, 6, 11 };
+    int best = cands[0];
+    u32 best_score = channel_congestion(best);
+    int i;
 
-            mac_to_str(bss->BSSID, bssid_str, sizeof(bssid_str));
-            u8 sig = WD_GetRadioLevel(bss);
+    for (i = 1; i < 3; i++) {
+        u32 s = channel_congestion(cands[i]);
+        if (s < best_score) { best = cands[i]; best_score = s; }
+    }
+    if (score_out) *score_out = best_score;
+    return best;
+}
 
-            snprintf(line, sizeof(line), "%-24s Ch:%-2d  Sig:%s  %s",
-                     ssid, bss->channel, signal_str(sig), security_str(bss));
 
-            if (sig >= 2) ui_draw_ok(line);
-            else if (sig == 1) ui_draw_warn(line);
-            else ui_draw_err(line);
+// prints s_aps and the channel breakdown, records the same into rep.
+// rep can be NULL for screen-only output.
+static void show_aps(report_sink *rep, s32 scan_ret) {
+    int i;
 
-            rpos += snprintf(s_report + rpos, sizeof(s_report) - rpos,
-                             "  %s  BSSID:%s  Ch:%d  Signal:%s  %s\n",
-                             ssid, bssid_str, bss->channel, signal_str(sig), security_str(bss));
-            count++;
-            ptr += bss->length;
-        }
+    sink_subsection(rep, "Nearby Access Points");
+
+    if (scan_ret < 0) {
+        char tmp[64];
+        snprintf(tmp, sizeof(tmp), "AP scan failed (error %d)", (int)scan_ret);
+        ui_draw_err(tmp);
+        sink_text(rep, "  AP scan failed (error %d)\n", (int)scan_ret);
+        sink_field_int(rep, "scan_error", scan_ret);
+        return;
     }
 
-    if (count == 0) {
+    sink_list(rep, "aps");
+    for (i = 0; i < s_ap_count; i++) {
+        ap_record *ap = &s_aps[i];
+        char bssid_str[20], line[128];
+
+        mac_to_str(ap->bssid, bssid_str, sizeof(bssid_str));
+        snprintf(line, sizeof(line), "%-24s Ch:%-2d  Sig:%s  %s",
+                 ap->ssid, ap->channel, signal_str(ap->sig), ap->sec);
+
+        if (ap->sig >= 2) ui_draw_ok(line);
+        else if (ap->sig == 1) ui_draw_warn(line);
+        else ui_draw_err(line);
+
+        sink_text(rep, "  %s  BSSID:%s  Ch:%d  Signal:%s  %s\n",
+                  ap->ssid, bssid_str, ap->channel, signal_str(ap->sig), ap->sec);
+        sink_item(rep);
+        sink_field_str(rep, "ssid",     ap->ssid);
+        sink_field_str(rep, "bssid",    bssid_str);
+        sink_field_int(rep, "channel",  ap->channel);
+        sink_field_int(rep, "signal",   ap->sig);
+        sink_field_str(rep, "security", ap->sec);
+    }
+    sink_list_end(rep);
+
+    if (s_ap_count == 0) {
         ui_draw_warn("No access points found");
-        rpos += snprintf(s_report + rpos, sizeof(s_report) - rpos, "  (none found)\n");
+        sink_text(rep, "  (none found)\n");
+        return;
     } else {
         char tmp[64];
-        snprintf(tmp, sizeof(tmp), "Found %d access point(s)", count);
+        snprintf(tmp, sizeof(tmp), "Found %d access point(s)", s_ap_count);
         ui_draw_ok(tmp);
     }
 
-    *rpos_ptr = rpos;
-    return count;
+    // --- per-channel breakdown ---
+    {
+        u32 max = 1, score;
+        int best;
+        char label[48], buf[48];
+
+        for (i = 1; i <= NUM_CHANNELS; i++)
+            if (s_ch_count[i] > max) max = s_ch_count[i];
+
+        ui_draw_section("Channel Congestion");
+        sink_text(rep, "Channel usage:\n");
+        sink_list(rep, "channels");
+        for (i = 1; i <= NUM_CHANNELS; i++) {
+            if (s_ch_count[i] == 0) continue;
+            // average level rounded, so two Good + one Fair reads as Good
+            u8 avg = (u8)((s_ch_sig[i] + s_ch_count[i] / 2) / s_ch_count[i]);
+            const char *color = s_ch_count[i] >= 4 ? UI_BRED :
+                                s_ch_count[i] >= 2 ? UI_BYELLOW : UI_BGREEN;
+
+            snprintf(label, sizeof(label), "Ch %-2d %2u AP  avg %s",
+                     i, s_ch_count[i], signal_str(avg));
+            ui_draw_hbar(s_ch_count[i], max, 20, color, label);
+            sink_text(rep, "  Ch %-2d  %2u AP  avg signal %s\n",
+                      i, s_ch_count[i], signal_str(avg));
+            sink_item(rep);
+            sink_field_int(rep, "channel",    i);
+            sink_field_int(rep, "aps",        s_ch_count[i]);
+            sink_field_int(rep, "avg_signal", avg);
+            sink_field_int(rep, "congestion", channel_congestion(i));
+        }
+        sink_list_end(rep);
+
+        best = best_channel(&score);
+        snprintf(buf, sizeof(buf), "%d (score %u)", best, score);
+        ui_draw_kv_color("Best Channel", score == 0 ? UI_BGREEN : UI_BWHITE, buf);
+        sink_kv(rep, "Least Congested", "channel %d (of 1/6/11, score %u)", best, score);
+        sink_field_int(rep, "best_channel",       best);
+        sink_field_int(rep, "best_channel_score", score);
+    }
+}
+
+
+static int find_ap(const ap_record *list, int n, const u8 *bssid) {
+    int i;
+    for (i = 0; i < n; i++)
+        if (memcmp(list[i].bssid, bssid, 6) == 0) return i;
+    return -1;
+}
+
+// diffs s_aps against s_prev_aps: new, gone, and signal/channel changes.
+// only the first max_lines changes get drawn, the counts cover all of them
+static void compare_scans(report_sink *rep, int max_lines) {
+    int i, added = 0, gone = 0, changed = 0;
+    char line[96];
+
+    ui_draw_section("Changes Since Last Scan");
+
+    for (i = 0; i < s_ap_count; i++) {
+        ap_record *ap = &s_aps[i];
+        int j = find_ap(s_prev_aps, s_prev_count, ap->bssid);
+        if (j < 0) {
+            snprintf(line, sizeof(line), "+ %-22s Ch:%-2d  %s", ap->ssid, ap->channel, signal_str(ap->sig));
+            if (added + gone + changed < max_lines) ui_draw_ok(line);
+            added++;
+        } else if (s_prev_aps[j].sig != ap->sig || s_prev_aps[j].channel != ap->channel) {
+            snprintf(line, sizeof(line), "~ %-22s Ch:%d->%d  Sig:%s->%s", ap->ssid,
+                     s_prev_aps[j].channel, ap->channel,
+                     signal_str(s_prev_aps[j].sig), signal_str(ap->sig));
+            if (added + gone + changed < max_lines) ui_draw_info(line);
+            changed++;
+        }
+    }
+    for (i = 0; i < s_prev_count; i++) {
+        if (find_ap(s_aps, s_ap_count, s_prev_aps[i].bssid) >= 0) continue;
+        snprintf(line, sizeof(line), "- %-22s Ch:%-2d", s_prev_aps[i].ssid, s_prev_aps[i].channel);
+        if (added + gone + changed < max_lines) ui_draw_warn(line);
+        gone++;
+    }
+
+    if (!added && !gone && !changed) ui_draw_ok("No changes");
+    else if (added + gone + changed > max_lines)
+        ui_printf(UI_WHITE "   ... %d more\n" UI_RESET, added + gone + changed - max_lines);
+    sink_text(rep, "  vs previous: %d new, %d gone, %d changed\n", added, gone, changed);
+    sink_field_int(rep, "added",   added);
+    sink_field_int(rep, "gone",    gone);
+    sink_field_int(rep, "changed", changed);
+}
+
+
+// one AP scan into s_scan_buf. WD has to already be up in scan mode.
+static s32 scan_once(void) {
+    ScanParameters sp;
+    WD_SetDefaultScanParameters(&sp);
+    sp.MaxChannelTime  = 400;
+    sp.ChannelBitmap   = 0x3FFF;  // scan all 14 channels
+    memset(s_scan_buf, 0, sizeof(s_scan_buf));
+
+    s32 scan_ret = WD_ScanOnce(&sp, s_scan_buf, sizeof(s_scan_buf));
+
+    // retry a couple of times if the results look empty
+    int tries = 1;
+    while (scan_ret >= 0 && s_scan_buf[0] == 0 && s_scan_buf[1] == 0 &&
+           tries++ < SCAN_RETRIES) {
+        usleep(READY_POLL_US * 10);
+        scan_ret = WD_ScanOnce(&sp, s_scan_buf, sizeof(s_scan_buf));
+    }
+    return scan_ret;
 }
 
 
@@ -298,60 +852,746 @@ static bool run_connectivity(void) {
 
     ui_draw_section("Connectivity Tests");
 
-    // test against Google DNS port 53 and Cloudflare HTTP port 80.
-    // these are pretty reliable targets - if both fail the internet is definitely not working.
-    bool dns_ok  = test_tcp("Google DNS (8.8.8.8:53)",  0x08080808, 53);
-    bool http_ok = test_tcp("Cloudflare (1.1.1.1:80)",  0x01010101, 80);
+    // the essential targets (Google DNS port 53, Cloudflare HTTP port 80) are
+    // pretty reliable - if both fail the internet is definitely not working.
+    // the service ones tell you if the thing you actually want is reachable.
+    resolve_targets(s_targets, s_probes, s_num_targets);
+    run_probes(s_targets, s_probes, s_num_targets, PROBE_TIMEOUT_MS);
+    s_probes_valid = true;
+
+    // mean connect time of whatever answered goes into the history
+    {
+        hist_record h;
+        u32 sum_us = 0, ok = 0, j;
+        for (j = 0; j < s_num_targets; j++) {
+            if (s_probes[j].state != PROBE_OK) continue;
+            sum_us += s_probes[j].us;
+            ok++;
+        }
+        if (ok > 0) {
+            memset(&h, 0, sizeof(h));
+            h.flags          = HIST_NET;
+            h.net_latency_ms = (float)sum_us / (float)ok / 1000.0f;
+            history_add(&h);
+        }
+    }
+
+    int essential = 0, essential_ok = 0, services_ok = 0, services = 0, i;
+    for (i = 0; i < s_num_targets; i++) {
+        const probe_result *r = &s_probes[i];
+        char buf[128];
+
+        if (r->state == PROBE_OK)
+            snprintf(buf, sizeof(buf), "%s (port %u): Connected (%.1f ms)",
+                     s_targets[i].label, s_targets[i].port, (float)r->us / 1000.0f);
+        else if (r->state == PROBE_FAILED && r->err != 0)
+            snprintf(buf, sizeof(buf), "%s (port %u): Failed (error %d)",
+                     s_targets[i].label, s_targets[i].port, (int)r->err);
+        else
+            snprintf(buf, sizeof(buf), "%s (port %u): %s",
+                     s_targets[i].label, s_targets[i].port, probe_state_str(r->state));
+
+        if (r->state == PROBE_OK) ui_draw_ok(buf);
+        else if (s_targets[i].essential) ui_draw_err(buf);
+        else ui_draw_warn(buf);
+
+        if (s_targets[i].essential) {
+            essential++;
+            if (r->state == PROBE_OK) essential_ok++;
+        } else {
+            services++;
+            if (r->state == PROBE_OK) services_ok++;
+        }
+    }
+    {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%d probes in %u ms (run in parallel)", s_num_targets, s_probe_total_ms);
+        ui_draw_info(buf);
+    }
     ui_printf("\n");
 
-    if (dns_ok && http_ok) {
+    bool any_ok = essential_ok > 0;
+    bool all_ok = essential_ok == essential;
+
+    if (all_ok) {
         ui_draw_ok("Internet: FULL connectivity");
-        ui_draw_info("Wiimmfi, WiiLink, RiiConnect24 should all work");
-    } else if (dns_ok || http_ok) {
+        if (services_ok == services)
+            ui_draw_info(s_targets == s_default_targets ? "Wiimmfi, WiiLink, RiiConnect24 should all work"
+                                                        : "Every service probe answered");
+        else
+            ui_draw_warn("Some online services didn't answer - they may be down right now");
+    } else if (any_ok) {
         ui_draw_warn("Internet: PARTIAL - some things may not work");
     } else {
         ui_draw_err("Internet: NONE - WiFi connected but no internet");
         ui_draw_warn("Check your router or ISP");
     }
 
-    return dns_ok || http_ok;
+    return any_ok;
 }
 
 
-// spawns the net_init thread and waits for it to finish.
-// returns whatever net_init returned.
-static s32 do_net_init(void) {
-    s_net_done = false;
-    LWP_CreateThread(&s_net_thread, net_init_thread, NULL,
-                     s_net_stack, sizeof(s_net_stack), 64);
-    while (!s_net_done) VIDEO_WaitVSync();
-    return s_net_ret;
+// runs net_init on the worker thread. EAGAIN means the stack is still
+// busy (usually WD hasn't fully let go yet), so keep trying until the
+// deadline instead of sleeping a fixed time up front.
+// returns whatever the last net_init returned.
+static s32 net_init_ready(u32 timeout_ms) {
+    u64 t0 = gettime();
+    while (1) {
+        job_start(net_init_thread);
+        job_join();
+        if (s_net_ret != -EAGAIN || ticks_to_millisecs(gettime() - t0) >= timeout_ms)
+            return s_net_ret;
+        usleep(READY_POLL_US);
+    }
+}
+
+
+// WD_Init fails while net_init still holds the radio. poll it rather than
+// guessing how long the release takes. mode < 0 means "0, then AOSSAPScan"
+static bool wd_init_ready(int mode, u32 timeout_ms) {
+    u64 t0 = gettime();
+    while (1) {
+        if (mode < 0) {
+            if (WD_Init(0) == 0 || WD_Init(AOSSAPScan) == 0) return true;
+        } else if (WD_Init((u8)mode) == 0) {
+            return true;
+        }
+        if (ticks_to_millisecs(gettime() - t0) >= timeout_ms) return false;
+        usleep(READY_POLL_US);
+    }
+}
+
+
+// right after WD_Init the card can hand back zeroes for a bit. wait for a
+// real MAC and channel, or give up and return the last result as-is
+static s32 wd_info_ready(u32 timeout_ms) {
+    u64 t0 = gettime();
+    s32 ret;
+    while (1) {
+        int i;
+        memset(&s_wdinfo, 0, sizeof(s_wdinfo));
+        ret = WD_GetInfo(&s_wdinfo);
+        if (ret == 0 && s_wdinfo.channel >= 1 && s_wdinfo.channel <= 14) {
+            for (i = 0; i < 6; i++)
+                if (s_wdinfo.MAC[i] != 0 && s_wdinfo.MAC[i] != 0xFF) return ret;
+        }
+        if (ticks_to_millisecs(gettime() - t0) >= timeout_ms) return ret;
+        usleep(READY_POLL_US);
+    }
+}
+
+
+static int cmp_u32(const void *a, const void *b) {
+    u32 x = *(const u32 *)a, y = *(const u32 *)b;
+    return (x > y) - (x < y);
+}
+
+
+// per-target stats and histogram. jitter is the mean difference between
+// consecutive samples, which is what actually hurts online play.
+static void show_latency(int t) {
+    static u32 sorted[LAT_ROUNDS];
+    u32 hist[LAT_BUCKETS] = { 0 };
+    u32 peak = 0;
+    u64 sum = 0, jsum = 0;
+    int n = s_lat_n[t], i, b;
+    char buf[96];
+
+    ui_draw_section(s_targets[t].label);
+
+    if (n == 0) {
+        ui_draw_err("No successful connects - unreachable");
+        sink_text(&s_lat_log.sink, "%-14s unreachable\n", s_targets[t].label);
+        sink_item(&s_lat_log.sink);
+        sink_field_str(&s_lat_log.sink, "target",    s_targets[t].label);
+        sink_field_bool(&s_lat_log.sink, "reachable", false);
+        return;
+    }
+
+    for (i = 0; i < n; i++) {
+        sum += s_lat[t][i];
+        if (i > 0) {
+            u32 d = (s_lat[t][i] > s_lat[t][i - 1]) ? s_lat[t][i] - s_lat[t][i - 1]
+                                                    : s_lat[t][i - 1] - s_lat[t][i];
+            jsum += d;
+        }
+        for (b = 0; b < LAT_BUCKETS - 1; b++)
+            if (s_lat[t][i] < s_lat_edges_ms[b] * 1000) break;
+        hist[b]++;
+    }
+    memcpy(sorted, s_lat[t], n * sizeof(u32));
+    qsort(sorted, n, sizeof(u32), cmp_u32);
+
+    float mn  = (float)sorted[0] / 1000.0f;
+    float avg = (float)(sum / n) / 1000.0f;
+    float p95 = (float)sorted[(n * 95 + 99) / 100 - 1] / 1000.0f;
+    float mx  = (float)sorted[n - 1] / 1000.0f;
+    float jit = (n > 1) ? (float)(jsum / (n - 1)) / 1000.0f : 0.0f;
+    int lost  = LAT_ROUNDS - n;
+
+    snprintf(buf, sizeof(buf), "%.2f / %.2f / %.2f / %.2f ms", mn, avg, p95, mx);
+    ui_draw_kv("Min/Avg/P95/Max", buf);
+    snprintf(buf, sizeof(buf), "%.2f ms", jit);
+    ui_draw_kv_color("Jitter", jit < 5.0f ? UI_BGREEN : jit < 20.0f ? UI_BYELLOW : UI_BRED, buf);
+    snprintf(buf, sizeof(buf), "%d of %d", lost, LAT_ROUNDS);
+    ui_draw_kv_color("Lost / Timed Out", lost == 0 ? UI_BGREEN : UI_BYELLOW, buf);
+
+    ui_printf("\n");
+    for (b = 0; b < LAT_BUCKETS; b++)
+        if (hist[b] > peak) peak = hist[b];
+    for (b = 0; b < LAT_BUCKETS; b++) {
+        char lbl[32];
+        if (b == 0)
+            snprintf(lbl, sizeof(lbl), "   < %3u ms  %u", s_lat_edges_ms[0], hist[b]);
+        else if (b == LAT_BUCKETS - 1)
+            snprintf(lbl, sizeof(lbl), "  >= %3u ms  %u", s_lat_edges_ms[b - 1], hist[b]);
+        else
+            snprintf(lbl, sizeof(lbl), "%3u-%3u ms  %u", s_lat_edges_ms[b - 1], s_lat_edges_ms[b], hist[b]);
+        ui_draw_hbar(hist[b], peak, 30, b < 3 ? UI_BGREEN : b < 5 ? UI_BYELLOW : UI_BRED, lbl);
+    }
+
+    sink_text(&s_lat_log.sink,
+              "%-14s min %6.2f  avg %6.2f  p95 %6.2f  max %6.2f  jitter %6.2f ms  lost %d/%d\n",
+              s_targets[t].label, mn, avg, p95, mx, jit, lost, LAT_ROUNDS);
+    sink_item(&s_lat_log.sink);
+    sink_field_str(&s_lat_log.sink,  "target",    s_targets[t].label);
+    sink_field_bool(&s_lat_log.sink, "reachable", true);
+    sink_field_num(&s_lat_log.sink,  "min_ms",    mn);
+    sink_field_num(&s_lat_log.sink,  "avg_ms",    avg);
+    sink_field_num(&s_lat_log.sink,  "p95_ms",    p95);
+    sink_field_num(&s_lat_log.sink,  "max_ms",    mx);
+    sink_field_num(&s_lat_log.sink,  "jitter_ms", jit);
+    sink_field_int(&s_lat_log.sink,  "lost",      lost);
+}
+
+
+// brings up net_init for the modes that only need a working connection
+static bool bring_up_network(void) {
+    char msg[64];
+
+    ui_draw_info("Bringing up the network...");
+    net_deinit();
+
+    s32 ret = net_init_ready(NET_READY_MS);
+    if (ret < 0) {
+        snprintf(msg, sizeof(msg), "WiFi init failed (error %d)", ret);
+        ui_draw_err(msg);
+        ui_draw_info("Run the standard test for a diagnosis");
+        net_deinit();
+        return false;
+    }
+    return true;
+}
+
+
+static bool sock_wait(s32 sock, u32 events, u32 timeout_ms) {
+    struct pollsd p;
+    p.socket  = sock;
+    p.events  = events;
+    p.revents = 0;
+    return net_poll(&p, 1, timeout_ms) > 0 && (p.revents & events);
+}
+
+
+// pulls the status code and Content-Length out of a response header block
+static void parse_http_header(const char *hdr, dl_result *res) {
+    const char *line = hdr;
+
+    if (strncmp(hdr, "HTTP/1.", 7) == 0 && strlen(hdr) > 12)
+        res->status = atoi(hdr + 9);
+
+    while ((line = strstr(line, "\r\n")) != NULL) {
+        line += 2;
+        if (strncasecmp(line, "Content-Length:", 15) == 0)
+            res->content_len = (u32)strtoul(line + 15, NULL, 10);
+    }
+}
+
+
+// blocking-style connect on top of the probe engine, the socket stays
+// open (and non-blocking) on success. returns 0 or a net_* error
+static s32 http_connect(probe_result *conn, u32 ip, u16 port) {
+    memset(conn, 0, sizeof(*conn));
+    conn->ip   = ip;
+    conn->keep = true;
+
+    if (probe_start(conn, port)) {
+        while (conn->state == PROBE_PENDING) {
+            if (sock_wait(conn->sock, POLLOUT, PROBE_POLL_MS))
+                probe_check(conn, port);
+            if (conn->state == PROBE_PENDING &&
+                ticks_to_millisecs(gettime() - conn->t0) >= PROBE_TIMEOUT_MS)
+                probe_finish(conn, PROBE_TIMEOUT, -ETIMEDOUT);
+        }
+    }
+    if (conn->state != PROBE_OK) return conn->err ? conn->err : -ETIMEDOUT;
+    return 0;
+}
+
+// all of it or an error, waiting out EAGAIN up to DL_IDLE_MS at a time
+static s32 send_all(s32 sock, const char *data, u32 len) {
+    u32 sent = 0;
+    while (sent < len) {
+        s32 n = net_send(sock, data + sent, len - sent, 0);
+        if (n > 0) { sent += n; continue; }
+        if (n != -EAGAIN || !sock_wait(sock, POLLOUT, DL_IDLE_MS))
+            return n ? n : -ETIMEDOUT;
+    }
+    return 0;
+}
+
+
+// one GET, streamed through buf read_size bytes at a time and dropped.
+// stops at max_bytes of body so the sweep doesn't take forever.
+static void http_download(const dl_object *obj, u32 ip, u8 *buf, u32 read_size,
+                          u32 max_bytes, dl_result *res) {
+    static char hdr[1024];
+    probe_result conn;
+    char req[256];
+    int hlen = 0, reqlen;
+    bool in_body = false;
+    u64 t_req, t_body = 0, t_last;
+
+    memset(res, 0, sizeof(*res));
+    if ((res->err = http_connect(&conn, ip, 80)) != 0) return;
+
+    reqlen = snprintf(req, sizeof(req),
+                      "GET %s HTTP/1.1\r\nHost: %s\r\n"
+                      "User-Agent: WiiMedic/" WIIMEDIC_VERSION "\r\n"
+                      "Connection: close\r\n\r\n", obj->path, obj->host);
+
+    t_req = t_last = gettime();
+    if ((res->err = send_all(conn.sock, req, (u32)reqlen)) != 0) {
+        net_close(conn.sock);
+        return;
+    }
+
+    while (1) {
+        u64 now = gettime();
+        s32 n;
+
+        if (ticks_to_millisecs(now - t_last) >= DL_IDLE_MS) { res->err = -ETIMEDOUT; break; }
+        if (in_body && ticks_to_millisecs(now - t_body) >= DL_MAX_MS) break;
+        if (in_body && res->body_bytes >= max_bytes) break;
+        if (in_body && res->content_len && res->body_bytes >= res->content_len) break;
+
+        n = net_recv(conn.sock, buf, read_size, 0);
+        if (n == -EAGAIN) {
+            sock_wait(conn.sock, POLLIN, PROBE_POLL_MS);
+            continue;
+        }
+        if (n < 0) { res->err = n; break; }
+        if (n == 0) break;  // server closed, we're done
+
+        now = t_last = gettime();
+        if (res->ttfb_us == 0)
+            res->ttfb_us = (u32)ticks_to_microsecs(now - t_req);
+
+        if (in_body) {
+            res->body_bytes += n;
+            continue;
+        }
+
+        // still in the headers - collect them until the blank line
+        int take = (n < (int)sizeof(hdr) - 1 - hlen) ? n : (int)sizeof(hdr) - 1 - hlen;
+        memcpy(hdr + hlen, buf, take);
+        hlen += take;
+        hdr[hlen] = '\0';
+
+        char *endp = strstr(hdr, "\r\n\r\n");
+        if (endp) {
+            int header_bytes = (int)(endp + 4 - hdr);
+            *endp = '\0';
+            parse_http_header(hdr, res);
+            if (res->status != 200) break;
+            in_body = true;
+            t_body = now;
+            // whatever came in after the headers in this read is body.
+            // header_bytes is counted from the start of this response, the
+            // earlier reads were all headers so that's still right
+            res->body_bytes = (u32)(hlen - header_bytes) + (u32)(n - take);
+        } else if (hlen >= (int)sizeof(hdr) - 1) {
+            res->err = -EMSGSIZE;
+            break;
+        }
+    }
+
+    if (in_body) res->body_us = (u32)ticks_to_microsecs(gettime() - t_body);
+    net_close(conn.sock);
+}
+
+
+static float dl_kbs(const dl_result *r) {
+    if (r->body_us == 0) return 0.0f;
+    return (float)r->body_bytes / 1024.0f / ((float)r->body_us / 1000000.0f);
+}
+
+
+static const char *dl_color(float kbs) {
+    if (kbs >= 500.0f) return UI_BGREEN;
+    if (kbs >= 150.0f) return UI_BYELLOW;
+    return UI_BRED;
+}
+
+
+// first object whose host resolves and answers with a 200 wins
+static int pick_dl_object(u32 *ip_out, u8 *buf) {
+    int i;
+    for (i = 0; i < NUM_DL_OBJECTS; i++) {
+        struct hostent *he = net_gethostbyname(s_dl_objects[i].host);
+        dl_result probe;
+        if (!he || !he->h_addr_list || !he->h_addr_list[0]) continue;
+        *ip_out = ntohl(*(u32 *)he->h_addr_list[0]);
+
+        // tiny fetch just to make sure the file is still there
+        http_download(&s_dl_objects[i], *ip_out, buf, DL_DEFAULT_READ, 1, &probe);
+        if (probe.err == 0 && probe.status == 200) return i;
+    }
+    return -1;
+}
+
+
+// --- report upload ---
+// a chunked POST, so nothing needs the report's length up front. the
+// report's own file buffer hands each piece straight to net_upload_chunk
+// as it goes to the card, the report never exists twice in memory.
+
+// http://host[:port]/path, nothing fancier. no TLS on IOS anyway
+static bool parse_http_url(const char *url, char *host, int hostsize, u16 *port, const char **path) {
+    const char *p, *end;
+    int len;
+
+    if (strncasecmp(url, "http://", 7) != 0) return false;
+    p = url + 7;
+    end = p + strcspn(p, ":/");
+    len = (int)(end - p);
+    if (len == 0 || len >= hostsize) return false;
+    memcpy(host, p, len);
+    host[len] = '\0';
+
+    *port = 80;
+    if (*end == ':') {
+        char *after;
+        unsigned long n = strtoul(end + 1, &after, 10);
+        if (after == end + 1 || n == 0 || n > 0xFFFF || (*after && *after != '/')) return false;
+        *port = (u16)n;
+        end = after;
+    }
+    *path = *end ? end : "/";
+    return true;
+}
+
+bool net_upload_begin(net_upload *u, const char *url, const char *content_type) {
+    PROF_FUNC();
+    static char req[512];
+    char host[64];
+    const char *path;
+    u16 port;
+    u32 id = 0;
+    int len;
+
+    memset(u, 0, sizeof(*u));
+    u->sock = -1;
+    if (!parse_http_url(url, host, sizeof(host), &port, &path)) {
+        u->err = -EINVAL;
+        return false;
+    }
+    if (!bring_up_network()) {
+        u->err = s_net_ret;
+        return false;
+    }
+
+    {
+        probe_target t = { host, host, 0, port, false };
+        probe_result r;
+        unsigned a, b, c, d;
+        char tail;
+        if (sscanf(host, "%u.%u.%u.%u%c", &a, &b, &c, &d, &tail) == 4) {
+            t.host = NULL;
+            t.ip   = (a << 24) | (b << 16) | (c << 8) | d;
+        }
+        resolve_targets(&t, &r, 1);
+        if (r.ip == 0) {
+            u->err = -EHOSTUNREACH;
+            net_deinit();
+            return false;
+        }
+        if ((u->err = http_connect(&r, r.ip, port)) != 0) {
+            net_deinit();
+            return false;
+        }
+        u->sock = r.sock;
+    }
+
+    ES_GetDeviceID(&id);
+    len = snprintf(req, sizeof(req),
+                   "POST %s HTTP/1.1\r\nHost: %s:%u\r\n"
+                   "User-Agent: WiiMedic/" WIIMEDIC_VERSION "\r\n"
+                   "Content-Type: %s\r\n"
+                   "X-WiiMedic-Device: %08X\r\n"
+                   "Transfer-Encoding: chunked\r\n"
+                   "Connection: close\r\n\r\n",
+                   path, host, (unsigned)port, content_type, (unsigned)id);
+    if (len >= (int)sizeof(req) || (u->err = send_all(u->sock, req, (u32)len)) != 0) {
+        if (!u->err) u->err = -EMSGSIZE;
+        net_close(u->sock);
+        net_deinit();
+        u->sock = -1;
+        return false;
+    }
+    return true;
+}
+
+void net_upload_chunk(void *ctx, const char *data, u32 len) {
+    net_upload *u = (net_upload *)ctx;
+    char size[16];
+    int n;
+
+    if (u->sock < 0 || u->err || len == 0) return;
+    n = snprintf(size, sizeof(size), "%X\r\n", (unsigned)len);
+    if ((u->err = send_all(u->sock, size, (u32)n)) == 0 &&
+        (u->err = send_all(u->sock, data, len)) == 0 &&
+        (u->err = send_all(u->sock, "\r\n", 2)) == 0)
+        u->sent += len;
+}
+
+bool net_upload_finish(net_upload *u) {
+    PROF_FUNC();
+    static char reply[512];
+    dl_result res;
+    int got = 0;
+    u64 t0;
+
+    if (u->sock < 0) return false;
+    if (u->err == 0)
+        u->err = send_all(u->sock, "0\r\n\r\n", 5);
+
+    // only the status line matters, whatever the server says after it
+    // can be dropped
+    reply[0] = '\0';
+    t0 = gettime();
+    while (u->err == 0 && got < (int)sizeof(reply) - 1 && !strstr(reply, "\r\n")) {
+        s32 n = net_recv(u->sock, reply + got, sizeof(reply) - 1 - got, 0);
+        if (n == -EAGAIN) {
+            if (ticks_to_millisecs(gettime() - t0) >= DL_IDLE_MS) u->err = -ETIMEDOUT;
+            else sock_wait(u->sock, POLLIN, PROBE_POLL_MS);
+            continue;
+        }
+        if (n <= 0) {
+            if (n < 0) u->err = n;
+            break;
+        }
+        got += n;
+        reply[got] = '\0';
+    }
+
+    memset(&res, 0, sizeof(res));
+    parse_http_header(reply, &res);
+    u->status = res.status;
+    net_close(u->sock);
+    net_deinit();
+    u->sock = -1;
+    return u->err == 0 && u->status >= 200 && u->status < 300;
+}
+
+
+static void run_download_test(bool sweep) {
+    PROF_FUNC();
+    u8 *buf;
+    u32 ip = 0;
+    int obj, i, best = -1;
+    dl_result res[DL_NSIZES];
+    char msg[96];
+    report_sink *rep = &s_dl_log.sink;
+
+    logs_init();
+    sink_log_clear(&s_dl_log);
+    if (!bring_up_network()) return;
+
+    // one receive buffer for every read of every run
+    buf = (u8 *)scratch_alloc(DL_MAX_READ);
+    if (!buf) {
+        ui_draw_err("Out of memory - can't allocate the receive buffer");
+        net_deinit();
+        return;
+    }
+
+    ui_spin_set_msg("Finding a download server...");
+    obj = pick_dl_object(&ip, buf);
+    if (obj < 0) {
+        ui_draw_err("None of the test servers answered");
+        ui_draw_info("Connectivity might still be fine - the servers could be down");
+        sink_section(rep, "DOWNLOAD THROUGHPUT");
+        sink_text(rep, "No test server reachable\n");
+        sink_field_bool(rep, "reachable", false);
+        sink_end(rep);
+        scratch_free(buf);
+        net_deinit();
+        return;
+    }
+
+    ui_draw_section("Download Throughput");
+    snprintf(msg, sizeof(msg), "http://%s%s", s_dl_objects[obj].host, s_dl_objects[obj].path);
+    ui_draw_kv("Source", msg);
+    sink_section(rep, "DOWNLOAD THROUGHPUT");
+    sink_kv(rep, "Source", "%s", msg);
+    sink_field_bool(rep, "reachable", true);
+    sink_field_str(rep, "source", msg);
+
+    if (!sweep) {
+        ui_spin_set_msg("Downloading...");
+        http_download(&s_dl_objects[obj], ip, buf, DL_DEFAULT_READ, s_dl_objects[obj].size, &res[0]);
+
+        if (res[0].status != 200 || res[0].body_bytes == 0) {
+            snprintf(msg, sizeof(msg), "Download failed (HTTP %d, error %d)", res[0].status, (int)res[0].err);
+            ui_draw_err(msg);
+            sink_text(rep, "%s\n", msg);
+            sink_field_int(rep, "http_status", res[0].status);
+            sink_field_int(rep, "error",       res[0].err);
+        } else {
+            float kbs = dl_kbs(&res[0]);
+            snprintf(msg, sizeof(msg), "%.1f MB in %.1f s", (float)res[0].body_bytes / (1024.0f * 1024.0f),
+                     (float)res[0].body_us / 1000000.0f);
+            ui_draw_kv("Downloaded", msg);
+            snprintf(msg, sizeof(msg), "%.1f ms", (float)res[0].ttfb_us / 1000.0f);
+            ui_draw_kv("Time To First Byte", msg);
+            snprintf(msg, sizeof(msg), "%.0f KB/s", kbs);
+            ui_draw_kv_color("Sustained Speed", dl_color(kbs), msg);
+            if (res[0].err != 0)
+                ui_draw_warn("Connection dropped before the end - speed is for what arrived");
+
+            sink_kv(rep, "Read Size", "%u bytes", DL_DEFAULT_READ);
+            sink_kv(rep, "Time To First Byte", "%.1f ms", (float)res[0].ttfb_us / 1000.0f);
+            sink_kv(rep, "Sustained Speed", "%.0f KB/s (%u bytes in %.1f s)", kbs,
+                    res[0].body_bytes, (float)res[0].body_us / 1000000.0f);
+            sink_field_int(rep, "read_size", DL_DEFAULT_READ);
+            sink_field_num(rep, "ttfb_ms",   (float)res[0].ttfb_us / 1000.0f);
+            sink_field_num(rep, "kbs",       kbs);
+            sink_field_int(rep, "bytes",     res[0].body_bytes);
+            sink_field_int(rep, "body_us",   res[0].body_us);
+            sink_field_bool(rep, "complete", res[0].err == 0);
+
+            // put the number in terms of a big WAD or game update
+            if (kbs > 0.0f) {
+                snprintf(msg, sizeof(msg), "A 100 MB download would take about %.0f min",
+                         100.0f * 1024.0f / kbs / 60.0f);
+                ui_draw_info(msg);
+            }
+        }
+    } else {
+        ui_printf("\n   " UI_BCYAN "%-10s %10s %10s\n" UI_RESET, "Read size", "KB/s", "TTFB ms");
+        sink_list(rep, "sweep");
+        for (i = 0; i < DL_NSIZES; i++) {
+            snprintf(msg, sizeof(msg), "Downloading with %u byte reads...", s_dl_sizes[i]);
+            ui_spin_set_msg(msg);
+            http_download(&s_dl_objects[obj], ip, buf, s_dl_sizes[i], DL_SWEEP_BYTES, &res[i]);
+
+            float kbs = dl_kbs(&res[i]);
+            if (res[i].status == 200 && res[i].body_bytes > 0) {
+                if (best < 0 || kbs > dl_kbs(&res[best])) best = i;
+                ui_printf("   %-10u %s%10.0f" UI_RESET " %10.1f\n",
+                          s_dl_sizes[i], dl_color(kbs), kbs, (float)res[i].ttfb_us / 1000.0f);
+            } else {
+                ui_printf("   %-10u " UI_BRED "%10s" UI_RESET "\n", s_dl_sizes[i], "failed");
+            }
+            sink_text(rep, "  %5u byte reads: %6.0f KB/s  TTFB %.1f ms\n",
+                      s_dl_sizes[i], kbs, (float)res[i].ttfb_us / 1000.0f);
+            sink_item(rep);
+            sink_field_int(rep, "read_size", s_dl_sizes[i]);
+            sink_field_bool(rep, "ok",       res[i].status == 200 && res[i].body_bytes > 0);
+            sink_field_num(rep, "kbs",       kbs);
+            sink_field_num(rep, "ttfb_ms",   (float)res[i].ttfb_us / 1000.0f);
+        }
+        sink_list_end(rep);
+        ui_printf("\n");
+        if (best >= 0) {
+            snprintf(msg, sizeof(msg), "Best read size: %u bytes (%.0f KB/s)",
+                     s_dl_sizes[best], dl_kbs(&res[best]));
+            ui_draw_ok(msg);
+            sink_text(rep, "%s\n", msg);
+            sink_field_int(rep, "best_read_size", s_dl_sizes[best]);
+        } else {
+            ui_draw_err("Every download failed");
+        }
+    }
+
+    sink_end(rep);
+    scratch_free(buf);
+    net_deinit();
+
+    ui_printf("\n");
+    ui_draw_ok("Download test complete");
+}
+
+
+static void run_latency_test(void) {
+    PROF_FUNC();
+    char msg[64];
+    int r, i;
+
+    logs_init();
+    sink_log_clear(&s_lat_log);
+    if (!bring_up_network()) return;
+
+    resolve_targets(s_targets, s_probes, s_num_targets);
+    memset(s_lat_n, 0, sizeof(s_lat_n));
+
+    for (r = 0; r < LAT_ROUNDS; r++) {
+        snprintf(msg, sizeof(msg), "Probing... round %d/%d", r + 1, LAT_ROUNDS);
+        ui_spin_set_msg(msg);
+        run_probes(s_targets, s_probes, s_num_targets, LAT_TIMEOUT_MS);
+        for (i = 0; i < s_num_targets; i++) {
+            if (s_probes[i].state == PROBE_OK)
+                s_lat[i][s_lat_n[i]++] = s_probes[i].us;
+        }
+    }
+    net_deinit();
+
+    sink_section(&s_lat_log.sink, "NETWORK LATENCY");
+    sink_kv(&s_lat_log.sink, "TCP Connects", "%d per target", LAT_ROUNDS);
+    sink_field_int(&s_lat_log.sink, "rounds", LAT_ROUNDS);
+    sink_list(&s_lat_log.sink, "targets");
+    for (i = 0; i < s_num_targets; i++)
+        show_latency(i);
+    sink_list_end(&s_lat_log.sink);
+    sink_end(&s_lat_log.sink);
+
+    ui_printf("\n");
+    ui_draw_info("Wiimmfi races get laggy once jitter goes past ~20 ms");
+    ui_printf("\n");
+    ui_draw_ok("Latency test complete");
 }
 
 
 void run_network_test(void) {
-    int rpos = 0;
+    PROF_FUNC();
+    report_sink *rep = &s_log.sink;
     s32 last_err = 0;
 
-    memset(s_report, 0, sizeof(s_report));
+    logs_init();
+    sink_log_clear(&s_log);
+    // the extra modes' results belong to the network as it was before,
+    // don't let them ride along in this run's report
+    sink_log_clear(&s_lat_log);
+    sink_log_clear(&s_dl_log);
+    sink_log_clear(&s_scan_log);
     memset(&s_wdinfo, 0, sizeof(s_wdinfo));
     memset(s_scan_buf, 0, sizeof(s_scan_buf));
-    s_wifi_ok = s_ip_ok = s_wd_ok = s_wdinfo_valid = false;
+    s_wifi_ok = s_ip_ok = s_wd_ok = s_wdinfo_valid = s_probes_valid = false;
+    s_stage_count = 0;
     strcpy(s_ip_str, "N/A");
 
-    // write the header with placeholder values that we'll patch in later
-    rpos += snprintf(s_report + rpos, sizeof(s_report) - rpos,
-                     "=== NETWORK TEST ===\n"
-                     "WiiMedic Version:    v%-14s\n"
-                     "WiFi Module:         Searching...   \n"
-                     "IP Address:          Searching...   \n\n",
-                     WIIMEDIC_VERSION);
-
+    // the header (driver and IP status) is only known at the end, so
+    // get_network_test_report writes it from state ahead of this log
     // clean slate for the network stack before we try anything
+    stage_begin("Stack reset");
     net_deinit();
-    wait_frames(30);
+    stage_end();
 
-    s32 ret = do_net_init();
+    stage_begin("Network init");
+    s32 ret = net_init_ready(NET_READY_MS);
+    stage_end();
 
     if (ret < 0) {
         last_err = ret;
@@ -386,14 +1626,15 @@ void run_network_test(void) {
     } else {
         s_wifi_ok = true;
         ui_draw_ok("WiFi module initialized");
+        stage_begin("Connectivity probes");
         run_connectivity();
+        stage_end();
         net_deinit();
     }
 
     // --- WiFi Card Info + AP Scan ---
     // WD needs the radio free from net_init before it can do anything
 
-    wait_frames(60);
     ui_draw_section("WiFi Card Info");
     ui_draw_info("Reading card info and scanning for APs...");
     ui_printf("\n");
@@ -404,20 +1645,22 @@ void run_network_test(void) {
         bool wd_ready = false;
 
         // try mode 0 first (normal), fall back to AOSSAPScan if that fails
-        if (WD_Init(0) == 0)          wd_ready = true;
-        if (!wd_ready && WD_Init(AOSSAPScan) == 0) wd_ready = true;
+        stage_begin("WiFi driver init");
+        wd_ready = wd_init_ready(-1, WD_READY_MS);
+        stage_end();
 
         if (!wd_ready) {
             ui_draw_err("WiFi driver init failed (WD_Init returned error)");
-            rpos += snprintf(s_report + rpos, sizeof(s_report) - rpos,
-                             "WiFi Driver: FAILED\n");
+            sink_kv(rep, "WiFi Driver", "FAILED");
+            sink_field_bool(rep, "driver_ok", false);
         } else {
             s_wd_ok = true;
-            wait_frames(30);
 
             // grab card info
-            memset(&s_wdinfo, 0, sizeof(s_wdinfo));
-            if (WD_GetInfo(&s_wdinfo) == 0) {
+            stage_begin("Card info");
+            s32 info_ret = wd_info_ready(WD_READY_MS);
+            stage_end();
+            if (info_ret == 0) {
                 int ci, ch_pos = 0;
                 bool mac_ok = false;
                 int i;
@@ -471,53 +1714,50 @@ void run_network_test(void) {
 
                     ui_draw_ok("Card info read successfully");
 
-                    rpos += snprintf(s_report + rpos, sizeof(s_report) - rpos,
-                                     "MAC Address:         %s\n"
-                                     "Firmware:            %s\n"
-                                     "Current Channel:     %d\n"
-                                     "Enabled Channels:    %s\n",
-                                     mac_str, (const char *)s_wdinfo.version,
-                                     s_wdinfo.channel, chan_buf);
+                    sink_kv(rep, "MAC Address", "%s", mac_str);
+                    sink_kv(rep, "Firmware", "%s", (const char *)s_wdinfo.version);
+                    sink_kv(rep, "Current Channel", "%d", s_wdinfo.channel);
+                    sink_kv(rep, "Enabled Channels", "%s", chan_buf);
+                    sink_field_bool(rep, "driver_ok",    true);
+                    sink_field_str(rep,  "mac",          mac_str);
+                    sink_field_str(rep,  "firmware",     (const char *)s_wdinfo.version);
+                    sink_field_int(rep,  "channel",      s_wdinfo.channel);
+                    sink_field_int(rep,  "channel_mask", s_wdinfo.EnableChannelsMask);
                 } else {
                     ui_draw_warn("Card info came back invalid (bad MAC or channel)");
-                    rpos += snprintf(s_report + rpos, sizeof(s_report) - rpos,
-                                     "WiFi Card Info: INVALID\n");
+                    sink_kv(rep, "WiFi Card Info", "INVALID");
+                    sink_field_bool(rep, "driver_ok", true);
                 }
             } else {
                 ui_draw_err("WD_GetInfo failed");
-                rpos += snprintf(s_report + rpos, sizeof(s_report) - rpos,
-                                 "WiFi Card Info: FAILED\n");
+                sink_kv(rep, "WiFi Card Info", "FAILED");
+                sink_field_bool(rep, "driver_ok", true);
             }
 
             // AP scan - some IOS versions specifically need AOSSAPScan mode for this
             ui_draw_section("Nearby Access Points");
             ui_draw_info("Scanning...");
 
+            stage_begin("Driver switch to scan mode");
             WD_Deinit();
-            wait_frames(30);
-            WD_Init(AOSSAPScan);
+            wd_init_ready(AOSSAPScan, WD_READY_MS);
+            stage_end();
 
             {
-                ScanParameters sp;
-                WD_SetDefaultScanParameters(&sp);
-                sp.MaxChannelTime  = 400;
-                sp.ChannelBitmap   = 0x3FFF;  // scan all 14 channels
-                memset(s_scan_buf, 0, sizeof(s_scan_buf));
-
-                s32 scan_ret = WD_ScanOnce(&sp, s_scan_buf, sizeof(s_scan_buf));
-
-                // retry once if the results look empty
-                if (scan_ret >= 0 && s_scan_buf[0] == 0 && s_scan_buf[1] == 0) {
-                    wait_frames(45);
-                    scan_ret = WD_ScanOnce(&sp, s_scan_buf, sizeof(s_scan_buf));
-                }
-
-                parse_and_display_aps(&rpos, s_scan_buf, scan_ret);
+                stage_begin("AP scan");
+                s32 scan_ret = scan_once();
+                stage_end();
+
+                // release the driver so net_init can use the hardware again.
+                // that's a slow IOS call and the parse only touches our copy
+                // of the results, so do both at once
+                stage_begin("Driver release + AP parse");
+                job_start(wd_release_thread);
+                scan_parse(s_scan_buf, scan_ret);
+                show_aps(rep, scan_ret);
+                job_join();
+                stage_end();
             }
-
-            // release the driver so net_init can use the hardware again
-            WD_Deinit();
-            wait_frames(60);
         }
     }
 
@@ -526,15 +1766,17 @@ void run_network_test(void) {
     if (!s_wifi_ok) {
         ui_draw_section("Network Connectivity (Retry)");
         ui_draw_info("Trying again after WD release...");
-        wait_frames(60);
         net_deinit();
-        wait_frames(30);
 
-        s32 ret2 = do_net_init();
+        stage_begin("Network init (retry)");
+        s32 ret2 = net_init_ready(NET_READY_MS);
+        stage_end();
         if (ret2 >= 0) {
             s_wifi_ok = true;
             ui_draw_ok("Connected on retry!");
+            stage_begin("Connectivity probes");
             run_connectivity();
+            stage_end();
             net_deinit();
         } else {
             last_err = ret2;
@@ -553,19 +1795,65 @@ void run_network_test(void) {
 
     // build report connectivity section
     if (s_wifi_ok) {
-        rpos += snprintf(s_report + rpos, sizeof(s_report) - rpos,
-                         "\n=== NETWORK CONNECTIVITY ===\nWiFi Status: Connected\n"
-                         "IP Address: %s\n", s_ip_str);
+        sink_end(rep);
+        sink_section(rep, "NETWORK CONNECTIVITY");
+        sink_kv(rep, "WiFi Status", "Connected");
+        sink_kv(rep, "IP Address", "%s", s_ip_str);
+        sink_field_bool(rep, "connected", true);
+        sink_field_str(rep, "ip", s_ip_str);
+        if (s_probes_valid) {
+            int i;
+            sink_list(rep, "probes");
+            for (i = 0; i < s_num_targets; i++) {
+                const probe_result *r = &s_probes[i];
+                sink_text(rep, "  %-14s port %-5u %-18s %7.1f ms\n",
+                          s_targets[i].label, s_targets[i].port,
+                          probe_state_str(r->state), (float)r->us / 1000.0f);
+                sink_item(rep);
+                sink_field_str(rep, "target", s_targets[i].label);
+                sink_field_int(rep, "port",   s_targets[i].port);
+                sink_field_bool(rep, "ok",    r->state == PROBE_OK);
+                sink_field_str(rep, "state",  probe_state_str(r->state));
+                sink_field_num(rep, "ms",     (float)r->us / 1000.0f);
+            }
+            sink_list_end(rep);
+            sink_text(rep, "  (all probes finished in %u ms)\n", s_probe_total_ms);
+            sink_field_int(rep, "probe_total_ms", s_probe_total_ms);
+        }
     } else {
-        rpos += snprintf(s_report + rpos, sizeof(s_report) - rpos,
-                         "\n=== NETWORK CONNECTIVITY ===\nWiFi Status: FAILED (error %d)\n",
-                         last_err);
+        sink_end(rep);
+        sink_section(rep, "NETWORK CONNECTIVITY");
+        sink_kv(rep, "WiFi Status", "FAILED (error %d)", (int)last_err);
+        sink_field_bool(rep, "connected", false);
+        sink_field_int(rep, "error", last_err);
         if (last_err == -24)
-            rpos += snprintf(s_report + rpos, sizeof(s_report) - rpos,
-                             "  (error -24 = no connection configured in Wii Settings)\n");
+            sink_text(rep, "  (error -24 = no connection configured in Wii Settings)\n");
         else if (last_err == -116)
-            rpos += snprintf(s_report + rpos, sizeof(s_report) - rpos,
-                             "  (error -116 = connection timed out)\n");
+            sink_text(rep, "  (error -116 = connection timed out)\n");
+    }
+
+    ui_draw_section("Stage Timings");
+    {
+        u32 total = 0;
+        int i;
+        char buf[32];
+
+        sink_subsection(rep, "Stage Timings");
+        sink_list(rep, "stages");
+        for (i = 0; i < s_stage_count; i++) {
+            snprintf(buf, sizeof(buf), "%u ms", s_stages[i].ms);
+            ui_draw_kv(s_stages[i].name, buf);
+            sink_text(rep, "  %-28s %6u ms\n", s_stages[i].name, s_stages[i].ms);
+            sink_item(rep);
+            sink_field_str(rep, "name", s_stages[i].name);
+            sink_field_int(rep, "ms",   s_stages[i].ms);
+            total += s_stages[i].ms;
+        }
+        snprintf(buf, sizeof(buf), "%u ms", total);
+        ui_draw_kv_color("Total", UI_BWHITE, buf);
+        sink_list_end(rep);
+        sink_text(rep, "  %-28s %6u ms\n", "Total", total);
+        sink_field_int(rep, "stages_total_ms", total);
     }
 
     ui_draw_section("WiFi Notes");
@@ -574,23 +1862,7 @@ void run_network_test(void) {
     ui_draw_info("WPA3, WPA Enterprise, and captive portals won't work");
     ui_draw_info("Wiimmfi needs ports 28910 and 29900-29901 open on your router");
 
-    // patch the header placeholders now that we have final status
-    {
-        char *p = strstr(s_report, "Searching...   ");
-        if (p) {
-            char tmp[16];
-            snprintf(tmp, sizeof(tmp), "%-14s", s_wd_ok ? "Working" : "Failed");
-            memcpy(p, tmp, 14);
-
-            p = strstr(p + 14, "Searching...   ");
-            if (p) {
-                snprintf(tmp, sizeof(tmp), "%-14s", s_ip_str);
-                memcpy(p, tmp, 14);
-            }
-        }
-    }
-
-    rpos += snprintf(s_report + rpos, sizeof(s_report) - rpos, "\n");
+    sink_end(rep);
 
     ui_printf("\n");
     ui_draw_ok("Network test complete");
@@ -598,7 +1870,172 @@ void run_network_test(void) {
 }
 
 
-void get_network_test_report(char *buf, int bufsize) {
-    strncpy(buf, s_report, bufsize - 1);
-    buf[bufsize - 1] = '\0';
+// scan over and over so you can walk the Wii around, or watch what
+// changes when a neighbour's router comes and goes. each round is diffed
+// against the one before it.
+// one round on its own page so rounds can be compared as they come in -
+// the scroll buffer only shows up after Done. A scans again, B stops.
+static bool scan_round_page(int round, s32 scan_ret, int best, u32 score) {
+    char title[32], buf[48];
+    int i;
+
+    ui_live_begin();
+    ui_printf(UI_BGREEN " [+] WiiMedic" UI_RESET " " UI_CYAN "v" WIIMEDIC_VERSION UI_RESET
+              "  " UI_BWHITE "Repeated AP Scan\n" UI_RESET);
+    ui_printf(UI_WHITE " -----------------------------------------------------------\n" UI_RESET);
+
+    snprintf(title, sizeof(title), "Scan #%d", round);
+    ui_draw_section(title);
+    if (scan_ret < 0) {
+        snprintf(buf, sizeof(buf), "AP scan failed (error %d)", (int)scan_ret);
+        ui_draw_err(buf);
+    } else {
+        snprintf(buf, sizeof(buf), "%d", s_ap_count);
+        ui_draw_kv("Access Points", buf);
+        snprintf(buf, sizeof(buf), "%d (score %u)", best, score);
+        ui_draw_kv_color("Best Channel", score == 0 ? UI_BGREEN : UI_BWHITE, buf);
+
+        for (i = 0; i < s_ap_count && i < ROUND_AP_ROWS; i++) {
+            ap_record *ap = &s_aps[i];
+            char line[96];
+            snprintf(line, sizeof(line), "%-24s Ch:%-2d  Sig:%s",
+                     ap->ssid, ap->channel, signal_str(ap->sig));
+            if (ap->sig >= 2) ui_draw_ok(line);
+            else if (ap->sig == 1) ui_draw_warn(line);
+            else ui_draw_err(line);
+        }
+        if (s_ap_count > ROUND_AP_ROWS)
+            ui_printf(UI_WHITE "   ... %d more\n" UI_RESET, s_ap_count - ROUND_AP_ROWS);
+    }
+    if (round > 1)
+        compare_scans(NULL, ROUND_DIFF_ROWS);
+
+    ui_printf("\n" UI_WHITE " -----------------------------------------------------------\n" UI_RESET);
+    ui_printf(UI_WHITE " [A] Scan again   [B] Done\n" UI_RESET);
+
+    while (1) {
+        u32 wpad, gpad;
+        WPAD_ScanPads();
+        PAD_ScanPads();
+        wpad = WPAD_ButtonsDown(0);
+        gpad = PAD_ButtonsDown(0);
+        if ((wpad & WPAD_BUTTON_A) || (gpad & PAD_BUTTON_A)) break;
+        if ((wpad & WPAD_BUTTON_B) || (gpad & PAD_BUTTON_B)) {
+            ui_live_end("Network Connectivity");
+            return false;
+        }
+        VIDEO_WaitVSync();
+    }
+
+    ui_live_end("Network Connectivity");
+    return true;
+}
+
+static void run_scan_loop(void) {
+    PROF_FUNC();
+    report_sink *rep = &s_scan_log.sink;
+    int round = 0;
+
+    logs_init();
+    sink_log_clear(&s_scan_log);
+    sink_section(rep, "REPEATED AP SCAN");
+
+    ui_draw_section("Repeated AP Scan");
+    net_deinit();
+    if (!wd_init_ready(AOSSAPScan, WD_READY_MS)) {
+        ui_draw_err("Could not start the WiFi driver in scan mode");
+        sink_text(rep, "  WiFi driver failed to start\n");
+        sink_field_bool(rep, "driver_ok", false);
+        sink_end(rep);
+        return;
+    }
+
+    sink_field_bool(rep, "driver_ok", true);
+    sink_list(rep, "rounds");
+    s_prev_count = 0;
+    while (1) {
+        char title[32];
+        u32 score;
+        s32 scan_ret;
+        int best;
+
+        round++;
+        snprintf(title, sizeof(title), "Scan #%d", round);
+        ui_draw_section(title);
+        ui_spin_set_msg("Scanning...");
+
+        memcpy(s_prev_aps, s_aps, sizeof(s_aps));
+        s_prev_count = round > 1 ? s_ap_count : 0;
+
+        scan_ret = scan_once();
+        scan_parse(s_scan_buf, scan_ret);
+
+        // the full list of every round won't fit in the report, so only
+        // one summary line per round goes there
+        show_aps(NULL, scan_ret);
+        best = best_channel(&score);
+        sink_text(rep, "Round %d: %d AP(s), best channel %d (score %u)\n",
+                  round, s_ap_count, best, score);
+        sink_item(rep);
+        sink_field_int(rep, "round",              round);
+        sink_field_int(rep, "aps",                s_ap_count);
+        sink_field_int(rep, "best_channel",       best);
+        sink_field_int(rep, "best_channel_score", score);
+        if (round > 1)
+            compare_scans(rep, MAX_SCAN_APS * 2);
+
+        if (!scan_round_page(round, scan_ret, best, score)) break;
+    }
+
+    sink_list_end(rep);
+    sink_end(rep);
+    WD_Deinit();
+}
+
+
+void run_network_menu(void) {
+    static const char *modes[] = {
+        "Standard test (WiFi, IP, connectivity, AP scan)",
+        "Latency & jitter (100 connects per target)",
+        "Download speed (10 MB over HTTP)",
+        "Download read-size sweep (1-32 KB reads)",
+        "Repeated AP scan (channel congestion)"
+    };
+    int mode = ui_choose("Network Connectivity", modes, 5);
+
+    if (mode < 0) ui_draw_info("Cancelled.");
+    else if (mode == 0) run_network_test();
+    else if (mode == 1) run_latency_test();
+    else if (mode == 4) run_scan_loop();
+    else run_download_test(mode == 3);
+}
+
+
+void get_network_test_report(report_sink *sink) {
+    PROF_FUNC();
+    logs_init();
+    sink_section(sink, "NETWORK TEST");
+
+    if (!s_test_done && sink_log_empty(&s_lat_log) &&
+        sink_log_empty(&s_dl_log) && sink_log_empty(&s_scan_log)) {
+        sink_text(sink, "Not run yet. Run Network Test from main menu for full data.\n");
+        sink_field_bool(sink, "run", false);
+        sink_end(sink);
+        return;
+    }
+
+    sink_kv(sink, "WiiMedic Version", "v%s", WIIMEDIC_VERSION);
+    sink_field_bool(sink, "run", s_test_done);
+    if (s_test_done) {
+        sink_kv(sink, "WiFi Module", "%s", s_wd_ok ? "Working" : "Failed");
+        sink_kv(sink, "IP Address", "%s", s_ip_str);
+        sink_field_bool(sink, "wifi_module_ok", s_wd_ok);
+        sink_log_replay(&s_log, sink);
+    } else {
+        sink_text(sink, "Standard test not run, only the extra modes below.\n");
+        sink_end(sink);
+    }
+    sink_log_replay(&s_lat_log, sink);
+    sink_log_replay(&s_dl_log, sink);
+    sink_log_replay(&s_scan_log, sink);
 }
@@ -5,13 +5,47 @@
 #ifndef NETWORK_TEST_H
 #define NETWORK_TEST_H
 
+#include "report_sink.h"
+
 // Run the network connectivity test
 void run_network_test(void);
 
-// Get network test report as string
-void get_network_test_report(char *buf, int bufsize);
+// Ask which network test to run (standard or latency) and run it
+void run_network_menu(void);
+
+// Emit the network test report section into a sink
+void get_network_test_report(report_sink *sink);
 
 // Check if the network test has already been run in this session
 bool has_network_test_run(void);
 
+// Result cache key for the report: the saved connection settings and the
+// probe targets. 0 if the settings can't be read
+u64 get_network_test_cache_key(void);
+
+// Probe host:port instead of the built-in online services (the essential
+// Google DNS and Cloudflare probes stay). host can be a name or a dotted
+// IP. Returns false once MAX_TARGETS probes are set up
+bool add_network_probe(const char *label, const char *host, u16 port, bool essential);
+
+// Streaming HTTP POST (chunked) for sending the report off the console
+typedef struct {
+    s32  sock;
+    s32  err;       // first net_* error, 0 if none
+    int  status;    // HTTP status of the reply, 0 if there wasn't one
+    u32  sent;      // body bytes sent
+} net_upload;
+
+// Brings up the network, connects to url (http://host[:port]/path) and
+// sends the request headers. False if any of that failed
+bool net_upload_begin(net_upload *u, const char *url, const char *content_type);
+
+// Sends data as one chunk. ctx is the net_upload; the signature matches
+// sink_file_tap so the file sink can feed it straight from its buffer
+void net_upload_chunk(void *ctx, const char *data, u32 len);
+
+// Ends the body, reads the reply and takes the network down again.
+// True if everything went and the server said 2xx
+bool net_upload_finish(net_upload *u);
+
 #endif // NETWORK_TEST_H
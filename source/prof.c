@@ -0,0 +1,145 @@
+// prof.c
+// where does the time actually go on a real console? every ISFS, ES, WD,
+// socket and libfat call goes through a PROF_CALL (see prof_calls.h) and
+// every module entry point through PROF_FUNC, each with its own little
+// counter: hits, total ticks and the worst single call. it's one timebase
+// read either side of the call, nothing next to an IPC round-trip.
+//
+// results screens can show the top sites as an overlay ([1] toggles it,
+// [2] zeroes the counters), and while it's on the report gets the whole
+// table too - so two reports from consoles on different IOS versions show
+// which calls got slower.
+
+#include <gccore.h>
+#include <ogc/lwp_watchdog.h>
+#include <ogc/machine/processor.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "prof.h"
+#include "report_sink.h"
+#include "ui_common.h"
+
+#define PROF_MAX_SORTED 256
+
+static prof_site *s_sites = NULL;
+static bool       s_shown = false;
+
+
+void prof_end(prof_timer *t) {
+    u64 dt = gettime() - t->t0;
+    prof_site *s = t->site;
+    u32 level;
+
+    // the report runs modules on several threads at once
+    _CPU_ISR_Disable(level);
+    if (!s->linked) {
+        s->linked = true;
+        s->next   = s_sites;
+        s_sites   = s;
+    }
+    s->count++;
+    s->total += dt;
+    if (dt > s->max) s->max = dt;
+    _CPU_ISR_Restore(level);
+}
+
+
+void prof_reset(void) {
+    prof_site *s;
+    u32 level;
+
+    _CPU_ISR_Disable(level);
+    for (s = s_sites; s; s = s->next) {
+        s->count = 0;
+        s->total = s->max = 0;
+    }
+    _CPU_ISR_Restore(level);
+}
+
+
+bool prof_shown(void)  { return s_shown; }
+void prof_toggle(void) { s_shown = !s_shown; }
+
+
+// "fopen storage_test.c:412" - __FILE__ comes with the whole build path
+static void site_label(const prof_site *s, char *out, int outsize) {
+    const char *base = strrchr(s->file, '/');
+    snprintf(out, outsize, "%s %s:%d", s->name, base ? base + 1 : s->file, s->line);
+}
+
+// sites that have been hit, most total time first. insertion sort is fine,
+// there are a couple of hundred sites at most and this is never hot
+static int sorted_sites(prof_site **out, int max) {
+    prof_site *s;
+    int n = 0, i;
+
+    if (max <= 0) return 0;
+    for (s = s_sites; s; s = s->next) {
+        if (s->count == 0) continue;
+        if (n == max) {
+            if (out[max - 1]->total >= s->total) continue;
+            n--;    // the smallest one drops off the end
+        }
+        for (i = n; i > 0 && out[i - 1]->total < s->total; i--)
+            out[i] = out[i - 1];
+        out[i] = s;
+        n++;
+    }
+    return n;
+}
+
+
+void prof_draw_overlay(int rows) {
+    static prof_site *top[PROF_MAX_SORTED];
+    char label[48];
+    int n, i;
+
+    n = sorted_sites(top, rows < PROF_MAX_SORTED ? rows : PROF_MAX_SORTED);
+
+    ui_printf(UI_BYELLOW " %-38s %6s %9s %8s\n" UI_RESET, "Call timing ([2] resets)", "calls", "total ms", "max ms");
+    for (i = 0; i < rows; i++) {
+        if (i >= n) {
+            ui_printf("\n");
+            continue;
+        }
+        site_label(top[i], label, sizeof(label));
+        ui_printf(UI_WHITE " %-38.38s %6u %9.1f %8.2f\n" UI_RESET, label, top[i]->count,
+                  (float)ticks_to_microsecs(top[i]->total) / 1000.0f,
+                  (float)ticks_to_microsecs(top[i]->max) / 1000.0f);
+    }
+}
+
+
+void get_prof_report(report_sink *sink) {
+    static prof_site *all[PROF_MAX_SORTED];
+    char label[48];
+    int n, i;
+
+    n = sorted_sites(all, PROF_MAX_SORTED);
+
+    sink_section(sink, "CALL TIMING");
+    sink_kv(sink, "Running IOS", "IOS%d v%d", IOS_GetVersion(), IOS_GetRevision());
+    sink_field_int(sink, "ios", IOS_GetVersion());
+    sink_field_int(sink, "ios_revision", IOS_GetRevision());
+    sink_text(sink, "%-40s %7s %10s %9s\n", "Call site", "Calls", "Total ms", "Max ms");
+
+    sink_list(sink, "sites");
+    for (i = 0; i < n; i++) {
+        const prof_site *s = all[i];
+        site_label(s, label, sizeof(label));
+        sink_text(sink, "%-40s %7u %10.1f %9.2f\n", label, s->count,
+                  (float)ticks_to_microsecs(s->total) / 1000.0f,
+                  (float)ticks_to_microsecs(s->max) / 1000.0f);
+        sink_item(sink);
+        sink_field_str(sink, "call", s->name);
+        sink_field_str(sink, "file", strrchr(s->file, '/') ? strrchr(s->file, '/') + 1 : s->file);
+        sink_field_int(sink, "line", s->line);
+        sink_field_int(sink, "count", s->count);
+        sink_field_int(sink, "total_us", (s64)ticks_to_microsecs(s->total));
+        sink_field_int(sink, "max_us", (s64)ticks_to_microsecs(s->max));
+    }
+    sink_list_end(sink);
+    sink_end(sink);
+}
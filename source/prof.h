@@ -0,0 +1,64 @@
+/*
+ * WiiMedic - prof.h
+ * Per-call-site timers for IOS calls and module entry points
+ */
+#ifndef PROF_H
+#define PROF_H
+
+#include <gccore.h>
+#include <ogc/lwp_watchdog.h>
+
+#include "report_sink.h"
+
+// One of these lives next to every timed call. Sites link themselves into
+// a global list the first time they're hit, so nothing needs registering
+typedef struct prof_site prof_site;
+struct prof_site {
+    const char *name;
+    const char *file;
+    int         line;
+    u32         count;
+    u64         total;      // ticks
+    u64         max;
+    prof_site  *next;
+    bool        linked;
+};
+
+typedef struct {
+    prof_site *site;
+    u64        t0;
+} prof_timer;
+
+static inline prof_timer prof_begin(prof_site *site) {
+    prof_timer t = { site, gettime() };
+    return t;
+}
+
+// Adds the time since prof_begin to the site (safe from any thread)
+void prof_end(prof_timer *t);
+
+// Times the rest of the enclosing block, however it's left
+#define PROF_SCOPE(label) \
+    static prof_site _prof_site = { label, __FILE__, __LINE__, 0, 0, 0, NULL, false }; \
+    prof_timer _prof_t __attribute__((cleanup(prof_end))) = prof_begin(&_prof_site)
+
+// Times the enclosing function, for module entry points
+#define PROF_FUNC() PROF_SCOPE(__func__)
+
+// Times one call and evaluates to its result (void calls work too)
+#define PROF_CALL(label, call) ({ PROF_SCOPE(label); call; })
+
+// Zero every site (they stay linked)
+void prof_reset(void);
+
+// The timing overlay on the results screen; also puts the table in the report
+bool prof_shown(void);
+void prof_toggle(void);
+
+// Draws the `rows` sites with the most total time, one line each
+void prof_draw_overlay(int rows);
+
+// Emit every site that was hit, most total time first
+void get_prof_report(report_sink *sink);
+
+#endif // PROF_H
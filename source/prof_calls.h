@@ -0,0 +1,67 @@
+/*
+ * WiiMedic - prof_calls.h
+ * Wraps every ISFS/ES/WD/net/FAT call made in a file with a call-site timer
+ *
+ * Include it LAST, after every system header. The macros take over the
+ * function names from here down, so a prototype that came in after this
+ * would be mangled. A macro's own name isn't expanded again inside it, so
+ * each wrapper still ends up calling the real function.
+ */
+#ifndef PROF_CALLS_H
+#define PROF_CALLS_H
+
+#include "prof.h"
+
+// NAND filesystem
+#define ISFS_Initialize(...)    PROF_CALL("ISFS_Initialize", ISFS_Initialize(__VA_ARGS__))
+#define ISFS_Deinitialize(...)  PROF_CALL("ISFS_Deinitialize", ISFS_Deinitialize(__VA_ARGS__))
+#define ISFS_Open(...)          PROF_CALL("ISFS_Open", ISFS_Open(__VA_ARGS__))
+#define ISFS_Close(...)         PROF_CALL("ISFS_Close", ISFS_Close(__VA_ARGS__))
+#define ISFS_Read(...)          PROF_CALL("ISFS_Read", ISFS_Read(__VA_ARGS__))
+#define ISFS_ReadDir(...)       PROF_CALL("ISFS_ReadDir", ISFS_ReadDir(__VA_ARGS__))
+#define ISFS_GetUsage(...)      PROF_CALL("ISFS_GetUsage", ISFS_GetUsage(__VA_ARGS__))
+#define ISFS_GetFileStats(...)  PROF_CALL("ISFS_GetFileStats", ISFS_GetFileStats(__VA_ARGS__))
+
+// titles
+#define ES_GetNumTitles(...)     PROF_CALL("ES_GetNumTitles", ES_GetNumTitles(__VA_ARGS__))
+#define ES_GetTitles(...)        PROF_CALL("ES_GetTitles", ES_GetTitles(__VA_ARGS__))
+#define ES_GetStoredTMDSize(...) PROF_CALL("ES_GetStoredTMDSize", ES_GetStoredTMDSize(__VA_ARGS__))
+#define ES_GetStoredTMD(...)     PROF_CALL("ES_GetStoredTMD", ES_GetStoredTMD(__VA_ARGS__))
+#define ES_GetDeviceID(...)      PROF_CALL("ES_GetDeviceID", ES_GetDeviceID(__VA_ARGS__))
+
+// wireless driver
+#define WD_Init(...)            PROF_CALL("WD_Init", WD_Init(__VA_ARGS__))
+#define WD_Deinit(...)          PROF_CALL("WD_Deinit", WD_Deinit(__VA_ARGS__))
+#define WD_ScanOnce(...)        PROF_CALL("WD_ScanOnce", WD_ScanOnce(__VA_ARGS__))
+#define WD_GetInfo(...)         PROF_CALL("WD_GetInfo", WD_GetInfo(__VA_ARGS__))
+
+// sockets
+#define net_init(...)           PROF_CALL("net_init", net_init(__VA_ARGS__))
+#define net_deinit(...)         PROF_CALL("net_deinit", net_deinit(__VA_ARGS__))
+#define net_gethostip(...)      PROF_CALL("net_gethostip", net_gethostip(__VA_ARGS__))
+#define net_gethostbyname(...)  PROF_CALL("net_gethostbyname", net_gethostbyname(__VA_ARGS__))
+#define net_socket(...)         PROF_CALL("net_socket", net_socket(__VA_ARGS__))
+#define net_connect(...)        PROF_CALL("net_connect", net_connect(__VA_ARGS__))
+#define net_send(...)           PROF_CALL("net_send", net_send(__VA_ARGS__))
+#define net_recv(...)           PROF_CALL("net_recv", net_recv(__VA_ARGS__))
+#define net_poll(...)           PROF_CALL("net_poll", net_poll(__VA_ARGS__))
+#define net_close(...)          PROF_CALL("net_close", net_close(__VA_ARGS__))
+
+// SD/USB through libfat
+#define fatInitDefault(...)     PROF_CALL("fatInitDefault", fatInitDefault(__VA_ARGS__))
+#define fatMountSimple(...)     PROF_CALL("fatMountSimple", fatMountSimple(__VA_ARGS__))
+#define fopen(...)              PROF_CALL("fopen", fopen(__VA_ARGS__))
+#define fclose(...)             PROF_CALL("fclose", fclose(__VA_ARGS__))
+#define fread(...)              PROF_CALL("fread", fread(__VA_ARGS__))
+#define fwrite(...)             PROF_CALL("fwrite", fwrite(__VA_ARGS__))
+#define fseek(...)              PROF_CALL("fseek", fseek(__VA_ARGS__))
+#define fsync(...)              PROF_CALL("fsync", fsync(__VA_ARGS__))
+#define opendir(...)            PROF_CALL("opendir", opendir(__VA_ARGS__))
+#define readdir(...)            PROF_CALL("readdir", readdir(__VA_ARGS__))
+#define closedir(...)           PROF_CALL("closedir", closedir(__VA_ARGS__))
+#define stat(...)               PROF_CALL("stat", stat(__VA_ARGS__))
+#define statvfs(...)            PROF_CALL("statvfs", statvfs(__VA_ARGS__))
+#define mkdir(...)              PROF_CALL("mkdir", mkdir(__VA_ARGS__))
+#define remove(...)             PROF_CALL("remove", remove(__VA_ARGS__))
+
+#endif // PROF_CALLS_H
@@ -2,14 +2,16 @@
 // runs all the diagnostic modules and saves everything to a text file on SD or USB.
 // if a module has already been run from the main menu, we use the cached results
 // instead of running it again. saves time and avoids hammering the NAND twice.
+// results also get saved on the card (see result_cache.c), so the next report
+// on the same console only re-runs the modules whose inputs have changed.
 
+#include <errno.h>
 #include <fat.h>
 #include <gccore.h>
 #include <malloc.h>
 #include <network.h>
 #include <ogc/lwp.h>
 #include <ogc/lwp_watchdog.h>
-#include <stdarg.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -22,20 +24,62 @@
 #include "nand_health.h"
 #include "network_test.h"
 #include "report.h"
+#include "report_sink.h"
+#include "result_cache.h"
 #include "storage_test.h"
+#include "subsys.h"
 #include "system_info.h"
+#include "task_sched.h"
 #include "ui_common.h"
 
+// last, it wraps the IOS and libfat calls by name
+#include "prof_calls.h"
+
 #define REPORT_PATH_SD  "sd:/WiiMedic_Report.txt"
 #define REPORT_PATH_USB "usb:/WiiMedic_Report.txt"
 
-
-static void report_write(FILE *fp, const char *fmt, ...) {
-    if (!fp) return;
-    va_list args;
-    va_start(args, fmt);
-    vfprintf(fp, fmt, args);
-    va_end(args);
+#define HOUR_SECS (60 * 60)
+
+// one row per report section, in file order. cache_name NULL means never
+// cached - those are quick, and what they read (settings, pads in hand)
+// can change without anything on the NAND or card changing
+typedef struct {
+    const char *name;       // what autorun.cfg calls it
+    const char *cache_name;
+    const char *task_name;
+    u32         needs;      // RES_* for the scheduler
+    u32         max_age;    // seconds a saved result is good for, 0 = until the key changes
+    u64       (*cache_key)(void);
+    bool      (*has_run)(void);
+    void      (*run)(void);
+    void      (*report)(report_sink *sink);
+} report_module;
+
+static const report_module s_modules[] = {
+    { "sysinfo",     NULL,      "System information", RES_ISFS | RES_ES, 0, NULL, NULL,
+      collect_system_info, get_system_info_report },
+    { "nand",        "nand",    "NAND health",        RES_ISFS | RES_ES, 0, get_nand_health_cache_key,
+      has_nand_health_run, run_nand_health, get_nand_health_report },
+    { "ios",         "ios",     "IOS scan",           RES_ISFS | RES_ES, 0, get_ios_check_cache_key,
+      has_ios_check_run, run_ios_quick_scan, get_ios_check_report },
+    // cards slow down as they wear, so redo it once a month regardless.
+    // on its own, so the KB/s that go into the history match a standalone run
+    { "storage",     "storage", "Storage benchmark",  RES_SOLO, 30 * 24 * HOUR_SECS, get_storage_test_cache_key,
+      has_storage_test_run, run_storage_quick, get_storage_test_report },
+    { "controllers", NULL,      "Controllers",        RES_WPAD, 0, NULL, NULL,
+      scan_controllers_quick, get_controller_test_report },
+    // the router or the ISP can change without the settings changing
+    { "network",     "network", "Network",            RES_WIFI, HOUR_SECS, get_network_test_cache_key,
+      has_network_test_run, run_network_test, get_network_test_report },
+};
+#define NUM_MODULES (int)(sizeof(s_modules) / sizeof(s_modules[0]))
+
+
+u32 report_module_bit(const char *name) {
+    int i;
+    for (i = 0; i < NUM_MODULES; i++)
+        if (strcmp(s_modules[i].name, name) == 0) return 1u << i;
+    return 0;
 }
 
 
@@ -64,6 +108,36 @@ static void next_available_filename(const char *dir, char *out, int outsize) {
 }
 
 
+// WiiMedic_Report_2.txt -> WiiMedic_Report_2.json
+static void json_report_path(const char *txt_path, char *out, int outsize) {
+    const char *dot = strrchr(txt_path, '.');
+    int len = dot ? (int)(dot - txt_path) : (int)strlen(txt_path);
+    snprintf(out, outsize, "%.*s.json", len, txt_path);
+}
+
+
+// writes one module's section. saved ones get replayed; live ones go out
+// as they are and are recorded for next time on the way through
+static void emit_module(const report_module *m, u64 key, bool cached, report_sink *out) {
+    static sink_tee rec;
+    sink_log *log = NULL;
+
+    if (cached) {
+        rcache_replay(m->cache_name, out);
+        return;
+    }
+    // a module that never got to run only has "not run yet" to say
+    if (m->cache_name && key && m->has_run())
+        log = rcache_store(m->cache_name, key);
+    if (!log) {
+        m->report(out);
+        return;
+    }
+    sink_tee_init(&rec, out, &log->sink);
+    m->report(&rec.sink);
+}
+
+
 // shows a little menu when we find an existing report.
 // returns 0 = replace, 1 = keep both, 2 = cancel
 static int ask_what_to_do(const char *path, long size) {
@@ -74,24 +148,25 @@ static int ask_what_to_do(const char *path, long size) {
     while (1) {
         u32 wpad, gpad;
 
-        printf("\x1b[2J\x1b[0;0H");
-        printf(UI_BGREEN " [+] WiiMedic" UI_RESET " " UI_CYAN "v" WIIMEDIC_VERSION UI_RESET "\n");
-        printf(UI_WHITE " -----------------------------------------------------------\n" UI_RESET);
+        ui_frame_begin();
+        ui_printf(UI_BGREEN " [+] WiiMedic" UI_RESET " " UI_CYAN "v" WIIMEDIC_VERSION UI_RESET "\n");
+        ui_printf(UI_WHITE " -----------------------------------------------------------\n" UI_RESET);
 
-        printf("\n" UI_BYELLOW "   Found an existing report!\n\n" UI_RESET);
-        printf("   " UI_CYAN "File" UI_RESET " ......... " UI_BWHITE "%s\n" UI_RESET, path);
-        printf("   " UI_CYAN "Size" UI_RESET " ......... " UI_BWHITE "%s\n" UI_RESET, szstr);
-        printf("\n" UI_WHITE "   What do you want to do?\n\n" UI_RESET);
+        ui_printf("\n" UI_BYELLOW "   Found an existing report!\n\n" UI_RESET);
+        ui_printf("   " UI_CYAN "File" UI_RESET " ......... " UI_BWHITE "%s\n" UI_RESET, path);
+        ui_printf("   " UI_CYAN "Size" UI_RESET " ......... " UI_BWHITE "%s\n" UI_RESET, szstr);
+        ui_printf("\n" UI_WHITE "   What do you want to do?\n\n" UI_RESET);
 
-        printf(sel == 0 ? UI_BGREEN "   >> [1] Overwrite it\n"          UI_RESET
-                        : UI_WHITE  "      [1] Overwrite it\n"           UI_RESET);
-        printf(sel == 1 ? UI_BGREEN "   >> [2] Keep it, save new file alongside\n" UI_RESET
-                        : UI_WHITE  "      [2] Keep it, save new file alongside\n" UI_RESET);
-        printf(sel == 2 ? UI_BGREEN "   >> [3] Cancel\n"                UI_RESET
-                        : UI_WHITE  "      [3] Cancel\n"                 UI_RESET);
+        ui_printf(sel == 0 ? UI_BGREEN "   >> [1] Overwrite it\n"          UI_RESET
+                           : UI_WHITE  "      [1] Overwrite it\n"           UI_RESET);
+        ui_printf(sel == 1 ? UI_BGREEN "   >> [2] Keep it, save new file alongside\n" UI_RESET
+                           : UI_WHITE  "      [2] Keep it, save new file alongside\n" UI_RESET);
+        ui_printf(sel == 2 ? UI_BGREEN "   >> [3] Cancel\n"                UI_RESET
+                           : UI_WHITE  "      [3] Cancel\n"                 UI_RESET);
 
-        printf("\n" UI_WHITE " -----------------------------------------------------------\n" UI_RESET);
-        printf(UI_WHITE " [UP/DOWN] Choose   [A] Confirm   [B] Cancel\n" UI_RESET);
+        ui_printf("\n" UI_WHITE " -----------------------------------------------------------\n" UI_RESET);
+        ui_printf(UI_WHITE " [UP/DOWN] Choose   [A] Confirm   [B] Cancel\n" UI_RESET);
+        ui_frame_end();
 
         while (1) {
             bool brk = false;
@@ -120,19 +195,64 @@ static int ask_what_to_do(const char *path, long size) {
 }
 
 
+// a file per console, so one card can go round a whole bench of them
+static bool console_save_path(char *out, int outsize) {
+    static const char *roots[] = { "sd:", "usb:" };
+    u32 id = 0;
+    FILE *fp;
+    int i;
+
+    ES_GetDeviceID(&id);
+    for (i = 0; i < 2; i++) {
+        snprintf(out, outsize, "%s/WiiMedic_Report_%08X.txt", roots[i], (unsigned)id);
+        // append, so an old report only goes once there's a new one
+        fp = fopen(out, "a");
+        if (!fp) continue;
+        fclose(fp);
+        return true;
+    }
+    out[0] = '\0';
+    return false;
+}
+
+
 void run_report_generator(void) {
-    // static so we don't blow the stack - 8KB on the stack is a bad idea
-    static char section[8192];
+    report_opts opts;
+
+    memset(&opts, 0, sizeof(opts));
+    opts.modules   = REPORT_ALL;
+    opts.use_cache = true;
+    opts.existing  = REPORT_FILE_ASK;
+    report_generate(&opts);
+}
+
+
+bool report_generate(const report_opts *opts) {
+    // static, the file sink carries its own buffer pointer but the
+    // struct itself has no business being on the stack either
+    static sink_file   file, json_file;
+    static sink_screen screen;
+    static sink_json   json;
+    static sink_tee    tee, rest;
+    static sched_task  tasks[SCHED_MAX_TASKS];
     // save_path as a fixed buffer so we never have a dangling pointer
     static char save_path[256];
+    static char json_path[256];
+    static u64  keys[NUM_MODULES];
+    static bool cached[NUM_MODULES];
+    static net_upload upload;
+    bool json_ok, uploading = false, uploaded = false;
+    int ntasks, ncached, i;
     char buf[128];
     FILE *fp = NULL;
 
     ui_draw_info("This runs all diagnostic modules and saves results to SD/USB.");
-    ui_draw_info("If you already ran a module, we'll use those results.");
+    ui_draw_info("If you already ran a module, or nothing changed since the");
+    ui_draw_info("last report, we'll use those results.");
     ui_printf("\n");
 
     save_path[0] = '\0';
+    subsys_wait_fat();
 
     long existing_sd  = check_existing(REPORT_PATH_SD);
     long existing_usb = check_existing(REPORT_PATH_USB);
@@ -142,7 +262,10 @@ void run_report_generator(void) {
     // path of the existing report (points into REPORT_PATH_SD/USB literals)
     const char *existing_path = NULL;
 
-    if (existing_sd >= 0) {
+    if (opts->existing == REPORT_FILE_CONSOLE) {
+        // never asks, the same console just gets its file replaced
+        console_save_path(save_path, sizeof(save_path));
+    } else if (existing_sd >= 0) {
         existing_sz   = existing_sd;
         existing_path = REPORT_PATH_SD;
         base_dir      = "sd:";
@@ -153,15 +276,17 @@ void run_report_generator(void) {
     }
 
     if (existing_sz >= 0) {
-        // ask_what_to_do uses raw printf so we must NOT be in scroll mode.
-        // ui_scroll_view hasn't been entered yet at this point so we're fine,
-        // but call VIDEO_WaitVSync first to make sure the last frame is flushed.
-        VIDEO_WaitVSync();
-
-        int action = ask_what_to_do(existing_path, existing_sz);
+        // the dialog takes over the whole screen, so park the spinner and
+        // scroll capture while it's up
+        int action = opts->existing == REPORT_FILE_OVERWRITE ? 0 : 1;
+        if (opts->existing == REPORT_FILE_ASK) {
+            ui_live_begin();
+            action = ask_what_to_do(existing_path, existing_sz);
+            ui_live_end("Generate Full Report");
+        }
         if (action == 2) {
             ui_draw_info("Cancelled.");
-            return;
+            return false;
         } else if (action == 1) {
             // keep the old one, find a new numbered name
             next_available_filename(base_dir, save_path, sizeof(save_path));
@@ -170,7 +295,7 @@ void run_report_generator(void) {
             strncpy(save_path, existing_path, sizeof(save_path) - 1);
             save_path[sizeof(save_path) - 1] = '\0';
         }
-    } else {
+    } else if (opts->existing != REPORT_FILE_CONSOLE) {
         // no existing report - try SD first, then USB
         fp = fopen(REPORT_PATH_SD, "w");
         if (fp) {
@@ -189,128 +314,125 @@ void run_report_generator(void) {
     if (save_path[0] == '\0') {
         ui_draw_err("No writable storage found!");
         ui_draw_warn("Insert an SD card or USB drive and try again.");
-        return;
+        return false;
     }
 
-    // clear the dialog off screen and show something immediately so the
-    // user knows we're working - on real hardware the first module takes
-    // a second or two to init and it looks totally frozen without this
-    printf("\x1b[2J\x1b[0;0H");
-    printf(UI_BGREEN " [+] WiiMedic" UI_RESET " " UI_CYAN "v" WIIMEDIC_VERSION UI_RESET "\n");
-    printf(UI_WHITE " -----------------------------------------------------------\n" UI_RESET);
-    printf("\n" UI_BYELLOW "   Preparing report, please wait...\n" UI_RESET);
-    printf("\n" UI_WHITE "   This may take a minute on real hardware.\n" UI_RESET);
-    VIDEO_WaitVSync();
-    VIDEO_WaitVSync();
-
-    fp = fopen(save_path, "w");
-    if (!fp) {
+    // the saved results live on the same device as the report. a module
+    // that already ran this session keeps its results; otherwise if its
+    // key (a hash of whatever it depends on) matches what was saved, we
+    // replay that instead of running it. the keys are meant to be cheap -
+    // one usage query, the IOS TMDs, a boot sector, one small file
+    // timed from here, the prompts above are just waiting on the user
+    PROF_SCOPE("report");
+    rcache_load(strncmp(save_path, "usb:", 4) == 0 ? "usb:" : "sd:");
+    ntasks = ncached = 0;
+    for (i = 0; i < NUM_MODULES; i++) {
+        const report_module *m = &s_modules[i];
+        keys[i]   = 0;
+        cached[i] = false;
+        if (!(opts->modules & (1u << i))) continue;
+        keys[i] = m->cache_key ? m->cache_key() : 0;
+        if (m->has_run && m->has_run()) continue;
+        if (opts->use_cache && keys[i] && rcache_valid(m->cache_name, keys[i], m->max_age)) {
+            cached[i] = true;
+            ncached++;
+            continue;
+        }
+        // whatever still needs running. the modules only touch their own
+        // hardware, so the scheduler overlaps them - the NAND walk, the
+        // network test and the Bluetooth warmup were most of the wait
+        // when they ran back to back
+        sched_add(tasks, &ntasks, m->task_name, m->needs, m->run);
+    }
+    if (ncached > 0) {
+        snprintf(buf, sizeof(buf), "%d module%s unchanged since the last report, reusing saved results",
+                 ncached, ncached == 1 ? "" : "s");
+        ui_draw_info(buf);
+    }
+    sched_run(tasks, ntasks, "Generate Full Report");
+
+    // everything renders into the file sink's buffer and hits the card in
+    // one write at the end. the headline numbers of each section also go
+    // to the screen so there's something to look at afterwards
+    if (!sink_file_open(&file, save_path)) {
+        rcache_free();
         ui_draw_err("Failed to open file for writing!");
         ui_draw_warn("Check that the card isn't write-protected.");
-        return;
+        return false;
+    }
+
+    // the structured copy sits next to the text one with the same name,
+    // for whoever collects these in bulk. not having it isn't fatal
+    json_report_path(save_path, json_path, sizeof(json_path));
+    json_ok = sink_file_open(&json_file, json_path);
+    if (json_ok) sink_json_begin(&json, &json_file.sink);
+
+    // the upload rides on one of the file sinks: each time its buffer goes
+    // to the card the same bytes go out as an HTTP chunk, so the whole
+    // report is on the wire by the time the file is closed
+    if (opts->upload_url) {
+        if (opts->upload_json && !json_ok) {
+            ui_draw_warn("No .json copy to upload");
+        } else if (net_upload_begin(&upload, opts->upload_url,
+                                    opts->upload_json ? "application/json" : "text/plain; charset=us-ascii")) {
+            sink_file_tap(opts->upload_json ? &json_file : &file, net_upload_chunk, &upload);
+            uploading = true;
+        } else {
+            snprintf(buf, sizeof(buf), "Couldn't reach the upload server (error %d)", (int)upload.err);
+            ui_draw_warn(buf);
+        }
     }
 
-    report_write(fp,
+    // tee = file + (screen summary + JSON)
+    sink_screen_init(&screen, true);
+    sink_tee_init(&rest, &screen.sink, json_ok ? &json.sink : NULL);
+    sink_tee_init(&tee, &file.sink, &rest.sink);
+
+    sink_text(&file.sink,
         "==========================================================\n"
         "     WiiMedic Diagnostic Report v" WIIMEDIC_VERSION "\n"
         "==========================================================\n\n"
         "Generated by WiiMedic - Wii System Diagnostic & Health Monitor\n"
         "Post this file when asking for help on forums or Reddit.\n"
         "----------------------------------------------------------\n\n");
+    if (opts->note)
+        sink_text(&file.sink, "%s\n\n", opts->note);
 
-    // [1/6] system info
-    // does ISFS reads which can stall for a couple seconds, hence the spinner
-    ui_printf(UI_BCYAN "   [1/6]" UI_WHITE " System information...\n" UI_RESET);
-    ui_spin_start("Gathering system info...");
-    memset(section, 0, sizeof(section));
-    get_system_info_report(section, sizeof(section));
-    ui_spin_stop();
-    report_write(fp, "%s", section);
-    ui_draw_ok("Done.");
-
-    // [2/6] NAND health
-    ui_printf(UI_BCYAN "   [2/6]" UI_WHITE " NAND health...\n" UI_RESET);
-    if (!has_nand_health_run()) {
-        run_nand_health();
-    } else {
-        ui_printf("   " UI_WHITE "(using cached results)\n" UI_RESET);
-    }
-    memset(section, 0, sizeof(section));
-    get_nand_health_report(section, sizeof(section));
-    report_write(fp, "%s", section);
-    ui_draw_ok("Done.");
-
-    // [3/6] IOS scan
-    ui_printf(UI_BCYAN "   [3/6]" UI_WHITE " IOS installations...\n" UI_RESET);
-    memset(section, 0, sizeof(section));
-    get_ios_check_report(section, sizeof(section));
-    if (strlen(section) > 0) {
-        report_write(fp, "%s", section);
-    } else {
-        report_write(fp,
-            "=== IOS INSTALLATION SCAN ===\n"
-            "Not run yet. Go to the main menu and run IOS Scan first for full data.\n\n");
-    }
-    ui_draw_ok("Done.");
-
-    // [4/6] storage
-    ui_printf(UI_BCYAN "   [4/6]" UI_WHITE " Storage devices...\n" UI_RESET);
-    memset(section, 0, sizeof(section));
-    get_storage_test_report(section, sizeof(section));
-    if (strlen(section) > 0) {
-        report_write(fp, "%s", section);
-    } else {
-        report_write(fp,
-            "=== STORAGE TEST ===\n"
-            "Not run yet. Run Storage Test from main menu for full data.\n\n");
+    // everything is in module state or the cache by now, writing it out is quick
+    for (i = 0; i < NUM_MODULES; i++) {
+        if (opts->modules & (1u << i))
+            emit_module(&s_modules[i], keys[i], cached[i], &tee.sink);
     }
-    ui_draw_ok("Done.");
-
-    // [5/6] controllers
-    // has a ~30-frame BT warmup that looks frozen without a spinner
-    ui_printf(UI_BCYAN "   [5/6]" UI_WHITE " Controllers...\n" UI_RESET);
-    ui_spin_start("Scanning controllers...");
-    scan_controllers_quick();
-    ui_spin_stop();
-    memset(section, 0, sizeof(section));
-    get_controller_test_report(section, sizeof(section));
-    report_write(fp, "%s", section);
-    ui_draw_ok("Done.");
-
-    // [6/6] network
-    // if already tested we skip re-running it - network test is slow
-    if (has_network_test_run()) {
-        ui_printf(UI_BCYAN "   [6/6]" UI_WHITE " Network (cached)...\n" UI_RESET);
-    } else {
-        ui_printf(UI_BCYAN "   [6/6]" UI_WHITE " Network...\n" UI_RESET);
-        // let IOS breathe after the NAND/IOS reads before hitting the WiFi stack
-        net_deinit();
-        {
-            int i;
-            for (i = 0; i < 60; i++) VIDEO_WaitVSync();
-        }
-        run_network_test();
-    }
-    memset(section, 0, sizeof(section));
-    get_network_test_report(section, sizeof(section));
-    if (strlen(section) > 0) {
-        report_write(fp, "%s", section);
-    } else {
-        report_write(fp,
-            "=== NETWORK TEST ===\n"
-            "Not run yet. Run Network Test from main menu for full data.\n\n");
-    }
-    ui_draw_ok("Done.");
+    // with the timing overlay on, the call table goes in as well. it only
+    // covers this session, so it never goes in the cache
+    if (prof_shown())
+        get_prof_report(&tee.sink);
 
-    report_write(fp,
+    sink_text(&file.sink,
         "----------------------------------------------------------\n"
         "END OF WIIMEDIC DIAGNOSTIC REPORT\n"
         "For best results, run each module individually first,\n"
         "then regenerate this report to capture everything.\n"
         "----------------------------------------------------------\n");
 
-    long file_size = ftell(fp);
-    fclose(fp);
+    if (json_ok) {
+        sink_json_finish(&json);
+        json_ok = sink_file_close(&json_file) >= 0;
+    }
+
+    long file_size = sink_file_close(&file);
+    if (uploading) {
+        // a half-written file means a half-sent report. leaving the chunked
+        // body unterminated makes sure the server doesn't take it as whole
+        if (file_size < 0 && upload.err == 0) upload.err = -EIO;
+        uploaded = net_upload_finish(&upload);
+    }
+    if (file_size < 0) {
+        rcache_free();
+        ui_draw_err("Writing the report failed - the card may be full.");
+        return false;
+    }
+    bool cache_ok = rcache_save();
 
     ui_printf("\n");
     ui_draw_ok("Report saved!");
@@ -322,6 +444,25 @@ void run_report_generator(void) {
     snprintf(buf, sizeof(buf), "File size: %ld bytes", file_size);
     ui_draw_ok(buf);
 
+    if (json_ok) {
+        snprintf(pathmsg, sizeof(pathmsg), "Structured copy: %s", json_path);
+        ui_draw_ok(pathmsg);
+    } else {
+        ui_draw_warn("Couldn't write the .json copy of the report");
+    }
+    if (!cache_ok)
+        ui_draw_warn("Couldn't save results for next time - the next report will re-run everything");
+    if (uploaded) {
+        snprintf(buf, sizeof(buf), "Uploaded %u bytes (HTTP %d)", (unsigned)upload.sent, upload.status);
+        ui_draw_ok(buf);
+    } else if (uploading) {
+        if (upload.status)
+            snprintf(buf, sizeof(buf), "Upload rejected by the server (HTTP %d)", upload.status);
+        else
+            snprintf(buf, sizeof(buf), "Upload failed after %u bytes (error %d)", (unsigned)upload.sent, (int)upload.err);
+        ui_draw_warn(buf);
+    }
+
     if (existing_sz >= 0) {
         if (strcmp(save_path, REPORT_PATH_SD) == 0 ||
             strcmp(save_path, REPORT_PATH_USB) == 0)
@@ -335,4 +476,5 @@ void run_report_generator(void) {
 
     ui_printf("\n");
     ui_draw_info("Copy the .txt file to your PC and paste it when asking for help.");
+    return !opts->upload_url || uploaded;
 }
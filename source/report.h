@@ -5,7 +5,37 @@
 #ifndef REPORT_H
 #define REPORT_H
 
+#include <gccore.h>
+#include <stdbool.h>
+
+#define REPORT_ALL 0xFFFFFFFF
+
+// What to do when WiiMedic_Report.txt is already there
+enum {
+    REPORT_FILE_ASK = 0,    // the overwrite / keep both / cancel dialog
+    REPORT_FILE_OVERWRITE,
+    REPORT_FILE_KEEP,       // save alongside as WiiMedic_Report_2.txt etc.
+    REPORT_FILE_CONSOLE,    // WiiMedic_Report_<device ID>.txt, replaced every run
+};
+
+typedef struct {
+    u32         modules;    // report_module_bit()s, REPORT_ALL for every section
+    bool        use_cache;  // false runs everything fresh (results still get saved)
+    int         existing;   // REPORT_FILE_*
+    const char *note;       // extra line under the file header, or NULL
+    const char *upload_url; // http://host[:port]/path to POST the report to, or NULL
+    bool        upload_json;    // send the .json copy instead of the text one
+} report_opts;
+
 // Run the report generator (saves to SD card)
 void run_report_generator(void);
 
+// Same, with the choices spelled out. Returns true if the report was
+// written (and uploaded, if upload_url is set)
+bool report_generate(const report_opts *opts);
+
+// The bit for a report section by short name (sysinfo, nand, ios, storage,
+// controllers, network). 0 if there's no such section
+u32 report_module_bit(const char *name);
+
 #endif // REPORT_H
@@ -0,0 +1,456 @@
+// report_sink.c
+// modules used to snprintf their whole report section into a static array,
+// which report.c then copied into another static array before writing it.
+// now they emit records (section, key/value, text) into whatever sink the
+// caller hands them: the report file, the screen, or a log that gets
+// replayed later for modules that only know their results while running.
+//
+// the file sink renders into one big aligned buffer and writes the lot in
+// one go at the end, so the SD card sees one long write instead of dozens
+// of little fprintf flushes.
+
+#include <gccore.h>
+#include <malloc.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "report_sink.h"
+#include "scratch.h"
+#include "ui_common.h"
+
+// last, it wraps the IOS and libfat calls by name
+#include "prof_calls.h"
+
+#define SINK_FMT_MAX    1024
+#define SINK_LOG_STEP   4096
+#define SINK_FILE_SIZE  (128 * 1024)
+#define SINK_KEY_COL    21      // where values start, "Key:" padded to here
+
+
+void sink_section(report_sink *s, const char *title) {
+    if (s) s->emit(s, SINK_SECTION, NULL, title);
+}
+
+void sink_subsection(report_sink *s, const char *title) {
+    if (s) s->emit(s, SINK_SUBSECTION, NULL, title);
+}
+
+void sink_kv(report_sink *s, const char *key, const char *fmt, ...) {
+    char value[SINK_FMT_MAX];
+    va_list args;
+    if (!s) return;
+    va_start(args, fmt);
+    vsnprintf(value, sizeof(value), fmt, args);
+    va_end(args);
+    s->emit(s, SINK_KV, key, value);
+}
+
+void sink_text(report_sink *s, const char *fmt, ...) {
+    char text[SINK_FMT_MAX];
+    va_list args;
+    if (!s) return;
+    va_start(args, fmt);
+    vsnprintf(text, sizeof(text), fmt, args);
+    va_end(args);
+    s->emit(s, SINK_TEXT, NULL, text);
+}
+
+void sink_end(report_sink *s) {
+    if (s) s->emit(s, SINK_END, NULL, "");
+}
+
+void sink_field_int(report_sink *s, const char *key, s64 v) {
+    char lit[24];
+    if (!s) return;
+    snprintf(lit, sizeof(lit), "%lld", (long long)v);
+    s->emit(s, SINK_FIELD, key, lit);
+}
+
+void sink_field_num(report_sink *s, const char *key, double v) {
+    char lit[32];
+    if (!s) return;
+    // JSON has no nan/inf, a test that never produced a number is null
+    if (v != v || v > 1e300 || v < -1e300) strcpy(lit, "null");
+    else snprintf(lit, sizeof(lit), "%.6g", v);
+    s->emit(s, SINK_FIELD, key, lit);
+}
+
+void sink_field_bool(report_sink *s, const char *key, bool v) {
+    if (s) s->emit(s, SINK_FIELD, key, v ? "true" : "false");
+}
+
+void sink_field_str(report_sink *s, const char *key, const char *v) {
+    char lit[SINK_FMT_MAX];
+    u32 n = 0;
+    if (!s) return;
+    lit[n++] = '"';
+    for (; v && *v && n < sizeof(lit) - 8; v++) {
+        u8 c = (u8)*v;
+        if (c == '"' || c == '\\') {
+            lit[n++] = '\\';
+            lit[n++] = c;
+        } else if (c < 0x20 || c > 0x7E) {
+            // SSIDs and firmware strings can carry anything, keep it ASCII
+            n += snprintf(lit + n, sizeof(lit) - n, "\\u%04x", c);
+        } else {
+            lit[n++] = c;
+        }
+    }
+    lit[n++] = '"';
+    lit[n]   = '\0';
+    s->emit(s, SINK_FIELD, key, lit);
+}
+
+void sink_list(report_sink *s, const char *key) {
+    if (s) s->emit(s, SINK_LIST, key, "");
+}
+
+void sink_item(report_sink *s) {
+    if (s) s->emit(s, SINK_ITEM, NULL, "");
+}
+
+void sink_list_end(report_sink *s) {
+    if (s) s->emit(s, SINK_LIST_END, NULL, "");
+}
+
+
+// --- log sink ---
+// records are [kind][key\0][value\0] back to back. consecutive text
+// records get merged, modules tend to build one line out of many calls.
+
+static bool log_grow(sink_log *log, u32 n) {
+    char *p;
+    u32 cap;
+    if (log->used + n <= log->cap) return true;
+    cap = log->cap;
+    while (cap < log->used + n) cap += SINK_LOG_STEP;
+    p = (char *)realloc(log->data, cap);
+    if (!p) return false;
+    log->data = p;
+    log->cap  = cap;
+    return true;
+}
+
+static void log_emit(report_sink *s, sink_kind kind, const char *key, const char *value) {
+    sink_log *log = (sink_log *)s;
+    u32 klen = key ? (u32)strlen(key) : 0;
+    u32 vlen = (u32)strlen(value);
+
+    if (kind == SINK_TEXT && log->used > 0 && log->data[log->last] == SINK_TEXT) {
+        // drop the old terminator and carry on the same record
+        if (!log_grow(log, vlen)) return;
+        memcpy(log->data + log->used - 1, value, vlen + 1);
+        log->used += vlen;
+        return;
+    }
+
+    if (!log_grow(log, 1 + klen + 1 + vlen + 1)) return;
+    log->last = log->used;
+    log->data[log->used++] = (char)kind;
+    memcpy(log->data + log->used, key ? key : "", klen + 1);
+    log->used += klen + 1;
+    memcpy(log->data + log->used, value, vlen + 1);
+    log->used += vlen + 1;
+}
+
+void sink_log_init(sink_log *log) {
+    memset(log, 0, sizeof(*log));
+    log->sink.emit = log_emit;
+}
+
+void sink_log_clear(sink_log *log) {
+    log->used = 0;
+    log->last = 0;
+}
+
+void sink_log_free(sink_log *log) {
+    free(log->data);
+    log->data = NULL;
+    log->used = log->cap = log->last = 0;
+}
+
+bool sink_log_empty(const sink_log *log) {
+    return log->used == 0;
+}
+
+bool sink_log_load(sink_log *log, const void *data, u32 size) {
+    const char *p = (const char *)data;
+    u32 pos = 0, last = 0;
+
+    // walk it first, a truncated record would send replay off the end
+    while (pos < size) {
+        const char *nul;
+        if ((u8)p[pos] > SINK_LIST_END) return false;
+        last = pos++;
+        nul = memchr(p + pos, '\0', size - pos);
+        if (!nul) return false;
+        pos = (u32)(nul - p) + 1;
+        nul = memchr(p + pos, '\0', size - pos);
+        if (!nul) return false;
+        pos = (u32)(nul - p) + 1;
+    }
+
+    sink_log_clear(log);
+    if (!log_grow(log, size)) return false;
+    memcpy(log->data, data, size);
+    log->used = size;
+    log->last = last;
+    return true;
+}
+
+void sink_log_replay(const sink_log *log, report_sink *dst) {
+    u32 pos = 0;
+    if (!dst) return;
+    while (pos < log->used) {
+        sink_kind kind = (sink_kind)log->data[pos++];
+        const char *key = log->data + pos;
+        const char *value;
+        pos += (u32)strlen(key) + 1;
+        value = log->data + pos;
+        pos += (u32)strlen(value) + 1;
+        dst->emit(dst, kind, *key ? key : NULL, value);
+    }
+}
+
+
+// --- file sink ---
+
+static void file_flush(sink_file *f) {
+    if (f->used == 0) return;
+    if (f->tap) f->tap(f->tap_ctx, f->buf, f->used);
+    if (fwrite(f->buf, 1, f->used, f->fp) != f->used) f->failed = true;
+    f->written += f->used;
+    f->used = 0;
+}
+
+static void file_put(sink_file *f, const char *str, u32 len) {
+    while (len > 0) {
+        u32 n = f->size - f->used;
+        if (n > len) n = len;
+        memcpy(f->buf + f->used, str, n);
+        f->used += n;
+        str += n;
+        len -= n;
+        if (f->used == f->size) file_flush(f);
+    }
+}
+
+static void file_emit(report_sink *s, sink_kind kind, const char *key, const char *value) {
+    sink_file *f = (sink_file *)s;
+    char line[SINK_FMT_MAX + 64];
+    int n = 0;
+
+    switch (kind) {
+        case SINK_SECTION:    n = snprintf(line, sizeof(line), "=== %s ===\n", value);   break;
+        case SINK_SUBSECTION: n = snprintf(line, sizeof(line), "\n--- %s ---\n", value); break;
+        case SINK_END:        n = snprintf(line, sizeof(line), "\n");                      break;
+        case SINK_KV: {
+            int pad = SINK_KEY_COL - (int)strlen(key) - 1;
+            if (pad < 1) pad = 1;
+            n = snprintf(line, sizeof(line), "%s:%*s%s\n", key, pad, "", value);
+            break;
+        }
+        case SINK_TEXT:
+            file_put(f, value, (u32)strlen(value));
+            return;
+        default:
+            return;
+    }
+    if (n > (int)sizeof(line) - 1) n = sizeof(line) - 1;
+    if (n > 0) file_put(f, line, (u32)n);
+}
+
+bool sink_file_open(sink_file *f, const char *path) {
+    memset(f, 0, sizeof(*f));
+    f->sink.emit = file_emit;
+    f->buf = (char *)scratch_alloc(SINK_FILE_SIZE);
+    if (!f->buf) return false;
+    f->size = SINK_FILE_SIZE;
+    f->fp = fopen(path, "w");
+    if (!f->fp) {
+        scratch_free(f->buf);
+        f->buf = NULL;
+        return false;
+    }
+    return true;
+}
+
+void sink_file_tap(sink_file *f, sink_file_tap_fn tap, void *ctx) {
+    f->tap     = tap;
+    f->tap_ctx = ctx;
+}
+
+long sink_file_close(sink_file *f) {
+    if (!f->fp) return -1;
+    file_flush(f);
+    if (fclose(f->fp) != 0) f->failed = true;
+    f->fp = NULL;
+    scratch_free(f->buf);
+    f->buf = NULL;
+    return f->failed ? -1 : f->written;
+}
+
+
+// --- screen sink ---
+
+static void screen_emit(report_sink *s, sink_kind kind, const char *key, const char *value) {
+    sink_screen *scr = (sink_screen *)s;
+    switch (kind) {
+        case SINK_SECTION:
+        case SINK_SUBSECTION: ui_draw_section(value);     break;
+        case SINK_KV:         ui_draw_kv(key, value);     break;
+        case SINK_TEXT:       if (!scr->kv_only) ui_printf("%s", value); break;
+        default:              break;
+    }
+}
+
+void sink_screen_init(sink_screen *scr, bool kv_only) {
+    scr->sink.emit = screen_emit;
+    scr->kv_only   = kv_only;
+}
+
+
+// --- tee ---
+
+static void tee_emit(report_sink *s, sink_kind kind, const char *key, const char *value) {
+    sink_tee *t = (sink_tee *)s;
+    if (t->a) t->a->emit(t->a, kind, key, value);
+    if (t->b) t->b->emit(t->b, kind, key, value);
+}
+
+void sink_tee_init(sink_tee *t, report_sink *a, report_sink *b) {
+    t->sink.emit = tee_emit;
+    t->a = a;
+    t->b = b;
+}
+
+
+// --- JSON ---
+// depth 0 is the top-level object. a section opens an object, a list opens
+// an array and each item an object inside it. open[] remembers which
+// bracket each level needs, so closing is just popping back down. levels
+// past SINK_JSON_DEPTH are only counted, so their closes get eaten too.
+
+static void json_out(sink_json *j, const char *str) {
+    j->out->emit(j->out, SINK_TEXT, NULL, str);
+}
+
+// comma if needed, then "key":
+static void json_key(sink_json *j, const char *key) {
+    char buf[96];
+    if (j->comma[j->depth]) json_out(j, ",");
+    j->comma[j->depth] = true;
+    if (!key) return;
+    snprintf(buf, sizeof(buf), "\"%s\":", key);
+    json_out(j, buf);
+}
+
+// bracket of the level `down` below the innermost one, skipped levels
+// included. 0 below the top-level object
+static char json_bracket(const sink_json *j, int down) {
+    int lvl = j->skipped - 1 - down;
+    if (lvl >= 32) return '{';
+    if (lvl >= 0)  return (j->skip_lists >> lvl) & 1 ? '[' : '{';
+    lvl += j->depth + 1;
+    return lvl >= 0 ? j->open[lvl] : 0;
+}
+
+static void json_open(sink_json *j, const char *key, char bracket) {
+    char str[2] = { bracket, '\0' };
+    if (j->skipped || j->depth >= SINK_JSON_DEPTH - 1) {
+        if (j->skipped < 32) {
+            if (bracket == '[') j->skip_lists |= 1u << j->skipped;
+            else                j->skip_lists &= ~(1u << j->skipped);
+        }
+        j->skipped++;
+        return;
+    }
+    json_key(j, key);
+    json_out(j, str);
+    j->depth++;
+    j->open[j->depth]  = bracket;
+    j->comma[j->depth] = false;
+}
+
+static void json_close(sink_json *j) {
+    if (j->skipped) {
+        j->skipped--;
+        return;
+    }
+    if (j->depth == 0) return;
+    json_out(j, j->open[j->depth] == '[' ? "]" : "}");
+    j->depth--;
+}
+
+// "SYSTEM INFORMATION" -> system_information
+static void json_section_key(const char *title, char *out, int outsize) {
+    int n = 0;
+    bool gap = false;
+    for (; *title && n < outsize - 1; title++) {
+        char c = *title;
+        if (c >= 'A' && c <= 'Z') c = c - 'A' + 'a';
+        if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9')) {
+            if (gap && n > 0 && n < outsize - 2) out[n++] = '_';
+            out[n++] = c;
+            gap = false;
+        } else {
+            gap = true;
+        }
+    }
+    out[n] = '\0';
+}
+
+static void json_emit(report_sink *s, sink_kind kind, const char *key, const char *value) {
+    sink_json *j = (sink_json *)s;
+    char name[64];
+
+    switch (kind) {
+        case SINK_SECTION:
+            // a section that never saw its END gets closed here
+            while (j->depth > 0 || j->skipped) json_close(j);
+            json_section_key(value, name, sizeof(name));
+            json_open(j, name, '{');
+            break;
+        case SINK_END:
+            while (j->depth > 0 || j->skipped) json_close(j);
+            break;
+        case SINK_FIELD:
+            if (j->skipped || json_bracket(j, 0) == '[') break;    // outside an item, or too deep
+            json_key(j, key);
+            json_out(j, value);
+            break;
+        case SINK_LIST:
+            json_open(j, key, '[');
+            break;
+        case SINK_ITEM:
+            if (json_bracket(j, 0) == '{' && json_bracket(j, 1) == '[')
+                json_close(j);
+            if (json_bracket(j, 0) == '[') json_open(j, NULL, '{');
+            break;
+        case SINK_LIST_END:
+            while ((j->depth > 0 || j->skipped) && json_bracket(j, 0) != '[') json_close(j);
+            json_close(j);
+            break;
+        default:
+            break;
+    }
+}
+
+void sink_json_begin(sink_json *j, report_sink *out) {
+    char buf[80];
+    memset(j, 0, sizeof(*j));
+    j->sink.emit = json_emit;
+    j->out = out;
+    snprintf(buf, sizeof(buf), "{\"schema\":%d,\"version\":\"%s\"",
+             REPORT_SCHEMA_VERSION, WIIMEDIC_VERSION);
+    json_out(j, buf);
+    j->open[0]  = '{';
+    j->comma[0] = true;
+}
+
+void sink_json_finish(sink_json *j) {
+    json_emit(&j->sink, SINK_END, NULL, "");
+    json_out(j, "}\n");
+}
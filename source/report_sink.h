@@ -0,0 +1,134 @@
+/*
+ * WiiMedic - report_sink.h
+ * Record-based report output (file, screen, replay log)
+ */
+#ifndef REPORT_SINK_H
+#define REPORT_SINK_H
+
+#include <gccore.h>
+#include <stdio.h>
+
+typedef enum {
+    SINK_SECTION,       // "=== TITLE ===", starts a module's section
+    SINK_SUBSECTION,    // "--- Title ---" inside a section
+    SINK_KV,            // "Key:                value"
+    SINK_TEXT,          // free text, written as-is (may hold several lines)
+    SINK_END,           // end of a section
+    // machine-readable records. the text and screen sinks skip these,
+    // only the JSON sink renders them
+    SINK_FIELD,         // typed field, value is already a JSON literal
+    SINK_LIST,          // starts an array of items under key
+    SINK_ITEM,          // starts the next item (object) of the open list
+    SINK_LIST_END
+} sink_kind;
+
+#define REPORT_SCHEMA_VERSION 1
+
+// Every sink struct starts with one of these; emit gets it back as `s`.
+// key is NULL for anything but SINK_KV.
+typedef struct report_sink report_sink;
+struct report_sink {
+    void (*emit)(report_sink *s, sink_kind kind, const char *key, const char *value);
+};
+
+// Record helpers. All of them are no-ops on a NULL sink, so a module can
+// pass NULL when it only wants the screen output.
+void sink_section(report_sink *s, const char *title);
+void sink_subsection(report_sink *s, const char *title);
+void sink_kv(report_sink *s, const char *key, const char *fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+void sink_text(report_sink *s, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+void sink_end(report_sink *s);
+
+// Typed fields for the structured report. Keys are lower_snake_case and
+// stay stable across versions; bump REPORT_SCHEMA_VERSION if one changes
+// meaning or goes away.
+void sink_field_int(report_sink *s, const char *key, s64 v);
+void sink_field_num(report_sink *s, const char *key, double v);
+void sink_field_bool(report_sink *s, const char *key, bool v);
+void sink_field_str(report_sink *s, const char *key, const char *v);
+void sink_list(report_sink *s, const char *key);
+void sink_item(report_sink *s);
+void sink_list_end(report_sink *s);
+
+// Keeps records in a growable buffer so a module can record its report
+// while it runs and replay it into the real sink later.
+typedef struct {
+    report_sink sink;
+    char *data;
+    u32   used;
+    u32   cap;
+    u32   last;         // offset of the last record, for merging text
+} sink_log;
+
+void sink_log_init(sink_log *log);
+void sink_log_clear(sink_log *log);
+void sink_log_free(sink_log *log);
+bool sink_log_empty(const sink_log *log);
+void sink_log_replay(const sink_log *log, report_sink *dst);
+// Replaces the log with records saved from an earlier log's data/used.
+// Returns false if they don't parse (the log is left as it was) or if
+// there's no memory for them (the log is left empty)
+bool sink_log_load(sink_log *log, const void *data, u32 size);
+
+// Renders the text report into one aligned buffer and writes it out in a
+// single fwrite on close (or in buffer-sized pieces if it ever fills up).
+typedef void (*sink_file_tap_fn)(void *ctx, const char *data, u32 len);
+typedef struct {
+    report_sink sink;
+    FILE *fp;
+    char *buf;
+    u32   size;
+    u32   used;
+    long  written;
+    bool  failed;
+    sink_file_tap_fn tap;
+    void            *tap_ctx;
+} sink_file;
+
+bool sink_file_open(sink_file *f, const char *path);
+// tap also gets every piece of the buffer right before it goes to the card
+// (the report upload). It must be done with data when it returns
+void sink_file_tap(sink_file *f, sink_file_tap_fn tap, void *ctx);
+// Flushes and closes. Returns bytes written, or -1 if any write failed
+long sink_file_close(sink_file *f);
+
+// Shows records with the usual ui_draw_* look. kv_only skips free text,
+// which keeps the on-screen version down to the headline numbers.
+typedef struct {
+    report_sink sink;
+    bool kv_only;
+} sink_screen;
+
+void sink_screen_init(sink_screen *scr, bool kv_only);
+
+// Sends every record to two sinks
+typedef struct {
+    report_sink  sink;
+    report_sink *a;
+    report_sink *b;
+} sink_tee;
+
+void sink_tee_init(sink_tee *t, report_sink *a, report_sink *b);
+
+// Renders the typed records as one compact JSON object and passes it on
+// as text to `out` (normally a sink_file). Sections become objects keyed
+// by their lowercased title; key/value and free text records are left out.
+// Anything nested deeper than SINK_JSON_DEPTH is dropped whole, brackets
+// included, so the output stays valid.
+#define SINK_JSON_DEPTH 8
+typedef struct {
+    report_sink  sink;
+    report_sink *out;
+    int          depth;
+    char         open[SINK_JSON_DEPTH];     // '{' or '[' for each open level
+    bool         comma[SINK_JSON_DEPTH];    // level already has a member
+    int          skipped;                   // levels past the limit, not written
+    u32          skip_lists;                // bit n set = skipped level n is a list
+} sink_json;
+
+void sink_json_begin(sink_json *j, report_sink *out);
+void sink_json_finish(sink_json *j);
+
+#endif // REPORT_SINK_H
@@ -0,0 +1,283 @@
+// result_cache.c
+// the report used to remember module results only until the app exited,
+// so every visit to the same console paid for the NAND walk, the IOS scan
+// and the network test all over again. now each module's report records
+// (the same sink_log the modules already keep) get saved on the card next
+// to the report, tagged with when they were made and a cheap key that
+// changes whenever the thing they describe does - free clusters for the
+// NAND, IOS revisions for the IOS scan, and so on. if the key still matches
+// next time, the report replays the saved records instead of re-running.
+//
+// the file is tiny (a few KB per module), read in one go and written in
+// one go. anything that doesn't look right is thrown away - worst case we
+// just run the module again.
+
+#include <gccore.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "report_sink.h"
+#include "result_cache.h"
+#include "ui_common.h"
+
+// last, it wraps the IOS and libfat calls by name
+#include "prof_calls.h"
+
+#define RCACHE_MAGIC     0x574D5243     // 'WMRC'
+#define RCACHE_VERSION   1
+#define RCACHE_MAX_BYTES (512 * 1024)
+
+typedef struct {
+    u32 magic;
+    u32 version;
+    u64 build;      // hash of the app version, other builds word things differently
+    u32 count;
+    u32 pad;
+} rcache_header;
+
+typedef struct {
+    char name[RCACHE_NAME_LEN];
+    u64  key;
+    u32  saved;     // time() when the records were made
+    u32  size;      // record bytes that follow
+} rcache_disk;
+
+typedef struct {
+    char     name[RCACHE_NAME_LEN];
+    u64      key;
+    u32      saved;
+    sink_log log;
+} rcache_entry;
+
+static rcache_entry s_entries[RCACHE_MAX];
+static int          s_count = 0;
+static bool         s_dirty = false;
+static char         s_path[64];
+
+
+u64 rcache_hash(u64 h, const void *data, u32 len) {
+    const u8 *p = (const u8 *)data;
+    while (len--) {
+        h ^= *p++;
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+u64 rcache_hash_u32(u64 h, u32 v) {
+    return rcache_hash(h, &v, sizeof(v));
+}
+
+static u64 build_hash(void) {
+    u64 h = rcache_hash(RCACHE_KEY_INIT, WIIMEDIC_VERSION, sizeof(WIIMEDIC_VERSION));
+    return rcache_hash_u32(h, REPORT_SCHEMA_VERSION);
+}
+
+
+static rcache_entry *find_entry(const char *module) {
+    int i;
+    for (i = 0; i < s_count; i++) {
+        if (strcmp(s_entries[i].name, module) == 0) return &s_entries[i];
+    }
+    return NULL;
+}
+
+
+void rcache_free(void) {
+    int i;
+    for (i = 0; i < s_count; i++) sink_log_free(&s_entries[i].log);
+    s_count = 0;
+    s_dirty = false;
+}
+
+
+void rcache_load(const char *base) {
+    rcache_header hdr;
+    FILE *fp;
+    u8 *buf;
+    long size;
+    u32 pos, i;
+
+    rcache_free();
+    snprintf(s_path, sizeof(s_path), "%s/" RCACHE_FILE, base);
+
+    fp = fopen(s_path, "rb");
+    if (!fp) return;
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    if (size < (long)sizeof(hdr) || size > RCACHE_MAX_BYTES) {
+        fclose(fp);
+        return;
+    }
+
+    buf = (u8 *)malloc(size);
+    if (!buf) {
+        fclose(fp);
+        return;
+    }
+    if (fread(buf, 1, size, fp) != (size_t)size) {
+        fclose(fp);
+        free(buf);
+        return;
+    }
+    fclose(fp);
+
+    memcpy(&hdr, buf, sizeof(hdr));
+    if (hdr.magic != RCACHE_MAGIC || hdr.version != RCACHE_VERSION || hdr.build != build_hash()) {
+        free(buf);
+        return;
+    }
+
+    pos = sizeof(hdr);
+    for (i = 0; i < hdr.count && s_count < RCACHE_MAX; i++) {
+        rcache_entry *e = &s_entries[s_count];
+        rcache_disk d;
+
+        if (pos + sizeof(d) > (u32)size) break;
+        memcpy(&d, buf + pos, sizeof(d));
+        pos += sizeof(d);
+        if (d.size > (u32)size - pos) break;
+
+        memset(e, 0, sizeof(*e));
+        memcpy(e->name, d.name, RCACHE_NAME_LEN - 1);
+        e->key   = d.key;
+        e->saved = d.saved;
+        sink_log_init(&e->log);
+        if (sink_log_load(&e->log, buf + pos, d.size) && !find_entry(e->name))
+            s_count++;
+        else
+            sink_log_free(&e->log);
+        pos += d.size;
+    }
+
+    free(buf);
+}
+
+
+bool rcache_valid(const char *module, u64 key, u32 max_age) {
+    rcache_entry *e = find_entry(module);
+    u32 now;
+
+    if (!e || e->key != key || sink_log_empty(&e->log)) return false;
+    if (max_age == 0) return true;
+
+    // a clock that went backwards means we can't tell how old it is
+    now = (u32)time(NULL);
+    return now >= e->saved && now - e->saved <= max_age;
+}
+
+
+// passes records through, adding the "cached" note after each section
+// header so it's obvious in the file which numbers weren't measured today
+typedef struct {
+    report_sink  sink;
+    report_sink *dst;
+    u32          saved;
+    char         when[32];
+} note_sink;
+
+static void note_emit(report_sink *s, sink_kind kind, const char *key, const char *value) {
+    note_sink *n = (note_sink *)s;
+    n->dst->emit(n->dst, kind, key, value);
+    if (kind == SINK_SECTION) {
+        sink_kv(n->dst, "Cached result", "%s", n->when);
+        sink_field_int(n->dst, "cached_at", n->saved);
+    }
+}
+
+void rcache_replay(const char *module, report_sink *dst) {
+    rcache_entry *e = find_entry(module);
+    note_sink note;
+    time_t t;
+
+    if (!e || !dst) return;
+
+    note.sink.emit = note_emit;
+    note.dst   = dst;
+    note.saved = e->saved;
+    t = (time_t)e->saved;
+    if (strftime(note.when, sizeof(note.when), "%Y-%m-%d %H:%M", localtime(&t)) == 0)
+        strcpy(note.when, "earlier session");
+    sink_log_replay(&e->log, &note.sink);
+}
+
+
+sink_log *rcache_store(const char *module, u64 key) {
+    rcache_entry *e = find_entry(module);
+
+    if (!e) {
+        if (s_count >= RCACHE_MAX) return NULL;
+        e = &s_entries[s_count++];
+        memset(e, 0, sizeof(*e));
+        strncpy(e->name, module, RCACHE_NAME_LEN - 1);
+        sink_log_init(&e->log);
+    }
+    sink_log_clear(&e->log);
+    e->key   = key;
+    e->saved = (u32)time(NULL);
+    s_dirty  = true;
+    return &e->log;
+}
+
+
+bool rcache_save(void) {
+    rcache_header hdr;
+    u32 total = sizeof(hdr), pos;
+    bool ok;
+    FILE *fp;
+    u8 *buf;
+    int i;
+
+    if (!s_dirty || !s_path[0]) {
+        rcache_free();
+        return true;
+    }
+
+    for (i = 0; i < s_count; i++) total += sizeof(rcache_disk) + s_entries[i].log.used;
+    buf = (u8 *)malloc(total);
+    if (!buf) {
+        rcache_free();
+        return false;
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic   = RCACHE_MAGIC;
+    hdr.version = RCACHE_VERSION;
+    hdr.build   = build_hash();
+    hdr.count   = (u32)s_count;
+    memcpy(buf, &hdr, sizeof(hdr));
+    pos = sizeof(hdr);
+
+    for (i = 0; i < s_count; i++) {
+        const rcache_entry *e = &s_entries[i];
+        rcache_disk d;
+
+        memset(&d, 0, sizeof(d));
+        memcpy(d.name, e->name, RCACHE_NAME_LEN);
+        d.key   = e->key;
+        d.saved = e->saved;
+        d.size  = e->log.used;
+        memcpy(buf + pos, &d, sizeof(d));
+        pos += sizeof(d);
+        if (e->log.used) memcpy(buf + pos, e->log.data, e->log.used);
+        pos += e->log.used;
+    }
+    rcache_free();
+
+    fp = fopen(s_path, "wb");
+    if (!fp) {
+        free(buf);
+        return false;
+    }
+    ok = fwrite(buf, 1, total, fp) == total;
+    fclose(fp);
+    free(buf);
+
+    // half a cache file would only confuse the next load
+    if (!ok) remove(s_path);
+    return ok;
+}
@@ -0,0 +1,45 @@
+/*
+ * WiiMedic - result_cache.h
+ * Module report records kept on SD/USB between sessions
+ */
+#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+
+#include <gccore.h>
+
+#include "report_sink.h"
+
+#define RCACHE_FILE      "WiiMedic_Cache.bin"
+#define RCACHE_MAX       8
+#define RCACHE_NAME_LEN  16
+
+// Validation keys are FNV-1a hashes. Start from RCACHE_KEY_INIT and feed
+// in whatever the module's results depend on
+#define RCACHE_KEY_INIT  0xcbf29ce484222325ULL
+u64 rcache_hash(u64 h, const void *data, u32 len);
+u64 rcache_hash_u32(u64 h, u32 v);
+
+// Reads <base>/WiiMedic_Cache.bin (base is "sd:" or "usb:"). A missing,
+// old or damaged file just means an empty cache
+void rcache_load(const char *base);
+
+// True if the module has records saved under this key, no older than
+// max_age seconds (0 = no age limit)
+bool rcache_valid(const char *module, u64 key, u32 max_age);
+
+// Replays the saved records into dst, with a note under every section
+// saying when they were recorded
+void rcache_replay(const char *module, report_sink *dst);
+
+// Log to record the module's fresh report into. Whatever is in it on
+// rcache_save() replaces the old entry. NULL if the cache is full
+sink_log *rcache_store(const char *module, u64 key);
+
+// Writes the cache back next to where it was loaded from (only if
+// something was stored) and frees it
+bool rcache_save(void);
+
+// Drops the loaded cache without writing anything
+void rcache_free(void);
+
+#endif // RESULT_CACHE_H
@@ -0,0 +1,115 @@
+// scratch.c
+// every test used to memalign its own buffers and free them again - a MB
+// for the benchmark, two for the surface scan, 64 KB here, 512 KB there,
+// plus 32 KB stacks for the report's threads. that's a lot of churn on a
+// heap that's shared with libfat and the network stack, and nobody knew
+// what the worst case actually was. now there's one block, taken off the
+// top of MEM2 at start-up so it never touches the heap at all, and the
+// buffers are lent out of it.
+//
+// it's a first-fit over a short address-ordered list of live blocks, not a
+// stack: the report runs several modules at once and they finish in any
+// order. the list is tiny (nobody holds more than a few buffers) so a
+// linear walk with interrupts off is plenty. if something doesn't fit it
+// goes to memalign like before and gets counted, so the numbers in System
+// Information say whether SCRATCH_SIZE is right.
+
+#include <gccore.h>
+#include <malloc.h>
+#include <ogc/machine/processor.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "scratch.h"
+
+typedef struct {
+    u32 off;
+    u32 size;
+} scratch_blk;
+
+static u8           *s_base = NULL;
+static scratch_blk   s_blks[SCRATCH_MAX_BLKS];     // address order
+static int           s_nblks = 0;
+static scratch_stats s_stats;
+
+
+void scratch_init(void) {
+    u32 level, hi, lo;
+
+    if (s_base) return;
+    _CPU_ISR_Disable(level);
+    hi = (u32)SYS_GetArena2Hi();
+    lo = (u32)SYS_GetArena2Lo();
+    if (hi - lo > SCRATCH_SIZE + SCRATCH_ALIGN) {
+        hi = (hi - SCRATCH_SIZE) & ~(u32)(SCRATCH_ALIGN - 1);
+        SYS_SetArena2Hi((void *)hi);
+        s_base = (u8 *)hi;
+        s_stats.size = SCRATCH_SIZE;
+    }
+    _CPU_ISR_Restore(level);
+}
+
+
+void *scratch_alloc(u32 size) {
+    u32 need = (size + SCRATCH_ALIGN - 1) & ~(u32)(SCRATCH_ALIGN - 1);
+    u32 level, off = 0;
+    void *p = NULL;
+    int i;
+
+    _CPU_ISR_Disable(level);
+    if (s_stats.size && need && s_nblks < SCRATCH_MAX_BLKS) {
+        // first gap that's big enough, the one after the last block included
+        for (i = 0; i <= s_nblks; i++) {
+            u32 end = i < s_nblks ? s_blks[i].off : s_stats.size;
+            if (end - off >= need) break;
+            if (i < s_nblks) off = s_blks[i].off + s_blks[i].size;
+        }
+        if (i <= s_nblks) {
+            memmove(&s_blks[i + 1], &s_blks[i], (s_nblks - i) * sizeof(s_blks[0]));
+            s_blks[i].off  = off;
+            s_blks[i].size = need;
+            s_nblks++;
+            s_stats.used += need;
+            if (s_stats.used > s_stats.peak)   s_stats.peak = s_stats.used;
+            if (off + need > s_stats.peak_end) s_stats.peak_end = off + need;
+            p = s_base + off;
+        }
+    }
+    if (!p) {
+        s_stats.fallbacks++;
+        if (size > s_stats.fallback_max) s_stats.fallback_max = size;
+    }
+    _CPU_ISR_Restore(level);
+
+    return p ? p : memalign(SCRATCH_ALIGN, size);
+}
+
+
+void scratch_free(void *p) {
+    u32 level;
+    int i;
+
+    if (!p) return;
+    if (!s_base || (u8 *)p < s_base || (u8 *)p >= s_base + s_stats.size) {
+        free(p);
+        return;
+    }
+
+    _CPU_ISR_Disable(level);
+    for (i = 0; i < s_nblks; i++) {
+        if (s_base + s_blks[i].off != (u8 *)p) continue;
+        s_stats.used -= s_blks[i].size;
+        memmove(&s_blks[i], &s_blks[i + 1], (s_nblks - i - 1) * sizeof(s_blks[0]));
+        s_nblks--;
+        break;
+    }
+    _CPU_ISR_Restore(level);
+}
+
+
+void scratch_get_stats(scratch_stats *out) {
+    u32 level;
+    _CPU_ISR_Disable(level);
+    *out = s_stats;
+    _CPU_ISR_Restore(level);
+}
@@ -0,0 +1,39 @@
+/*
+ * WiiMedic - scratch.h
+ * One fixed MEM2 block that every module borrows its work buffers from
+ */
+#ifndef SCRATCH_H
+#define SCRATCH_H
+
+#include <gccore.h>
+
+// Big enough for the surface scan (two 1 MB chunks) with the report's
+// thread stacks and file buffers on top
+#define SCRATCH_SIZE     (3 * 1024 * 1024)
+#define SCRATCH_ALIGN    32
+#define SCRATCH_MAX_BLKS 24
+
+typedef struct {
+    u32 size;           // 0 if the arena couldn't be set up
+    u32 used;           // bytes lent out right now
+    u32 peak;           // most ever lent out at once
+    u32 peak_end;       // furthest into the arena anything has reached
+    u32 fallbacks;      // requests that didn't fit and went to the heap
+    u32 fallback_max;   // largest of those
+} scratch_stats;
+
+// Carve the arena off the top of MEM2. Call once, early, before the heap
+// has had a chance to grow up into it
+void scratch_init(void);
+
+// size bytes, 32-byte aligned. Goes to memalign if the arena is full, so
+// callers only have to cope with NULL the way they did before. Safe from
+// any thread
+void *scratch_alloc(u32 size);
+
+// Give back something from scratch_alloc (NULL is fine)
+void scratch_free(void *p);
+
+void scratch_get_stats(scratch_stats *out);
+
+#endif // SCRATCH_H
@@ -0,0 +1,130 @@
+// sha1.c
+// plain SHA-1, written for Broadway rather than borrowed from a desktop
+// library. the Wii is big-endian so message words load straight out of
+// memory with no byte swapping, the 80 rounds are fully unrolled so the
+// five state words stay in registers, and the schedule is a rolling
+// 16-word window instead of the full 80-word array.
+// whole 64-byte blocks go straight from the caller's buffer, only the
+// leftovers get copied, so big aligned ISFS reads hash at full speed.
+
+#include <gccore.h>
+#include <string.h>
+
+#include "sha1.h"
+
+#define ROL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+// w[i] = rol(w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16], 1), kept mod 16
+#define W(i) (w[(i) & 15] = ROL(w[((i) + 13) & 15] ^ w[((i) + 8) & 15] ^ \
+                                w[((i) + 2) & 15] ^ w[(i) & 15], 1))
+
+#define R0(a, b, c, d, e, i) e += ROL(a, 5) + (d ^ (b & (c ^ d))) + w[i] + 0x5A827999; b = ROL(b, 30);
+#define R1(a, b, c, d, e, i) e += ROL(a, 5) + (d ^ (b & (c ^ d))) + W(i) + 0x5A827999; b = ROL(b, 30);
+#define R2(a, b, c, d, e, i) e += ROL(a, 5) + (b ^ c ^ d)         + W(i) + 0x6ED9EBA1; b = ROL(b, 30);
+#define R3(a, b, c, d, e, i) e += ROL(a, 5) + (((b | c) & d) | (b & c)) + W(i) + 0x8F1BBCDC; b = ROL(b, 30);
+#define R4(a, b, c, d, e, i) e += ROL(a, 5) + (b ^ c ^ d)         + W(i) + 0xCA62C1D6; b = ROL(b, 30);
+
+// five rounds with the variables rotated, after which they're back in place
+#define R5(R, i) R(a, b, c, d, e, (i))     R(e, a, b, c, d, (i) + 1) \
+                 R(d, e, a, b, c, (i) + 2) R(c, d, e, a, b, (i) + 3) \
+                 R(b, c, d, e, a, (i) + 4)
+
+
+static void sha1_block(u32 h[5], const u8 *p) {
+    u32 w[16];
+    u32 a, b, c, d, e;
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    // native order already, this turns into 16 plain loads
+    memcpy(w, p, 64);
+#else
+    int i;
+    for (i = 0; i < 16; i++)
+        w[i] = ((u32)p[i * 4] << 24) | ((u32)p[i * 4 + 1] << 16) |
+               ((u32)p[i * 4 + 2] << 8) | (u32)p[i * 4 + 3];
+#endif
+
+    a = h[0]; b = h[1]; c = h[2]; d = h[3]; e = h[4];
+
+    R5(R0, 0)  R5(R0, 5)  R5(R0, 10)
+    R0(a, b, c, d, e, 15) R1(e, a, b, c, d, 16) R1(d, e, a, b, c, 17)
+    R1(c, d, e, a, b, 18) R1(b, c, d, e, a, 19)
+    R5(R2, 20) R5(R2, 25) R5(R2, 30) R5(R2, 35)
+    R5(R3, 40) R5(R3, 45) R5(R3, 50) R5(R3, 55)
+    R5(R4, 60) R5(R4, 65) R5(R4, 70) R5(R4, 75)
+
+    h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+}
+
+
+void sha1_init(sha1_ctx *ctx) {
+    ctx->h[0] = 0x67452301;
+    ctx->h[1] = 0xEFCDAB89;
+    ctx->h[2] = 0x98BADCFE;
+    ctx->h[3] = 0x10325476;
+    ctx->h[4] = 0xC3D2E1F0;
+    ctx->len  = 0;
+    ctx->used = 0;
+}
+
+
+void sha1_update(sha1_ctx *ctx, const void *data, u32 len) {
+    const u8 *p = (const u8 *)data;
+
+    ctx->len += len;
+
+    if (ctx->used > 0) {
+        u32 take = 64 - ctx->used;
+        if (take > len) take = len;
+        memcpy(ctx->buf + ctx->used, p, take);
+        ctx->used += take;
+        p   += take;
+        len -= take;
+        if (ctx->used < 64) return;
+        sha1_block(ctx->h, ctx->buf);
+        ctx->used = 0;
+    }
+
+    while (len >= 64) {
+        sha1_block(ctx->h, p);
+        p   += 64;
+        len -= 64;
+    }
+
+    if (len > 0) {
+        memcpy(ctx->buf, p, len);
+        ctx->used = len;
+    }
+}
+
+
+void sha1_final(sha1_ctx *ctx, u8 out[SHA1_DIGEST_SIZE]) {
+    u64 bits = ctx->len * 8;
+    int i;
+
+    ctx->buf[ctx->used++] = 0x80;
+    if (ctx->used > 56) {
+        memset(ctx->buf + ctx->used, 0, 64 - ctx->used);
+        sha1_block(ctx->h, ctx->buf);
+        ctx->used = 0;
+    }
+    memset(ctx->buf + ctx->used, 0, 56 - ctx->used);
+    for (i = 0; i < 8; i++)
+        ctx->buf[56 + i] = (u8)(bits >> (56 - i * 8));
+    sha1_block(ctx->h, ctx->buf);
+
+    for (i = 0; i < 5; i++) {
+        out[i * 4]     = (u8)(ctx->h[i] >> 24);
+        out[i * 4 + 1] = (u8)(ctx->h[i] >> 16);
+        out[i * 4 + 2] = (u8)(ctx->h[i] >> 8);
+        out[i * 4 + 3] = (u8)ctx->h[i];
+    }
+}
+
+
+void sha1(const void *data, u32 len, u8 out[SHA1_DIGEST_SIZE]) {
+    sha1_ctx ctx;
+    sha1_init(&ctx);
+    sha1_update(&ctx, data, len);
+    sha1_final(&ctx, out);
+}
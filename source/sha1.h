@@ -0,0 +1,26 @@
+/*
+ * WiiMedic - sha1.h
+ * SHA-1 for content verification
+ */
+#ifndef SHA1_H
+#define SHA1_H
+
+#include <gccore.h>
+
+#define SHA1_DIGEST_SIZE 20
+
+typedef struct {
+    u32 h[5];
+    u64 len;        // total bytes fed in
+    u8  buf[64];    // partial block
+    u32 used;
+} sha1_ctx;
+
+void sha1_init(sha1_ctx *ctx);
+void sha1_update(sha1_ctx *ctx, const void *data, u32 len);
+void sha1_final(sha1_ctx *ctx, u8 out[SHA1_DIGEST_SIZE]);
+
+// One-shot hash of a buffer
+void sha1(const void *data, u32 len, u8 out[SHA1_DIGEST_SIZE]);
+
+#endif // SHA1_H
@@ -5,28 +5,219 @@
 // the benchmark writes a 1MB temp file and reads it back, repeated 3 times
 // and averaged. it's not super scientific but it gives a reasonable ballpark
 // for whether your card is fast enough for USB Loader GX and friends.
+//
+// there's also a block-size sweep for when 1MB isn't enough. USB drives with
+// a big write cache swallow 1MB whole and report silly numbers, so the sweep
+// goes up to 64MB files and 1MB blocks to find where the cache runs out.
+//
+// the quick benchmark also does a random 4KB read/write pass, because game
+// loaders hop around WBFS/ISO files and sequential KB/s doesn't tell you
+// much about that. the latency tail (p95/p99) is what shows up as stutter.
+//
+// last step reads raw sectors through the disc_io driver (same one libfat
+// sits on), skipping FAT and stdio completely. comparing that against the
+// fread number shows how much the filesystem layer is costing you.
+//
+// the pipeline mode splits writing across two threads: one fills buffers,
+// the other writes them out, with a ring of N buffers between them. libfat
+// itself is still synchronous, so what this measures is how much a device
+// gains when the next buffer is always ready the moment a write returns.
+//
+// the quick benchmark checks its reads too: every block is written with its
+// own seeded pattern and CRC32'd on the way back, so a fake-capacity or
+// dying card that hands back the wrong data gets caught in the same pass.
+//
+// surface scan is the big one: fill all the free space with 64MB files of
+// seeded 1MB chunks, then read everything back. fake-capacity cards pass
+// the small tests and fall over here. a checkpoint file on the card after
+// every 64MB means you can stop it (or lose power) and pick up later.
 
 #include <dirent.h>
+#include <errno.h>
 #include <fat.h>
 #include <gccore.h>
 #include <malloc.h>
+#include <ogc/disc_io.h>
+#include <ogc/lwp.h>
 #include <ogc/lwp_watchdog.h>
+#include <ogc/semaphore.h>
+#include <ogc/usbstorage.h>
+#include <sdcard/wiisd_io.h>
+#include <wiiuse/wpad.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <sys/statvfs.h>
 #include <time.h>
+#include <unistd.h>
 
+#include "history.h"
+#include "result_cache.h"
+#include "scratch.h"
 #include "storage_test.h"
+#include "subsys.h"
 #include "ui_common.h"
 
+// last, it wraps the IOS and libfat calls by name
+#include "prof_calls.h"
+
 #define TEST_SIZE       (1024 * 1024)  // 1MB - big enough to get a real measurement
+#define TEST_SIZE_MAX   (16 * 1024 * 1024)
 #define BLOCK_SIZE      (32 * 1024)    // 32KB blocks, matches typical SD cluster size
 #define ITERATIONS      3              // average over 3 runs to smooth out caching
+#define ITERATIONS_MAX  10
 #define SPEED_GOOD_KB   2000           // >= 2000 KB/s = thumbs up
 #define SPEED_OK_KB     1000           // >= 1000 KB/s = acceptable but not great
 
-static char s_report[4096];
+// sweep grid. every file size gets tested with every block size, so the
+// 64MB row is where the time goes - a slow card takes a few minutes.
+#define SWEEP_MAX_BLOCK (1024 * 1024)
+#define SWEEP_NBLOCKS   5
+#define SWEEP_NFILES    4
+static const u32 s_sweep_blocks[SWEEP_NBLOCKS] = {
+    4 * 1024, 16 * 1024, 64 * 1024, 256 * 1024, 1024 * 1024
+};
+static const u32 s_sweep_files_mb[SWEEP_NFILES] = { 1, 4, 16, 64 };
+
+// random access test. the file has to be well past libfat's sector cache
+// or we'd just be timing memcpy.
+#define RAND_FILE_SIZE  (8 * 1024 * 1024)
+#define RAND_IO_SIZE    4096
+#define RAND_OPS        256
+#define RAND_READ_GOOD  300    // IOPS
+#define RAND_READ_OK    100
+#define RAND_WRITE_GOOD 100
+#define RAND_WRITE_OK   25
+#define RAND_TAIL_MS    20.0f  // p99 above this = users will feel it
+
+// raw sector reads. start 32MB in so we're past the FAT tables, which the
+// device has probably just cached for us. each buffer size gets its own
+// fresh RAW_READ_BYTES window so they can't help each other either.
+#define RAW_START_SECTOR 65536
+#define RAW_READ_BYTES   (4 * 1024 * 1024)
+#define RAW_MAX_BUF      (512 * 1024)
+#define RAW_NSIZES       4
+static const u32 s_raw_sizes[RAW_NSIZES] = {
+    4 * 1024, 32 * 1024, 128 * 1024, 512 * 1024
+};
+
+// queued write pipeline. depths are tried in this order, 1 being the
+// "no overlap" baseline everything else gets compared against.
+#define PIPE_FILE_SIZE  (8 * 1024 * 1024)
+#define PIPE_BLOCK      (32 * 1024)
+#define PIPE_MAX_DEPTH  8
+#define PIPE_NDEPTHS    4
+static const int s_pipe_depths[PIPE_NDEPTHS] = { 1, 2, 4, 8 };
+
+#define PIPE_PROD_STACK  8192
+#define PIPE_WRITE_STACK 16384
+
+// PIPE_MAX_DEPTH * PIPE_BLOCK of buffers, then the two thread stacks, all
+// in one scratch block for as long as the test runs
+static u8            *s_pipe_bufs = NULL;
+static int            s_pipe_depth;
+static FILE          *s_pipe_fp;
+static sem_t          s_pipe_free, s_pipe_full;
+static volatile bool  s_pipe_failed;
+static lwp_t          s_pipe_prod_thread, s_pipe_write_thread;
+
+// surface scan. one 64MB file is one checkpoint and one cell on the region
+// map. the state file is rewritten after every file, so at worst you redo
+// 64MB when resuming.
+#define SCAN_DIR          "wiimedic_scan"
+#define SCAN_CHUNK        (1024 * 1024)
+#define SCAN_FILE_CHUNKS  64
+#define SCAN_FILE_MB      (SCAN_FILE_CHUNKS * SCAN_CHUNK / (1024 * 1024))
+#define SCAN_MAX_FILES    4096      // 256GB worth, way past any FAT32 card
+#define SCAN_RESERVE      (16 * 1024 * 1024)
+#define SCAN_MAGIC        0x574D5343  // 'WMSC'
+#define SCAN_VERSION      1
+#define SCAN_HIST         8
+#define SCAN_MAP_COLS     50
+#define SCAN_MAP_ROWS     6
+
+// worst last, the map shows the highest value in each cell
+enum { SCAN_UNTESTED = 0, SCAN_GOOD, SCAN_BAD, SCAN_IOERR, SCAN_WRERR };
+
+// this many files in a row refusing writes (not for lack of space) and the
+// card is treated as having stopped taking them altogether
+#define SCAN_WRERR_STREAK 4
+
+typedef struct {
+    u32 magic;
+    u32 version;
+    u32 nfiles;     // how many 64MB files the scan covers
+    u32 written;    // files fully written so far
+    u32 verified;   // files fully read back so far
+    u8  map[SCAN_MAX_FILES];
+} scan_state;
+
+static scan_state s_scan;
+static float      s_scan_hist[SCAN_HIST];
+static float      s_scan_peak;
+
+static u32 s_lat_us[RAND_OPS];
+static u32 s_rand_state = 1;
+
+// results are only known while the tests run, so they get recorded into a
+// log and replayed into whatever sink asks for the report later
+static sink_log s_log;
+
+// what the report runs. the menu always does the default quick benchmark,
+// autorun.cfg can ask for something else
+static int s_report_mode   = STORAGE_QUICK;
+static u32 s_bench_size    = TEST_SIZE;
+static int s_bench_passes  = ITERATIONS;
+
+
+static void report_add(const char *fmt, ...) {
+    char line[256];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+    sink_text(&s_log.sink, "%s", line);
+}
+
+// field key for the structured report, prefixed by device:
+// ("SD Card", "rand_%s_iops", "Read") -> "sd_rand_read_iops".
+// returns a static buffer, use it straight away
+static const char *dev_key(const char *name, const char *fmt, ...) {
+    static char key[48];
+    va_list args;
+    int n = snprintf(key, sizeof(key), "%s_", strncmp(name, "SD", 2) == 0 ? "sd" : "usb");
+    char *p;
+    va_start(args, fmt);
+    vsnprintf(key + n, sizeof(key) - n, fmt, args);
+    va_end(args);
+    for (p = key; *p; p++)
+        if (*p >= 'A' && *p <= 'Z') *p = *p - 'A' + 'a';
+    return key;
+}
+
+
+// microsecond resolution - the small sweep files finish in a handful of ms
+// and whole-millisecond rounding makes the numbers jump around
+static float ticks_to_kbs(u64 ticks, u32 bytes) {
+    u64 us = ticks_to_microsecs(ticks);
+    if (us == 0) return 0.0f;
+    return (float)bytes / 1024.0f * 1000000.0f / (float)us;
+}
+
+
+static const char *speed_color(float kbs) {
+    if (kbs > SPEED_GOOD_KB) return UI_BGREEN;
+    if (kbs > SPEED_OK_KB)   return UI_BYELLOW;
+    return UI_BRED;
+}
+
+
+static void size_label(u32 bytes, char *buf, int bufsize) {
+    if (bytes >= 1024 * 1024) snprintf(buf, bufsize, "%uM", bytes / (1024 * 1024));
+    else                      snprintf(buf, bufsize, "%uK", bytes / 1024);
+}
 
 
 static bool device_is_accessible(const char *path) {
@@ -91,101 +282,1104 @@ static void show_device_info(const char *name, const char *path) {
 }
 
 
-static void run_benchmark(const char *name, const char *base) {
-    char testfile[256];
-    int blocks = TEST_SIZE / BLOCK_SIZE;
-    int i, iter;
-    u64 write_ticks = 0, read_ticks = 0;
-    float write_kbs, read_kbs;
-    char buf[128];
+// read-back verification for timed_read. expect[] holds the CRC32 of every
+// block as it was written, pattern is the written data itself (only touched
+// when a block fails, to find the first bad byte).
+#define VERIFY_MAX_SHOWN 8
 
-    snprintf(testfile, sizeof(testfile), "%s/wiimedic_bench.tmp", base);
+typedef struct {
+    const u32 *expect;
+    const u8  *pattern;
+    u64        ticks;       // time spent checksumming, kept out of read time
+    u32        bad_blocks;
+} verify_ctx;
 
-    u8 *data = (u8 *)memalign(32, BLOCK_SIZE);
+static u32  s_crc_table[4][256];
+static bool s_crc_ready = false;
+
+
+// plain reflected CRC32 (same as zip), sliced 4 bytes at a time.
+// the word gets assembled from bytes so it comes out the same on the
+// big-endian Broadway as it does on a PC checking the file afterwards.
+static void crc32_init(void) {
+    u32 i, j, c;
+    for (i = 0; i < 256; i++) {
+        c = i;
+        for (j = 0; j < 8; j++)
+            c = (c & 1) ? (c >> 1) ^ 0xEDB88320u : (c >> 1);
+        s_crc_table[0][i] = c;
+    }
+    for (i = 0; i < 256; i++) {
+        c = s_crc_table[0][i];
+        for (j = 1; j < 4; j++) {
+            c = s_crc_table[0][c & 0xFF] ^ (c >> 8);
+            s_crc_table[j][i] = c;
+        }
+    }
+    s_crc_ready = true;
+}
+
+static u32 crc32_block(const u8 *p, u32 len) {
+    u32 crc = 0xFFFFFFFFu;
+
+    if (!s_crc_ready) crc32_init();
+
+    while (len >= 4) {
+        crc ^= (u32)p[0] | ((u32)p[1] << 8) | ((u32)p[2] << 16) | ((u32)p[3] << 24);
+        crc = s_crc_table[3][crc & 0xFF] ^ s_crc_table[2][(crc >> 8) & 0xFF] ^
+              s_crc_table[1][(crc >> 16) & 0xFF] ^ s_crc_table[0][crc >> 24];
+        p += 4;
+        len -= 4;
+    }
+    while (len--)
+        crc = s_crc_table[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+
+// CRC check of one block that just came back. on a mismatch, finds the
+// first wrong byte and tells the user exactly where it was.
+static void verify_block(verify_ctx *v, const u8 *data, u32 block, u32 block_size) {
+    u64 t0 = gettime();
+    u32 crc = crc32_block(data, block_size);
+    v->ticks += gettime() - t0;
+
+    if (crc == v->expect[block]) return;
+
+    if (v->bad_blocks < VERIFY_MAX_SHOWN) {
+        const u8 *want = v->pattern + block * block_size;
+        u32 off = 0;
+        char msg[96];
+        while (off < block_size && data[off] == want[off]) off++;
+        snprintf(msg, sizeof(msg), "Data mismatch at offset 0x%08X (block %u)",
+                 (unsigned)(block * block_size + off), (unsigned)block);
+        ui_draw_err(msg);
+        report_add("  %s\n", msg);
+    }
+    v->bad_blocks++;
+}
+
+
+// fills a block with a pattern seeded by its block number, a word at a time.
+// every block ends up different so nothing downstream can dedupe them.
+static void fill_pattern(u8 *buf, u32 size, u32 seed) {
+    u32 *w = (u32 *)buf;
+    u32 n = size / 4;
+    u32 v = seed * 0x9E3779B9u + 0x7F4A7C15u;
+    u32 i;
+    for (i = 0; i < n; i++) {
+        w[i] = v;
+        v = v * 1664525u + 1013904223u;
+    }
+}
+
+
+// writes file_size bytes in block_size chunks and adds the elapsed time to
+// *ticks. block i comes from data at (i * block_size) % data_len, so pass one
+// block to repeat it or the whole file's worth for distinct blocks.
+// on any failure it shows an error, cleans up the file and returns false.
+static bool timed_write(const char *name, const char *path, const u8 *data, u32 data_len,
+                        u32 file_size, u32 block_size, u64 *ticks) {
+    u32 blocks = file_size / block_size;
+    u32 i;
+
+    FILE *fp = fopen(path, "wb");
+    if (!fp) {
+        char msg[128];
+        snprintf(msg, sizeof(msg), "Can't create temp file on %s - is it write protected?", name);
+        ui_draw_err(msg);
+        return false;
+    }
+
+    u64 t0 = gettime();
+    for (i = 0; i < blocks; i++) {
+        const u8 *src = data + (u32)(((u64)i * block_size) % data_len);
+        if (fwrite(src, 1, block_size, fp) != block_size) {
+            ui_draw_err("Write error - card may be full or failing");
+            fclose(fp);
+            remove(path);
+            return false;
+        }
+    }
+    fflush(fp);
+    fclose(fp);
+    *ticks += (gettime() - t0);
+    return true;
+}
+
+
+// reads the file back the same way. if v is given every block is CRC
+// checked against it as it arrives; that time is kept separate in v->ticks.
+static bool timed_read(const char *path, u8 *data, u32 file_size, u32 block_size,
+                       u64 *ticks, verify_ctx *v) {
+    u32 blocks = file_size / block_size;
+    u32 i;
+
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        ui_draw_err("Can't open temp file for reading");
+        remove(path);
+        return false;
+    }
+
+    u64 t0 = gettime();
+    u64 vt0 = v ? v->ticks : 0;
+    for (i = 0; i < blocks; i++) {
+        if (fread(data, 1, block_size, fp) != block_size) {
+            ui_draw_err("Read error - storage may be failing");
+            fclose(fp);
+            remove(path);
+            return false;
+        }
+        if (v) verify_block(v, data, i, block_size);
+    }
+    fclose(fp);
+    *ticks += (gettime() - t0) - (v ? v->ticks - vt0 : 0);
+    return true;
+}
+
+
+// xorshift32, plenty random enough to defeat read-ahead
+static u32 rand_next(void) {
+    u32 x = s_rand_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    s_rand_state = x;
+    return x;
+}
+
+
+static int cmp_u32(const void *a, const void *b) {
+    u32 x = *(const u32 *)a, y = *(const u32 *)b;
+    return (x > y) - (x < y);
+}
+
+
+// RAND_OPS 4KB transfers at random 4KB-aligned offsets. writes are synced
+// one by one, otherwise libfat just soaks them up in its cache.
+// per-op latency goes into s_lat_us[], total time into *ticks.
+static bool random_pass(FILE *fp, u8 *data, bool write, u64 *ticks) {
+    u32 slots = RAND_FILE_SIZE / RAND_IO_SIZE;
+    int i;
+
+    for (i = 0; i < RAND_OPS; i++) {
+        long off = (long)(rand_next() % slots) * RAND_IO_SIZE;
+        u64 t0 = gettime();
+
+        if (fseek(fp, off, SEEK_SET) != 0) return false;
+        if (write) {
+            if (fwrite(data, 1, RAND_IO_SIZE, fp) != RAND_IO_SIZE) return false;
+            fflush(fp);
+            fsync(fileno(fp));
+        } else {
+            if (fread(data, 1, RAND_IO_SIZE, fp) != RAND_IO_SIZE) return false;
+        }
+
+        u64 dt = gettime() - t0;
+        s_lat_us[i] = (u32)ticks_to_microsecs(dt);
+        *ticks += dt;
+    }
+    return true;
+}
+
+
+// sorts s_lat_us[] and prints IOPS + latency percentiles for one pass
+static void show_random_result(const char *name, const char *what, u64 ticks,
+                               int good, int ok) {
+    char key[32], buf[96];
+    u64 us = ticks_to_microsecs(ticks);
+    float iops = (us > 0) ? (float)RAND_OPS * 1000000.0f / (float)us : 0.0f;
+    float p50, p95, p99;
+    const char *color;
+
+    qsort(s_lat_us, RAND_OPS, sizeof(u32), cmp_u32);
+    p50 = (float)s_lat_us[RAND_OPS * 50 / 100] / 1000.0f;
+    p95 = (float)s_lat_us[RAND_OPS * 95 / 100] / 1000.0f;
+    p99 = (float)s_lat_us[RAND_OPS * 99 / 100] / 1000.0f;
+
+    color = (iops >= good) ? UI_BGREEN : (iops >= ok) ? UI_BYELLOW : UI_BRED;
+
+    snprintf(key, sizeof(key), "Random 4K %s", what);
+    snprintf(buf, sizeof(buf), "%.0f IOPS", iops);
+    ui_draw_kv_color(key, color, buf);
+
+    snprintf(buf, sizeof(buf), "%.2f / %.2f / %.2f ms", p50, p95, p99);
+    ui_draw_kv_color("  p50 / p95 / p99", (p99 > RAND_TAIL_MS) ? UI_BYELLOW : UI_BWHITE, buf);
+
+    report_add("%s: Random 4K %s %.0f IOPS (p50 %.2f ms, p95 %.2f ms, p99 %.2f ms)\n",
+               name, what, iops, p50, p95, p99);
+    sink_field_num(&s_log.sink, dev_key(name, "rand_%s_iops", what),   iops);
+    sink_field_num(&s_log.sink, dev_key(name, "rand_%s_p50_ms", what), p50);
+    sink_field_num(&s_log.sink, dev_key(name, "rand_%s_p95_ms", what), p95);
+    sink_field_num(&s_log.sink, dev_key(name, "rand_%s_p99_ms", what), p99);
+
+    if (p99 > RAND_TAIL_MS) {
+        snprintf(buf, sizeof(buf), "Slow %s tail (p99 over %.0f ms) - expect stutter in games",
+                 what, RAND_TAIL_MS);
+        ui_draw_warn(buf);
+    }
+}
+
+
+// preallocates an 8MB file with big sequential writes, then times random
+// 4KB reads and writes inside it. data must hold at least BLOCK_SIZE bytes.
+static void run_random_io(const char *name, const char *base, u8 *data) {
+    PROF_FUNC();
+    char randfile[256];
+    u64 prefill = 0, rticks = 0, wticks = 0;
+    bool ok;
+
+    snprintf(randfile, sizeof(randfile), "%s/wiimedic_rand.tmp", base);
+
+    ui_printf("   " UI_WHITE "Random 4K test...\n" UI_RESET);
+    if (!timed_write(name, randfile, data, BLOCK_SIZE, RAND_FILE_SIZE, BLOCK_SIZE, &prefill))
+        return;
+
+    FILE *fp = fopen(randfile, "r+b");
+    if (!fp) {
+        ui_draw_err("Can't reopen random test file");
+        remove(randfile);
+        return;
+    }
+    // no stdio buffering - every op should reach the card
+    setvbuf(fp, NULL, _IONBF, 0);
+    s_rand_state = (u32)gettime() | 1;
+
+    ok = random_pass(fp, data, false, &rticks);
+    if (ok) show_random_result(name, "Read", rticks, RAND_READ_GOOD, RAND_READ_OK);
+
+    if (ok) ok = random_pass(fp, data, true, &wticks);
+    if (ok) show_random_result(name, "Write", wticks, RAND_WRITE_GOOD, RAND_WRITE_OK);
+
+    if (!ok) ui_draw_err("Random I/O error - storage may be failing");
+
+    fclose(fp);
+    remove(randfile);
+}
+
+
+// USB drives can have 4KB sectors and readSectors counts in device sectors,
+// so asking for "8 sectors" could write 32KB into a 4KB buffer. read one
+// sector into a big pre-filled buffer twice with different fill bytes and
+// see how far the driver actually wrote. returns 0 if the read fails.
+static u32 probe_sector_size(const DISC_INTERFACE *io, sec_t sector, u8 *buf) {
+    u32 last = 0;
+    int pass, i;
+
+    for (pass = 0; pass < 2; pass++) {
+        u8 fill = pass ? 0x5A : 0xA5;
+        memset(buf, fill, 8192);
+        if (!io->readSectors(sector, 1, buf)) return 0;
+        for (i = 8191; i >= 0; i--) {
+            if (buf[i] != fill) break;
+        }
+        if ((u32)(i + 1) > last) last = (u32)(i + 1);
+    }
+
+    if (last <= 512)  return 512;
+    if (last <= 1024) return 1024;
+    if (last <= 2048) return 2048;
+    return 4096;
+}
+
+
+// FAT volume serial out of the boot sector, following the first MBR
+// partition if the card has a partition table. 0 if there's no telling
+static u32 volume_serial(const DISC_INTERFACE *io) {
+    u32 serial = 0, lba = 0;
+    u8 *buf;
+
+    if (!io || !io->readSectors || (io->isInserted && !io->isInserted())) return 0;
+    // 8KB so a 4KB-sector drive can't overrun it (see probe_sector_size)
+    buf = (u8 *)scratch_alloc(8192);
+    if (!buf) return 0;
+
+    if (io->readSectors(0, 1, buf) && buf[510] == 0x55 && buf[511] == 0xAA) {
+        bool ok = true;
+        if (memcmp(buf + 0x36, "FAT", 3) != 0 && memcmp(buf + 0x52, "FAT", 3) != 0) {
+            lba = buf[0x1C6] | (buf[0x1C7] << 8) | (buf[0x1C8] << 16) | ((u32)buf[0x1C9] << 24);
+            ok = lba != 0 && io->readSectors(lba, 1, buf);
+        }
+        if (ok && memcmp(buf + 0x52, "FAT32", 5) == 0)
+            serial = buf[0x43] | (buf[0x44] << 8) | (buf[0x45] << 16) | ((u32)buf[0x46] << 24);
+        else if (ok && memcmp(buf + 0x36, "FAT", 3) == 0)
+            serial = buf[0x27] | (buf[0x28] << 8) | (buf[0x29] << 16) | ((u32)buf[0x2A] << 24);
+    }
+
+    scratch_free(buf);
+    return serial;
+}
+
+
+// times raw readSectors() calls for each buffer size and prints them next to
+// the filesystem read speed (fs_read_kbs, measured with BLOCK_SIZE freads).
+static void run_raw_read(const char *name, const char *base,
+                         const DISC_INTERFACE *io, float fs_read_kbs) {
+    PROF_FUNC();
+    sec_t start = RAW_START_SECTOR;
+    u32 sector_size;
+    float raw_kbs[RAW_NSIZES];
+    float raw_at_block = 0.0f;
+    char key[32], buf[96], lbl[8];
+    int i;
+
+    if (!io || !io->readSectors || (io->isInserted && !io->isInserted())) {
+        ui_draw_warn("Raw device access not available for this drive");
+        return;
+    }
+
+    ui_printf("   " UI_WHITE "Raw sector read test...\n" UI_RESET);
+
+    u8 *data = (u8 *)scratch_alloc(RAW_MAX_BUF);
     if (!data) {
-        ui_draw_err("Can't allocate benchmark buffer - out of memory?");
+        ui_draw_err("Can't allocate raw read buffer - out of memory?");
         return;
     }
 
-    // fill with a known pattern so we can theoretically verify reads too
-    // (we don't actually verify here but at least the data isn't garbage)
-    for (i = 0; i < BLOCK_SIZE; i++)
-        data[i] = (u8)(i & 0xFF);
+    // tiny cards (<64MB) don't go that far, just start at the beginning then
+    sector_size = probe_sector_size(io, start, data);
+    if (sector_size == 0) {
+        start = 0;
+        sector_size = probe_sector_size(io, start, data);
+    }
+    if (sector_size == 0) {
+        ui_draw_err("Raw sector read failed - driver refused the request");
+        scratch_free(data);
+        return;
+    }
 
-    // --- write test ---
-    ui_printf("   " UI_WHITE "Write test...\n" UI_RESET);
+    for (i = 0; i < RAW_NSIZES; i++)
+        raw_kbs[i] = -1.0f;
 
-    for (iter = 0; iter < ITERATIONS; iter++) {
-        FILE *fp = fopen(testfile, "wb");
-        if (!fp) {
-            char msg[128];
-            snprintf(msg, sizeof(msg), "Can't create temp file on %s - is it write protected?", name);
-            ui_draw_err(msg);
-            free(data);
-            return;
+    for (i = 0; i < RAW_NSIZES; i++) {
+        u32 count = s_raw_sizes[i] / sector_size;
+        u32 ops = RAW_READ_BYTES / s_raw_sizes[i];
+        u32 op;
+        u64 t0, ticks;
+
+        if (count == 0) continue;
+
+        t0 = gettime();
+        for (op = 0; op < ops; op++) {
+            if (!io->readSectors(start, count, data)) break;
+            start += count;
         }
+        ticks = gettime() - t0;
+        if (op < ops) {
+            snprintf(buf, sizeof(buf), "Raw read failed near sector %u", (unsigned)start);
+            ui_draw_err(buf);
+            break;
+        }
+        raw_kbs[i] = ticks_to_kbs(ticks, RAW_READ_BYTES);
+        if (s_raw_sizes[i] == BLOCK_SIZE) raw_at_block = raw_kbs[i];
+    }
+    scratch_free(data);
 
-        u64 t0 = gettime();
-        for (i = 0; i < blocks; i++) {
-            if ((int)fwrite(data, 1, BLOCK_SIZE, fp) != BLOCK_SIZE) {
+    report_add("%s: Raw sector reads (%u-byte sectors):", name, sector_size);
+    for (i = 0; i < RAW_NSIZES; i++) {
+        if (raw_kbs[i] < 0.0f) continue;
+        size_label(s_raw_sizes[i], lbl, sizeof(lbl));
+        snprintf(key, sizeof(key), "Raw Read %s", lbl);
+        snprintf(buf, sizeof(buf), "%.1f KB/s (%.2f MB/s)", raw_kbs[i], raw_kbs[i] / 1024.0f);
+        ui_draw_kv_color(key, speed_color(raw_kbs[i]), buf);
+        report_add(" %s=%.0f KB/s", lbl, raw_kbs[i]);
+        sink_field_num(&s_log.sink, dev_key(name, "raw_read_%u_kbs", s_raw_sizes[i]), raw_kbs[i]);
+    }
+    report_add("\n");
+
+    // same transfer size on both sides, so the difference is FAT + stdio
+    if (raw_at_block > 0.0f && fs_read_kbs > 0.0f) {
+        float pct = fs_read_kbs * 100.0f / raw_at_block;
+        snprintf(buf, sizeof(buf), "%.0f%% of raw speed at 32K", pct);
+        ui_draw_kv_color("Filesystem Efficiency", (pct >= 80.0f) ? UI_BGREEN : UI_BYELLOW, buf);
+        report_add("%s: Filesystem reads at %.0f%% of raw speed\n", name, pct);
+        sink_field_num(&s_log.sink, dev_key(name, "fs_efficiency_pct"), pct);
+    }
+
+    {
+        char root[16];
+        struct statvfs vfs;
+        snprintf(root, sizeof(root), "%s/", base);
+        if (statvfs(root, &vfs) == 0 && vfs.f_bsize > 0) {
+            size_label((u32)vfs.f_bsize, lbl, sizeof(lbl));
+            ui_draw_kv("Cluster Size", lbl);
+            report_add("%s: Cluster size %s\n", name, lbl);
+            sink_field_int(&s_log.sink, dev_key(name, "cluster_bytes"), vfs.f_bsize);
+            if (vfs.f_bsize < 32 * 1024)
+                ui_draw_info("Clusters under 32K make FAT do more work per read");
+        }
+    }
+}
+
+
+static void *pipe_producer(void *arg) {
+    u32 blocks = PIPE_FILE_SIZE / PIPE_BLOCK;
+    u32 i;
+    (void)arg;
+
+    for (i = 0; i < blocks; i++) {
+        LWP_SemWait(s_pipe_free);
+        if (s_pipe_failed) break;
+        fill_pattern(s_pipe_bufs + (i % s_pipe_depth) * PIPE_BLOCK, PIPE_BLOCK, i);
+        LWP_SemPost(s_pipe_full);
+    }
+    return NULL;
+}
+
+
+static void *pipe_writer(void *arg) {
+    u32 blocks = PIPE_FILE_SIZE / PIPE_BLOCK;
+    u32 i;
+    (void)arg;
+
+    for (i = 0; i < blocks; i++) {
+        LWP_SemWait(s_pipe_full);
+        if (s_pipe_failed) break;   // no producer after all
+        if (fwrite(s_pipe_bufs + (i % s_pipe_depth) * PIPE_BLOCK, 1, PIPE_BLOCK, s_pipe_fp)
+                != PIPE_BLOCK) {
+            // wake the producer up so it notices and quits
+            s_pipe_failed = true;
+            LWP_SemPost(s_pipe_free);
+            break;
+        }
+        LWP_SemPost(s_pipe_free);
+    }
+    fflush(s_pipe_fp);
+    return NULL;
+}
+
+
+#define PIPE_ERR_WRITE   -1.0f
+#define PIPE_ERR_THREAD  -2.0f
+
+// one pipelined write of PIPE_FILE_SIZE with the given ring depth.
+// returns KB/s, or PIPE_ERR_* if the write failed or a thread wouldn't start.
+static float pipe_write_once(const char *path, int depth) {
+    u64 t0, ticks;
+    bool started = true;
+
+    s_pipe_fp = fopen(path, "wb");
+    if (!s_pipe_fp) return -1.0f;
+
+    s_pipe_depth  = depth;
+    s_pipe_failed = false;
+    LWP_SemInit(&s_pipe_free, depth, depth);
+    LWP_SemInit(&s_pipe_full, 0, depth);
+
+    t0 = gettime();
+    if (LWP_CreateThread(&s_pipe_write_thread, pipe_writer, NULL,
+                         s_pipe_bufs + PIPE_MAX_DEPTH * PIPE_BLOCK, PIPE_WRITE_STACK, 64) < 0) {
+        started = false;
+    } else if (LWP_CreateThread(&s_pipe_prod_thread, pipe_producer, NULL,
+                                s_pipe_bufs + PIPE_MAX_DEPTH * PIPE_BLOCK + PIPE_WRITE_STACK,
+                                PIPE_PROD_STACK, 64) < 0) {
+        // the writer is already waiting for a block, let it go
+        started = false;
+        s_pipe_failed = true;
+        LWP_SemPost(s_pipe_full);
+        LWP_JoinThread(s_pipe_write_thread, NULL);
+    } else {
+        LWP_JoinThread(s_pipe_prod_thread, NULL);
+        LWP_JoinThread(s_pipe_write_thread, NULL);
+    }
+    fclose(s_pipe_fp);
+    ticks = gettime() - t0;
+
+    LWP_SemDestroy(s_pipe_free);
+    LWP_SemDestroy(s_pipe_full);
+
+    if (!started)      return PIPE_ERR_THREAD;
+    if (s_pipe_failed) return PIPE_ERR_WRITE;
+    return ticks_to_kbs(ticks, PIPE_FILE_SIZE);
+}
+
+
+static void run_pipeline(const char *name, const char *base) {
+    PROF_FUNC();
+    char testfile[256];
+    char buf[96], msg[64];
+    float kbs[PIPE_NDEPTHS];
+    float best_gain = 0.0f;
+    int best = 0;
+    int i;
+
+    snprintf(testfile, sizeof(testfile), "%s/wiimedic_bench.tmp", base);
+
+    s_pipe_bufs = (u8 *)scratch_alloc(PIPE_MAX_DEPTH * PIPE_BLOCK + PIPE_WRITE_STACK + PIPE_PROD_STACK);
+    if (!s_pipe_bufs) {
+        ui_draw_err("Can't allocate pipeline buffers - out of memory?");
+        return;
+    }
+
+    ui_printf("   " UI_WHITE "Queued write test (8MB per queue depth)...\n" UI_RESET);
+
+    for (i = 0; i < PIPE_NDEPTHS; i++) {
+        snprintf(msg, sizeof(msg), "%s: queue depth %d...", name, s_pipe_depths[i]);
+        ui_spin_set_msg(msg);
+        kbs[i] = pipe_write_once(testfile, s_pipe_depths[i]);
+        if (kbs[i] < 0.0f) {
+            if (kbs[i] == PIPE_ERR_THREAD)
+                ui_draw_err("Can't start the pipeline threads - out of memory?");
+            else
                 ui_draw_err("Write error - card may be full or failing");
-                fclose(fp);
-                free(data);
-                remove(testfile);
-                return;
-            }
+            remove(testfile);
+            scratch_free(s_pipe_bufs);
+            s_pipe_bufs = NULL;
+            return;
         }
-        fflush(fp);
-        fclose(fp);
-        write_ticks += (gettime() - t0);
     }
 
-    {
-        float ms = (float)ticks_to_millisecs(write_ticks / ITERATIONS);
-        write_kbs = (ms > 0) ? (float)(TEST_SIZE / 1024) * 1000.0f / ms : 0.0f;
+    remove(testfile);
+    scratch_free(s_pipe_bufs);
+    s_pipe_bufs = NULL;
+
+    ui_printf("\n   " UI_BCYAN "Queue depth      KB/s    vs QD1\n" UI_RESET);
+    report_add("%s queued writes (KB/s):", name);
+    for (i = 0; i < PIPE_NDEPTHS; i++) {
+        float gain = (kbs[0] > 0.0f) ? (kbs[i] - kbs[0]) * 100.0f / kbs[0] : 0.0f;
+        if (i == 0)
+            snprintf(buf, sizeof(buf), "%6s", "--");
+        else
+            snprintf(buf, sizeof(buf), "%+5.0f%%", gain);
+        ui_printf("   " UI_WHITE "%8d     " UI_RESET "%s%8.0f" UI_RESET "   %s\n",
+                  s_pipe_depths[i], speed_color(kbs[i]), kbs[i], buf);
+        report_add(" QD%d=%.0f", s_pipe_depths[i], kbs[i]);
+        sink_field_num(&s_log.sink, dev_key(name, "qd%d_write_kbs", s_pipe_depths[i]), kbs[i]);
+        if (gain > best_gain) { best_gain = gain; best = i; }
     }
+    report_add("\n");
 
-    // --- read test ---
-    ui_printf("   " UI_WHITE "Read test...\n" UI_RESET);
+    ui_printf("\n");
+    if (best_gain >= 10.0f) {
+        snprintf(buf, sizeof(buf), "Queued I/O helps: +%.0f%% at depth %d",
+                 best_gain, s_pipe_depths[best]);
+        ui_draw_ok(buf);
+    } else {
+        ui_draw_info("Queue depth makes no real difference on this device");
+    }
+    report_add("%s best queue depth: %d (%+.0f%% vs QD1)\n",
+               name, s_pipe_depths[best], best_gain);
+    sink_field_int(&s_log.sink, dev_key(name, "best_queue_depth"), s_pipe_depths[best]);
+}
 
-    for (iter = 0; iter < ITERATIONS; iter++) {
-        FILE *fp = fopen(testfile, "rb");
-        if (!fp) { ui_draw_err("Can't open temp file for reading"); break; }
 
-        u64 t0 = gettime();
-        for (i = 0; i < blocks; i++) {
-            if ((int)fread(data, 1, BLOCK_SIZE, fp) != BLOCK_SIZE) {
-                ui_draw_err("Read error - storage may be failing");
+static void scan_file_path(char *out, int outsize, const char *base, u32 n) {
+    snprintf(out, outsize, "%s/" SCAN_DIR "/scan_%04u.bin", base, (unsigned)n);
+}
+
+
+static bool scan_save_state(const char *base) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s/" SCAN_DIR "/state.bin", base);
+    FILE *fp = fopen(path, "wb");
+    if (!fp) return false;
+    bool ok = (fwrite(&s_scan, 1, sizeof(s_scan), fp) == sizeof(s_scan));
+    fclose(fp);
+    return ok;
+}
+
+
+// true if there's an unfinished scan on this device to pick up
+static bool scan_load_state(const char *base) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s/" SCAN_DIR "/state.bin", base);
+    FILE *fp = fopen(path, "rb");
+    if (!fp) return false;
+    bool ok = (fread(&s_scan, 1, sizeof(s_scan), fp) == sizeof(s_scan));
+    fclose(fp);
+    return ok && s_scan.magic == SCAN_MAGIC && s_scan.version == SCAN_VERSION &&
+           s_scan.nfiles > 0 && s_scan.nfiles <= SCAN_MAX_FILES &&
+           s_scan.verified < s_scan.nfiles;
+}
+
+
+static void scan_cleanup(const char *base) {
+    char path[256];
+    u32 i;
+    for (i = 0; i < SCAN_MAX_FILES; i++) {
+        scan_file_path(path, sizeof(path), base, i);
+        if (remove(path) != 0 && i >= s_scan.nfiles) break;
+    }
+    snprintf(path, sizeof(path), "%s/" SCAN_DIR "/state.bin", base);
+    remove(path);
+    snprintf(path, sizeof(path), "%s/" SCAN_DIR, base);
+    remove(path);
+}
+
+
+static char scan_map_char(u8 v) {
+    switch (v) {
+        case SCAN_GOOD:  return '.';
+        case SCAN_BAD:   return 'X';
+        case SCAN_IOERR: return '?';
+        case SCAN_WRERR: return '!';
+        default:         return '-';
+    }
+}
+
+
+// region map, squeezed so it always fits SCAN_MAP_ROWS lines. when one
+// cell covers several files the worst result wins. live is the progress
+// screen frame, otherwise it's the final result and goes in the report too.
+static void scan_draw_map(bool live) {
+    u32 cells = SCAN_MAP_COLS * SCAN_MAP_ROWS;
+    u32 per = (s_scan.nfiles + cells - 1) / cells;
+    u32 c, f;
+    char line[SCAN_MAP_COLS + 1];
+    int col = 0;
+
+    if (per == 0) per = 1;
+    for (c = 0; c * per < s_scan.nfiles; c++) {
+        u8 worst = SCAN_GOOD;
+        bool any_untested = false;
+        for (f = c * per; f < (c + 1) * per && f < s_scan.nfiles; f++) {
+            if (s_scan.map[f] == SCAN_UNTESTED) any_untested = true;
+            else if (s_scan.map[f] > worst)     worst = s_scan.map[f];
+        }
+        line[col++] = (worst == SCAN_GOOD && any_untested) ? '-' : scan_map_char(worst);
+        if (col == SCAN_MAP_COLS) {
+            line[col] = '\0';
+            ui_printf("   " UI_WHITE "%s\n" UI_RESET, line);
+            if (!live) report_add("  %s\n", line);
+            col = 0;
+        }
+    }
+    if (col > 0) {
+        line[col] = '\0';
+        ui_printf("   " UI_WHITE "%s\n" UI_RESET, line);
+        if (!live) report_add("  %s\n", line);
+    }
+    if (per > 1)
+        ui_printf("   " UI_WHITE "(each cell = %u MB)\n" UI_RESET, (unsigned)(per * SCAN_FILE_MB));
+}
+
+
+static void scan_draw(const char *name, const char *phase, u32 done_mb, u32 total_mb,
+                      float avg_mbs) {
+    char lbl[24];
+    int i;
+    u32 eta_min = (avg_mbs > 0.0f) ? (u32)((float)(total_mb - done_mb) / avg_mbs / 60.0f) : 0;
+
+    // drawn as a frame, only the numbers and bar cells that moved get repainted
+    ui_frame_begin();
+    ui_printf(UI_BGREEN " [+] WiiMedic" UI_RESET " " UI_CYAN "v" WIIMEDIC_VERSION UI_RESET
+              "  " UI_BWHITE "Surface Scan - %s\n" UI_RESET, name);
+    ui_printf(UI_WHITE " -----------------------------------------------------------\n" UI_RESET);
+
+    ui_printf("\n   " UI_CYAN "%-8s" UI_RESET " " UI_BWHITE "%u / %u MB" UI_RESET
+              "   avg %.1f MB/s   ETA %u min\n",
+              phase, (unsigned)done_mb, (unsigned)total_mb, avg_mbs, (unsigned)eta_min);
+    snprintf(lbl, sizeof(lbl), "%.1f%%", total_mb ? (float)done_mb * 100.0f / (float)total_mb : 0.0f);
+    ui_draw_hbar(done_mb, total_mb, 40, UI_BGREEN, lbl);
+
+    ui_printf("\n   " UI_BCYAN "MB/s (newest first)\n" UI_RESET);
+    for (i = 0; i < SCAN_HIST; i++) {
+        float v = s_scan_hist[i];
+        if (v > 0.0f) snprintf(lbl, sizeof(lbl), "%.1f", v);
+        else          lbl[0] = '\0';
+        // tenths of a MB/s so the bar keeps its resolution
+        ui_draw_hbar((u32)(v * 10.0f), (u32)(s_scan_peak * 10.0f), 40, speed_color(v * 1024.0f), lbl);
+    }
+
+    ui_printf("\n   " UI_BCYAN "Region map" UI_RESET UI_WHITE "  . good  X bad  ? read error  - pending\n" UI_RESET);
+    scan_draw_map(true);
+
+    ui_printf("\n" UI_WHITE " [B] Pause - progress is saved, run the scan again to resume\n" UI_RESET);
+    ui_frame_end();
+}
+
+
+static void scan_push_speed(float mbs) {
+    int i;
+    for (i = SCAN_HIST - 1; i > 0; i--) s_scan_hist[i] = s_scan_hist[i - 1];
+    s_scan_hist[0] = mbs;
+    if (mbs > s_scan_peak) s_scan_peak = mbs;
+}
+
+
+static bool scan_pause_pressed(void) {
+    WPAD_ScanPads();
+    PAD_ScanPads();
+    return (WPAD_ButtonsDown(0) & WPAD_BUTTON_B) || (PAD_ButtonsDown(0) & PAD_BUTTON_B);
+}
+
+
+// one phase of the scan (write or verify), chunk by chunk with a live
+// screen. returns 1 if the user paused, 0 when the phase is done.
+static int scan_phase(const char *name, const char *base, bool verify, u8 *buf, u8 *expect) {
+    u32 *progress = verify ? &s_scan.verified : &s_scan.written;
+    u32 total_mb = s_scan.nfiles * SCAN_FILE_MB;
+    u32 start_mb = *progress * SCAN_FILE_MB;
+    u64 phase_t0 = gettime(), sample_t0 = phase_t0;
+    u32 sample_bytes = 0;
+    u64 phase_bytes = 0;
+    int wr_streak = 0;
+    char path[256];
+
+    memset(s_scan_hist, 0, sizeof(s_scan_hist));
+    s_scan_peak = 0.0f;
+
+    while (*progress < s_scan.nfiles) {
+        u32 f = *progress;
+        u32 c;
+        bool failed = false;
+        int err = 0;
+        FILE *fp;
+
+        // nothing to read back from a file that never got written
+        if (verify && s_scan.map[f] == SCAN_WRERR) {
+            (*progress)++;
+            continue;
+        }
+
+        scan_file_path(path, sizeof(path), base, f);
+        errno = 0;
+        fp = fopen(path, verify ? "rb" : "wb");
+        if (!fp) err = errno;
+
+        for (c = 0; fp && c < SCAN_FILE_CHUNKS; c++) {
+            u32 seed = f * SCAN_FILE_CHUNKS + c;
+            if (verify) {
+                if (fread(buf, 1, SCAN_CHUNK, fp) != SCAN_CHUNK) {
+                    s_scan.map[f] = SCAN_IOERR;
+                    break;
+                }
+                fill_pattern(expect, SCAN_CHUNK, seed);
+                if (memcmp(buf, expect, SCAN_CHUNK) != 0)
+                    s_scan.map[f] = SCAN_BAD;
+            } else {
+                fill_pattern(buf, SCAN_CHUNK, seed);
+                errno = 0;
+                if (fwrite(buf, 1, SCAN_CHUNK, fp) != SCAN_CHUNK) {
+                    err = errno;
+                    failed = true;
+                    break;
+                }
+            }
+
+            sample_bytes += SCAN_CHUNK;
+            phase_bytes  += SCAN_CHUNK;
+            if (ticks_to_millisecs(gettime() - sample_t0) >= 1000) {
+                u64 now = gettime();
+                float avg = (float)phase_bytes / (1024.0f * 1024.0f) /
+                            ((float)ticks_to_millisecs(now - phase_t0) / 1000.0f);
+                scan_push_speed(ticks_to_kbs(now - sample_t0, sample_bytes) / 1024.0f);
+                scan_draw(name, verify ? "Reading" : "Writing",
+                          start_mb + (u32)(phase_bytes / (1024 * 1024)), total_mb, avg);
+                sample_t0 = now;
+                sample_bytes = 0;
+            }
+
+            if (scan_pause_pressed()) {
+                // throw away the half-done file, the checkpoint is still good
                 fclose(fp);
-                free(data);
-                remove(testfile);
-                return;
+                if (!verify) remove(path);
+                scan_save_state(base);
+                return 1;
             }
         }
-        fclose(fp);
-        read_ticks += (gettime() - t0);
+
+        if (!fp) {
+            if (verify) s_scan.map[f] = SCAN_IOERR;
+            else        failed = true;
+        } else {
+            errno = 0;
+            if (fclose(fp) != 0 && !verify && !failed) {
+                err = errno;
+                failed = true;
+            }
+        }
+
+        if (failed && err == ENOSPC) {
+            // out of space (the free-space estimate is never exact) - the
+            // scan just covers what we managed to write
+            remove(path);
+            s_scan.nfiles = f;
+            scan_save_state(base);
+            break;
+        }
+        if (failed) {
+            // anything else is the card refusing data, which is exactly what
+            // this test is looking for - it goes on the map, not under the rug
+            s_scan.map[f] = SCAN_WRERR;
+            if (++wr_streak >= SCAN_WRERR_STREAK) {
+                s_scan.nfiles = f + 1;
+                s_scan.written = s_scan.nfiles;
+                scan_save_state(base);
+                break;
+            }
+        } else if (!verify) {
+            wr_streak = 0;
+        }
+
+        if (verify && s_scan.map[f] == SCAN_UNTESTED)
+            s_scan.map[f] = SCAN_GOOD;
+        (*progress)++;
+        scan_save_state(base);
     }
+    return 0;
+}
 
-    {
-        float ms = (float)ticks_to_millisecs(read_ticks / ITERATIONS);
-        read_kbs = (ms > 0) ? (float)(TEST_SIZE / 1024) * 1000.0f / ms : 0.0f;
+
+static void run_surface_scan(const char *name, const char *base) {
+    PROF_FUNC();
+    char path[256], buf[96];
+    bool resume = false;
+    u32 i, bad = 0, ioerr = 0, wrerr = 0, first_bad = 0;
+    bool have_bad = false;
+    int paused;
+
+    if (scan_load_state(base)) {
+        char label[80];
+        const char *items[2];
+        snprintf(label, sizeof(label), "Resume scan (%u of %u MB written, %u MB read back)",
+                 (unsigned)(s_scan.written * SCAN_FILE_MB),
+                 (unsigned)(s_scan.nfiles * SCAN_FILE_MB),
+                 (unsigned)(s_scan.verified * SCAN_FILE_MB));
+        items[0] = label;
+        items[1] = "Start over";
+        int choice = ui_choose("Surface Scan", items, 2);
+        if (choice < 0) {
+            ui_draw_info("Cancelled.");
+            return;
+        }
+        resume = (choice == 0);
+        if (!resume) scan_cleanup(base);
+    }
+
+    if (!resume) {
+        struct statvfs vfs;
+        u64 free_bytes = 0;
+
+        snprintf(path, sizeof(path), "%s/", base);
+        if (statvfs(path, &vfs) == 0)
+            free_bytes = (u64)vfs.f_bfree * (u64)vfs.f_bsize;
+
+        memset(&s_scan, 0, sizeof(s_scan));
+        s_scan.magic   = SCAN_MAGIC;
+        s_scan.version = SCAN_VERSION;
+        if (free_bytes > SCAN_RESERVE)
+            s_scan.nfiles = (u32)((free_bytes - SCAN_RESERVE) / ((u64)SCAN_FILE_MB * 1024 * 1024));
+        if (s_scan.nfiles > SCAN_MAX_FILES) s_scan.nfiles = SCAN_MAX_FILES;
+
+        if (s_scan.nfiles == 0) {
+            ui_draw_err("Not enough free space for a surface scan");
+            return;
+        }
+
+        snprintf(path, sizeof(path), "%s/" SCAN_DIR, base);
+        mkdir(path, 0777);
+        if (!scan_save_state(base)) {
+            ui_draw_err("Can't write scan checkpoint - is the card write protected?");
+            return;
+        }
+    }
+
+    // live screen needs the buffers up front, 2MB total
+    u8 *data   = (u8 *)scratch_alloc(SCAN_CHUNK);
+    u8 *expect = (u8 *)scratch_alloc(SCAN_CHUNK);
+    if (!data || !expect) {
+        ui_draw_err("Can't allocate surface scan buffers - out of memory?");
+        scratch_free(data);
+        scratch_free(expect);
+        return;
+    }
+
+    ui_live_begin();
+    paused = scan_phase(name, base, false, data, expect);
+    if (!paused) paused = scan_phase(name, base, true, data, expect);
+    ui_live_end("Storage Speed Test");
+
+    scratch_free(data);
+    scratch_free(expect);
+
+    ui_draw_section("Surface Scan");
+    if (paused) {
+        snprintf(buf, sizeof(buf), "Paused at %u MB written / %u MB read back",
+                 (unsigned)(s_scan.written * SCAN_FILE_MB),
+                 (unsigned)(s_scan.verified * SCAN_FILE_MB));
+        ui_draw_warn(buf);
+        ui_draw_info("Run the surface scan again to pick up where it stopped");
+        report_add("%s: Surface scan paused (%s)\n", name, buf);
+        sink_field_bool(&s_log.sink, dev_key(name, "surface_paused"), true);
+        sink_field_int(&s_log.sink,  dev_key(name, "surface_written_mb"),  s_scan.written * SCAN_FILE_MB);
+        sink_field_int(&s_log.sink,  dev_key(name, "surface_verified_mb"), s_scan.verified * SCAN_FILE_MB);
+        return;
+    }
+
+    for (i = 0; i < s_scan.nfiles; i++) {
+        if (s_scan.map[i] == SCAN_BAD || s_scan.map[i] == SCAN_IOERR || s_scan.map[i] == SCAN_WRERR) {
+            if (!have_bad) { first_bad = i; have_bad = true; }
+            if      (s_scan.map[i] == SCAN_BAD)   bad++;
+            else if (s_scan.map[i] == SCAN_IOERR) ioerr++;
+            else                                  wrerr++;
+        }
+    }
+
+    // ran out of room before the first file was done - nothing was checked,
+    // and that's not the same as nothing being wrong
+    if (s_scan.nfiles == 0) {
+        ui_draw_err("Nothing could be written - the card filled up straight away");
+        report_add("%s: Surface scan FAILED - no space could be written\n", name);
+        sink_field_bool(&s_log.sink, dev_key(name, "surface_paused"),     false);
+        sink_field_int(&s_log.sink,  dev_key(name, "surface_scanned_mb"), 0);
+        sink_field_bool(&s_log.sink, dev_key(name, "surface_failed"),     true);
+        scan_cleanup(base);
+        return;
+    }
+
+    snprintf(buf, sizeof(buf), "%u MB", (unsigned)(s_scan.nfiles * SCAN_FILE_MB));
+    ui_draw_kv("Space Scanned", buf);
+    report_add("%s: Surface scan of %s\n", name, buf);
+    sink_field_bool(&s_log.sink, dev_key(name, "surface_paused"),     false);
+    sink_field_int(&s_log.sink,  dev_key(name, "surface_scanned_mb"), s_scan.nfiles * SCAN_FILE_MB);
+    sink_field_int(&s_log.sink,  dev_key(name, "surface_bad"),        bad);
+    sink_field_int(&s_log.sink,  dev_key(name, "surface_unreadable"), ioerr);
+    sink_field_int(&s_log.sink,  dev_key(name, "surface_unwritable"), wrerr);
+    sink_field_bool(&s_log.sink, dev_key(name, "surface_failed"),     have_bad);
+    if (have_bad)
+        sink_field_int(&s_log.sink, dev_key(name, "surface_first_bad_mb"), first_bad * SCAN_FILE_MB);
+
+    ui_printf("\n   " UI_BCYAN "Region map" UI_RESET UI_WHITE "  . good  X bad  ? read error  ! write error\n" UI_RESET);
+    scan_draw_map(false);
+    ui_printf("\n");
+
+    if (!have_bad) {
+        ui_draw_ok("Every byte came back exactly as written");
+        report_add("%s: Surface scan clean\n", name);
+    } else {
+        snprintf(buf, sizeof(buf), "%u bad + %u unreadable + %u unwritable regions, first at %u MB",
+                 (unsigned)bad, (unsigned)ioerr, (unsigned)wrerr, (unsigned)(first_bad * SCAN_FILE_MB));
+        ui_draw_err(buf);
+        report_add("%s: Surface scan FAILED - %s\n", name, buf);
+
+        // everything from the first bad region to the end being bad is the
+        // classic fake-capacity signature: real flash runs out, writes wrap
+        if (bad + ioerr + wrerr == s_scan.nfiles - first_bad) {
+            snprintf(buf, sizeof(buf), "Looks like a fake-capacity card (real size ~%u MB used)",
+                     (unsigned)(first_bad * SCAN_FILE_MB));
+            ui_draw_warn(buf);
+            report_add("%s: %s\n", name, buf);
+        } else {
+            ui_draw_warn("Scattered bad regions - the card is failing, back it up");
+        }
+    }
+
+    scan_cleanup(base);
+    ui_draw_info("Scan files removed");
+}
+
+
+static void run_benchmark(const char *name, const char *base,
+                          const DISC_INTERFACE *io) {
+    PROF_FUNC();
+    static u32 expect[TEST_SIZE_MAX / BLOCK_SIZE];
+    const u32 size = s_bench_size;
+    const int passes = s_bench_passes;
+    char testfile[256];
+    int i, iter;
+    u64 write_ticks = 0, read_ticks = 0;
+    float write_kbs, read_kbs, verified_kbs;
+    verify_ctx v;
+    char buf[128];
+
+    snprintf(testfile, sizeof(testfile), "%s/wiimedic_bench.tmp", base);
+
+    // the whole file is laid out in memory so every block can be different
+    // without doing any pattern work inside the timed loop
+    u8 *pattern = (u8 *)scratch_alloc(size);
+    u8 *data    = (u8 *)scratch_alloc(BLOCK_SIZE);
+    if (!pattern || !data) {
+        ui_draw_err("Can't allocate benchmark buffer - out of memory?");
+        scratch_free(pattern);
+        scratch_free(data);
+        return;
+    }
+
+    for (i = 0; i < (int)(size / BLOCK_SIZE); i++) {
+        fill_pattern(pattern + i * BLOCK_SIZE, BLOCK_SIZE, (u32)i);
+        expect[i] = crc32_block(pattern + i * BLOCK_SIZE, BLOCK_SIZE);
+    }
+    memset(&v, 0, sizeof(v));
+    v.expect  = expect;
+    v.pattern = pattern;
+
+    // --- write test ---
+    ui_printf("   " UI_WHITE "Write test...\n" UI_RESET);
+
+    for (iter = 0; iter < passes; iter++) {
+        if (!timed_write(name, testfile, pattern, size, size, BLOCK_SIZE, &write_ticks)) {
+            scratch_free(pattern);
+            scratch_free(data);
+            return;
+        }
+    }
+    write_kbs = ticks_to_kbs(write_ticks / passes, size);
+
+    // --- read test ---
+    ui_printf("   " UI_WHITE "Read + verify test...\n" UI_RESET);
+
+    for (iter = 0; iter < passes; iter++) {
+        if (!timed_read(testfile, data, size, BLOCK_SIZE, &read_ticks, &v)) {
+            scratch_free(pattern);
+            scratch_free(data);
+            return;
+        }
     }
+    read_kbs     = ticks_to_kbs(read_ticks / passes, size);
+    verified_kbs = ticks_to_kbs((read_ticks + v.ticks) / passes, size);
 
     remove(testfile);
-    free(data);
 
     // --- results ---
-    const char *wcolor = (write_kbs > SPEED_GOOD_KB) ? UI_BGREEN :
-                         (write_kbs > SPEED_OK_KB)   ? UI_BYELLOW : UI_BRED;
-    const char *rcolor = (read_kbs  > SPEED_GOOD_KB) ? UI_BGREEN :
-                         (read_kbs  > SPEED_OK_KB)   ? UI_BYELLOW : UI_BRED;
-
     ui_printf("\n");
     snprintf(buf, sizeof(buf), "%.1f KB/s (%.2f MB/s)", write_kbs, write_kbs / 1024.0f);
-    ui_draw_kv_color("Write Speed", wcolor, buf);
+    ui_draw_kv_color("Write Speed", speed_color(write_kbs), buf);
 
     snprintf(buf, sizeof(buf), "%.1f KB/s (%.2f MB/s)", read_kbs, read_kbs / 1024.0f);
-    ui_draw_kv_color("Read Speed", rcolor, buf);
+    ui_draw_kv_color("Read Speed", speed_color(read_kbs), buf);
+
+    snprintf(buf, sizeof(buf), "%.1f KB/s (%.2f MB/s)", verified_kbs, verified_kbs / 1024.0f);
+    ui_draw_kv_color("Verified Read", speed_color(verified_kbs), buf);
+
+    report_add("%s: Write %.1f KB/s, Read %.1f KB/s, Verified read %.1f KB/s\n",
+               name, write_kbs, read_kbs, verified_kbs);
+    sink_field_num(&s_log.sink, dev_key(name, "write_kbs"),         write_kbs);
+    sink_field_num(&s_log.sink, dev_key(name, "read_kbs"),          read_kbs);
+    sink_field_num(&s_log.sink, dev_key(name, "verified_read_kbs"), verified_kbs);
+    sink_field_int(&s_log.sink, dev_key(name, "bad_block_reads"),   v.bad_blocks);
+
+    {
+        hist_record h;
+        memset(&h, 0, sizeof(h));
+        if (io == &__io_usbstorage) {
+            h.flags         = HIST_USB;
+            h.usb_serial    = volume_serial(io);
+            h.usb_write_kbs = write_kbs;
+            h.usb_read_kbs  = read_kbs;
+        } else {
+            h.flags         = HIST_SD;
+            h.sd_serial     = volume_serial(io);
+            h.sd_write_kbs  = write_kbs;
+            h.sd_read_kbs   = read_kbs;
+        }
+        history_add(&h);
+    }
+
+    if (v.bad_blocks == 0) {
+        snprintf(buf, sizeof(buf), "OK (%d blocks x %d passes)",
+                 (int)(size / BLOCK_SIZE), passes);
+        ui_draw_kv_color("Data Integrity", UI_BGREEN, buf);
+        report_add("%s: Data integrity OK\n", name);
+    } else {
+        snprintf(buf, sizeof(buf), "FAILED (%u bad block reads)", (unsigned)v.bad_blocks);
+        ui_draw_kv_color("Data Integrity", UI_BRED, buf);
+        ui_draw_warn("Card returned different data than was written - replace it");
+        ui_draw_info("Fake-capacity cards do this too once they run out of real space");
+        report_add("%s: Data integrity FAILED, %u bad block reads\n",
+                   name, (unsigned)v.bad_blocks);
+    }
 
     if (write_kbs > SPEED_GOOD_KB && read_kbs > SPEED_GOOD_KB) {
         ui_draw_ok("Speed Rating: Excellent - you're good");
@@ -195,45 +1389,251 @@ static void run_benchmark(const char *name, const char *base) {
         ui_draw_err("Speed Rating: Slow - game loading may be affected");
         ui_draw_info("Consider a faster SD card or USB drive");
     }
+
+    // --- random access ---
+    ui_printf("\n");
+    run_random_io(name, base, data);
+    scratch_free(pattern);
+    scratch_free(data);
+
+    // --- raw device ---
+    ui_printf("\n");
+    run_raw_read(name, base, io, read_kbs);
 }
 
 
-void run_storage_test(void) {
-    int rpos = 0;
+// prints one sweep table (write or read) to the screen and the report.
+// negative entries are combinations we skipped for lack of free space.
+static void print_sweep_table(const char *name, const char *what,
+                              float kbs[SWEEP_NFILES][SWEEP_NBLOCKS]) {
+    char lbl[8];
+    int f, b;
+
+    ui_printf("\n   " UI_BCYAN "%-5s KB/s" UI_RESET, what);
+    report_add("%s sweep, %s KB/s:\n  File  ", name, what);
+    for (b = 0; b < SWEEP_NBLOCKS; b++) {
+        size_label(s_sweep_blocks[b], lbl, sizeof(lbl));
+        ui_printf(UI_BCYAN " %7s" UI_RESET, lbl);
+        report_add(" %7s", lbl);
+    }
+    ui_printf("\n");
+    report_add("\n");
+
+    sink_list(&s_log.sink, dev_key(name, "sweep_%s", what));
+    for (f = 0; f < SWEEP_NFILES; f++) {
+        for (b = 0; b < SWEEP_NBLOCKS; b++) {
+            if (kbs[f][b] < 0.0f) continue;
+            sink_item(&s_log.sink);
+            sink_field_int(&s_log.sink, "file_mb", s_sweep_files_mb[f]);
+            sink_field_int(&s_log.sink, "block",   s_sweep_blocks[b]);
+            sink_field_num(&s_log.sink, "kbs",     kbs[f][b]);
+        }
+    }
+    sink_list_end(&s_log.sink);
+
+    for (f = 0; f < SWEEP_NFILES; f++) {
+        ui_printf("   " UI_WHITE "%5u MB  " UI_RESET, s_sweep_files_mb[f]);
+        report_add("  %3u MB", s_sweep_files_mb[f]);
+        for (b = 0; b < SWEEP_NBLOCKS; b++) {
+            if (kbs[f][b] < 0.0f) {
+                ui_printf(UI_WHITE " %7s" UI_RESET, "--");
+                report_add(" %7s", "--");
+            } else {
+                ui_printf("%s %7.0f" UI_RESET, speed_color(kbs[f][b]), kbs[f][b]);
+                report_add(" %7.0f", kbs[f][b]);
+            }
+        }
+        ui_printf("\n");
+        report_add("\n");
+    }
+}
+
+
+// works out where the device's cache stops helping. "sustained" is the best
+// block size on the biggest file we managed to test; any smaller file that
+// beat that by 50% or more was most likely landing in cache.
+static void summarize_sweep(const char *name, const char *what,
+                            float kbs[SWEEP_NFILES][SWEEP_NBLOCKS]) {
+    float best[SWEEP_NFILES];
+    int f, b, last = -1, cache_end = -1;
+    char buf[128];
+    char key[32];
+    char lbl[8];
+    int best_block = 0;
+
+    for (f = 0; f < SWEEP_NFILES; f++) {
+        best[f] = -1.0f;
+        for (b = 0; b < SWEEP_NBLOCKS; b++)
+            if (kbs[f][b] > best[f]) best[f] = kbs[f][b];
+        if (best[f] >= 0.0f) last = f;
+    }
+    if (last < 0) return;
+
+    for (b = 1; b < SWEEP_NBLOCKS; b++)
+        if (kbs[last][b] > kbs[last][best_block]) best_block = b;
+
+    for (f = 0; f < last; f++)
+        if (best[f] > best[last] * 1.5f) cache_end = f;
+
+    size_label(s_sweep_blocks[best_block], lbl, sizeof(lbl));
+    snprintf(buf, sizeof(buf), "%.0f KB/s (%u MB file, %s blocks)",
+             best[last], s_sweep_files_mb[last], lbl);
+    snprintf(key, sizeof(key), "Sustained %s", what);
+    ui_draw_kv_color(key, speed_color(best[last]), buf);
+    report_add("%s sustained %s: %s\n", name, what, buf);
+    sink_field_num(&s_log.sink, dev_key(name, "sustained_%s_kbs", what), best[last]);
+
+    if (cache_end >= 0) {
+        snprintf(buf, sizeof(buf), "%s cache absorbs files up to ~%u MB",
+                 what, s_sweep_files_mb[cache_end]);
+        ui_draw_info(buf);
+        report_add("%s %s\n", name, buf);
+        sink_field_int(&s_log.sink, dev_key(name, "cache_%s_mb", what), s_sweep_files_mb[cache_end]);
+    }
+}
+
+
+static void run_sweep(const char *name, const char *base) {
+    PROF_FUNC();
+    static float write_kbs[SWEEP_NFILES][SWEEP_NBLOCKS];
+    static float read_kbs[SWEEP_NFILES][SWEEP_NBLOCKS];
+    char testfile[256];
+    char msg[64];
+    char lbl[8];
+    u64 free_bytes = 0;
+    int f, b;
+    u32 i;
+    struct statvfs vfs;
+
+    snprintf(testfile, sizeof(testfile), "%s/wiimedic_bench.tmp", base);
+
+    {
+        char root[16];
+        snprintf(root, sizeof(root), "%s/", base);
+        if (statvfs(root, &vfs) == 0)
+            free_bytes = (u64)vfs.f_bfree * (u64)vfs.f_bsize;
+    }
+
+    u8 *data = (u8 *)scratch_alloc(SWEEP_MAX_BLOCK);
+    if (!data) {
+        ui_draw_err("Can't allocate 1MB sweep buffer - out of memory?");
+        return;
+    }
+    for (i = 0; i < SWEEP_MAX_BLOCK; i++)
+        data[i] = (u8)(i & 0xFF);
+
+    ui_printf("   " UI_WHITE "Sweeping block sizes 4K-1M over 1-64MB files...\n" UI_RESET);
+
+    for (f = 0; f < SWEEP_NFILES; f++) {
+        u32 file_size = s_sweep_files_mb[f] * 1024 * 1024;
+
+        // leave a little headroom, nobody wants their card filled to the brim
+        if (free_bytes > 0 && (u64)file_size + 4 * 1024 * 1024 > free_bytes) {
+            for (b = 0; b < SWEEP_NBLOCKS; b++)
+                write_kbs[f][b] = read_kbs[f][b] = -1.0f;
+            continue;
+        }
+
+        for (b = 0; b < SWEEP_NBLOCKS; b++) {
+            u64 wt = 0, rt = 0;
+
+            size_label(s_sweep_blocks[b], lbl, sizeof(lbl));
+            snprintf(msg, sizeof(msg), "%s: %u MB file, %s blocks...",
+                     name, s_sweep_files_mb[f], lbl);
+            ui_spin_set_msg(msg);
+
+            if (!timed_write(name, testfile, data, SWEEP_MAX_BLOCK, file_size,
+                             s_sweep_blocks[b], &wt) ||
+                !timed_read(testfile, data, file_size, s_sweep_blocks[b], &rt, NULL)) {
+                // the card is misbehaving, no point hammering it further
+                scratch_free(data);
+                return;
+            }
+            write_kbs[f][b] = ticks_to_kbs(wt, file_size);
+            read_kbs[f][b]  = ticks_to_kbs(rt, file_size);
+        }
+    }
+
+    remove(testfile);
+    scratch_free(data);
+
+    print_sweep_table(name, "Write", write_kbs);
+    print_sweep_table(name, "Read",  read_kbs);
+    ui_printf("\n");
+    summarize_sweep(name, "write", write_kbs);
+    summarize_sweep(name, "read",  read_kbs);
+
+    if (write_kbs[SWEEP_NFILES - 1][0] < 0.0f)
+        ui_draw_info("Bigger files skipped - not enough free space");
+}
+
+
+// mode is the index into the menu in run_storage_test()
+static void storage_run(int mode) {
+    PROF_FUNC();
     bool sd_ok, usb_ok;
 
-    memset(s_report, 0, sizeof(s_report));
-    rpos = snprintf(s_report, sizeof(s_report), "=== STORAGE SPEED TEST ===\n");
+    if (!s_log.sink.emit) sink_log_init(&s_log);
+    sink_log_clear(&s_log);
+    sink_section(&s_log.sink, "STORAGE SPEED TEST");
 
+    // a slow USB drive may still be answering the mount
+    subsys_wait_fat();
     sd_ok  = device_is_accessible("sd:/");
     usb_ok = device_is_accessible("usb:/");
 
+    // a full scan takes long enough that doing both devices back to back
+    // is never what anyone wants - pick one
+    if (mode == 3) {
+        static const char *devs[] = { "SD Card", "USB Drive" };
+        int dev = (sd_ok && usb_ok) ? ui_choose("Surface Scan", devs, 2) :
+                  sd_ok ? 0 : usb_ok ? 1 : -2;
+        if (dev == -2) {
+            ui_draw_err("No SD card or USB drive to scan");
+            report_add("Surface scan: no storage present\n");
+        } else if (dev < 0) {
+            ui_draw_info("Cancelled.");
+        } else {
+            ui_draw_section(devs[dev]);
+            show_device_info(devs[dev], dev == 0 ? "sd:/" : "usb:/");
+            run_surface_scan(devs[dev], dev == 0 ? "sd:" : "usb:");
+        }
+        sink_end(&s_log.sink);
+        ui_printf("\n");
+        ui_draw_ok("Storage test complete");
+        return;
+    }
+
     ui_draw_section("SD Card");
 
     if (sd_ok) {
         show_device_info("SD Card", "sd:/");
-        run_benchmark("SD Card", "sd:");
-        rpos += snprintf(s_report + rpos, sizeof(s_report) - rpos,
-                         "SD Card: Present, benchmark completed\n");
+        sink_kv(&s_log.sink, "SD Card", "Present");
+        sink_field_bool(&s_log.sink, "sd_present", true);
+        if      (mode == 1) run_sweep("SD Card", "sd:");
+        else if (mode == 2) run_pipeline("SD Card", "sd:");
+        else                run_benchmark("SD Card", "sd:", &__io_wiisd);
     } else {
         ui_draw_warn("SD Card not found");
         ui_draw_info("Insert an SD card and re-run");
-        rpos += snprintf(s_report + rpos, sizeof(s_report) - rpos,
-                         "SD Card: Not present\n");
+        sink_kv(&s_log.sink, "SD Card", "Not present");
+        sink_field_bool(&s_log.sink, "sd_present", false);
     }
 
     ui_draw_section("USB Storage");
 
     if (usb_ok) {
         show_device_info("USB Drive", "usb:/");
-        run_benchmark("USB Drive", "usb:");
-        rpos += snprintf(s_report + rpos, sizeof(s_report) - rpos,
-                         "USB: Present, benchmark completed\n");
+        sink_kv(&s_log.sink, "USB", "Present");
+        sink_field_bool(&s_log.sink, "usb_present", true);
+        if      (mode == 1) run_sweep("USB Drive", "usb:");
+        else if (mode == 2) run_pipeline("USB Drive", "usb:");
+        else                run_benchmark("USB Drive", "usb:", &__io_usbstorage);
     } else {
         ui_printf("   " UI_WHITE "No USB drive detected (that's fine if you don't have one)\n" UI_RESET);
         ui_draw_info("USB must go in the port closest to the edge of the Wii");
-        rpos += snprintf(s_report + rpos, sizeof(s_report) - rpos,
-                         "USB: Not present\n");
+        sink_kv(&s_log.sink, "USB", "Not present");
+        sink_field_bool(&s_log.sink, "usb_present", false);
     }
 
     ui_draw_section("Tips");
@@ -243,14 +1643,102 @@ void run_storage_test(void) {
     ui_draw_info("Format USB as FAT32 with 32KB clusters for best results");
     ui_draw_info("SD cards over 32GB need to be formatted as FAT32, not exFAT");
 
-    rpos += snprintf(s_report + rpos, sizeof(s_report) - rpos, "\n");
+    sink_end(&s_log.sink);
 
     ui_printf("\n");
     ui_draw_ok("Storage test complete");
 }
 
 
-void get_storage_test_report(char *buf, int bufsize) {
-    strncpy(buf, s_report, bufsize - 1);
-    buf[bufsize - 1] = '\0';
+void run_storage_test(void) {
+    static char quick[48];
+    static const char *modes[] = {
+        quick,
+        "Block-size sweep (4 KB-1 MB blocks, 1-64 MB files)",
+        "Queued write pipeline (queue depth 1-8)",
+        "Surface scan (fills all free space, resumable)"
+    };
+    int mode;
+
+    // autorun.cfg can change the size, say what will actually be written
+    if (s_bench_size % (1024 * 1024) == 0)
+        snprintf(quick, sizeof(quick), "Quick benchmark (%u MB, 32 KB blocks)", s_bench_size / (1024 * 1024));
+    else
+        snprintf(quick, sizeof(quick), "Quick benchmark (%u KB, 32 KB blocks)", s_bench_size / 1024);
+    mode = ui_choose("Storage Speed Test", modes, 4);
+    if (mode < 0) {
+        ui_draw_info("Cancelled.");
+        return;
+    }
+    storage_run(mode);
+}
+
+void run_storage_quick(void) {
+    storage_run(s_report_mode);
+}
+
+void set_storage_test_options(int mode, u32 bench_kb, int passes) {
+    u32 size = bench_kb * 1024;
+
+    if (mode < STORAGE_QUICK || mode > STORAGE_PIPELINE) mode = STORAGE_QUICK;
+    // whole blocks only, the verify pass checks one CRC per block
+    size -= size % BLOCK_SIZE;
+    if (size < BLOCK_SIZE)    size = BLOCK_SIZE;
+    if (size > TEST_SIZE_MAX) size = TEST_SIZE_MAX;
+    if (passes < 1)              passes = 1;
+    if (passes > ITERATIONS_MAX) passes = ITERATIONS_MAX;
+
+    s_report_mode  = mode;
+    s_bench_size   = size;
+    s_bench_passes = passes;
+}
+
+bool has_storage_test_run(void) {
+    return !sink_log_empty(&s_log);
+}
+
+
+u32 get_storage_volume_serial(bool usb) {
+    if (!subsys_wait_fat()) return 0;
+    if (!device_is_accessible(usb ? "usb:/" : "sd:/")) return 0;
+    return volume_serial(usb ? &__io_usbstorage : &__io_wiisd);
+}
+
+
+static u64 device_key(u64 h, const char *root, const DISC_INTERFACE *io) {
+    struct statvfs vfs;
+
+    if (!device_is_accessible(root)) return rcache_hash_u32(h, 0);
+    h = rcache_hash_u32(h, 1);
+    h = rcache_hash_u32(h, volume_serial(io));
+    if (statvfs(root, &vfs) == 0) {
+        h = rcache_hash_u32(h, (u32)vfs.f_blocks);
+        h = rcache_hash_u32(h, (u32)vfs.f_bsize);
+    }
+    return h;
+}
+
+// which cards are in: volume serial and size. a reformat gets a new serial.
+// a sweep saved last time is no answer to a quick benchmark, so the options
+// go in too
+u64 get_storage_test_cache_key(void) {
+    u64 h = rcache_hash_u32(RCACHE_KEY_INIT, (u32)s_report_mode);
+    h = rcache_hash_u32(h, s_bench_size);
+    h = rcache_hash_u32(h, (u32)s_bench_passes);
+    h = device_key(h, "sd:/", &__io_wiisd);
+    return device_key(h, "usb:/", &__io_usbstorage);
+}
+
+
+void get_storage_test_report(report_sink *sink) {
+    PROF_FUNC();
+    if (sink_log_empty(&s_log)) {
+        // same title as a real run, so the JSON key doesn't move
+        sink_section(sink, "STORAGE SPEED TEST");
+        sink_text(sink, "Not run yet. Run Storage Test from main menu for full data.\n");
+        sink_field_bool(sink, "run", false);
+        sink_end(sink);
+        return;
+    }
+    sink_log_replay(&s_log, sink);
 }
@@ -5,10 +5,36 @@
 #ifndef STORAGE_TEST_H
 #define STORAGE_TEST_H
 
-// Run the storage speed test
+#include "report_sink.h"
+
+// Run the storage speed test (asks which one first)
 void run_storage_test(void);
 
-// Get storage test report as string
-void get_storage_test_report(char *buf, int bufsize);
+// What the report runs (the first three storage test menu entries)
+#define STORAGE_QUICK     0
+#define STORAGE_SWEEP     1
+#define STORAGE_PIPELINE  2
+
+// Run the report's storage test on whatever is plugged in, without asking.
+// That's the quick benchmark unless set_storage_test_options changed it
+void run_storage_quick(void);
+
+// For unattended runs: which test, and the quick benchmark's file size
+// (KB, rounded down to whole 32 KB blocks, 32 KB-16 MB) and pass count (1-10)
+void set_storage_test_options(int mode, u32 bench_kb, int passes);
+
+// True if any storage test has run this session
+bool has_storage_test_run(void);
+
+// FAT volume serial of the SD card or USB drive that's in right now (waits
+// for the background mount), 0 if there isn't one or it can't be read
+u32 get_storage_volume_serial(bool usb);
+
+// Result cache key for the report: volume serial and size of each
+// device that's present
+u64 get_storage_test_cache_key(void);
+
+// Emit the storage test report section into a sink
+void get_storage_test_report(report_sink *sink);
 
 #endif // STORAGE_TEST_H
@@ -0,0 +1,85 @@
+// subsys.c
+// main() used to do WPAD, PAD and fatInitDefault() before it drew anything,
+// and fatInitDefault probes USB - a slow drive, or a hub with nothing in
+// it, held the menu back for seconds. now the mounting happens on its own
+// thread while the menu is already up, and anything that touches a card
+// waits here first (usually it's long done by then).
+//
+// Bluetooth is the same idea. it needs a moment after WPAD_Init before the
+// remotes report properly, and the controller test and the report each used
+// to sit through their own 30 frames for it. the settle time is counted
+// from WPAD_Init once, so whoever spent a while in the menu waits for nothing.
+
+#include <fat.h>
+#include <gccore.h>
+#include <ogc/lwp.h>
+#include <ogc/lwp_watchdog.h>
+#include <ogc/usbstorage.h>
+#include <sdcard/wiisd_io.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <wiiuse/wpad.h>
+
+#include "subsys.h"
+#include "ui_common.h"
+
+// last, it wraps the IOS and libfat calls by name
+#include "prof_calls.h"
+
+#define MOUNT_PRIO     64
+#define WAIT_POLL_US   1000
+
+static lwp_t          s_mount_thread;
+static u8             s_mount_stack[16384] __attribute__((aligned(32)));
+static volatile bool  s_sd_done  = false;
+static volatile bool  s_fat_done = false;
+static bool           s_sd_ok    = false;
+static bool           s_usb_ok   = false;
+static u64            s_wpad_t0;
+
+
+static void *mount_thread(void *arg) {
+    PROF_FUNC();
+    (void)arg;
+    s_sd_ok  = fatMountSimple("sd", &__io_wiisd);
+    s_sd_done = true;
+    s_usb_ok = fatMountSimple("usb", &__io_usbstorage);
+    s_fat_done = true;
+    return NULL;
+}
+
+
+void subsys_init(void) {
+    PROF_FUNC();
+    WPAD_Init();
+    WPAD_SetDataFormat(WPAD_CHAN_ALL, WPAD_FMT_BTNS_ACC_IR);
+    PAD_Init();
+    s_wpad_t0 = gettime();
+
+    if (LWP_CreateThread(&s_mount_thread, mount_thread, NULL,
+                         s_mount_stack, sizeof(s_mount_stack), MOUNT_PRIO) < 0) {
+        // no thread, do it the old way
+        mount_thread(NULL);
+    }
+}
+
+
+bool subsys_wait_sd(void) {
+    while (!s_sd_done) usleep(WAIT_POLL_US);
+    return s_sd_ok;
+}
+
+bool subsys_wait_fat(void) {
+    while (!s_fat_done) usleep(WAIT_POLL_US);
+    return s_sd_ok || s_usb_ok;
+}
+
+
+// the time check is all there is once it's passed, so any thread can call
+// this as often as it likes
+void subsys_wait_wpad(u32 settle_ms) {
+    while (ticks_to_millisecs(gettime() - s_wpad_t0) < settle_ms) {
+        WPAD_ScanPads();
+        ui_wait_frame();
+    }
+}
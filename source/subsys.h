@@ -0,0 +1,27 @@
+/*
+ * WiiMedic - subsys.h
+ * Start-up of the controllers and SD/USB, and waiting until they're ready
+ */
+#ifndef SUBSYS_H
+#define SUBSYS_H
+
+#include <gccore.h>
+
+// How long Bluetooth needs after WPAD_Init before remotes show up properly
+#define SUBSYS_WPAD_SETTLE_MS 500
+
+// WPAD and PAD now, they're quick. SD and USB get mounted on a background
+// thread, SD first - a slow or missing USB drive can take seconds
+void subsys_init(void);
+
+// Block until the SD card has been tried. True if sd: is mounted
+bool subsys_wait_sd(void);
+
+// Block until both SD and USB have been tried. True if either is mounted
+bool subsys_wait_fat(void);
+
+// Block until settle_ms have passed since WPAD_Init, scanning the remotes
+// meanwhile. Normally long over by the time anyone asks, so free
+void subsys_wait_wpad(u32 settle_ms);
+
+#endif // SUBSYS_H
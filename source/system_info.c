@@ -12,43 +12,31 @@
 #include <string.h>
 #include <unistd.h>
 
+#include "nand_index.h"
+#include "scratch.h"
 #include "system_info.h"
 #include "ui_common.h"
 
+// last, it wraps the IOS and libfat calls by name
+#include "prof_calls.h"
 
-#define SM_ID (u64)0x0000000100000002ULL
 
-// ISFS_Initialize returns this if the filesystem was already open.
-// kinda annoying that there's no "is it initialized" query, but whatever
-#define ISFS_EALREADY -105
+#define SM_ID (u64)0x0000000100000002ULL
 
 
 // grabs the content ID that the system menu is currently booting.
 // priiloader hooks in here and boots a different content, so if the
 // content ID doesn't match the SM's .app we know priiloader is running.
 static u32 get_SM_boot_content_id(void) {
-    u32 tmd_size = 0;
-    if (ES_GetStoredTMDSize(SM_ID, &tmd_size) < 0 || tmd_size == 0)
-        return 0;
+    const tmd *t = nand_index_tmd(SM_ID);
+    if (!t) return 0;
 
-    signed_blob *stmd = (signed_blob *)memalign(32, (tmd_size + 31) & ~31);
-    if (!stmd) return 0;
-
-    u32 content_id = 0;
-    if (ES_GetStoredTMD(SM_ID, stmd, tmd_size) >= 0) {
-        tmd *t = (tmd *)SIGNATURE_PAYLOAD(stmd);
-        u16 boot_index = t->boot_index;
-        u16 i;
-        for (i = 0; i < t->num_contents; i++) {
-            if (t->contents[i].index == boot_index) {
-                content_id = t->contents[i].cid;
-                break;
-            }
-        }
+    u16 i;
+    for (i = 0; i < t->num_contents; i++) {
+        if (t->contents[i].index == t->boot_index)
+            return t->contents[i].cid;
     }
-
-    free(stmd);
-    return content_id;
+    return 0;
 }
 
 
@@ -59,9 +47,7 @@ static bool detect_priiloader(void) {
     u32 content_id = get_SM_boot_content_id();
     if (content_id == 0) return false;
 
-    s32 isfs_res = ISFS_Initialize();
-    bool we_opened_isfs = (isfs_res >= 0);
-    if (isfs_res < 0 && isfs_res != ISFS_EALREADY)
+    if (!nand_index_ready())
         return false;
 
     bool found = false;
@@ -74,10 +60,8 @@ static bool detect_priiloader(void) {
     };
     int j;
     for (j = 0; j < 2; j++) {
-        s32 fd = ISFS_Open(markers[j], ISFS_OPEN_READ);
-        if (fd >= 0) {
+        if (nand_index_file_size(markers[j]) >= 0) {
             found = true;
-            ISFS_Close(fd);
             break;
         }
     }
@@ -87,21 +71,94 @@ static bool detect_priiloader(void) {
         snprintf(path, sizeof(path),
                  "/title/00000001/00000002/content/%08x.app",
                  (unsigned int)(content_id + 0x10000000));
-        s32 fd = ISFS_Open(path, ISFS_OPEN_READ);
-        if (fd >= 0) {
+        if (nand_index_file_size(path) >= 0)
             found = true;
-            ISFS_Close(fd);
-        }
     }
 
-    if (we_opened_isfs) ISFS_Deinitialize();
     return found;
 }
 
 
+// loader signatures we look for in the booted SM content. version entries
+// start a capture (the version string is the signature plus whatever
+// printable text follows it), name entries just tell us which loader it is.
+// only loaders that replace the system menu's boot content belong here:
+// BootMii lives in boot2 or as IOS254 and never touches this file, so it's
+// found by detect_bootmii_ios and the boot1 check instead.
+typedef struct {
+    const char *sig;
+    const char *name;
+    bool        is_version;
+} loader_sig;
+
+static const loader_sig s_loader_sigs[] = {
+    { "0.10.",      NULL,         true  },  // 0.10.x era
+    { "v0.",        NULL,         true  },  // older versions
+    { "Priiloader", "Priiloader", false },
+    { "Preloader",  "Preloader",  false },  // what priiloader was before the rename
+    { "preloader",  "Preloader",  false },
+};
+#define NUM_LOADER_SIGS  (int)(sizeof(s_loader_sigs) / sizeof(s_loader_sigs[0]))
+
+// big aligned reads - the .app is a couple MB and every read is an IPC call
+#define LOADER_SCAN_CHUNK (64 * 1024)
+
+// aho-corasick automaton over all the signatures, built once as a full
+// transition table so the scan is one table lookup per byte. the state
+// carries across read boundaries so nothing straddling two chunks is missed.
+#define AC_MAX_STATES 64
+
+static u8   s_ac_next[AC_MAX_STATES][256];
+static u16  s_ac_out[AC_MAX_STATES];    // bit n set = signature n ends here
+static bool s_ac_built = false;
+
+static void ac_build(void) {
+    u8 fail[AC_MAX_STATES], queue[AC_MAX_STATES];
+    int nstates = 1, head = 0, tail = 0, p, c;
+
+    if (s_ac_built) return;
+    memset(s_ac_next, 0, sizeof(s_ac_next));
+    memset(s_ac_out, 0, sizeof(s_ac_out));
+
+    // trie first. state 0 is the root so 0 doubles as "no child yet"
+    for (p = 0; p < NUM_LOADER_SIGS; p++) {
+        const u8 *sig = (const u8 *)s_loader_sigs[p].sig;
+        int st = 0;
+        for (; *sig; sig++) {
+            if (s_ac_next[st][*sig] == 0) {
+                if (nstates >= AC_MAX_STATES) break;
+                s_ac_next[st][*sig] = nstates++;
+            }
+            st = s_ac_next[st][*sig];
+        }
+        if (*sig == '\0') s_ac_out[st] |= (u16)(1 << p);
+    }
+
+    // then BFS to fill in failure links and turn it into a DFA
+    for (c = 0; c < 256; c++) {
+        u8 s = s_ac_next[0][c];
+        if (s) { fail[s] = 0; queue[tail++] = s; }
+    }
+    while (head < tail) {
+        u8 r = queue[head++];
+        for (c = 0; c < 256; c++) {
+            u8 s = s_ac_next[r][c];
+            if (s) {
+                fail[s] = s_ac_next[fail[r]][c];
+                s_ac_out[s] |= s_ac_out[fail[s]];
+                queue[tail++] = s;
+            } else {
+                s_ac_next[r][c] = s_ac_next[fail[r]][c];
+            }
+        }
+    }
+    s_ac_built = true;
+}
+
+
 // scans the active SM binary for priiloader's version string.
 // it embeds something like "0.10.x" or "v0.x" in the .app file.
-// we just scan through the binary looking for the patterns.
+// one pass through the file with the matcher above, 64KB at a time.
 // Is it sliyght sketch? yes. Does it work? yes.
 static void get_priiloader_version(char *out, int maxlen) {
     strncpy(out, "Unknown", maxlen);
@@ -109,60 +166,91 @@ static void get_priiloader_version(char *out, int maxlen) {
     u32 content_id = get_SM_boot_content_id();
     if (content_id == 0) return;
 
-    s32 isfs_res = ISFS_Initialize();
-    bool we_opened_isfs = (isfs_res >= 0);
+    if (!nand_index_ready()) return;
 
-    char path[ISFS_MAXPATH];
+    // ISFS wants aligned paths
+    static char path[ISFS_MAXPATH] ATTRIBUTE_ALIGN(32);
     snprintf(path, sizeof(path),
              "/title/00000001/00000002/content/%08x.app",
              (unsigned int)content_id);
 
     s32 fd = ISFS_Open(path, ISFS_OPEN_READ);
-    if (fd >= 0) {
-        u8 *buf = memalign(32, 4096);
-        if (buf) {
-            s32 nbytes;
-            bool found = false;
-            while (!found && (nbytes = ISFS_Read(fd, buf, 4096)) > 0) {
-                int i;
-                for (i = 0; i < nbytes - 12; i++) {
-                    // match "0.10." (0.10.x era) or "v0." (older versions)
-                    if ((buf[i] == '0' && buf[i+1] == '.' && buf[i+2] == '1' &&
-                         buf[i+3] == '0' && buf[i+4] == '.') ||
-                        (buf[i] == 'v' && buf[i+1] == '0' && buf[i+2] == '.')) {
-
-                        strncpy(out, (char *)&buf[i], maxlen - 1);
-                        out[maxlen - 1] = '\0';
-
-                        // strip anything non-printable, binary data lurks here
-                        int slen = (int)strnlen(out, maxlen);
-                        int k;
-                        for (k = 0; k < slen; k++) {
-                            if (out[k] < 0x20 || out[k] > 0x7E) {
-                                out[k] = '\0';
-                                break;
-                            }
-                        }
-                        if ((int)strlen(out) > 3) {
-                            found = true;
-                            break;
-                        }
+    if (fd < 0) return;
+
+    u8 *buf = scratch_alloc(LOADER_SCAN_CHUNK);
+    if (!buf) {
+        ISFS_Close(fd);
+        return;
+    }
+
+    ac_build();
+
+    char ver[32];
+    const char *name = NULL;
+    int cap = -1;       // length captured so far, -1 = not capturing
+    bool found = false;
+    u8 state = 0;
+    s32 nbytes;
+
+    while (!found && (nbytes = ISFS_Read(fd, buf, LOADER_SCAN_CHUNK)) > 0) {
+        int i;
+        for (i = 0; i < nbytes; i++) {
+            u8 c = buf[i];
+
+            // version text runs until the first non-printable byte,
+            // binary data lurks right after it
+            if (cap >= 0) {
+                if (c >= 0x20 && c <= 0x7E && cap < (int)sizeof(ver) - 1) {
+                    ver[cap++] = (char)c;
+                } else {
+                    ver[cap] = '\0';
+                    if (cap > 3) {
+                        found = true;
+                        break;
+                    }
+                    cap = -1;
+                }
+            }
+
+            state = s_ac_next[state][c];
+            if (s_ac_out[state]) {
+                int p;
+                for (p = 0; p < NUM_LOADER_SIGS; p++) {
+                    if (!(s_ac_out[state] & (1 << p))) continue;
+                    if (!s_loader_sigs[p].is_version) {
+                        name = s_loader_sigs[p].name;
+                    } else if (cap < 0) {
+                        strcpy(ver, s_loader_sigs[p].sig);
+                        cap = (int)strlen(ver);
                     }
                 }
             }
-            free(buf);
         }
-        ISFS_Close(fd);
     }
 
-    if (we_opened_isfs) ISFS_Deinitialize();
+    // file ended mid-capture
+    if (!found && cap > 3) {
+        ver[cap] = '\0';
+        found = true;
+    }
+
+    scratch_free(buf);
+    ISFS_Close(fd);
+
+    if (!found) return;
+    if (name && strcmp(name, "Priiloader") != 0)
+        snprintf(out, maxlen, "%s %s", name, ver);
+    else {
+        strncpy(out, ver, maxlen - 1);
+        out[maxlen - 1] = '\0';
+    }
 }
 
 
 // BootMii as IOS installs as IOS254. if that title exists, it's likely there.
 static bool detect_bootmii_ios(void) {
     u32 tmd_size = 0;
-    return (ES_GetStoredTMDSize(0x00000001000000FEULL, &tmd_size) >= 0 && tmd_size > 0);
+    return (nand_index_tmd_size(0x00000001000000FEULL, &tmd_size) >= 0 && tmd_size > 0);
 }
 
 
@@ -238,6 +326,13 @@ static void collect_protection_info(void) {
     s_cached = true;
 }
 
+// the slow part of the report section (NAND reads for Priiloader and
+// boot1), split out so the report scheduler can run it next to the others
+void collect_system_info(void) {
+    PROF_FUNC();
+    collect_protection_info();
+}
+
 
 static const char *get_region_string(void) {
     switch (CONF_GetRegion()) {
@@ -283,6 +378,27 @@ static const char *get_aspect_string(void) {
     }
 }
 
+// what the arenas have left is all libogc tells us, so "used" is everything
+// else - the program, the heap, IOS's chunk of MEM2 and the scratch arena
+#define MEM1_TOTAL (24 * 1024 * 1024)
+#define MEM2_TOTAL (64 * 1024 * 1024)
+
+typedef struct {
+    u32 mem1_free, mem2_free;
+    u32 heap_used, heap_size;   // mallinfo: handed out / taken from the arenas
+    scratch_stats scratch;
+} mem_usage;
+
+static void get_mem_usage(mem_usage *m) {
+    struct mallinfo mi = mallinfo();
+
+    m->mem1_free = SYS_GetArena1Size();
+    m->mem2_free = SYS_GetArena2Size();
+    m->heap_used = (u32)mi.uordblks;
+    m->heap_size = (u32)mi.arena;
+    scratch_get_stats(&m->scratch);
+}
+
 static const char *get_progressive_string(void) {
     s32 v = CONF_GetProgressiveScan();
     if (v > 0)  return "Enabled";
@@ -292,15 +408,15 @@ static const char *get_progressive_string(void) {
 
 
 void run_system_info(void) {
+    PROF_FUNC();
     u32 hollywood_ver = SYS_GetHollywoodRevision();
-    u32 mem1_size     = SYS_GetArena1Size();
-    u32 mem2_size     = SYS_GetArena2Size();
     s32 ios_ver       = IOS_GetVersion();
     s32 ios_rev       = IOS_GetRevision();
     u32 boot2_ver     = 0;
     s32 boot2_ret     = ES_GetBoot2Version(&boot2_ver);
     u32 device_id     = 0;
-    char buf[64];
+    mem_usage mem;
+    char buf[80];
 
     ES_GetDeviceID(&device_id);
 
@@ -327,17 +443,37 @@ void run_system_info(void) {
     }
 
     ui_draw_section("Memory");
-
-    snprintf(buf, sizeof(buf), "%u KB (%.1f MB)", mem1_size / 1024,
-             (float)mem1_size / (1024.0f * 1024.0f));
-    ui_draw_kv("MEM1 Arena Free", buf);
-
-    snprintf(buf, sizeof(buf), "%u KB (%.1f MB)", mem2_size / 1024,
-             (float)mem2_size / (1024.0f * 1024.0f));
-    ui_draw_kv("MEM2 Arena Free", buf);
-
-    ui_draw_kv("MEM1 Total", "24 MB (fixed)");
-    ui_draw_kv("MEM2 Total", "64 MB (fixed)");
+    get_mem_usage(&mem);
+
+    snprintf(buf, sizeof(buf), "%u KB of 24 MB (%u KB free)",
+             (MEM1_TOTAL - mem.mem1_free) / 1024, mem.mem1_free / 1024);
+    ui_draw_kv("MEM1 Used", buf);
+    ui_draw_bar(MEM1_TOTAL - mem.mem1_free, MEM1_TOTAL, 40);
+
+    snprintf(buf, sizeof(buf), "%u KB of 64 MB (%u KB free)",
+             (MEM2_TOTAL - mem.mem2_free) / 1024, mem.mem2_free / 1024);
+    ui_draw_kv("MEM2 Used", buf);
+    ui_draw_bar(MEM2_TOTAL - mem.mem2_free, MEM2_TOTAL, 40);
+
+    snprintf(buf, sizeof(buf), "%u KB of %u KB", mem.heap_used / 1024, mem.heap_size / 1024);
+    ui_draw_kv("Heap In Use", buf);
+
+    if (mem.scratch.size) {
+        snprintf(buf, sizeof(buf), "%u KB, %u KB lent out", mem.scratch.size / 1024,
+                 mem.scratch.used / 1024);
+        ui_draw_kv("Scratch Arena", buf);
+        snprintf(buf, sizeof(buf), "%u KB (%u KB in)", mem.scratch.peak / 1024,
+                 mem.scratch.peak_end / 1024);
+        ui_draw_kv("Scratch High Water", buf);
+        if (mem.scratch.fallbacks > 0) {
+            snprintf(buf, sizeof(buf), "%u buffer%s didn't fit and came off the heap (largest %u KB)",
+                     mem.scratch.fallbacks, mem.scratch.fallbacks == 1 ? "" : "s",
+                     mem.scratch.fallback_max / 1024);
+            ui_draw_warn(buf);
+        }
+    } else {
+        ui_draw_kv_color("Scratch Arena", UI_BYELLOW, "Not set up - buffers come off the heap");
+    }
 
     ui_draw_section("Firmware");
 
@@ -405,19 +541,20 @@ void run_system_info(void) {
 }
 
 
-// separate function for when the report generator needs the data as a string
-void get_system_info_report(char *buf, int bufsize) {
+// separate function for when the report generator needs the data
+void get_system_info_report(report_sink *sink) {
+    PROF_FUNC();
     u32 hollywood_ver = SYS_GetHollywoodRevision();
-    u32 mem1_size     = SYS_GetArena1Size();
-    u32 mem2_size     = SYS_GetArena2Size();
     s32 ios_ver       = IOS_GetVersion();
     s32 ios_rev       = IOS_GetRevision();
     u32 boot2_ver     = 0;
     s32 boot2_ret     = ES_GetBoot2Version(&boot2_ver);
     u32 device_id     = 0;
+    mem_usage mem;
 
     ES_GetDeviceID(&device_id);
     collect_protection_info();
+    get_mem_usage(&mem);
 
     bool has_bm_boot2 = (s_boot1_ok == 1) ||
                         (s_boot1_ok < 0 && boot2_ret >= 0 && boot2_ver <= 4);
@@ -447,31 +584,55 @@ void get_system_info_report(char *buf, int bufsize) {
         (s_has_priiloader || s_has_bm_ios || has_bm_boot2)   ? "PARTIAL" :
                                                                  "NONE";
 
-    snprintf(buf, bufsize,
-             "=== SYSTEM INFORMATION ===\n"
-             "Region:              %s\n"
-             "Video Standard:      %s\n"
-             "Language:            %s\n"
-             "Aspect Ratio:        %s\n"
-             "Progressive Scan:    %s\n"
-             "Hollywood Revision:  0x%08X\n"
-             "Device ID:           %u\n"
-             "Boot2 Version:       v%u\n"
-             "Running IOS:         IOS%d (rev %d)\n"
-             "MEM1 Arena Free:     %u KB\n"
-             "MEM2 Arena Free:     %u KB\n"
-             "\n"
-             "--- Brick Protection ---\n"
-             "Priiloader:          %s\n"
-             "BootMii (boot2):     %s\n"
-             "BootMii (IOS):       %s\n"
-             "Protection Rating:   %s\n"
-             "\n",
-             get_region_string(), get_video_mode_string(),
-             get_language_string(), get_aspect_string(),
-             get_progressive_string(), hollywood_ver, device_id, boot2_ver,
-             ios_ver, ios_rev, mem1_size / 1024, mem2_size / 1024,
-             prii_str, boot2_str,
-             s_has_bm_ios ? "Installed" : "Not found",
-             rating);
+    sink_section(sink, "SYSTEM INFORMATION");
+    sink_kv(sink, "Region",             "%s", get_region_string());
+    sink_kv(sink, "Video Standard",     "%s", get_video_mode_string());
+    sink_kv(sink, "Language",           "%s", get_language_string());
+    sink_kv(sink, "Aspect Ratio",       "%s", get_aspect_string());
+    sink_kv(sink, "Progressive Scan",   "%s", get_progressive_string());
+    sink_kv(sink, "Hollywood Revision", "0x%08X", hollywood_ver);
+    sink_kv(sink, "Device ID",          "%u", device_id);
+    sink_kv(sink, "Boot2 Version",      "v%u", boot2_ver);
+    sink_kv(sink, "Running IOS",        "IOS%d (rev %d)", ios_ver, ios_rev);
+    sink_kv(sink, "MEM1 Arena Free",    "%u KB", mem.mem1_free / 1024);
+    sink_kv(sink, "MEM2 Arena Free",    "%u KB", mem.mem2_free / 1024);
+    sink_kv(sink, "MEM1 Used",          "%u KB of 24 MB", (MEM1_TOTAL - mem.mem1_free) / 1024);
+    sink_kv(sink, "MEM2 Used",          "%u KB of 64 MB", (MEM2_TOTAL - mem.mem2_free) / 1024);
+    sink_kv(sink, "Heap In Use",        "%u KB of %u KB", mem.heap_used / 1024, mem.heap_size / 1024);
+    sink_kv(sink, "Scratch Arena",      "%u KB, high water %u KB, %u heap fallback%s",
+            mem.scratch.size / 1024, mem.scratch.peak / 1024, mem.scratch.fallbacks,
+            mem.scratch.fallbacks == 1 ? "" : "s");
+
+    sink_subsection(sink, "Brick Protection");
+    sink_kv(sink, "Priiloader",         "%s", prii_str);
+    sink_kv(sink, "BootMii (boot2)",    "%s", boot2_str);
+    sink_kv(sink, "BootMii (IOS)",      "%s", s_has_bm_ios ? "Installed" : "Not found");
+    sink_kv(sink, "Protection Rating",  "%s", rating);
+
+    sink_field_str(sink,  "region",             get_region_string());
+    sink_field_str(sink,  "video_standard",     get_video_mode_string());
+    sink_field_str(sink,  "language",           get_language_string());
+    sink_field_str(sink,  "aspect_ratio",       get_aspect_string());
+    sink_field_str(sink,  "progressive_scan",   get_progressive_string());
+    sink_field_int(sink,  "hollywood_rev",      hollywood_ver);
+    sink_field_int(sink,  "device_id",          device_id);
+    sink_field_int(sink,  "boot2_version",      boot2_ver);
+    sink_field_int(sink,  "ios",                ios_ver);
+    sink_field_int(sink,  "ios_rev",            ios_rev);
+    sink_field_int(sink,  "mem1_free",          mem.mem1_free);
+    sink_field_int(sink,  "mem2_free",          mem.mem2_free);
+    sink_field_int(sink,  "heap_used",          mem.heap_used);
+    sink_field_int(sink,  "heap_size",          mem.heap_size);
+    sink_field_int(sink,  "scratch_size",       mem.scratch.size);
+    sink_field_int(sink,  "scratch_peak",       mem.scratch.peak);
+    sink_field_int(sink,  "scratch_peak_end",   mem.scratch.peak_end);
+    sink_field_int(sink,  "scratch_fallbacks",  mem.scratch.fallbacks);
+    sink_field_bool(sink, "priiloader",         s_has_priiloader);
+    sink_field_str(sink,  "priiloader_version", s_has_priiloader ? s_prii_ver : "");
+    // 1 = boot1a/b, 0 = boot1c/d, 2 = unknown revision, < 0 = couldn't read it
+    sink_field_int(sink,  "boot1_compatible",   s_boot1_ok);
+    sink_field_bool(sink, "bootmii_boot2",      has_bm_boot2);
+    sink_field_bool(sink, "bootmii_ios",        s_has_bm_ios);
+    sink_field_str(sink,  "protection",         rating);
+    sink_end(sink);
 }
@@ -5,11 +5,15 @@
 #ifndef SYSTEM_INFO_H
 #define SYSTEM_INFO_H
 
+#include "report_sink.h"
+
 // Run the system information display
 void run_system_info(void);
 
-// Get system info as formatted string for reports
-// buf must be at least 2048 bytes
-void get_system_info_report(char *buf, int bufsize);
+// Gather the slow NAND-backed bits ahead of get_system_info_report
+void collect_system_info(void);
+
+// Emit the system info report section into a sink
+void get_system_info_report(report_sink *sink);
 
 #endif // SYSTEM_INFO_H
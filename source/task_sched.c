@@ -0,0 +1,168 @@
+// task_sched.c
+// the full report used to run every module back to back, even though the
+// controller scan only waits on Bluetooth, the network test only waits on
+// the radio and the NAND walk only waits on ISFS. now each module is a task
+// with a mask of the hardware it touches, and anything that doesn't clash
+// with what's already running gets its own LWP straight away.
+//
+// modules print with ui_printf like they always do - the task thread just
+// captures it (see ui_capture_begin) so two modules never interleave. the
+// captured logs get replayed in task order once everything has finished.
+
+#include <gccore.h>
+#include <malloc.h>
+#include <ogc/lwp.h>
+#include <ogc/lwp_watchdog.h>
+#include <ogc/machine/processor.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "report_sink.h"
+#include "scratch.h"
+#include "task_sched.h"
+#include "ui_common.h"
+
+#define SCHED_STACK      (32 * 1024)
+#define SCHED_PRIO       64
+#define SCHED_MAX_RUNNING 4         // one ui capture slot each
+#define SCHED_DRAW_EVERY 6          // frames between progress redraws
+
+
+void sched_add(sched_task *tasks, int *count, const char *name, u32 needs, void (*run)(void)) {
+    sched_task *t;
+    if (*count >= SCHED_MAX_TASKS) return;
+    t = &tasks[(*count)++];
+    memset(t, 0, sizeof(*t));
+    t->name  = name;
+    t->needs = needs;
+    t->run   = run;
+}
+
+
+static void task_body(sched_task *t) {
+    bool captured = ui_capture_begin(&t->out, t->status, sizeof(t->status));
+    t->run();
+    if (captured) ui_capture_end();
+    t->ms = (u32)ticks_to_millisecs(gettime() - t->t_start);
+    _sync();
+    t->state = TASK_DONE;
+}
+
+static void *task_entry(void *arg) {
+    task_body((sched_task *)arg);
+    return NULL;
+}
+
+
+static void draw_progress(const sched_task *tasks, int count, const char *title, int frame) {
+    static const char spin[] = "|/-\\";
+    int i;
+
+    ui_frame_begin();
+    ui_printf(UI_BGREEN " [+] WiiMedic" UI_RESET " " UI_CYAN "v" WIIMEDIC_VERSION UI_RESET
+              "  " UI_BWHITE "%s\n" UI_RESET, title);
+    ui_printf(UI_WHITE " -----------------------------------------------------------\n\n" UI_RESET);
+
+    for (i = 0; i < count; i++) {
+        const sched_task *t = &tasks[i];
+        if (t->state == TASK_WAITING) {
+            ui_printf(UI_WHITE "   [ ] %-20s waiting\n" UI_RESET, t->name);
+        } else if (t->state == TASK_RUNNING) {
+            u32 ms = (u32)ticks_to_millisecs(gettime() - t->t_start);
+            char status[SCHED_STATUS_LEN];
+            u32 level;
+            // the task can be halfway through ui_spin_set_msg on it
+            _CPU_ISR_Disable(level);
+            memcpy(status, t->status, sizeof(status));
+            _CPU_ISR_Restore(level);
+            ui_printf(UI_BYELLOW "   [%c] " UI_BWHITE "%-20s" UI_RESET UI_WHITE " %5.1fs  %.34s\n" UI_RESET,
+                      spin[(frame / SCHED_DRAW_EVERY) & 3], t->name, (float)ms / 1000.0f, status);
+        } else {
+            ui_printf(UI_BGREEN "   [+] " UI_WHITE "%-20s %5.1fs\n" UI_RESET,
+                      t->name, (float)t->ms / 1000.0f);
+        }
+    }
+
+    ui_printf("\n" UI_WHITE "   Modules that use different hardware run at the same time.\n" UI_RESET);
+    ui_frame_end();
+}
+
+
+void sched_run(sched_task *tasks, int count, const char *title) {
+    bool reaped[SCHED_MAX_TASKS] = { false };
+    sink_screen screen;
+    u32 held = 0;
+    int running = 0, done = 0, frame = 0, i;
+    u64 t0 = gettime();
+
+    for (i = 0; i < count; i++) {
+        tasks[i].state = TASK_WAITING;
+        tasks[i].status[0] = '\0';
+        sink_log_init(&tasks[i].out);
+    }
+
+    ui_live_begin();
+
+    while (done < count) {
+        // start whatever fits, earlier tasks first
+        for (i = 0; i < count && running < SCHED_MAX_RUNNING; i++) {
+            sched_task *t = &tasks[i];
+            if (t->state != TASK_WAITING || (t->needs & held)) continue;
+
+            t->stack = scratch_alloc(SCHED_STACK);
+            t->t_start = gettime();
+            if (!t->stack) {
+                // no memory for another thread. if nothing else is going,
+                // just run it here - slower, but the report still happens
+                if (running > 0) break;
+                t->state = TASK_RUNNING;
+                task_body(t);
+                continue;
+            }
+            t->state = TASK_RUNNING;
+            if (LWP_CreateThread(&t->thread, task_entry, t, t->stack, SCHED_STACK, SCHED_PRIO) < 0) {
+                // out of threads - same deal as out of stacks. nothing it
+                // needs is held by anyone else, so running it here is safe
+                scratch_free(t->stack);
+                t->stack = NULL;
+                task_body(t);
+                continue;
+            }
+            held |= t->needs;
+            running++;
+        }
+
+        for (i = 0; i < count; i++) {
+            sched_task *t = &tasks[i];
+            if (t->state != TASK_DONE || reaped[i]) continue;
+            reaped[i] = true;
+            done++;
+            if (t->stack) {
+                LWP_JoinThread(t->thread, NULL);
+                scratch_free(t->stack);
+                t->stack = NULL;
+                held &= ~t->needs;
+                running--;
+            }
+        }
+
+        if (!ui_is_headless() && (frame % SCHED_DRAW_EVERY == 0 || done == count))
+            draw_progress(tasks, count, title, frame);
+        frame++;
+        ui_wait_frame();
+    }
+
+    ui_live_end(title);
+
+    // now the output, in the order the tasks were listed
+    sink_screen_init(&screen, false);
+    for (i = 0; i < count; i++) {
+        sched_task *t = &tasks[i];
+        ui_printf(UI_BCYAN "   [%d/%d]" UI_WHITE " %s " UI_RESET "(%u ms)\n", i + 1, count, t->name, t->ms);
+        sink_log_replay(&t->out, &screen.sink);
+        sink_log_free(&t->out);
+    }
+    ui_printf(UI_WHITE "   All modules finished in %u ms\n\n" UI_RESET,
+              (unsigned)ticks_to_millisecs(gettime() - t0));
+}
@@ -0,0 +1,54 @@
+/*
+ * WiiMedic - task_sched.h
+ * Runs report modules side by side on LWPs, serialised by the hardware they use
+ */
+#ifndef TASK_SCHED_H
+#define TASK_SCHED_H
+
+#include <gccore.h>
+
+#include "report_sink.h"
+
+// Hardware a task touches. Two tasks that share a bit never run at once.
+#define RES_ISFS    (1 << 0)    // NAND filesystem, and the shared NAND index
+#define RES_ES      (1 << 1)    // title/ticket queries
+#define RES_WIFI    (1 << 2)    // net_init and WD_Init fight over the radio
+#define RES_FAT     (1 << 3)    // SD/USB through libfat
+#define RES_WPAD    (1 << 4)    // Wii Remotes and GameCube pads
+#define RES_SOLO    0xFFFFFFFF  // all of them - runs with nothing else going
+
+#define SCHED_MAX_TASKS 8
+#define SCHED_STATUS_LEN 40
+
+typedef enum {
+    TASK_WAITING,
+    TASK_RUNNING,
+    TASK_DONE
+} task_state;
+
+typedef struct {
+    const char *name;
+    u32         needs;      // RES_* mask
+    void      (*run)(void);
+
+    // filled in by the scheduler
+    volatile task_state state;
+    u64         t_start;
+    u32         ms;
+    lwp_t       thread;
+    void       *stack;
+    sink_log    out;        // everything the module printed while it ran
+    char        status[SCHED_STATUS_LEN];
+} sched_task;
+
+// Appends a task to the list (up to SCHED_MAX_TASKS)
+void sched_add(sched_task *tasks, int *count, const char *name, u32 needs, void (*run)(void));
+
+// Runs every task, starting each one as soon as nothing running holds a
+// resource it needs (earlier tasks get first pick). The screen shows one
+// progress line per task until all are done. Each task's output is then
+// replayed into the scroll buffer in task order, so the log reads the same
+// as a sequential run.
+void sched_run(sched_task *tasks, int count, const char *title);
+
+#endif // TASK_SCHED_H
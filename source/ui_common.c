@@ -8,10 +8,15 @@
 #include <gccore.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include <wiiuse/wpad.h>
 #include <ogc/lwp.h>
+#include <ogc/machine/processor.h>
 
+#include "prof.h"
+#include "report_sink.h"
 #include "ui_common.h"
 
 // how wide a "line" is in characters. not really enforced anywhere
@@ -19,70 +24,411 @@
 
 // scroll buffer - when a module runs, its output goes here instead of
 // directly to the terminal. then the user can scroll through it after.
-// 256 lines should be enough for anyone (famous last words)
-#define SCROLL_MAX_LINES 256
-#define SCROLL_LINE_LEN  512
-#define SCROLL_VISIBLE   18
-
-static char s_scroll_lines[SCROLL_MAX_LINES][SCROLL_LINE_LEN];
-static int  s_scroll_count = 0;
-static char s_scroll_cur[SCROLL_LINE_LEN];  // line currently being built
-static int  s_scroll_pos = 0;
+// text is appended to a chain of heap chunks and s_scroll_lines just
+// points into them, so there's no line limit and an empty run costs
+// nothing. a line never straddles two chunks.
+#define SCROLL_CHUNK      16384
+#define SCROLL_INDEX_STEP 256
+#define SCROLL_VISIBLE    18
+#define PROF_ROWS         8     // timing overlay, plus its header line
+
+typedef struct scroll_chunk {
+    struct scroll_chunk *next;
+    u32  size;
+    u32  used;
+    char data[];
+} scroll_chunk;
+
+static scroll_chunk *s_scroll_head  = NULL;
+static scroll_chunk *s_scroll_tail  = NULL;
+static char        **s_scroll_lines = NULL;     // offset index into the chunks
+static int           s_scroll_count = 0;
+static int           s_scroll_cap   = 0;
+static char         *s_scroll_cur   = NULL;     // start of the line being built
 static bool s_scroll_active = false;
 
+// autorun mode. nobody is watching, so nothing gets drawn and the polling
+// loops stop pacing themselves to the TV
+static bool s_headless = false;
+
+#define HEADLESS_TICK_US 1000
+
+
+// back-buffered screen. a full screen gets drawn into s_back, then
+// ui_frame_end compares it against s_front (what the console is showing)
+// and only sends the cells that changed. a libogc [2J repaints the whole
+// framebuffer, which is what made every keypress flicker.
+//
+// s_front is only trusted while nothing else has printed. anything that
+// writes straight to the console (ui_clear, live views, the spinner, plain
+// ui_printf) drops s_frame_valid and the next frame starts from a clear.
+
+#define FRAME_MAX_COLS  80
+#define FRAME_MAX_ROWS  40
+#define ATTR_DEFAULT    7       // white, not bold
+#define ATTR_BOLD       0x08
+
+typedef struct {
+    char ch;
+    u8   attr;                  // bits 0-2 color, bit 3 bold
+} ui_cell;
+
+static ui_cell s_front[FRAME_MAX_ROWS][FRAME_MAX_COLS];
+static ui_cell s_back[FRAME_MAX_ROWS][FRAME_MAX_COLS];
+static int     s_frame_cols = 0;
+static int     s_frame_rows = 0;
+static int     s_frame_row, s_frame_col;
+static u8      s_frame_attr = ATTR_DEFAULT;
+static bool    s_frame_valid  = false;
+static bool    s_frame_active = false;
+
+static void frame_blank(ui_cell grid[FRAME_MAX_ROWS][FRAME_MAX_COLS]) {
+    int r, c;
+    for (r = 0; r < FRAME_MAX_ROWS; r++)
+        for (c = 0; c < FRAME_MAX_COLS; c++) {
+            grid[r][c].ch   = ' ';
+            grid[r][c].attr = ATTR_DEFAULT;
+        }
+}
+
+// feeds text into s_back. understands the escape codes this app actually
+// sends: colors (0, 1, 30-37), [2J and [row;colH
+static void frame_put(const char *s) {
+    while (*s) {
+        char ch = *s++;
+
+        if (ch == '\x1b' && *s == '[') {
+            int p[4] = { 0, 0, 0, 0 };
+            int np = 0, i;
+
+            s++;
+            while ((*s >= '0' && *s <= '9') || *s == ';') {
+                if (*s == ';') { if (np < 3) np++; }
+                else           p[np] = p[np] * 10 + (*s - '0');
+                s++;
+            }
+            np++;
+            ch = *s ? *s++ : '\0';
+
+            if (ch == 'm') {
+                for (i = 0; i < np; i++) {
+                    if (p[i] == 0)                      s_frame_attr = ATTR_DEFAULT;
+                    else if (p[i] == 1)                 s_frame_attr |= ATTR_BOLD;
+                    else if (p[i] >= 30 && p[i] <= 37)  s_frame_attr = (u8)((s_frame_attr & ATTR_BOLD) | (p[i] - 30));
+                }
+            } else if (ch == 'J') {
+                frame_blank(s_back);
+                s_frame_row = s_frame_col = 0;
+            } else if (ch == 'H') {
+                s_frame_row = p[0];
+                s_frame_col = p[1];
+            }
+            continue;
+        }
+
+        if (ch == '\n') { s_frame_row++; s_frame_col = 0; continue; }
+        if (ch == '\r') { s_frame_col = 0; continue; }
+
+        // clip instead of wrapping, a wrapped line would push the footer off
+        if (s_frame_row < s_frame_rows && s_frame_col < s_frame_cols) {
+            s_back[s_frame_row][s_frame_col].ch   = ch;
+            s_back[s_frame_row][s_frame_col].attr = s_frame_attr;
+        }
+        s_frame_col++;
+    }
+}
+
+static void frame_set_attr(u8 attr) {
+    if (attr & ATTR_BOLD) printf(UI_RESET "\x1b[3%d;1m", attr & 7);
+    else                  printf(UI_RESET "\x1b[3%dm", attr & 7);
+}
+
+
+static void con_goto(int row, int col) {
+    // relative moves from home, so it doesn't matter whether this libogc
+    // counts [row;colH from 0 or 1. and [0B still moves one line, so skip it
+    printf("\x1b[0;0H");
+    if (row > 0) printf("\x1b[%dB", row);
+    if (col > 0) printf("\x1b[%dC", col);
+}
+
+
+void ui_frame_begin(void) {
+    if (s_frame_cols == 0) {
+        CON_GetMetrics(&s_frame_cols, &s_frame_rows);
+        if (s_frame_cols > FRAME_MAX_COLS) s_frame_cols = FRAME_MAX_COLS;
+        // never touch the bottom row, writing its last cell scrolls the console
+        s_frame_rows--;
+        if (s_frame_rows > FRAME_MAX_ROWS) s_frame_rows = FRAME_MAX_ROWS;
+        if (s_frame_cols < 1) s_frame_cols = 1;
+        if (s_frame_rows < 1) s_frame_rows = 1;
+    }
+    frame_blank(s_back);
+    s_frame_row = s_frame_col = 0;
+    s_frame_attr = ATTR_DEFAULT;
+    s_frame_active = true;
+}
+
+
+void ui_frame_goto(int row, int col) {
+    s_frame_row = row;
+    s_frame_col = col;
+}
+
+
+void ui_frame_end(void) {
+    int r, c;
+    u8 cur = 0xFF;
+
+    s_frame_active = false;
+    if (s_headless) return;
+    if (!s_frame_valid) {
+        printf(UI_RESET "\x1b[2J\x1b[0;0H");
+        frame_blank(s_front);
+        s_frame_valid = true;
+    }
+
+    for (r = 0; r < s_frame_rows; r++) {
+        c = 0;
+        while (c < s_frame_cols) {
+            int end, gap;
+
+            if (s_back[r][c].ch == s_front[r][c].ch && s_back[r][c].attr == s_front[r][c].attr) {
+                c++;
+                continue;
+            }
+
+            // extend the run; a short stretch of unchanged cells is cheaper
+            // to reprint than another cursor move
+            end = c + 1;
+            gap = 0;
+            while (end < s_frame_cols && gap <= 4) {
+                if (s_back[r][end].ch == s_front[r][end].ch &&
+                    s_back[r][end].attr == s_front[r][end].attr) gap++;
+                else gap = 0;
+                end++;
+            }
+            end -= gap;
+
+            con_goto(r, c);
+            for (; c < end; c++) {
+                if (s_back[r][c].attr != cur) {
+                    cur = s_back[r][c].attr;
+                    frame_set_attr(cur);
+                }
+                putchar(s_back[r][c].ch);
+            }
+        }
+    }
+
+    printf(UI_RESET);
+    fflush(stdout);
+    memcpy(s_front, s_back, sizeof(s_front));
+}
+
+
+static void scroll_push_line(char *line) {
+    if (s_scroll_count == s_scroll_cap) {
+        int cap = s_scroll_cap + SCROLL_INDEX_STEP;
+        char **idx = (char **)realloc(s_scroll_lines, cap * sizeof(char *));
+        if (!idx) return;   // out of memory, lose the line rather than crash
+        s_scroll_lines = idx;
+        s_scroll_cap   = cap;
+    }
+    s_scroll_lines[s_scroll_count++] = line;
+}
+
+// makes sure the tail chunk has room for n more bytes after the line
+// being built. a new chunk takes the partial line with it.
+static bool scroll_reserve(u32 n) {
+    scroll_chunk *c;
+    u32 partial = 0, size = SCROLL_CHUNK;
+
+    if (s_scroll_tail && s_scroll_tail->size - s_scroll_tail->used >= n)
+        return true;
+
+    if (s_scroll_tail) partial = (u32)(s_scroll_tail->data + s_scroll_tail->used - s_scroll_cur);
+    if (partial + n > size) size = partial + n;
+
+    c = (scroll_chunk *)malloc(sizeof(scroll_chunk) + size);
+    if (!c) return false;
+    c->next = NULL;
+    c->size = size;
+    c->used = partial;
+    if (partial) {
+        memcpy(c->data, s_scroll_cur, partial);
+        s_scroll_tail->used -= partial;
+    }
+
+    if (s_scroll_tail) s_scroll_tail->next = c;
+    else               s_scroll_head = c;
+    s_scroll_tail = c;
+    s_scroll_cur  = c->data;
+    return true;
+}
+
+// cuts the text appended at p into lines
+static void scroll_split(char *p, int len) {
+    int i;
+    for (i = 0; i < len; i++) {
+        if (p[i] == '\n') {
+            p[i] = '\0';
+            scroll_push_line(s_scroll_cur);
+            s_scroll_cur = p + i + 1;
+        }
+    }
+}
+
 
 // intercept printf when the scroll buffer is active.
-// splits on newlines and packs lines into s_scroll_lines[].
-// when scroll is off it just falls through to vprintf like normal.
+// formats straight onto the end of the scroll arena, then splits on newlines.
+// between ui_frame_begin/end it draws into the frame instead, and when
+// neither is on it just falls through to vprintf like normal.
+// per-thread capture. the report scheduler runs modules side by side, and
+// each one's output has to stay in one piece - so a capturing thread's
+// ui_printf lands in its own log, to be replayed later in module order.
+// spinner messages from that thread go to its status line instead.
+#define MAX_CAPTURES 4
+
+typedef struct {
+    lwp_t     thread;
+    sink_log *log;      // NULL = free slot
+    char     *status;
+    int       status_size;
+} ui_capture;
+
+static ui_capture s_captures[MAX_CAPTURES];
+static volatile int s_capture_count = 0;
+
+static ui_capture *capture_self(void) {
+    lwp_t me;
+    int i;
+    if (s_capture_count == 0) return NULL;
+    me = LWP_GetSelf();
+    for (i = 0; i < MAX_CAPTURES; i++)
+        if (s_captures[i].log && s_captures[i].thread == me) return &s_captures[i];
+    return NULL;
+}
+
+bool ui_capture_begin(sink_log *log, char *status, int status_size) {
+    u32 level;
+    int i;
+
+    _CPU_ISR_Disable(level);
+    for (i = 0; i < MAX_CAPTURES; i++) {
+        if (s_captures[i].log) continue;
+        s_captures[i].thread      = LWP_GetSelf();
+        s_captures[i].status      = status;
+        s_captures[i].status_size = status_size;
+        s_captures[i].log         = log;
+        s_capture_count++;
+        break;
+    }
+    _CPU_ISR_Restore(level);
+    return i < MAX_CAPTURES;
+}
+
+void ui_capture_end(void) {
+    ui_capture *c = capture_self();
+    u32 level;
+    if (!c) return;
+    _CPU_ISR_Disable(level);
+    c->log = NULL;
+    s_capture_count--;
+    _CPU_ISR_Restore(level);
+}
+
+
+void ui_set_headless(bool on) { s_headless = on; }
+bool ui_is_headless(void)     { return s_headless; }
+
+// sleeps rather than spinning, the loops that call this are waiting on
+// worker threads that run at a lower priority than main
+void ui_wait_frame(void) {
+    if (s_headless) usleep(HEADLESS_TICK_US);
+    else            VIDEO_WaitVSync();
+}
+
+
 int ui_printf(const char *fmt, ...) {
-    va_list args;
-    char tmp[512];
-    int len, i;
+    va_list args, again;
+    int len;
+    ui_capture *cap;
 
     va_start(args, fmt);
-    if (!s_scroll_active) {
+    if ((cap = capture_self()) != NULL) {
+        char tmp[512];
+        len = vsnprintf(tmp, sizeof(tmp), fmt, args);
+        va_end(args);
+        sink_text(&cap->log->sink, "%s", tmp);
+        return len;
+    }
+    if (s_headless) {
+        va_end(args);
+        return 0;
+    }
+    if (!s_scroll_active && !s_frame_active) {
         len = vprintf(fmt, args);
         va_end(args);
+        s_frame_valid = false;
         return len;
     }
 
-    len = vsnprintf(tmp, sizeof(tmp), fmt, args);
-    va_end(args);
+    if (s_frame_active) {
+        char tmp[512];
+        len = vsnprintf(tmp, sizeof(tmp), fmt, args);
+        va_end(args);
+        frame_put(tmp);
+        return len;
+    }
 
-    for (i = 0; i < len && tmp[i]; i++) {
-        if (tmp[i] == '\n') {
-            s_scroll_cur[s_scroll_pos] = '\0';
-            if (s_scroll_count < SCROLL_MAX_LINES) {
-                memcpy(s_scroll_lines[s_scroll_count], s_scroll_cur, s_scroll_pos + 1);
-                s_scroll_count++;
-            }
-            // silently drop lines past the limit. not ideal but itll work
-            s_scroll_pos = 0;
-            s_scroll_cur[0] = '\0';
-        } else {
-            if (s_scroll_pos < SCROLL_LINE_LEN - 1)
-                s_scroll_cur[s_scroll_pos++] = tmp[i];
+    // try the space we've got first, only the odd call that doesn't fit
+    // gets formatted a second time into a fresh chunk
+    va_copy(again, args);
+    if (!scroll_reserve(1)) {
+        va_end(again);
+        va_end(args);
+        return 0;
+    }
+    {
+        u32 room = s_scroll_tail->size - s_scroll_tail->used;
+        len = vsnprintf(s_scroll_tail->data + s_scroll_tail->used, room, fmt, args);
+        if (len >= 0 && (u32)len >= room) {
+            if (scroll_reserve((u32)len + 1))
+                vsnprintf(s_scroll_tail->data + s_scroll_tail->used, len + 1, fmt, again);
+            else
+                len = (int)room - 1;    // keep what fit
         }
     }
+    va_end(again);
+    va_end(args);
+
+    if (len > 0) {
+        char *p = s_scroll_tail->data + s_scroll_tail->used;
+        s_scroll_tail->used += len;
+        scroll_split(p, len);
+    }
     return len;
 }
 
 
 void ui_clear(void) {
+    if (s_headless) return;
     printf("\x1b[2J\x1b[0;0H");
+    s_frame_valid = false;
 }
 
 
 void ui_draw_banner(void) {
-    printf("\n");
-    printf(UI_BGREEN "  ==========================================================\n" UI_RESET);
-    printf("\n");
-    printf(UI_BWHITE "          [+]  W i i M e d i c" UI_RESET "   " UI_CYAN "v" WIIMEDIC_VERSION "\n" UI_RESET);
-    printf("\n");
-    printf(UI_WHITE  "          System Diagnostic & Health Monitor\n" UI_RESET);
-    printf("\n");
-    printf(UI_BGREEN "  ==========================================================\n" UI_RESET);
-    printf("\n");
+    ui_printf("\n");
+    ui_printf(UI_BGREEN "  ==========================================================\n" UI_RESET);
+    ui_printf("\n");
+    ui_printf(UI_BWHITE "          [+]  W i i M e d i c" UI_RESET "   " UI_CYAN "v" WIIMEDIC_VERSION "\n" UI_RESET);
+    ui_printf("\n");
+    ui_printf(UI_WHITE  "          System Diagnostic & Health Monitor\n" UI_RESET);
+    ui_printf("\n");
+    ui_printf(UI_BGREEN "  ==========================================================\n" UI_RESET);
+    ui_printf("\n");
 }
 
 
@@ -151,6 +497,49 @@ void ui_draw_bar(u32 used, u32 total, int bar_width) {
 }
 
 
+// same look as ui_draw_bar but the caller picks the color and the text
+// after it - for graphs and histograms where "90% = red" makes no sense
+void ui_draw_hbar(u32 value, u32 max, int bar_width, const char *color, const char *label) {
+    int filled = 0;
+    int i;
+
+    if (max > 0)
+        filled = (int)((u64)value * bar_width / max);
+    if (filled > bar_width) filled = bar_width;
+
+    ui_printf("   [");
+    for (i = 0; i < bar_width; i++) {
+        if (i < filled)
+            ui_printf("%s#" UI_RESET, color);
+        else
+            ui_printf(UI_WHITE "." UI_RESET);
+    }
+    ui_printf("] %s%s\n" UI_RESET, color, label);
+}
+
+
+void ui_draw_spark(const float *vals, int count, int width, const char *color, const char *label) {
+    // eight heights the console font can do without box-drawing chars
+    static const char ramp[] = "_.-:=+*#";
+    float lo, hi;
+    int i, start;
+
+    start = count > width ? count - width : 0;
+    lo = hi = count > 0 ? vals[start] : 0.0f;
+    for (i = start; i < count; i++) {
+        if (vals[i] < lo) lo = vals[i];
+        if (vals[i] > hi) hi = vals[i];
+    }
+
+    ui_printf("   [%s", color);
+    for (i = start; i < count; i++) {
+        int lvl = (hi > lo) ? (int)((vals[i] - lo) * 7.0f / (hi - lo) + 0.5f) : 3;
+        ui_printf("%c", ramp[lvl]);
+    }
+    ui_printf(UI_RESET "%*s] %s%s\n" UI_RESET, width - (count - start), "", color, label);
+}
+
+
 void ui_draw_ok(const char *msg)   { ui_printf("   " UI_BGREEN  "[OK]" UI_RESET " %s\n", msg); }
 void ui_draw_warn(const char *msg) { ui_printf("   " UI_BYELLOW "[!!]" UI_RESET " %s\n", msg); }
 void ui_draw_err(const char *msg)  { ui_printf("   " UI_BRED    "[XX]" UI_RESET " %s\n", msg); }
@@ -158,9 +547,20 @@ void ui_draw_info(const char *msg) { ui_printf("   " UI_BCYAN   "(i)" UI_RESET
 
 
 void ui_scroll_begin(void) {
-    s_scroll_count = 0;
-    s_scroll_pos   = 0;
-    s_scroll_cur[0] = '\0';
+    // keep the first chunk around for the next run, free the rest
+    scroll_chunk *c = s_scroll_head ? s_scroll_head->next : NULL;
+    while (c) {
+        scroll_chunk *next = c->next;
+        free(c);
+        c = next;
+    }
+    if (s_scroll_head) {
+        s_scroll_head->next = NULL;
+        s_scroll_head->used = 0;
+        s_scroll_cur = s_scroll_head->data;
+    }
+    s_scroll_tail   = s_scroll_head;
+    s_scroll_count  = 0;
     s_scroll_active = true;
 }
 
@@ -170,58 +570,66 @@ void ui_scroll_begin(void) {
 void ui_scroll_view(const char *title) {
     int offset = 0;
     int max_offset;
-    int visible = SCROLL_VISIBLE;
+    int visible;
     int i;
 
     // flush whatever line is still in the buffer
-    if (s_scroll_pos > 0) {
-        s_scroll_cur[s_scroll_pos] = '\0';
-        if (s_scroll_count < SCROLL_MAX_LINES) {
-            memcpy(s_scroll_lines[s_scroll_count], s_scroll_cur, s_scroll_pos + 1);
-            s_scroll_count++;
-        }
-        s_scroll_pos = 0;
+    if (s_scroll_tail && s_scroll_cur != s_scroll_tail->data + s_scroll_tail->used &&
+        scroll_reserve(1)) {
+        s_scroll_tail->data[s_scroll_tail->used++] = '\0';
+        scroll_push_line(s_scroll_cur);
+        s_scroll_cur = s_scroll_tail->data + s_scroll_tail->used;
     }
     s_scroll_active = false;
 
-    max_offset = s_scroll_count - visible;
-    if (max_offset < 0) max_offset = 0;
-
     while (1) {
         int end;
         u32 wpad, gpad;
         bool redraw;
 
-        printf("\x1b[2J\x1b[0;0H");
+        // the timing overlay takes the bottom of the text area
+        visible = prof_shown() ? SCROLL_VISIBLE - PROF_ROWS - 1 : SCROLL_VISIBLE;
+        max_offset = s_scroll_count - visible;
+        if (max_offset < 0) max_offset = 0;
+        if (offset > max_offset) offset = max_offset;
+
+        ui_frame_begin();
 
-        printf(UI_BGREEN " [+] WiiMedic" UI_RESET " " UI_CYAN "v" WIIMEDIC_VERSION UI_RESET
-               "  " UI_BWHITE "%s\n" UI_RESET, title);
-        printf(UI_WHITE " ");
-        for (i = 0; i < 58; i++) printf("-");
-        printf("\n" UI_RESET);
+        ui_printf(UI_BGREEN " [+] WiiMedic" UI_RESET " " UI_CYAN "v" WIIMEDIC_VERSION UI_RESET
+                  "  " UI_BWHITE "%s\n" UI_RESET, title);
+        ui_printf(UI_WHITE " ");
+        for (i = 0; i < 58; i++) ui_printf("-");
+        ui_printf("\n" UI_RESET);
 
         end = offset + visible;
         if (end > s_scroll_count) end = s_scroll_count;
 
-        for (i = offset; i < end; i++)
-            printf(UI_RESET "%s\n", s_scroll_lines[i]);
+        // lines can be any length now, feed them in whole
+        for (i = offset; i < end; i++) {
+            frame_put(UI_RESET);
+            frame_put(s_scroll_lines[i]);
+            frame_put("\n");
+        }
 
         // pad blank lines so the footer always sits at the bottom
         for (i = end - offset; i < visible; i++)
-            printf("\n");
+            ui_printf("\n");
+        if (prof_shown()) prof_draw_overlay(PROF_ROWS);
 
-        printf(UI_WHITE " ");
-        for (i = 0; i < 58; i++) printf("-");
-        printf("\n" UI_RESET);
+        ui_printf(UI_WHITE " ");
+        for (i = 0; i < 58; i++) ui_printf("-");
+        ui_printf("\n" UI_RESET);
 
         if (max_offset > 0) {
-            printf(UI_WHITE " [UP/DOWN] Scroll  [LEFT/RIGHT] Page  [A/B] Return"
-                   UI_RESET UI_CYAN "  [%d-%d/%d]\n" UI_RESET,
-                   offset + 1, end, s_scroll_count);
+            ui_printf(UI_WHITE " [UP/DOWN] Scroll  [L/R] Page  [A/B] Return  [1] Timing"
+                      UI_RESET UI_CYAN "  [%d-%d/%d]\n" UI_RESET,
+                      offset + 1, end, s_scroll_count);
         } else {
-            printf(UI_WHITE " Press [A] or [B] to return to menu...\n" UI_RESET);
+            ui_printf(UI_WHITE " Press [A] or [B] to return to menu...  [1] Timing\n" UI_RESET);
         }
 
+        ui_frame_end();
+
         while (1) {
             WPAD_ScanPads();
             PAD_ScanPads();
@@ -245,6 +653,14 @@ void ui_scroll_view(const char *title) {
                 if (offset > max_offset) offset = max_offset;
                 redraw = true;
             }
+            if ((wpad & WPAD_BUTTON_1) || (gpad & PAD_BUTTON_Y)) {
+                prof_toggle();
+                redraw = true;
+            }
+            if (((wpad & WPAD_BUTTON_2) || (gpad & PAD_BUTTON_X)) && prof_shown()) {
+                prof_reset();
+                redraw = true;
+            }
             if ((wpad & WPAD_BUTTON_A) || (wpad & WPAD_BUTTON_B) ||
                 (gpad & PAD_BUTTON_A) || (gpad & PAD_BUTTON_B)) {
                 return;
@@ -258,12 +674,12 @@ void ui_scroll_view(const char *title) {
 
 
 void ui_draw_footer(const char *msg) {
-    printf("\n");
+    ui_printf("\n");
     ui_draw_line();
     if (msg)
-        printf("   " UI_WHITE "%s\n" UI_RESET, msg);
+        ui_printf("   " UI_WHITE "%s\n" UI_RESET, msg);
     else
-        printf("   " UI_WHITE "[UP/DOWN] Navigate   [A] Select   [HOME] Exit\n" UI_RESET);
+        ui_printf("   " UI_WHITE "[UP/DOWN] Navigate   [A] Select   [HOME] Exit\n" UI_RESET);
 }
 
 
@@ -291,14 +707,21 @@ static lwp_t          s_spin_thread;
 static u8             s_spin_stack[4096] __attribute__((aligned(32)));
 static char           s_spin_msg[64] = "Working...";
 
+// the message can change under us from the module's thread, so it's only
+// ever copied in or out with interrupts off - it's 64 bytes, that's nothing
 static void *spin_thread_func(void *arg) {
     const char *frames = "|/-\\";
+    char msg[sizeof(s_spin_msg)];
+    u32 level;
     int f = 0;
     int i;
     (void)arg;
 
     while (s_spin_active) {
-        printf("\r   " UI_BYELLOW "[%c]" UI_RESET " %s   ", frames[f & 3], s_spin_msg);
+        _CPU_ISR_Disable(level);
+        memcpy(msg, s_spin_msg, sizeof(msg));
+        _CPU_ISR_Restore(level);
+        printf("\r   " UI_BYELLOW "[%c]" UI_RESET " %s   ", frames[f & 3], msg);
         f++;
         for (i = 0; i < 6 && s_spin_active; i++)
             VIDEO_WaitVSync();
@@ -316,6 +739,7 @@ void ui_spin_start(const char *msg) {
         strncpy(s_spin_msg, "Working...", sizeof(s_spin_msg));
     }
     s_spin_active = true;
+    s_frame_valid = false;
     LWP_CreateThread(&s_spin_thread, spin_thread_func, NULL,
                      s_spin_stack, sizeof(s_spin_stack), 80);
 }
@@ -324,3 +748,117 @@ void ui_spin_stop(void) {
     s_spin_active = false;
     LWP_JoinThread(s_spin_thread, NULL);
 }
+
+void ui_spin_set_msg(const char *msg) {
+    ui_capture *cap = capture_self();
+    u32 level;
+    if (!msg) return;
+    // the scheduler's progress screen reads cap->status the same way
+    _CPU_ISR_Disable(level);
+    if (cap) {
+        if (cap->status && cap->status_size > 0) {
+            strncpy(cap->status, msg, cap->status_size - 1);
+            cap->status[cap->status_size - 1] = '\0';
+        }
+    } else {
+        strncpy(s_spin_msg, msg, sizeof(s_spin_msg) - 1);
+        s_spin_msg[sizeof(s_spin_msg) - 1] = '\0';
+    }
+    _CPU_ISR_Restore(level);
+}
+
+
+// live views. modules call these from inside run_subscreen, so the spinner
+// is already going and output is being captured - both get parked here.
+static bool s_live_spin   = false;
+static bool s_live_scroll = false;
+
+void ui_live_begin(void) {
+    s_live_spin   = s_spin_active;
+    s_live_scroll = s_scroll_active;
+    if (s_live_spin) ui_spin_stop();
+    s_scroll_active = false;
+    ui_clear();
+}
+
+void ui_live_end(const char *title) {
+    // put the screen back the way run_subscreen left it
+    if (s_headless) return;
+    ui_clear();
+    ui_draw_banner();
+    printf("\n" UI_BCYAN "   --- %s ---\n\n" UI_RESET, title);
+
+    s_scroll_active = s_live_scroll;
+    if (s_live_spin) {
+        char msg[sizeof(s_spin_msg)];
+        strcpy(msg, s_spin_msg);
+        ui_spin_start(msg);
+    }
+}
+
+
+// full-screen pick list, same look as the "existing report" dialog.
+// modules call this from inside run_subscreen so the spinner is already
+// going - we have to stop it or it scribbles over the list.
+int ui_choose(const char *title, const char **items, int count) {
+    int sel = 0;
+    int result = -1;
+    int i;
+
+    ui_live_begin();
+
+    while (1) {
+        u32 wpad, gpad;
+        bool done = false;
+
+        ui_frame_begin();
+        ui_printf(UI_BGREEN " [+] WiiMedic" UI_RESET " " UI_CYAN "v" WIIMEDIC_VERSION UI_RESET
+                  "  " UI_BWHITE "%s\n" UI_RESET, title);
+        ui_printf(UI_WHITE " -----------------------------------------------------------\n" UI_RESET);
+        ui_printf("\n" UI_WHITE "   What do you want to run?\n\n" UI_RESET);
+
+        for (i = 0; i < count; i++) {
+            if (i == sel)
+                ui_printf(UI_BGREEN "   >> [%d] %s\n" UI_RESET, i + 1, items[i]);
+            else
+                ui_printf(UI_WHITE  "      [%d] %s\n" UI_RESET, i + 1, items[i]);
+        }
+
+        ui_printf("\n" UI_WHITE " -----------------------------------------------------------\n" UI_RESET);
+        ui_printf(UI_WHITE " [UP/DOWN] Choose   [A] Confirm   [B] Cancel\n" UI_RESET);
+        ui_frame_end();
+
+        while (1) {
+            bool brk = false;
+            WPAD_ScanPads();
+            PAD_ScanPads();
+            wpad = WPAD_ButtonsDown(0);
+            gpad = PAD_ButtonsDown(0);
+
+            if ((wpad & WPAD_BUTTON_UP) || (gpad & PAD_BUTTON_UP)) {
+                if (--sel < 0) sel = count - 1;
+                brk = true;
+            }
+            if ((wpad & WPAD_BUTTON_DOWN) || (gpad & PAD_BUTTON_DOWN)) {
+                if (++sel >= count) sel = 0;
+                brk = true;
+            }
+            if ((wpad & WPAD_BUTTON_A) || (gpad & PAD_BUTTON_A)) {
+                result = sel;
+                done = true;
+                break;
+            }
+            if ((wpad & WPAD_BUTTON_B) || (gpad & PAD_BUTTON_B)) {
+                done = true;
+                break;
+            }
+
+            if (brk) break;
+            VIDEO_WaitVSync();
+        }
+        if (done) break;
+    }
+
+    ui_live_end(title);
+    return result;
+}
@@ -9,6 +9,8 @@
 
 #include <gccore.h>
 
+#include "report_sink.h"
+
 /* App version */
 #define WIIMEDIC_VERSION "1.3.1"
 
@@ -54,6 +56,12 @@ void ui_draw_kv_color(const char *label, const char *color, const char *value);
 /* Draw a progress bar: [####..........] 45.2%  */
 void ui_draw_bar(u32 used, u32 total, int bar_width);
 
+/* Same bar with a fixed color and free text after it (graphs, histograms) */
+void ui_draw_hbar(u32 value, u32 max, int bar_width, const char *color, const char *label);
+
+/* Sparkline of the last `width` values, scaled to their own min..max:  [_.-:=+*#   ] label */
+void ui_draw_spark(const float *vals, int count, int width, const char *color, const char *label);
+
 /* Status messages with indicator prefix */
 void ui_draw_ok(const char *msg);
 void ui_draw_warn(const char *msg);
@@ -80,4 +88,42 @@ void ui_wait_button(void);
 void ui_spin_start(const char *msg);
 void ui_spin_stop(void);
 
+/* Change the spinner message while it's running (progress on long tests) */
+void ui_spin_set_msg(const char *msg);
+
+/* Pick one of count items from a full-screen list. Safe to call from inside
+ * a running module - the spinner is paused while the list is up.
+ * Returns the chosen index, or -1 if the user backed out with B. */
+int ui_choose(const char *title, const char **items, int count);
+
+/* Take over the screen from inside a running module for a live view.
+ * Pauses the spinner and scroll capture so ui_printf draws straight to the
+ * console. ui_live_end puts the module screen (banner + title) back. */
+void ui_live_begin(void);
+void ui_live_end(const char *title);
+
+/* Back-buffered drawing for screens that redraw in a loop. Everything
+ * ui_printf'd between ui_frame_begin and ui_frame_end lands in an off-screen
+ * grid, and ui_frame_end only sends the cells that changed since the last
+ * frame. ui_frame_goto moves the frame cursor (0-based row/col). */
+void ui_frame_begin(void);
+void ui_frame_goto(int row, int col);
+void ui_frame_end(void);
+
+/* Capture the calling thread's output for modules that run side by side.
+ * Its ui_printf text (and every ui_draw_* built on it) is appended to log,
+ * and its ui_spin_set_msg text is copied into status. Nothing reaches the
+ * screen or scroll buffer until the caller replays the log. Returns false
+ * if every capture slot is taken. */
+bool ui_capture_begin(sink_log *log, char *status, int status_size);
+void ui_capture_end(void);
+
+/* Unattended runs (autorun.cfg). While headless nothing is drawn - ui_printf
+ * only feeds captures - and ui_wait_frame stops waiting on the display. */
+void ui_set_headless(bool on);
+bool ui_is_headless(void);
+
+/* One pass of a polling loop: a VSync, or a millisecond when headless */
+void ui_wait_frame(void);
+
 #endif /* _UI_COMMON_H_ */